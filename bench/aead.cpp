@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Cost of encryption compared to plaintext: the time it takes to get a
+// gigabyte of full sized payloads into datagram buffers, by copying them
+// as they are, and by sealing them one at a time and in batches.
+
+#include <iostream>
+#include <maidsafe/crux/detail/crypto.hpp>
+
+#if defined(MAIDSAFE_CRUX_USE_OPENSSL)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <vector>
+#include <maidsafe/crux/detail/constants.hpp>
+
+namespace crux = maidsafe::crux;
+
+using aead = crux::detail::aead;
+
+const std::uint64_t gigabyte = 1ULL << 30;
+const std::size_t batch_size = 32;
+const std::size_t header_size = crux::detail::header::constant::size;
+const std::size_t payload_size = crux::detail::constant::max_payload_size;
+
+static double measure(const char *name,
+                      std::uint64_t total,
+                      const std::function<void (std::size_t)>& run_batch,
+                      double baseline)
+{
+    const auto count = total / (payload_size * batch_size);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 0; i < count; ++i)
+    {
+        run_batch(batch_size);
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    const double bytes = double(count * batch_size * payload_size);
+    const double rate = bytes / elapsed.count();
+
+    std::cout << std::left << std::setw(10) << name
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << rate / (1 << 20) << " MiB/s"
+              << std::setw(10) << elapsed.count() * gigabyte / bytes * 1000 << " ms/GiB";
+    if (baseline > 0)
+    {
+        std::cout << std::setw(8) << std::setprecision(2) << baseline / rate << "x";
+    }
+    std::cout << std::endl;
+    return rate;
+}
+
+int main(int argc, char *argv[])
+{
+    // Gigabytes to process per variant
+    const std::uint64_t total = gigabyte * ((argc > 1) ? std::strtoull(argv[1], 0, 10) : 1);
+
+    aead::key_type send_key;
+    aead::key_type receive_key;
+    send_key.fill(0x5A);
+    receive_key.fill(0xA5);
+    aead cipher(send_key, receive_key);
+    if (!cipher.valid())
+    {
+        std::cerr << "Cipher not available" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::uint8_t> header(header_size, 0x11);
+    std::vector<std::uint8_t> payload(payload_size);
+    for (std::size_t i = 0; i < payload.size(); ++i)
+    {
+        payload[i] = static_cast<std::uint8_t>(i * 31 + 7);
+    }
+
+    const std::size_t datagram_size = header_size + payload_size + aead::overhead;
+    std::vector<std::vector<std::uint8_t>> datagrams(batch_size,
+                                                     std::vector<std::uint8_t>(datagram_size));
+
+    std::cout << "Payload size " << payload_size << " bytes, batches of "
+              << batch_size << std::endl;
+
+    const auto copy = [&](std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto data = datagrams[i].data();
+            std::memcpy(data, header.data(), header_size);
+            std::memcpy(data + header_size, payload.data(), payload_size);
+        }
+    };
+
+    const double plaintext = measure("plaintext", total, copy, 0);
+
+    measure("single", total, [&](std::size_t count)
+            {
+                copy(count);
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    auto data = datagrams[i].data();
+                    cipher.seal(data, header_size, data + header_size, payload_size);
+                }
+            },
+            plaintext);
+
+    std::vector<aead::packet> packets(batch_size);
+    measure("batch", total, [&](std::size_t count)
+            {
+                copy(count);
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    auto data = datagrams[i].data();
+                    aead::packet packet = { data, header_size,
+                                            data + header_size, payload_size, false };
+                    packets[i] = packet;
+                }
+                cipher.seal(packets.data(), count);
+            },
+            plaintext);
+    return 0;
+}
+
+#else
+
+int main()
+{
+    std::cout << "Built without a crypto implementation" << std::endl;
+    return 0;
+}
+
+#endif // defined(MAIDSAFE_CRUX_USE_OPENSSL)
@@ -0,0 +1,509 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// The same workloads over crux sockets, TCP sockets and plain UDP sockets on
+// loopback, with both ends in one thread so that the CPU time is that of the
+// whole exchange:
+//
+//   ping-pong  one flow that sends a small message and waits for the echo
+//   bulk       one flow that streams messages of the largest payload, at
+//              most a window of them ahead of the receiver
+//   many-flow  many flows that each play ping-pong at the same time
+//
+// Throughput is in messages and payload bytes per second, latency is the
+// round trip in microseconds, and CPU is process time per payload byte.
+// Plain UDP has no retransmissions, so its bulk row stops short if the
+// receive buffer overflows.
+//
+//   compare_bench [round trips] [bulk messages] [flows]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <maidsafe/crux/acceptor.hpp>
+#include <maidsafe/crux/socket.hpp>
+#include <maidsafe/crux/detail/constants.hpp>
+
+namespace crux = maidsafe::crux;
+namespace asio = boost::asio;
+
+using error_code = boost::system::error_code;
+using wall_clock = std::chrono::steady_clock;
+
+namespace
+{
+
+// A connected flow of messages of known size, whatever the transport
+class channel
+{
+public:
+    using handler_type = std::function<void(const error_code&, std::size_t)>;
+
+    virtual ~channel() {}
+
+    virtual void send(const asio::const_buffer&, handler_type) = 0;
+    virtual void receive(const asio::mutable_buffer&, handler_type) = 0;
+    virtual void close() = 0;
+};
+
+// Sockets that keep message boundaries
+template <typename Socket>
+class datagram_channel : public channel
+{
+public:
+    explicit datagram_channel(std::shared_ptr<Socket> socket)
+        : socket(std::move(socket))
+    {
+    }
+
+    void send(const asio::const_buffer& buffer, handler_type handler) override
+    {
+        socket->async_send(asio::const_buffers_1(buffer), std::move(handler));
+    }
+
+    void receive(const asio::mutable_buffer& buffer, handler_type handler) override
+    {
+        socket->async_receive(asio::mutable_buffers_1(buffer), std::move(handler));
+    }
+
+    void close() override
+    {
+        socket->close();
+    }
+
+private:
+    std::shared_ptr<Socket> socket;
+};
+
+// Messages are told apart by their size alone
+class stream_channel : public channel
+{
+public:
+    explicit stream_channel(std::shared_ptr<asio::ip::tcp::socket> socket)
+        : socket(std::move(socket))
+    {
+        this->socket->set_option(asio::ip::tcp::no_delay(true));
+    }
+
+    void send(const asio::const_buffer& buffer, handler_type handler) override
+    {
+        asio::async_write(*socket, asio::const_buffers_1(buffer), std::move(handler));
+    }
+
+    void receive(const asio::mutable_buffer& buffer, handler_type handler) override
+    {
+        asio::async_read(*socket, asio::mutable_buffers_1(buffer), std::move(handler));
+    }
+
+    void close() override
+    {
+        error_code error;
+        socket->close(error);
+    }
+
+private:
+    std::shared_ptr<asio::ip::tcp::socket> socket;
+};
+
+struct connection
+{
+    std::unique_ptr<channel> client;
+    std::unique_ptr<channel> server;
+};
+
+// Runs handlers until done, or until there is nothing left to run
+void run_until(asio::io_service& io, const std::function<bool()>& done)
+{
+    io.reset();
+    while (!done() && io.run_one())
+    {
+    }
+}
+
+std::vector<connection> connect_crux(asio::io_service& io, std::size_t flows)
+{
+    const auto loopback = asio::ip::address_v4::loopback();
+
+    crux::acceptor acceptor(io, asio::ip::udp::endpoint(loopback, 0));
+    const asio::ip::udp::endpoint server(loopback, acceptor.local_endpoint().port());
+
+    std::vector<std::shared_ptr<crux::socket>> clients;
+    std::vector<std::shared_ptr<crux::socket>> servers;
+    std::size_t connected = 0;
+
+    acceptor.async_accept_each(
+        [&]() { return std::make_shared<crux::socket>(io); },
+        [&](error_code error, std::shared_ptr<crux::socket> socket) {
+            if (error)
+                return;
+            servers.push_back(socket);
+            if (servers.size() == flows)
+                acceptor.close();
+        });
+
+    for (std::size_t i = 0; i < flows; ++i)
+    {
+        clients.push_back(std::make_shared<crux::socket>(io, asio::ip::udp::endpoint(loopback, 0)));
+        clients.back()->async_connect(server, [&](error_code error) {
+                if (!error)
+                    ++connected;
+            });
+    }
+    run_until(io, [&]() { return (connected == flows) && (servers.size() == flows); });
+
+    std::vector<connection> result;
+    for (std::size_t i = 0; i < std::min(connected, servers.size()); ++i)
+    {
+        result.push_back(connection{
+            std::unique_ptr<channel>(new datagram_channel<crux::socket>(clients[i])),
+            std::unique_ptr<channel>(new datagram_channel<crux::socket>(servers[i]))});
+    }
+    return result;
+}
+
+std::vector<connection> connect_tcp(asio::io_service& io, std::size_t flows)
+{
+    using tcp = asio::ip::tcp;
+
+    tcp::acceptor acceptor(io, tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+
+    std::vector<connection> result;
+    for (std::size_t i = 0; i < flows; ++i)
+    {
+        auto client = std::make_shared<tcp::socket>(io);
+        auto server = std::make_shared<tcp::socket>(io);
+        client->connect(acceptor.local_endpoint());
+        acceptor.accept(*server);
+        result.push_back(connection{
+            std::unique_ptr<channel>(new stream_channel(client)),
+            std::unique_ptr<channel>(new stream_channel(server))});
+    }
+    return result;
+}
+
+std::vector<connection> connect_udp(asio::io_service& io, std::size_t flows)
+{
+    using udp = asio::ip::udp;
+
+    const udp::endpoint loopback(asio::ip::address_v4::loopback(), 0);
+
+    std::vector<connection> result;
+    for (std::size_t i = 0; i < flows; ++i)
+    {
+        auto client = std::make_shared<udp::socket>(io, loopback);
+        auto server = std::make_shared<udp::socket>(io, loopback);
+        client->connect(server->local_endpoint());
+        server->connect(client->local_endpoint());
+        result.push_back(connection{
+            std::unique_ptr<channel>(new datagram_channel<udp::socket>(client)),
+            std::unique_ptr<channel>(new datagram_channel<udp::socket>(server))});
+    }
+    return result;
+}
+
+struct outcome
+{
+    std::size_t messages;
+    std::size_t bytes;
+    double seconds;
+    double cpu_seconds;
+    // Round trips in microseconds, if any
+    std::vector<double> latencies;
+};
+
+class stopwatch
+{
+public:
+    stopwatch()
+        : wall(wall_clock::now())
+        , cpu(std::clock())
+    {
+    }
+
+    void stop(outcome& result) const
+    {
+        result.seconds = std::chrono::duration<double>(wall_clock::now() - wall).count();
+        result.cpu_seconds = double(std::clock() - cpu) / CLOCKS_PER_SEC;
+    }
+
+private:
+    wall_clock::time_point wall;
+    std::clock_t cpu;
+};
+
+// The server echoes whatever arrives until its channel is closed
+void echo(channel& server, std::shared_ptr<std::vector<char>> buffer)
+{
+    server.receive(asio::buffer(*buffer), [&server, buffer](const error_code& error, std::size_t size) {
+            if (error)
+                return;
+            server.send(asio::buffer(*buffer, size), [&server, buffer](const error_code& error, std::size_t) {
+                    if (!error)
+                        echo(server, buffer);
+                });
+        });
+}
+
+// Every flow makes the given number of round trips
+outcome ping_pong(asio::io_service& io,
+                  std::vector<connection>& links,
+                  std::size_t round_trips,
+                  std::size_t message_size)
+{
+    struct flow
+    {
+        channel *client;
+        std::vector<char> request;
+        std::vector<char> response;
+        std::size_t remaining;
+        wall_clock::time_point sent;
+    };
+
+    outcome result = outcome();
+    std::vector<flow> flows;
+    flows.reserve(links.size());
+    for (auto& ends : links)
+    {
+        flows.push_back(flow{ends.client.get(),
+                             std::vector<char>(message_size, 'x'),
+                             std::vector<char>(message_size),
+                             round_trips,
+                             wall_clock::time_point()});
+        echo(*ends.server, std::make_shared<std::vector<char>>(message_size));
+    }
+    result.latencies.reserve(links.size() * round_trips);
+
+    std::size_t finished = 0;
+    std::function<void(flow&)> next;
+    next = [&](flow& current) {
+        if (current.remaining-- == 0)
+        {
+            ++finished;
+            return;
+        }
+        current.client->receive(asio::buffer(current.response), [&](const error_code& error, std::size_t size) {
+                if (error)
+                {
+                    ++finished;
+                    return;
+                }
+                const auto elapsed = wall_clock::now() - current.sent;
+                result.latencies.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+                ++result.messages;
+                result.bytes += size;
+                next(current);
+            });
+        current.sent = wall_clock::now();
+        current.client->send(asio::buffer(current.request), [](const error_code&, std::size_t) {});
+    };
+
+    stopwatch watch;
+    for (auto& current : flows)
+    {
+        next(current);
+    }
+    run_until(io, [&]() { return finished == flows.size(); });
+    watch.stop(result);
+    return result;
+}
+
+// A single flow that streams messages, at most a window of them ahead of
+// the receiver
+outcome bulk(asio::io_service& io,
+             connection& ends,
+             std::size_t messages,
+             std::size_t message_size,
+             std::size_t window)
+{
+    outcome result = outcome();
+    const std::vector<char> message(message_size, 'x');
+    std::vector<char> buffer(message_size);
+
+    std::size_t sent = 0;
+    bool sending = false;
+    bool stopped = false;
+
+    std::function<void()> pump = [&]() {
+        if (sending || (sent == messages) || (sent - result.messages >= window))
+            return;
+        sending = true;
+        ends.client->send(asio::buffer(message), [&](const error_code& error, std::size_t) {
+                sending = false;
+                if (error)
+                    return;
+                ++sent;
+                pump();
+            });
+    };
+
+    std::function<void()> receive = [&]() {
+        ends.server->receive(asio::buffer(buffer), [&](const error_code& error, std::size_t size) {
+                if (error)
+                {
+                    stopped = true;
+                    return;
+                }
+                ++result.messages;
+                result.bytes += size;
+                pump();
+                if (result.messages < messages)
+                    receive();
+            });
+    };
+
+    // Lost datagrams would otherwise be waited for forever, so give up once
+    // nothing has arrived for a while
+    asio::steady_timer deadline(io);
+    std::size_t last = 0;
+    deadline.expires_from_now(std::chrono::seconds(5));
+    std::function<void(const error_code&)> check = [&](const error_code& error) {
+        if (error)
+            return;
+        if (result.messages == messages)
+            return;
+        if (result.messages == last)
+        {
+            stopped = true;
+            return;
+        }
+        last = result.messages;
+        deadline.expires_from_now(std::chrono::seconds(5));
+        deadline.async_wait(check);
+    };
+    deadline.async_wait(check);
+
+    stopwatch watch;
+    receive();
+    pump();
+    run_until(io, [&]() { return stopped || (result.messages == messages); });
+    watch.stop(result);
+
+    deadline.cancel();
+    return result;
+}
+
+void report(const std::string& workload, const std::string& transport, outcome result)
+{
+    auto& latencies = result.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double fraction) {
+        const auto index = std::min(latencies.size() - 1,
+                                    static_cast<std::size_t>(fraction * latencies.size()));
+        return latencies[index];
+    };
+
+    std::cout << std::left
+              << std::setw(11) << workload
+              << std::setw(6) << transport
+              << std::right << std::fixed
+              << std::setprecision(0)
+              << std::setw(12) << result.messages / result.seconds
+              << std::setprecision(2)
+              << std::setw(10) << result.bytes / result.seconds / 1e6;
+    if (latencies.empty())
+    {
+        std::cout << std::setw(12) << "-" << std::setw(12) << "-" << std::setw(12) << "-";
+    }
+    else
+    {
+        std::cout << std::setw(12) << percentile(0.5)
+                  << std::setw(12) << percentile(0.99)
+                  << std::setw(12) << percentile(0.999);
+    }
+    std::cout << std::setw(10) << result.cpu_seconds * 1e9 / double(std::max<std::size_t>(result.bytes, 1))
+              << std::endl;
+}
+
+void close(asio::io_service& io, std::vector<connection>& links)
+{
+    for (auto& ends : links)
+    {
+        ends.client->close();
+        ends.server->close();
+    }
+    io.reset();
+    io.run();
+    links.clear();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const std::size_t round_trips = (argc > 1) ? std::strtoull(argv[1], 0, 10) : 10000;
+    const std::size_t bulk_messages = (argc > 2) ? std::strtoull(argv[2], 0, 10) : 100000;
+    const std::size_t flows = (argc > 3) ? std::strtoull(argv[3], 0, 10) : 100;
+
+    const std::size_t small_size = 64;
+    const std::size_t large_size = crux::detail::constant::max_payload_size;
+    const std::size_t window = 32;
+
+    using connector = std::function<std::vector<connection>(asio::io_service&, std::size_t)>;
+    const std::vector<std::pair<std::string, connector>> transports = {
+        { "crux", connect_crux },
+        { "tcp", connect_tcp },
+        { "udp", connect_udp }
+    };
+
+    std::cout << std::left << std::setw(17) << "workload"
+              << std::right
+              << std::setw(12) << "msg/s"
+              << std::setw(10) << "MB/s"
+              << std::setw(12) << "p50 us"
+              << std::setw(12) << "p99 us"
+              << std::setw(12) << "p99.9 us"
+              << std::setw(10) << "CPU ns/B"
+              << std::endl;
+
+    for (const auto& transport : transports)
+    {
+        asio::io_service io;
+        auto links = transport.second(io, 1);
+        if (links.empty())
+        {
+            std::cerr << "Cannot connect over " << transport.first << std::endl;
+            return 1;
+        }
+        report("ping-pong", transport.first, ping_pong(io, links, round_trips, small_size));
+        close(io, links);
+    }
+
+    for (const auto& transport : transports)
+    {
+        asio::io_service io;
+        auto links = transport.second(io, 1);
+        report("bulk", transport.first, bulk(io, links.front(), bulk_messages, large_size, window));
+        close(io, links);
+    }
+
+    for (const auto& transport : transports)
+    {
+        asio::io_service io;
+        auto links = transport.second(io, flows);
+        if (links.size() < flows)
+        {
+            std::cerr << "Cannot connect " << flows << " flows over " << transport.first << std::endl;
+            return 1;
+        }
+        report("many-flow", transport.first,
+               ping_pong(io, links, std::max<std::size_t>(round_trips / flows, 1), small_size));
+        close(io, links);
+    }
+    return 0;
+}
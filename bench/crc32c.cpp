@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Cost of the checksum trailer: the time it takes to checksum a gigabyte of
+// full sized datagrams, once on sending and once on receiving.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <maidsafe/crux/detail/constants.hpp>
+#include <maidsafe/crux/detail/crc32c.hpp>
+
+namespace crux = maidsafe::crux;
+
+using crc32c = crux::detail::crc32c;
+using implementation_type = std::uint32_t (*)(std::uint32_t, const std::uint8_t *, std::size_t);
+
+const std::uint64_t gigabyte = 1ULL << 30;
+
+static void measure(const char *name,
+                    implementation_type implementation,
+                    const std::vector<std::uint8_t>& datagram,
+                    std::uint64_t total)
+{
+    const auto count = total / datagram.size();
+
+    std::uint32_t sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 0; i < count; ++i)
+    {
+        sink ^= implementation(0xFFFFFFFF, datagram.data(), datagram.size());
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    const double bytes = double(count * datagram.size());
+    const double seconds_per_gigabyte = elapsed.count() * gigabyte / bytes;
+
+    std::cout << std::left << std::setw(10) << name
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << bytes / elapsed.count() / (1 << 20) << " MiB/s"
+              << std::setw(10) << seconds_per_gigabyte * 1000 << " ms/GiB"
+              // Keeps the loop from being optimized away
+              << ((sink == 0x12345678) ? " " : "")
+              << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    // Gigabytes to checksum per implementation
+    const std::uint64_t total = gigabyte * ((argc > 1) ? std::strtoull(argv[1], 0, 10) : 1);
+
+    std::vector<std::uint8_t> datagram(crux::detail::constant::max_datagram_size);
+    for (std::size_t i = 0; i < datagram.size(); ++i)
+    {
+        datagram[i] = static_cast<std::uint8_t>(i * 31 + 7);
+    }
+
+    std::cout << "Datagram size " << datagram.size() << " bytes" << std::endl;
+
+    measure("software", &crc32c::software, datagram, total);
+    if (crc32c::is_hardware_accelerated())
+    {
+        measure("hardware", &crc32c::hardware, datagram, total);
+    }
+    else
+    {
+        std::cout << "hardware  not available" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Cost of turning a header, the buffers of a message and a trailer into the
+// iovecs that are handed to the operating system: walking the nested
+// concatenated sequence on every send, flattening into gather buffers on
+// every send, and flattening once and reusing the gather buffers for every
+// retransmission, either walked like any buffer sequence or handed over as
+// they are.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <maidsafe/crux/detail/concatenate.hpp>
+#include <maidsafe/crux/detail/constants.hpp>
+#include <maidsafe/crux/detail/gather_buffers.hpp>
+
+namespace crux = maidsafe::crux;
+namespace asio = boost::asio;
+
+using iovec_type = crux::detail::iovec_type;
+using gather_type = crux::detail::gather_buffers<crux::detail::constant::max_gather_buffers>;
+using body_type = std::vector<asio::const_buffer>;
+
+// The iovecs for one send, filled in the way the socket does it for any
+// buffer sequence.
+struct message_type
+{
+    std::array<iovec_type, crux::detail::constant::max_gather_buffers> vectors;
+    std::size_t count;
+};
+
+template <typename ConstBufferSequence>
+static std::size_t fill(message_type& message, const ConstBufferSequence& buffers)
+{
+    std::size_t total = 0;
+    message.count = 0;
+    for (auto it = buffers.begin(); it != buffers.end(); ++it)
+    {
+        const asio::const_buffer buffer(*it);
+        auto& vector = message.vectors[message.count++];
+        vector.iov_base = const_cast<void *>(asio::buffer_cast<const void *>(buffer));
+        vector.iov_len = asio::buffer_size(buffer);
+        total += vector.iov_len;
+    }
+    return total;
+}
+
+static void report(const char *name,
+                   std::chrono::steady_clock::time_point start,
+                   double count,
+                   std::size_t sink)
+{
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    std::cout << std::left << std::setw(12) << name
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << elapsed.count() * 1e9 / count << " ns/send"
+              // Keeps the loop from being optimized away
+              << ((sink == 0x12345678) ? " " : "")
+              << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    // Millions of sends per implementation
+    const std::uint64_t millions = (argc > 1) ? std::strtoull(argv[1], 0, 10) : 20;
+    // Buffers in each message
+    const std::size_t parts = (argc > 2)
+        ? std::strtoull(argv[2], 0, 10)
+        : 4;
+    const std::size_t max_parts = crux::detail::constant::max_gather_buffers - 2;
+    if (parts > max_parts)
+    {
+        std::cerr << "At most " << max_parts << " buffers per message" << std::endl;
+        return 1;
+    }
+
+    std::array<std::uint8_t, 16> header = {{}};
+    std::array<std::uint8_t, 4> trailer = {{}};
+    std::vector<std::uint8_t> payload(1024);
+    body_type body;
+    for (std::size_t i = 0; i < parts; ++i)
+    {
+        body.push_back(asio::buffer(&payload[i * payload.size() / parts],
+                                    payload.size() / parts));
+    }
+
+    const auto rounds = millions * 1000000;
+    message_type message;
+    std::size_t sink = 0;
+
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t round = 0; round < rounds; ++round)
+        {
+            sink += fill(message,
+                         crux::detail::concatenate
+                         (crux::detail::concatenate(asio::buffer(header), body),
+                          asio::buffer(trailer)));
+        }
+        report("concatenate", start, double(rounds), sink);
+    }
+
+    {
+        gather_type gather;
+        const auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t round = 0; round < rounds; ++round)
+        {
+            gather.clear();
+            gather.push_back(asio::buffer(header));
+            gather.append(body);
+            gather.push_back(asio::buffer(trailer));
+            sink += fill(message, gather);
+        }
+        report("reflatten", start, double(rounds), sink);
+    }
+
+    gather_type gather;
+    gather.push_back(asio::buffer(header));
+    gather.append(body);
+    gather.push_back(asio::buffer(trailer));
+
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t round = 0; round < rounds; ++round)
+        {
+            sink += fill(message, gather);
+        }
+        report("reuse", start, double(rounds), sink);
+    }
+
+    {
+        // As handed to sendmsg() or sendmmsg()
+        const iovec_type *volatile vectors = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t round = 0; round < rounds; ++round)
+        {
+            vectors = gather.data();
+            sink += gather.bytes() + gather.size();
+        }
+        report("direct", start, double(rounds), sink + (vectors != 0));
+    }
+    return 0;
+}
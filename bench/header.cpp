@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Cost of parsing received headers: the time it takes to get the type,
+// sequence number and ack out of a mix of data, keepalive and malformed
+// headers, field by field through the decoder and the message structures,
+// and in one pass through the header view.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <boost/optional.hpp>
+#include <maidsafe/crux/detail/header.hpp>
+#include <maidsafe/crux/detail/header_view.hpp>
+
+namespace crux = maidsafe::crux;
+namespace header = crux::detail::header;
+
+using sequence_type = header::sequence_type;
+using parser_type = std::uint32_t (*)(const header::data_type&);
+
+// Field by field, as the multiplexer used to do. Unknown types are skipped
+// instead of asserted on.
+static std::uint32_t parse_decoder(const header::data_type& data)
+{
+    crux::detail::decoder decoder(data.data(), data.data() + data.size());
+    const auto type = decoder.get<std::uint16_t>();
+    switch (type & header::constant::mask_type)
+    {
+    case header::constant::type_data:
+        {
+            header::data msg(type, decoder);
+            return msg.sequence_number.value() ^ (msg.ack ? msg.ack->value() : 0);
+        }
+    case header::constant::type_keepalive:
+        {
+            header::keepalive msg(type, decoder);
+            return msg.sequence_number.value() ^ (msg.ack ? msg.ack->value() : 0);
+        }
+    default:
+        return 0;
+    }
+}
+
+static std::uint32_t parse_view(const header::data_type& data)
+{
+    const header::view view(data);
+    if (!view.is_valid())
+        return 0;
+    const auto ack = view.ack();
+    return view.sequence_number().value() ^ (ack ? ack->value() : 0);
+}
+
+static void measure(const char *name,
+                    parser_type parser,
+                    const std::vector<header::data_type>& headers,
+                    std::uint64_t rounds)
+{
+    std::uint32_t sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t round = 0; round < rounds; ++round)
+    {
+        for (const auto& data : headers)
+        {
+            sink ^= parser(data);
+        }
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    const double count = double(rounds * headers.size());
+
+    std::cout << std::left << std::setw(10) << name
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << elapsed.count() * 1e9 / count << " ns/header"
+              << std::setw(10) << count / elapsed.count() / 1e6 << " M headers/s"
+              // Keeps the loop from being optimized away
+              << ((sink == 0x12345678) ? " " : "")
+              << std::endl;
+}
+
+template <typename Message>
+static header::data_type encode(const Message& message)
+{
+    header::data_type result;
+    crux::detail::encoder encoder(result.data(), result.size());
+    message.encode(encoder);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    // Millions of headers to parse per implementation
+    const std::uint64_t millions = (argc > 1) ? std::strtoull(argv[1], 0, 10) : 100;
+
+    // Mostly data with and without acks, some keepalives and a few that
+    // are malformed, in an order the branch predictor cannot learn.
+    std::mt19937 generator(42);
+    std::vector<header::data_type> headers(4096);
+    for (auto& data : headers)
+    {
+        const sequence_type sequence(generator());
+        const auto ack = (generator() % 2)
+            ? boost::optional<sequence_type>(sequence_type(generator()))
+            : boost::none;
+        const auto kind = generator() % 16;
+        if (kind < 12)
+        {
+            data = encode(header::data(0, sequence, ack, 1));
+        }
+        else if (kind < 15)
+        {
+            data = encode(header::keepalive(0, sequence, ack, 1));
+        }
+        else
+        {
+            data = encode(header::data(0, sequence, ack, 1));
+            data[0] ^= 0x20;
+        }
+    }
+
+    const auto rounds = millions * 1000000 / headers.size();
+    measure("decoder", &parse_decoder, headers, rounds);
+    measure("view", &parse_view, headers, rounds);
+    return 0;
+}
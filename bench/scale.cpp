@@ -0,0 +1,226 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Cost versus the number of connections to a single acceptor, measured over
+// the in-memory transport of the simulation build, where a million client
+// endpoints need neither ports nor file descriptors and waiting for timers
+// costs no time. Each row is a fresh network with that many connections:
+//
+//   handshake  connections established per second, both ends included
+//   memory     growth of resident memory per connection, both ends
+//              included, which is low where memory freed by the previous
+//              rows is reused; give a single count for an exact figure
+//   demux      per datagram delivered while every client sends one message,
+//              which the acceptor side must find the socket for
+//   idle       per connection and second of virtual time while nothing is
+//              sent, short of the keepalive timeout
+//   timeout    per connection whose keepalive timer expires, which closes
+//              the socket
+//
+//   scale_bench [max connections] [min connections]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <maidsafe/crux/acceptor.hpp>
+#include <maidsafe/crux/socket.hpp>
+#include <maidsafe/crux/simulation.hpp>
+
+#if defined(__linux__)
+# include <unistd.h>
+#endif
+
+namespace crux = maidsafe::crux;
+namespace asio = boost::asio;
+
+using endpoint_type = asio::ip::udp::endpoint;
+using wall_clock = std::chrono::steady_clock;
+
+// Zero where it cannot be told
+static std::size_t resident_memory()
+{
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    std::size_t size = 0;
+    std::size_t resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+static double seconds_since(wall_clock::time_point start)
+{
+    return std::chrono::duration<double>(wall_clock::now() - start).count();
+}
+
+// Clients get endpoints of their own on loopback addresses, as there are
+// not enough ports on one address for a million of them
+static endpoint_type client_endpoint(std::size_t index)
+{
+    const std::size_t ports_per_address = 50000;
+    const auto address = 0x7F000002 + static_cast<std::uint32_t>(index / ports_per_address);
+    const auto port = 10000 + index % ports_per_address;
+    return endpoint_type(asio::ip::address_v4(address), static_cast<unsigned short>(port));
+}
+
+static void measure(std::size_t count)
+{
+    asio::io_service io;
+    crux::simulation simulation(io, 1);
+
+    // Every phase is over well within the keepalive timeout, unless
+    // something is badly wrong
+    const auto step = std::chrono::milliseconds(10);
+    auto run_while = [&](const std::function<bool()>& busy) {
+        const auto deadline = simulation.now() + 2 * crux::detail::constant::keepalive_timeout;
+        while (busy())
+        {
+            if (simulation.now() > deadline)
+            {
+                std::cerr << "Stalled with " << count << " connections" << std::endl;
+                std::exit(1);
+            }
+            simulation.run_for(step);
+        }
+    };
+
+    const endpoint_type server(asio::ip::address_v4::loopback(), 9000);
+    crux::acceptor acceptor(io, server);
+
+    std::vector<std::shared_ptr<crux::socket>> server_sockets;
+    std::vector<std::unique_ptr<crux::socket>> client_sockets;
+    server_sockets.reserve(count);
+    client_sockets.reserve(count);
+
+    const auto memory_before = resident_memory();
+
+    std::size_t connected = 0;
+    std::size_t received = 0;
+    std::size_t closed = 0;
+    std::vector<char> message(100, 'x');
+    std::vector<char> sink(message.size());
+
+    acceptor.async_accept_each(
+        [&]() { return std::make_shared<crux::socket>(io); },
+        [&](boost::system::error_code error, std::shared_ptr<crux::socket> socket) {
+            if (error)
+                return;
+            server_sockets.push_back(socket);
+            if (server_sockets.size() == count)
+                acceptor.close();
+        });
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        client_sockets.emplace_back(new crux::socket(io, client_endpoint(i)));
+    }
+
+    // Handshakes
+    auto start = wall_clock::now();
+    for (auto& socket : client_sockets)
+    {
+        socket->async_connect(server, [&](boost::system::error_code error) {
+                if (!error)
+                    ++connected;
+            });
+    }
+    run_while([&]() { return (connected < count) || (server_sockets.size() < count); });
+    const auto handshake = seconds_since(start);
+    const auto memory = resident_memory() - std::min(memory_before, resident_memory());
+
+    // Demultiplexing
+    for (auto& socket : server_sockets)
+    {
+        socket->async_receive(asio::buffer(sink), [&](boost::system::error_code error, std::size_t) {
+                if (!error)
+                    ++received;
+                else
+                    ++closed;
+            });
+    }
+    auto delivered = simulation.delivered();
+    start = wall_clock::now();
+    for (auto& socket : client_sockets)
+    {
+        socket->async_send(asio::buffer(message), [](boost::system::error_code, std::size_t) {});
+    }
+    run_while([&]() { return received < count; });
+    const auto demux = seconds_since(start) / double(simulation.delivered() - delivered);
+
+    // Idle, with a receive and thereby a keepalive timer pending on every
+    // acceptor side socket
+    for (auto& socket : server_sockets)
+    {
+        socket->async_receive(asio::buffer(sink), [&](boost::system::error_code error, std::size_t) {
+                if (error)
+                    ++closed;
+            });
+    }
+    const auto idle_period = crux::detail::constant::keepalive_timeout - std::chrono::seconds(1);
+    start = wall_clock::now();
+    simulation.run_for(idle_period);
+    const auto idle = seconds_since(start)
+        / std::chrono::duration<double>(idle_period).count()
+        / double(count);
+
+    // Keepalive timeouts
+    start = wall_clock::now();
+    run_while([&]() { return closed < count; });
+    const auto timeout = seconds_since(start) / double(count);
+
+    std::cout << std::right << std::fixed
+              << std::setw(10) << count
+              << std::setprecision(0)
+              << std::setw(14) << double(count) / handshake << " /s"
+              << std::setprecision(2)
+              << std::setw(10) << double(memory) / double(count) / 1024.0 << " KiB"
+              << std::setw(10) << demux * 1e9 << " ns"
+              << std::setw(10) << idle * 1e9 << " ns/s"
+              << std::setw(10) << timeout * 1e9 << " ns"
+              << std::endl;
+
+    for (auto& socket : client_sockets) socket->close();
+    for (auto& socket : server_sockets) socket->close();
+    simulation.run();
+}
+
+int main(int argc, char *argv[])
+{
+    const std::size_t largest = (argc > 1) ? std::strtoull(argv[1], 0, 10) : 100000;
+    const std::size_t smallest = (argc > 2) ? std::strtoull(argv[2], 0, 10) : 1000;
+
+    std::cout << std::setw(10) << "count"
+              << std::setw(17) << "handshake"
+              << std::setw(14) << "memory"
+              << std::setw(13) << "demux"
+              << std::setw(15) << "idle"
+              << std::setw(13) << "timeout"
+              << std::endl;
+
+    for (std::size_t count = std::max<std::size_t>(smallest, 1); count <= largest; count *= 10)
+    {
+        measure(count);
+        if ((count < largest) && (count * 10 > largest))
+        {
+            measure(largest);
+        }
+    }
+    return 0;
+}
@@ -13,6 +13,7 @@
 
 #include <memory>
 #include <boost/asio/io_service.hpp>
+#include <maidsafe/crux/admission.hpp>
 #include <maidsafe/crux/detail/service.hpp>
 #include <maidsafe/crux/endpoint.hpp>
 #include <maidsafe/crux/socket.hpp>
@@ -40,8 +41,29 @@ public:
     async_accept(socket_type& socket,
                  CompletionToken&& token);
 
+    // Start accepting connections until the acceptor is closed.
+    //
+    // The factory is called for every handshake from a new remote endpoint
+    // and must return a std::shared_ptr to an unconnected socket_type. The
+    // handler is called with each established socket, and finally with
+    // operation_aborted and an empty pointer once the acceptor is closed.
+    template <typename SocketFactory,
+              typename AcceptHandler>
+    void async_accept_each(SocketFactory&& factory,
+                           AcceptHandler&& handler);
+
     endpoint_type local_endpoint() const;
 
+    // Limit the number of connections on the local endpoint. Handshakes
+    // beyond the limit are handled according to the admission policy.
+    void max_connections(std::size_t);
+    std::size_t max_connections() const;
+
+    void admission(admission_policy);
+    admission_policy admission() const;
+
+    admission_statistics statistics() const;
+
     ~acceptor();
 
     void close();
@@ -138,6 +160,65 @@ acceptor::async_accept(socket_type& socket,
     result.get();
 }
 
+template <typename SocketFactory,
+          typename AcceptHandler>
+void acceptor::async_accept_each(SocketFactory&& factory,
+                                 AcceptHandler&& handler)
+{
+    using handler_type = typename std::decay<AcceptHandler>::type;
+    using socket_pointer = std::shared_ptr<socket_type>;
+
+    handler_type accept_handler(std::forward<AcceptHandler>(handler));
+
+    if (!multiplexer)
+    {
+        get_io_service().post
+            ([accept_handler]() mutable
+             {
+                 accept_handler(boost::asio::error::invalid_argument, socket_pointer());
+             });
+        return;
+    }
+
+    auto& io = get_io_service();
+
+    multiplexer->async_accept_each
+        (*this,
+         [this, &io, factory, accept_handler]() mutable -> detail::socket_base *
+         {
+             socket_pointer socket = factory();
+             if (!socket || (socket->state() != socket_type::connectivity::closed))
+             {
+                 return nullptr;
+             }
+
+             socket->state(socket_type::connectivity::listening);
+             socket->set_multiplexer(multiplexer);
+
+             // The socket keeps itself alive until the handshake completes.
+             // The handler is posted so that the socket is not released
+             // from inside one of its own member functions.
+             socket->connect_handler
+                 = [&io, socket, accept_handler]
+                   (const boost::system::error_code& error) mutable
+                   {
+                       io.post([socket, accept_handler, error]() mutable
+                               {
+                                   if (!error)
+                                   {
+                                       accept_handler(error, socket);
+                                   }
+                               });
+                   };
+             return socket.get();
+         },
+         [accept_handler]
+         (const boost::system::error_code& error) mutable
+         {
+             accept_handler(error, socket_pointer());
+         });
+}
+
 template <typename AcceptHandler>
 void acceptor::process_accept(const boost::system::error_code& error,
                               socket_type& socket,
@@ -165,6 +246,46 @@ acceptor::endpoint_type acceptor::local_endpoint() const
     return multiplexer->next_layer().local_endpoint();
 }
 
+inline
+void acceptor::max_connections(std::size_t value)
+{
+    assert(multiplexer);
+
+    multiplexer->max_connections(value);
+}
+
+inline
+std::size_t acceptor::max_connections() const
+{
+    assert(multiplexer);
+
+    return multiplexer->max_connections();
+}
+
+inline
+void acceptor::admission(admission_policy value)
+{
+    assert(multiplexer);
+
+    multiplexer->admission(value);
+}
+
+inline
+admission_policy acceptor::admission() const
+{
+    assert(multiplexer);
+
+    return multiplexer->admission();
+}
+
+inline
+admission_statistics acceptor::statistics() const
+{
+    assert(multiplexer);
+
+    return multiplexer->statistics();
+}
+
 template <typename Handler,
           typename ErrorCode>
 void acceptor::invoke_handler(Handler&& handler,
@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_ADMISSION_HPP
+#define MAIDSAFE_CRUX_ADMISSION_HPP
+
+#include <cstddef>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+// What to do with a new handshake once a connection limit has been reached.
+enum struct admission_policy
+{
+    // Reply with a shutdown packet and forget about the remote endpoint.
+    refuse,
+    // Close the connection that has been idle the longest to make room for
+    // the new one. Falls back to refusing if nothing can be evicted.
+    evict_idle
+};
+
+struct admission_statistics
+{
+    std::size_t accepted = 0;
+    std::size_t refused = 0;
+    std::size_t evicted = 0;
+};
+
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_ADMISSION_HPP
@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_CAPTURE_HPP
+#define MAIDSAFE_CRUX_CAPTURE_HPP
+
+#include <string>
+#include <boost/asio/io_service.hpp>
+#include <maidsafe/crux/detail/capture.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+// Records every datagram that the sockets and acceptors of an io_service
+// send and receive, with the time at which they did so, to a file in the
+// pcap format. Returns false if the file could not be created.
+bool start_capture(boost::asio::io_service&, const std::string& path);
+
+// Stops recording and closes the file
+void stop_capture(boost::asio::io_service&);
+
+} // namespace crux
+} // namespace maidsafe
+
+#include <maidsafe/crux/detail/service.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+inline bool start_capture(boost::asio::io_service& io, const std::string& path)
+{
+    auto writer = detail::capture_writer::create(path);
+    if (!writer)
+        return false;
+    boost::asio::use_service<detail::service>(io).capture(writer);
+    return true;
+}
+
+inline void stop_capture(boost::asio::io_service& io)
+{
+    boost::asio::use_service<detail::service>(io).capture(nullptr);
+}
+
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_CAPTURE_HPP
@@ -0,0 +1,47 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DELIVERY_STATISTICS_HPP
+#define MAIDSAFE_CRUX_DELIVERY_STATISTICS_HPP
+
+#include <chrono>
+#include <cstdint>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+// What the acknowledgements of a connection tell about the path to the
+// remote endpoint. All estimates are zero until the first acknowledgement.
+struct delivery_statistics
+{
+    using duration_type = std::chrono::steady_clock::duration;
+
+    // Bytes per second that reach the remote endpoint, smoothed over
+    // recent acknowledgements.
+    double delivery_rate = 0.0;
+    // Smallest round-trip time seen recently. Round-trip times above it
+    // indicate that a queue is building up somewhere along the path.
+    duration_type min_roundtrip_time = duration_type::zero();
+    duration_type smoothed_roundtrip_time = duration_type::zero();
+    // Fraction of transmissions that were not acknowledged in time,
+    // smoothed over recent transmissions.
+    double loss_rate = 0.0;
+
+    std::uint64_t bytes_delivered = 0;
+    std::uint64_t transmissions = 0;
+    std::uint64_t retransmissions = 0;
+};
+
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DELIVERY_STATISTICS_HPP
@@ -0,0 +1,398 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_ARENA_HPP
+#define MAIDSAFE_CRUX_DETAIL_ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// A region of memory that is mapped once and handed out in slots of equal
+// size, for datagram buffers that are reused many times over.
+//
+// The region may be backed by huge pages, which keeps the buffers of a busy
+// endpoint within a few TLB entries, and may be bound to the NUMA node of
+// the thread that creates it. Either falls back to what the system offers:
+// explicit huge pages, then transparent ones, then normal pages, and heap
+// memory where memory cannot be mapped.
+class arena
+{
+public:
+    struct options
+    {
+        options();
+
+        bool huge_pages;
+        bool local_node;
+    };
+
+    // What the region ended up being backed by
+    enum struct backing
+    {
+        heap,
+        pages,
+        transparent_huge_pages,
+        huge_pages
+    };
+
+    // Room for at least the given number of slots. Huge pages round the
+    // region up, and the rest of it is used for more slots.
+    static std::shared_ptr<arena> create(std::size_t slot_size,
+                                         std::size_t slots,
+                                         const options&);
+    ~arena();
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    // A free slot, or null if the size does not fit in one or all are in use
+    void *allocate(std::size_t size);
+    // False if the memory is not from this arena
+    bool deallocate(void *);
+
+    std::size_t slot_size() const;
+    std::size_t capacity() const;
+    // Number of free slots
+    std::size_t available() const;
+    backing memory() const;
+
+private:
+    arena(std::size_t slot_size, std::size_t slots, const options&);
+
+    void map(const options&);
+    void place(const options&);
+
+private:
+    const std::size_t slot;
+    std::size_t length;
+    char *base;
+    backing kind;
+    std::vector<void *> unused;
+};
+
+// Allocator that takes memory from an arena while it has room, and from the
+// heap otherwise. Default constructed allocators only use the heap, and so
+// do copies of containers, so that only the buffers that an arena is given
+// to hold on to its slots.
+template <typename T>
+class arena_allocator
+{
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    arena_allocator();
+    explicit arena_allocator(std::shared_ptr<arena>);
+    // Moved allocators must still equal the original
+    arena_allocator(const arena_allocator&) = default;
+    arena_allocator& operator=(const arena_allocator&) = default;
+    template <typename U>
+    arena_allocator(const arena_allocator<U>&);
+
+    T *allocate(std::size_t count);
+    void deallocate(T *, std::size_t count);
+
+    arena_allocator select_on_container_copy_construction() const;
+
+    const std::shared_ptr<arena>& source() const;
+
+private:
+    std::shared_ptr<arena> store;
+};
+
+template <typename T, typename U>
+bool operator==(const arena_allocator<T>&, const arena_allocator<U>&);
+template <typename T, typename U>
+bool operator!=(const arena_allocator<T>&, const arena_allocator<U>&);
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <maidsafe/crux/detail/constants.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <sys/mman.h>
+# include <unistd.h>
+# define MAIDSAFE_CRUX_ARENA_MMAP 1
+#endif
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+inline arena::options::options()
+    : huge_pages(false)
+    , local_node(false)
+{
+}
+
+inline std::shared_ptr<arena> arena::create(std::size_t slot_size,
+                                            std::size_t slots,
+                                            const options& settings)
+{
+    return std::shared_ptr<arena>(new arena(slot_size, slots, settings));
+}
+
+inline arena::arena(std::size_t slot_size, std::size_t slots, const options& settings)
+    : slot(slot_size)
+    , length(slot_size * slots)
+    , base(nullptr)
+    , kind(backing::heap)
+{
+    assert(slot_size > 0);
+    assert(slots > 0);
+
+    map(settings);
+    place(settings);
+
+    const auto count = length / slot;
+    unused.reserve(count);
+    // Handed out from the start of the region
+    for (std::size_t i = count; i > 0; --i)
+    {
+        unused.push_back(base + (i - 1) * slot);
+    }
+}
+
+inline arena::~arena()
+{
+    // Slots that are still in use must not outlive the arena
+    assert(unused.size() == length / slot);
+
+#if defined(MAIDSAFE_CRUX_ARENA_MMAP)
+    if (kind != backing::heap)
+    {
+        ::munmap(base, length);
+        return;
+    }
+#endif
+    ::operator delete(base);
+}
+
+inline void arena::map(const options& settings)
+{
+#if defined(MAIDSAFE_CRUX_ARENA_MMAP)
+    const int protection = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    if (settings.huge_pages)
+    {
+        const auto page = constant::huge_page_size;
+        length = (length + page - 1) / page * page;
+
+# if defined(MAP_HUGETLB)
+        // Only succeeds if the administrator has reserved huge pages
+        void *region = ::mmap(nullptr, length, protection, flags | MAP_HUGETLB, -1, 0);
+        if (region != MAP_FAILED)
+        {
+            base = static_cast<char *>(region);
+            kind = backing::huge_pages;
+            return;
+        }
+# endif
+    }
+
+# if defined(MADV_HUGEPAGE)
+    if (settings.huge_pages)
+    {
+        // Transparent huge pages are only used for aligned ranges, so the
+        // region is mapped with room to spare and trimmed to alignment.
+        const auto page = constant::huge_page_size;
+        void *region = ::mmap(nullptr, length + page, protection, flags, -1, 0);
+        if (region != MAP_FAILED)
+        {
+            char *start = static_cast<char *>(region);
+            char *aligned = start + (page - reinterpret_cast<std::uintptr_t>(start) % page) % page;
+            if (aligned != start)
+            {
+                ::munmap(start, aligned - start);
+            }
+            ::munmap(aligned + length, start + page - aligned);
+
+            base = aligned;
+            kind = (::madvise(base, length, MADV_HUGEPAGE) == 0)
+                ? backing::transparent_huge_pages
+                : backing::pages;
+            return;
+        }
+    }
+# endif
+
+    void *region = ::mmap(nullptr, length, protection, flags, -1, 0);
+    if (region != MAP_FAILED)
+    {
+        base = static_cast<char *>(region);
+        kind = backing::pages;
+        return;
+    }
+#else
+    static_cast<void>(settings);
+#endif
+
+    base = static_cast<char *>(::operator new(length));
+    kind = backing::heap;
+}
+
+inline void arena::place(const options& settings)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    if (settings.local_node && (kind != backing::heap))
+    {
+        // Pages are allocated on the node of the thread that touches them
+        // first, but only under the default policy, which may have been
+        // changed for the process. Failures leave it as it was.
+        const int mpol_local = 4;
+        ::syscall(SYS_mbind, base, length, mpol_local, nullptr, 0, 0);
+    }
+#else
+    static_cast<void>(settings);
+#endif
+
+    // Fault the pages in now, from the thread that owns the arena, instead
+    // of on whichever thread first receives into them.
+    if (kind != backing::heap)
+    {
+        const std::size_t step = 4096;
+        for (std::size_t offset = 0; offset < length; offset += step)
+        {
+            base[offset] = 0;
+        }
+    }
+}
+
+inline void *arena::allocate(std::size_t size)
+{
+    if ((size > slot) || unused.empty())
+        return nullptr;
+
+    void *result = unused.back();
+    unused.pop_back();
+    return result;
+}
+
+inline bool arena::deallocate(void *memory)
+{
+    char *position = static_cast<char *>(memory);
+    if ((position < base) || (position >= base + length))
+        return false;
+
+    assert((position - base) % slot == 0);
+    unused.push_back(memory);
+    return true;
+}
+
+inline std::size_t arena::slot_size() const
+{
+    return slot;
+}
+
+inline std::size_t arena::capacity() const
+{
+    return length / slot;
+}
+
+inline std::size_t arena::available() const
+{
+    return unused.size();
+}
+
+inline arena::backing arena::memory() const
+{
+    return kind;
+}
+
+template <typename T>
+arena_allocator<T>::arena_allocator()
+{
+}
+
+template <typename T>
+arena_allocator<T>::arena_allocator(std::shared_ptr<arena> store)
+    : store(std::move(store))
+{
+}
+
+template <typename T>
+template <typename U>
+arena_allocator<T>::arena_allocator(const arena_allocator<U>& other)
+    : store(other.source())
+{
+}
+
+template <typename T>
+T *arena_allocator<T>::allocate(std::size_t count)
+{
+    if (store)
+    {
+        if (void *result = store->allocate(count * sizeof(T)))
+            return static_cast<T *>(result);
+    }
+    return static_cast<T *>(::operator new(count * sizeof(T)));
+}
+
+template <typename T>
+void arena_allocator<T>::deallocate(T *memory, std::size_t)
+{
+    if (store && store->deallocate(memory))
+        return;
+    ::operator delete(memory);
+}
+
+template <typename T>
+arena_allocator<T> arena_allocator<T>::select_on_container_copy_construction() const
+{
+    return arena_allocator();
+}
+
+template <typename T>
+const std::shared_ptr<arena>& arena_allocator<T>::source() const
+{
+    return store;
+}
+
+template <typename T, typename U>
+bool operator==(const arena_allocator<T>& lhs, const arena_allocator<U>& rhs)
+{
+    return lhs.source() == rhs.source();
+}
+
+template <typename T, typename U>
+bool operator!=(const arena_allocator<T>& lhs, const arena_allocator<U>& rhs)
+{
+    return !(lhs == rhs);
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#undef MAIDSAFE_CRUX_ARENA_MMAP
+
+#endif // MAIDSAFE_CRUX_DETAIL_ARENA_HPP
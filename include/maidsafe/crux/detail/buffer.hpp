@@ -13,6 +13,7 @@
 
 #include <algorithm>
 #include <vector>
+#include <maidsafe/crux/detail/arena.hpp>
 
 namespace maidsafe
 {
@@ -21,7 +22,9 @@ namespace crux
 namespace detail
 {
 
-using buffer = std::vector<char>;
+// Datagram buffers, which take their memory from the arena of a buffer pool
+// if there is one.
+using buffer = std::vector<char, arena_allocator<char>>;
 
 } // namespace detail
 } // namespace crux
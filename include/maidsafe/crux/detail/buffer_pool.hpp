@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_BUFFER_POOL_HPP
+#define MAIDSAFE_CRUX_DETAIL_BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <maidsafe/crux/detail/arena.hpp>
+#include <maidsafe/crux/detail/buffer.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// Datagram buffers that go back to the pool when the last reference to them
+// is gone, so that packets which must be copied anyway, such as encrypted
+// ones, do not cost an allocation each. Buffers may outlive the pool.
+//
+// If asked for huge pages or memory on the local NUMA node, buffers take
+// their memory from an arena with a slot for each of them. The arena is
+// created by the first acquire, and thereby on the thread that runs the
+// pool, rather than on the one that created it.
+class buffer_pool : public std::enable_shared_from_this<buffer_pool>
+{
+public:
+    // At most capacity unused buffers are kept.
+    static std::shared_ptr<buffer_pool> create(std::size_t capacity,
+                                               const arena::options& = arena::options());
+
+    std::shared_ptr<buffer> acquire(std::size_t size);
+
+    // Number of unused buffers
+    std::size_t size() const;
+
+    // Null until the first acquire, or if no arena is used
+    const std::shared_ptr<arena>& memory() const;
+
+private:
+    buffer_pool(std::size_t capacity, const arena::options&);
+
+    void release(buffer *);
+
+private:
+    std::size_t capacity;
+    arena::options settings;
+    std::shared_ptr<arena> store;
+    std::vector<std::unique_ptr<buffer>> unused;
+};
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#include <maidsafe/crux/detail/constants.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+inline std::shared_ptr<buffer_pool> buffer_pool::create(std::size_t capacity,
+                                                        const arena::options& settings)
+{
+    return std::shared_ptr<buffer_pool>(new buffer_pool(capacity, settings));
+}
+
+inline buffer_pool::buffer_pool(std::size_t capacity, const arena::options& settings)
+    : capacity(capacity)
+    , settings(settings)
+{
+}
+
+inline std::shared_ptr<buffer> buffer_pool::acquire(std::size_t size)
+{
+    std::unique_ptr<buffer> result;
+    if (unused.empty())
+    {
+        if (!store && (settings.huge_pages || settings.local_node))
+        {
+            store = arena::create(constant::arena_slot_size, capacity, settings);
+        }
+        result.reset(new buffer(buffer::allocator_type(store)));
+    }
+    else
+    {
+        result = std::move(unused.back());
+        unused.pop_back();
+    }
+    result->resize(size);
+
+    std::weak_ptr<buffer_pool> owner = shared_from_this();
+    return std::shared_ptr<buffer>(result.release(),
+                                   [owner](buffer *released)
+                                   {
+                                       if (auto self = owner.lock())
+                                       {
+                                           self->release(released);
+                                       }
+                                       else
+                                       {
+                                           delete released;
+                                       }
+                                   });
+}
+
+inline std::size_t buffer_pool::size() const
+{
+    return unused.size();
+}
+
+inline const std::shared_ptr<arena>& buffer_pool::memory() const
+{
+    return store;
+}
+
+inline void buffer_pool::release(buffer *released)
+{
+    std::unique_ptr<buffer> entry(released);
+    if (unused.size() < capacity)
+    {
+        unused.push_back(std::move(entry));
+    }
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_BUFFER_POOL_HPP
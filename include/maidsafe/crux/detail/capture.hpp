@@ -0,0 +1,479 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_CAPTURE_HPP
+#define MAIDSAFE_CRUX_DETAIL_CAPTURE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <maidsafe/crux/detail/clock.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// A datagram as it went over the wire, and when it did
+struct captured_datagram
+{
+    using endpoint_type = boost::asio::ip::udp::endpoint;
+
+    // Since the epoch of the clock of the capture
+    std::chrono::microseconds time;
+    endpoint_type source;
+    endpoint_type destination;
+    std::vector<char> payload;
+};
+
+// Datagrams written to a file in the pcap format, which tcpdump, Wireshark
+// and most other tools read. Each is stored as a raw IP packet with a UDP
+// header that is made up from the endpoints, without checksums.
+class capture_writer
+{
+public:
+    using endpoint_type = captured_datagram::endpoint_type;
+#if defined(MAIDSAFE_CRUX_SIMULATION)
+    using clock_type = detail::clock;
+#else
+    // Captures are read alongside others, which are in wall clock time
+    using clock_type = std::chrono::system_clock;
+#endif
+
+    // Returns an empty pointer if the file could not be created
+    static std::shared_ptr<capture_writer> create(const std::string& path);
+
+    capture_writer(const capture_writer&) = delete;
+    capture_writer& operator=(const capture_writer&) = delete;
+
+    // Stamped with the current time
+    template <typename ConstBufferSequence>
+    void write(const endpoint_type& source,
+               const endpoint_type& destination,
+               const ConstBufferSequence& payload);
+    void write(const captured_datagram&);
+
+    void flush();
+
+    // Number of datagrams written
+    std::size_t size() const;
+
+private:
+    explicit capture_writer(const std::string& path);
+
+    // The IP and UDP headers in front of the payload
+    std::size_t encode_headers(const endpoint_type& source,
+                               const endpoint_type& destination,
+                               std::size_t payload_size);
+    void write_packet(std::chrono::microseconds time);
+
+private:
+    std::ofstream file;
+    std::vector<std::uint8_t> packet;
+    std::size_t count;
+};
+
+// Reads back the UDP datagrams of a capture in the pcap format with raw IP
+// packets, as written by capture_writer.
+class capture_reader
+{
+public:
+    using endpoint_type = captured_datagram::endpoint_type;
+
+    // Returns an empty pointer if the file could not be opened or is not a
+    // capture of raw IP packets
+    static std::shared_ptr<capture_reader> open(const std::string& path);
+
+    capture_reader(const capture_reader&) = delete;
+    capture_reader& operator=(const capture_reader&) = delete;
+
+    // False at the end of the capture. Packets that are not UDP over IP or
+    // that were cut short by the capture are skipped.
+    bool read(captured_datagram&);
+
+private:
+    explicit capture_reader(const std::string& path);
+
+    bool read_header();
+    std::uint32_t load(const std::uint8_t *) const;
+    bool decode(const std::vector<std::uint8_t>&, captured_datagram&) const;
+
+private:
+    std::ifstream file;
+    bool swapped;
+    bool nanoseconds;
+};
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <maidsafe/crux/detail/decoder.hpp>
+#include <maidsafe/crux/detail/encoder.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+namespace capture_constant
+{
+
+const std::uint32_t magic_microseconds = 0xA1B2C3D4;
+const std::uint32_t magic_nanoseconds = 0xA1B23C4D;
+const std::uint16_t version_major = 2;
+const std::uint16_t version_minor = 4;
+const std::uint32_t snapshot_length = 65535;
+const std::size_t file_header_size = 24;
+const std::size_t record_header_size = 16;
+
+// Link types of packets that start with an IP header
+const std::uint32_t link_raw = 101;
+const std::uint32_t link_ipv4 = 228;
+const std::uint32_t link_ipv6 = 229;
+
+const std::size_t ipv4_header_size = 20;
+const std::size_t ipv6_header_size = 40;
+const std::size_t udp_header_size = 8;
+const std::uint8_t protocol_udp = 17;
+const std::uint8_t hop_limit = 64;
+
+} // namespace capture_constant
+
+//-----------------------------------------------------------------------------
+// capture_writer
+//-----------------------------------------------------------------------------
+
+inline std::shared_ptr<capture_writer> capture_writer::create(const std::string& path)
+{
+    std::shared_ptr<capture_writer> result(new capture_writer(path));
+    if (!result->file)
+    {
+        result.reset();
+    }
+    return result;
+}
+
+inline capture_writer::capture_writer(const std::string& path)
+    : file(path.c_str(), std::ios::binary | std::ios::trunc)
+    , count(0)
+{
+    namespace constant = capture_constant;
+
+    // In our byte order, which readers tell from the magic number
+    const std::uint32_t magic = constant::magic_microseconds;
+    const std::uint16_t major = constant::version_major;
+    const std::uint16_t minor = constant::version_minor;
+    const std::int32_t zone = 0;
+    const std::uint32_t accuracy = 0;
+    const std::uint32_t snapshot = constant::snapshot_length;
+    const std::uint32_t link = constant::link_raw;
+
+    file.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+    file.write(reinterpret_cast<const char *>(&major), sizeof(major));
+    file.write(reinterpret_cast<const char *>(&minor), sizeof(minor));
+    file.write(reinterpret_cast<const char *>(&zone), sizeof(zone));
+    file.write(reinterpret_cast<const char *>(&accuracy), sizeof(accuracy));
+    file.write(reinterpret_cast<const char *>(&snapshot), sizeof(snapshot));
+    file.write(reinterpret_cast<const char *>(&link), sizeof(link));
+}
+
+template <typename ConstBufferSequence>
+void capture_writer::write(const endpoint_type& source,
+                           const endpoint_type& destination,
+                           const ConstBufferSequence& payload)
+{
+    const auto now = std::chrono::duration_cast<std::chrono::microseconds>
+        (clock_type::now().time_since_epoch());
+
+    const auto size = boost::asio::buffer_size(payload);
+    const auto offset = encode_headers(source, destination, size);
+    boost::asio::buffer_copy(boost::asio::buffer(packet.data() + offset, size), payload);
+    write_packet(now);
+}
+
+inline void capture_writer::write(const captured_datagram& datagram)
+{
+    const auto size = datagram.payload.size();
+    const auto offset = encode_headers(datagram.source, datagram.destination, size);
+    std::copy(datagram.payload.begin(), datagram.payload.end(), packet.begin() + offset);
+    write_packet(datagram.time);
+}
+
+inline void capture_writer::flush()
+{
+    file.flush();
+}
+
+inline std::size_t capture_writer::size() const
+{
+    return count;
+}
+
+inline std::size_t capture_writer::encode_headers(const endpoint_type& source,
+                                                  const endpoint_type& destination,
+                                                  std::size_t payload_size)
+{
+    namespace constant = capture_constant;
+    using boost::asio::ip::address_v6;
+
+    // IPv4 endpoints talking to IPv6 ones are mapped
+    const bool version6 = source.address().is_v6() || destination.address().is_v6();
+    const std::size_t ip_size = version6 ? constant::ipv6_header_size : constant::ipv4_header_size;
+    const std::size_t udp_size = constant::udp_header_size + payload_size;
+
+    packet.resize(ip_size + udp_size);
+    detail::encoder encoder(packet.data(), packet.size());
+
+    if (version6)
+    {
+        const auto map = [](const boost::asio::ip::address& address) {
+            return address.is_v6() ? address.to_v6() : address_v6::v4_mapped(address.to_v4());
+        };
+
+        encoder.put<std::uint32_t>(0x60000000); // Version, class and flow
+        encoder.put<std::uint16_t>(static_cast<std::uint16_t>(udp_size));
+        encoder.put<std::uint8_t>(constant::protocol_udp);
+        encoder.put<std::uint8_t>(constant::hop_limit);
+        for (auto byte : map(source.address()).to_bytes())
+        {
+            encoder.put<std::uint8_t>(byte);
+        }
+        for (auto byte : map(destination.address()).to_bytes())
+        {
+            encoder.put<std::uint8_t>(byte);
+        }
+    }
+    else
+    {
+        encoder.put<std::uint8_t>(0x45); // Version and header length
+        encoder.put<std::uint8_t>(0); // Type of service
+        encoder.put<std::uint16_t>(static_cast<std::uint16_t>(ip_size + udp_size));
+        encoder.put<std::uint16_t>(0); // Identification
+        encoder.put<std::uint16_t>(0x4000); // Do not fragment
+        encoder.put<std::uint8_t>(constant::hop_limit);
+        encoder.put<std::uint8_t>(constant::protocol_udp);
+        encoder.put<std::uint16_t>(0); // Checksum, filled in below
+        encoder.put<std::uint32_t>(static_cast<std::uint32_t>(source.address().to_v4().to_ulong()));
+        encoder.put<std::uint32_t>(static_cast<std::uint32_t>(destination.address().to_v4().to_ulong()));
+
+        // Tools flag IP headers with bad checksums, unlike UDP without one
+        std::uint32_t sum = 0;
+        for (std::size_t i = 0; i < ip_size; i += 2)
+        {
+            sum += (packet[i] << 8) | packet[i + 1];
+        }
+        while (sum >> 16)
+        {
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        }
+        detail::encoder(packet.data() + 10, sizeof(std::uint16_t))
+            .put<std::uint16_t>(static_cast<std::uint16_t>(~sum));
+    }
+
+    encoder.put<std::uint16_t>(source.port());
+    encoder.put<std::uint16_t>(destination.port());
+    encoder.put<std::uint16_t>(static_cast<std::uint16_t>(udp_size));
+    encoder.put<std::uint16_t>(0); // No checksum
+
+    return ip_size + constant::udp_header_size;
+}
+
+inline void capture_writer::write_packet(std::chrono::microseconds time)
+{
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(time);
+    const std::uint32_t whole = static_cast<std::uint32_t>(seconds.count());
+    const std::uint32_t fraction = static_cast<std::uint32_t>((time - seconds).count());
+    const std::uint32_t length = static_cast<std::uint32_t>(packet.size());
+
+    file.write(reinterpret_cast<const char *>(&whole), sizeof(whole));
+    file.write(reinterpret_cast<const char *>(&fraction), sizeof(fraction));
+    file.write(reinterpret_cast<const char *>(&length), sizeof(length)); // Captured
+    file.write(reinterpret_cast<const char *>(&length), sizeof(length)); // On the wire
+    file.write(reinterpret_cast<const char *>(packet.data()), packet.size());
+    ++count;
+}
+
+//-----------------------------------------------------------------------------
+// capture_reader
+//-----------------------------------------------------------------------------
+
+inline std::shared_ptr<capture_reader> capture_reader::open(const std::string& path)
+{
+    std::shared_ptr<capture_reader> result(new capture_reader(path));
+    if (!result->file || !result->read_header())
+    {
+        result.reset();
+    }
+    return result;
+}
+
+inline capture_reader::capture_reader(const std::string& path)
+    : file(path.c_str(), std::ios::binary)
+    , swapped(false)
+    , nanoseconds(false)
+{
+}
+
+inline bool capture_reader::read_header()
+{
+    namespace constant = capture_constant;
+
+    std::array<std::uint8_t, constant::file_header_size> header;
+    if (!file.read(reinterpret_cast<char *>(header.data()), header.size()))
+        return false;
+
+    std::uint32_t magic;
+    std::memcpy(&magic, header.data(), sizeof(magic));
+    for (auto candidate : { constant::magic_microseconds, constant::magic_nanoseconds })
+    {
+        const std::uint32_t reversed = ((candidate & 0xFF) << 24)
+            | ((candidate & 0xFF00) << 8)
+            | ((candidate >> 8) & 0xFF00)
+            | (candidate >> 24);
+        if ((magic == candidate) || (magic == reversed))
+        {
+            swapped = (magic == reversed);
+            nanoseconds = (candidate == constant::magic_nanoseconds);
+            const auto link = load(header.data() + 20);
+            return (link == constant::link_raw)
+                || (link == constant::link_ipv4)
+                || (link == constant::link_ipv6);
+        }
+    }
+    return false;
+}
+
+inline std::uint32_t capture_reader::load(const std::uint8_t *data) const
+{
+    std::uint32_t result;
+    std::memcpy(&result, data, sizeof(result));
+    if (swapped)
+    {
+        result = ((result & 0xFF) << 24)
+            | ((result & 0xFF00) << 8)
+            | ((result >> 8) & 0xFF00)
+            | (result >> 24);
+    }
+    return result;
+}
+
+inline bool capture_reader::read(captured_datagram& datagram)
+{
+    namespace constant = capture_constant;
+
+    std::array<std::uint8_t, constant::record_header_size> header;
+    std::vector<std::uint8_t> packet;
+
+    while (file.read(reinterpret_cast<char *>(header.data()), header.size()))
+    {
+        const auto seconds = load(header.data());
+        const auto fraction = load(header.data() + 4);
+        const auto captured = load(header.data() + 8);
+        const auto original = load(header.data() + 12);
+
+        packet.resize(captured);
+        if (!file.read(reinterpret_cast<char *>(packet.data()), packet.size()))
+            return false;
+
+        if ((captured < original) || !decode(packet, datagram))
+            continue;
+
+        datagram.time = std::chrono::seconds(seconds)
+            + (nanoseconds
+               ? std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(fraction))
+               : std::chrono::microseconds(fraction));
+        return true;
+    }
+    return false;
+}
+
+inline bool capture_reader::decode(const std::vector<std::uint8_t>& packet,
+                                   captured_datagram& datagram) const
+{
+    namespace constant = capture_constant;
+    using namespace boost::asio::ip;
+
+    if (packet.empty())
+        return false;
+
+    std::size_t offset = 0;
+    address source;
+    address destination;
+
+    switch (packet[0] >> 4)
+    {
+    case 4:
+        {
+            offset = (packet[0] & 0x0F) * 4;
+            if ((offset < constant::ipv4_header_size)
+                || (packet.size() < offset)
+                || (packet[9] != constant::protocol_udp))
+                return false;
+
+            detail::decoder decoder(packet.data() + 12, 2 * sizeof(std::uint32_t));
+            source = address_v4(decoder.get<std::uint32_t>());
+            destination = address_v4(decoder.get<std::uint32_t>());
+        }
+        break;
+
+    case 6:
+        {
+            // Extension headers are not expected from us
+            offset = constant::ipv6_header_size;
+            if ((packet.size() < offset) || (packet[6] != constant::protocol_udp))
+                return false;
+
+            address_v6::bytes_type bytes;
+            std::copy(packet.begin() + 8, packet.begin() + 24, bytes.begin());
+            source = address_v6(bytes);
+            std::copy(packet.begin() + 24, packet.begin() + 40, bytes.begin());
+            destination = address_v6(bytes);
+        }
+        break;
+
+    default:
+        return false;
+    }
+
+    if (packet.size() < offset + constant::udp_header_size)
+        return false;
+
+    detail::decoder decoder(packet.data() + offset, constant::udp_header_size);
+    const auto source_port = decoder.get<std::uint16_t>();
+    const auto destination_port = decoder.get<std::uint16_t>();
+    const std::size_t length = decoder.get<std::uint16_t>();
+    if ((length < constant::udp_header_size) || (packet.size() < offset + length))
+        return false;
+
+    datagram.source = endpoint_type(source, source_port);
+    datagram.destination = endpoint_type(destination, destination_port);
+    datagram.payload.assign(packet.begin() + offset + constant::udp_header_size,
+                            packet.begin() + offset + length);
+    return true;
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_CAPTURE_HPP
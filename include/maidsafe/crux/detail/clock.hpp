@@ -0,0 +1,38 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_CLOCK_HPP
+#define MAIDSAFE_CRUX_DETAIL_CLOCK_HPP
+
+#include <chrono>
+
+#if defined(MAIDSAFE_CRUX_SIMULATION)
+# include <maidsafe/crux/detail/simulation.hpp>
+#endif
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// The clock of protocol time, which is virtual in simulation builds
+#if defined(MAIDSAFE_CRUX_SIMULATION)
+using clock = simulation::virtual_clock;
+#else
+using clock = std::chrono::steady_clock;
+#endif
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_CLOCK_HPP
@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_COMPACT_HEADER_HPP
+#define MAIDSAFE_CRUX_DETAIL_COMPACT_HEADER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <maidsafe/crux/detail/config.hpp>
+#include <maidsafe/crux/detail/header_constants.hpp>
+#include <maidsafe/crux/detail/sequence_number.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+namespace header
+{
+
+// Compact encoding of keepalive and data headers, for connections that agree
+// on it in the handshake:
+//
+//   flags            1 byte   10KARROO
+//   connection id    2 bytes
+//   sequence number  1-5 bytes
+//   ack              1-5 bytes, only if A is set
+//
+// where K marks a keepalive, A the presence of an ack, RR is the
+// retransmission count and OO are the skip and compressed data options.
+// Full headers never start with bits 10, so both can be told apart.
+//
+// Sequence numbers are truncated to their low 7 bits per byte, in groups of
+// seven with the high bit set on all but the last byte. The receiver takes
+// the sequence number nearest to the one it expects, and the ack nearest to
+// the last sequence number it has sent. Five bytes carry all 32 bits.
+//
+// Trailers are computed over the full header, so a sequence number that is
+// restored wrongly fails verification.
+namespace compact
+{
+
+const std::size_t min_width = 2;
+const std::size_t max_width = 5;
+
+const std::size_t min_size = 1 + 2 + 1;
+const std::size_t max_size = 1 + 2 + 2 * max_width;
+
+// The sender can only guess how far the ack is behind what the receiver
+// has sent, so it gets a generous window.
+const std::size_t ack_width = 3;
+
+using sequence_type = sequence_number<std::uint32_t>;
+
+bool is_compact(std::uint8_t first);
+
+// Number of bytes that tell a sequence number apart from all others within
+// span of it.
+std::size_t width(std::uint32_t span);
+
+// Encodes a full header into output, which must have room for max_size
+// bytes. Returns the size, or zero if the header cannot be compacted.
+std::size_t encode(const data_type& full,
+                   std::size_t sequence_width,
+                   std::uint8_t *output);
+
+// Restores the full header. Returns the size of the compact header, or zero
+// if it is malformed.
+std::size_t decode(const std::uint8_t *input,
+                   std::size_t size,
+                   sequence_type expected,
+                   sequence_type last_sent,
+                   data_type& full);
+
+// Sequence number with the given low bits that is nearest to the reference
+sequence_type restore(std::uint32_t truncated,
+                      std::size_t bits,
+                      sequence_type reference);
+
+} // namespace compact
+} // namespace header
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#if defined(MAIDSAFE_CRUX_HEADER_ONLY)
+# include <maidsafe/crux/detail/impl/compact_header.ipp>
+#endif
+
+#endif // MAIDSAFE_CRUX_DETAIL_COMPACT_HEADER_HPP
@@ -0,0 +1,383 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_COMPRESSION_HPP
+#define MAIDSAFE_CRUX_DETAIL_COMPRESSION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// Message compression in the LZ4 block format, optionally with a dictionary
+// that both peers have in advance.
+//
+// A compressed message is its uncompressed size as a 32-bit big-endian
+// integer followed by a single LZ4 block. Matches may refer back into the
+// dictionary as if it preceded the message.
+namespace compression
+{
+
+const std::size_t invalid = std::size_t(-1);
+
+// Larger messages are neither compressed nor accepted in compressed form.
+const std::size_t max_message_size = 0xFFFF;
+
+// Only this much of the end of a dictionary can be referred to.
+const std::size_t max_dictionary_size = 0xFFFF;
+
+// Identifies a dictionary in the handshake. Zero is no dictionary.
+std::uint32_t dictionary_id(const std::shared_ptr<const std::vector<char>>& dictionary);
+
+// Uncompressed size of a compressed message, or invalid if it is malformed.
+std::size_t decompressed_size(const std::uint8_t *input, std::size_t size);
+
+// Returns the decompressed size, or invalid if the message is malformed or
+// does not fit into the output.
+std::size_t decompress(const std::uint8_t *input,
+                       std::size_t size,
+                       std::uint8_t *output,
+                       std::size_t capacity,
+                       const std::shared_ptr<const std::vector<char>>& dictionary);
+
+class compressor
+{
+public:
+    explicit compressor(std::shared_ptr<const std::vector<char>> dictionary);
+
+    // Returns the compressed size, or zero if compression would not save
+    // anything.
+    template <typename ConstBufferSequence>
+    std::size_t compress(const ConstBufferSequence& input,
+                         std::uint8_t *output,
+                         std::size_t capacity);
+
+private:
+    std::size_t compress_window(std::size_t size,
+                                std::uint8_t *output,
+                                std::size_t capacity);
+
+private:
+    static const std::size_t hash_log = 12;
+
+    // The end of the dictionary followed by the message being compressed
+    std::vector<std::uint8_t> window;
+    std::size_t dictionary_size;
+    // Last position of each hash, with the dictionary already hashed
+    std::vector<std::uint32_t> dictionary_table;
+    std::vector<std::uint32_t> table;
+};
+
+} // namespace compression
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#include <algorithm>
+#include <cstring>
+#include <boost/asio/buffer.hpp>
+#include <maidsafe/crux/detail/crc32c.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+namespace compression
+{
+
+// LZ4 block format limits
+const std::size_t min_match = 4;
+const std::size_t last_literals = 5;
+const std::size_t match_limit = 12;
+const std::size_t max_offset = 0xFFFF;
+const std::size_t size_prefix = sizeof(std::uint32_t);
+const std::uint32_t empty_slot = 0xFFFFFFFF;
+
+inline std::uint32_t dictionary_id(const std::shared_ptr<const std::vector<char>>& dictionary)
+{
+    if (!dictionary || dictionary->empty())
+        return 0;
+
+    crc32c crc;
+    crc.update(dictionary->data(), dictionary->size());
+    return std::max<std::uint32_t>(crc.value(), 1);
+}
+
+inline std::size_t decompressed_size(const std::uint8_t *input, std::size_t size)
+{
+    if (size <= size_prefix)
+        return invalid;
+
+    const std::size_t result = (std::size_t(input[0]) << 24)
+        | (std::size_t(input[1]) << 16)
+        | (std::size_t(input[2]) << 8)
+        | std::size_t(input[3]);
+    return (result > max_message_size) ? invalid : result;
+}
+
+inline std::size_t decompress(const std::uint8_t *input,
+                              std::size_t size,
+                              std::uint8_t *output,
+                              std::size_t capacity,
+                              const std::shared_ptr<const std::vector<char>>& dictionary)
+{
+    const auto expected = decompressed_size(input, size);
+    if (expected == invalid || expected > capacity)
+        return invalid;
+
+    const std::uint8_t *dictionary_end = nullptr;
+    std::size_t dictionary_size = 0;
+    if (dictionary)
+    {
+        dictionary_size = std::min(dictionary->size(), max_dictionary_size);
+        dictionary_end = reinterpret_cast<const std::uint8_t *>(dictionary->data())
+            + dictionary->size();
+    }
+
+    const std::uint8_t *ip = input + size_prefix;
+    const std::uint8_t *const end = input + size;
+    std::size_t op = 0;
+
+    while (ip < end)
+    {
+        const std::uint8_t token = *ip++;
+
+        std::size_t literals = token >> 4;
+        if (literals == 15)
+        {
+            std::uint8_t more;
+            do
+            {
+                if (ip == end)
+                    return invalid;
+                more = *ip++;
+                literals += more;
+            } while (more == 255);
+        }
+        if (std::size_t(end - ip) < literals || expected - op < literals)
+            return invalid;
+        std::memcpy(output + op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == end)
+            break; // The last sequence has no match
+
+        if (end - ip < 2)
+            return invalid;
+        const std::size_t offset = std::size_t(ip[0]) | (std::size_t(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op + dictionary_size)
+            return invalid;
+
+        std::size_t length = token & 0x0F;
+        if (length == 15)
+        {
+            std::uint8_t more;
+            do
+            {
+                if (ip == end)
+                    return invalid;
+                more = *ip++;
+                length += more;
+            } while (more == 255);
+        }
+        length += min_match;
+        if (expected - op < length)
+            return invalid;
+
+        // The match may start in the dictionary and continue into the
+        // output, and may overlap with itself.
+        for (; length > 0 && op < offset; --length, ++op)
+        {
+            output[op] = dictionary_end[std::ptrdiff_t(op) - std::ptrdiff_t(offset)];
+        }
+        for (; length > 0; --length, ++op)
+        {
+            output[op] = output[op - offset];
+        }
+    }
+    return (op == expected) ? op : invalid;
+}
+
+inline compressor::compressor(std::shared_ptr<const std::vector<char>> dictionary)
+    : dictionary_size(0)
+    , dictionary_table(std::size_t(1) << hash_log, empty_slot)
+{
+    if (dictionary)
+    {
+        dictionary_size = std::min(dictionary->size(), max_dictionary_size);
+        window.assign(dictionary->end() - dictionary_size, dictionary->end());
+    }
+
+    // Hash the dictionary once, so that each message starts from a copy
+    const auto hash = [this](std::size_t position) -> std::uint32_t
+    {
+        std::uint32_t value;
+        std::memcpy(&value, window.data() + position, sizeof(value));
+        return (value * 2654435761U) >> (32 - hash_log);
+    };
+    for (std::size_t i = 0; i + min_match <= dictionary_size; ++i)
+    {
+        dictionary_table[hash(i)] = std::uint32_t(i);
+    }
+}
+
+template <typename ConstBufferSequence>
+std::size_t compressor::compress(const ConstBufferSequence& input,
+                                 std::uint8_t *output,
+                                 std::size_t capacity)
+{
+    const auto size = boost::asio::buffer_size(input);
+    if (size <= match_limit || size > max_message_size)
+        return 0;
+
+    window.resize(dictionary_size + size);
+    boost::asio::buffer_copy(boost::asio::buffer(window.data() + dictionary_size, size), input);
+
+    return compress_window(size, output, capacity);
+}
+
+inline std::size_t compressor::compress_window(std::size_t size,
+                                               std::uint8_t *output,
+                                               std::size_t capacity)
+{
+    // Not worth it unless it saves something
+    capacity = std::min(capacity, size);
+    if (capacity <= size_prefix)
+        return 0;
+
+    table = dictionary_table;
+
+    const std::uint8_t *const base = window.data();
+    const auto read32 = [base](std::size_t position) -> std::uint32_t
+    {
+        std::uint32_t value;
+        std::memcpy(&value, base + position, sizeof(value));
+        return value;
+    };
+    const auto hash = [](std::uint32_t value)
+    {
+        return (value * 2654435761U) >> (32 - hash_log);
+    };
+
+    std::uint8_t *op = output;
+    std::uint8_t *const output_end = output + capacity;
+
+    *op++ = std::uint8_t(size >> 24);
+    *op++ = std::uint8_t(size >> 16);
+    *op++ = std::uint8_t(size >> 8);
+    *op++ = std::uint8_t(size);
+
+    const auto put_length = [&op, output_end](std::size_t length) -> bool
+    {
+        for (; length >= 255; length -= 255)
+        {
+            if (op == output_end)
+                return false;
+            *op++ = 255;
+        }
+        if (op == output_end)
+            return false;
+        *op++ = std::uint8_t(length);
+        return true;
+    };
+
+    // Literals from anchor up to position, followed by a match unless
+    // this is the last sequence.
+    const auto put_sequence = [&](std::size_t anchor,
+                                  std::size_t position,
+                                  std::size_t offset,
+                                  std::size_t length) -> bool
+    {
+        const std::size_t literals = position - anchor;
+        if (op == output_end)
+            return false;
+        auto token = op++;
+        *token = std::uint8_t(std::min<std::size_t>(literals, 15) << 4);
+        if (literals >= 15 && !put_length(literals - 15))
+            return false;
+        if (std::size_t(output_end - op) < literals)
+            return false;
+        std::memcpy(op, base + anchor, literals);
+        op += literals;
+
+        if (length == 0)
+            return true;
+
+        if (output_end - op < 2)
+            return false;
+        *op++ = std::uint8_t(offset);
+        *op++ = std::uint8_t(offset >> 8);
+
+        length -= min_match;
+        *token |= std::uint8_t(std::min<std::size_t>(length, 15));
+        return (length < 15) || put_length(length - 15);
+    };
+
+    const std::size_t start = dictionary_size;
+    const std::size_t end = start + size;
+    const std::size_t last_match_start = end - match_limit;
+    const std::size_t last_match_end = end - last_literals;
+
+    std::size_t anchor = start;
+    std::size_t position = start;
+
+    while (position < last_match_start)
+    {
+        const auto value = read32(position);
+        auto& slot = table[hash(value)];
+        const std::size_t candidate = slot;
+        slot = std::uint32_t(position);
+
+        if (candidate == empty_slot
+            || position - candidate > max_offset
+            || read32(candidate) != value)
+        {
+            ++position;
+            continue;
+        }
+
+        std::size_t length = min_match;
+        while (position + length < last_match_end
+               && base[candidate + length] == base[position + length])
+        {
+            ++length;
+        }
+
+        if (!put_sequence(anchor, position, position - candidate, length))
+            return 0;
+
+        position += length;
+        anchor = position;
+    }
+
+    if (!put_sequence(anchor, end, 0, 0))
+        return 0;
+
+    const std::size_t result = op - output;
+    return (result < size) ? result : 0;
+}
+
+} // namespace compression
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_COMPRESSION_HPP
@@ -0,0 +1,33 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_CONFIG_HPP
+#define MAIDSAFE_CRUX_DETAIL_CONFIG_HPP
+
+// By default everything is defined in the headers. With
+// MAIDSAFE_CRUX_SEPARATE_COMPILATION defined for the crux library and
+// everything that uses it, the non-template parts of the multiplexer,
+// service, timer and header codecs, and the transmit queue of sockets, are
+// compiled once into the library instead of in every translation unit.
+//
+// Simulation builds (MAIDSAFE_CRUX_SIMULATION) run the protocol on a
+// virtual clock and an in-memory network, and are always header-only, as
+// the compiled library is built for real time and sockets.
+#if !defined(MAIDSAFE_CRUX_SEPARATE_COMPILATION) || defined(MAIDSAFE_CRUX_SIMULATION)
+# define MAIDSAFE_CRUX_HEADER_ONLY 1
+#endif
+
+#if defined(MAIDSAFE_CRUX_HEADER_ONLY)
+# define MAIDSAFE_CRUX_DECL inline
+#else
+# define MAIDSAFE_CRUX_DECL
+#endif
+
+#endif // MAIDSAFE_CRUX_DETAIL_CONFIG_HPP
@@ -12,6 +12,8 @@
 #define MAIDSAFE_CRUX_DETAIL_CONSTANTS_HPP
 
 #include <chrono>
+#include <cstddef>
+#include <maidsafe/crux/detail/header_constants.hpp>
 
 namespace maidsafe
 {
@@ -32,6 +34,50 @@ const std::chrono::seconds initial_roundtrip_time(3);
 
 const std::chrono::seconds keepalive_timeout(5*initial_roundtrip_time);
 
+// How long the smallest round-trip time seen is trusted. It is measured
+// again afterwards in case the path has changed.
+const std::chrono::seconds min_roundtrip_time_window(10);
+
+// Largest datagram that is not fragmented on common paths: a 1500 byte
+// Ethernet MTU less the IPv6 and UDP headers. Payloads leave room for the
+// checksum and encryption trailers.
+const std::size_t max_datagram_size = 1452;
+const std::size_t max_payload_size = max_datagram_size
+    - header::constant::size
+    - header::constant::checksum_size
+    - header::constant::encryption_size;
+
+// Smaller messages are not worth compressing.
+const std::size_t compression_threshold = 128;
+
+// Number of unused datagram buffers that each local endpoint keeps around.
+const std::size_t buffer_pool_capacity = 64;
+
+// Size of the slots that pooled datagram buffers take from their arena,
+// which has room for the largest datagram we send. Larger ones, such as
+// those received from others, are allocated elsewhere.
+const std::size_t arena_slot_size = 2048;
+
+// Size of the huge pages that arenas may be backed by.
+const std::size_t huge_page_size = 2 << 20;
+
+// Number of buffers that a datagram may be gathered from, header and
+// trailer included.
+const std::size_t max_gather_buffers = 16;
+
+// Number of messages that a socket may have queued for transmission, and
+// so the most messages that a single skip can stand for.
+const std::size_t max_transmit_queue_size = 1024;
+
+// Number of file slices that may be queued on the socket at a time.
+const std::size_t file_transfer_window = 16;
+
+// Number of stream segments that may be queued on the socket at a time.
+const std::size_t stream_window = 16;
+
+// Size of each direction of a shared memory connection. Must be a power of two.
+const std::size_t shared_memory_ring_size = 1 << 20;
+
 } // namespace constant
 } // namespace detail
 } // namespace crux
@@ -0,0 +1,284 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_CRC32C_HPP
+#define MAIDSAFE_CRUX_DETAIL_CRC32C_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <boost/asio/buffer.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define MAIDSAFE_CRUX_CRC32C_SSE42 1
+# include <nmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# define MAIDSAFE_CRUX_CRC32C_SSE42 1
+# include <intrin.h>
+# include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+# define MAIDSAFE_CRUX_CRC32C_ARMV8 1
+# include <arm_acle.h>
+#endif
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// CRC-32C (Castagnoli), as used by iSCSI and SCTP.
+//
+// Uses the CRC instructions of SSE 4.2 when the processor has them, or of
+// ARMv8 when built for it, and a slicing-by-8 table otherwise.
+class crc32c
+{
+public:
+    crc32c();
+
+    void update(const void *data, std::size_t size);
+
+    template <typename ConstBufferSequence>
+    void update(const ConstBufferSequence& buffers);
+
+    std::uint32_t value() const;
+
+    static bool is_hardware_accelerated();
+
+    // The implementations operate on the raw register, that is without
+    // the initial and final inversion. The hardware one must only be used
+    // if is_hardware_accelerated().
+    static std::uint32_t software(std::uint32_t state,
+                                  const std::uint8_t *data,
+                                  std::size_t size);
+    static std::uint32_t hardware(std::uint32_t state,
+                                  const std::uint8_t *data,
+                                  std::size_t size);
+
+private:
+    std::uint32_t state;
+};
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#include <cstring>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+namespace crc32c_detail
+{
+
+struct table_type
+{
+    table_type()
+    {
+        // Reversed polynomial
+        const std::uint32_t polynomial = 0x82F63B78;
+
+        for (std::uint32_t i = 0; i < 256; ++i)
+        {
+            std::uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+            }
+            entries[0][i] = crc;
+        }
+        for (std::uint32_t i = 0; i < 256; ++i)
+        {
+            for (int slice = 1; slice < 8; ++slice)
+            {
+                const auto previous = entries[slice - 1][i];
+                entries[slice][i] = (previous >> 8) ^ entries[0][previous & 0xFF];
+            }
+        }
+    }
+
+    std::uint32_t entries[8][256];
+};
+
+inline const table_type& table()
+{
+    static const table_type instance;
+    return instance;
+}
+
+inline std::uint32_t load_le32(const std::uint8_t *data)
+{
+    return std::uint32_t(data[0])
+        | (std::uint32_t(data[1]) << 8)
+        | (std::uint32_t(data[2]) << 16)
+        | (std::uint32_t(data[3]) << 24);
+}
+
+#if defined(MAIDSAFE_CRUX_CRC32C_SSE42)
+
+# if defined(__GNUC__)
+__attribute__((target("sse4.2")))
+# endif
+inline std::uint32_t sse42(std::uint32_t state,
+                           const std::uint8_t *data,
+                           std::size_t size)
+{
+# if defined(__x86_64__) || defined(_M_X64)
+    std::uint64_t wide = state;
+    for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t))
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+        data += sizeof(word);
+    }
+    state = static_cast<std::uint32_t>(wide);
+# endif
+    for (; size >= sizeof(std::uint32_t); size -= sizeof(std::uint32_t))
+    {
+        std::uint32_t word;
+        std::memcpy(&word, data, sizeof(word));
+        state = _mm_crc32_u32(state, word);
+        data += sizeof(word);
+    }
+    for (; size > 0; --size)
+    {
+        state = _mm_crc32_u8(state, *data++);
+    }
+    return state;
+}
+
+inline bool has_sse42()
+{
+# if defined(_MSC_VER)
+    int registers[4];
+    __cpuid(registers, 1);
+    return (registers[2] & (1 << 20)) != 0;
+# else
+    return __builtin_cpu_supports("sse4.2");
+# endif
+}
+
+#elif defined(MAIDSAFE_CRUX_CRC32C_ARMV8)
+
+inline std::uint32_t armv8(std::uint32_t state,
+                           const std::uint8_t *data,
+                           std::size_t size)
+{
+    for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t))
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        state = __crc32cd(state, word);
+        data += sizeof(word);
+    }
+    for (; size > 0; --size)
+    {
+        state = __crc32cb(state, *data++);
+    }
+    return state;
+}
+
+#endif
+
+} // namespace crc32c_detail
+
+inline crc32c::crc32c()
+    : state(0xFFFFFFFF)
+{
+}
+
+inline void crc32c::update(const void *data, std::size_t size)
+{
+    static const bool accelerated = is_hardware_accelerated();
+
+    const auto bytes = static_cast<const std::uint8_t *>(data);
+    state = accelerated
+        ? hardware(state, bytes, size)
+        : software(state, bytes, size);
+}
+
+template <typename ConstBufferSequence>
+void crc32c::update(const ConstBufferSequence& buffers)
+{
+    for (const auto& buffer : buffers)
+    {
+        const boost::asio::const_buffer view(buffer);
+        update(boost::asio::buffer_cast<const void *>(view),
+               boost::asio::buffer_size(view));
+    }
+}
+
+inline std::uint32_t crc32c::value() const
+{
+    return ~state;
+}
+
+inline bool crc32c::is_hardware_accelerated()
+{
+#if defined(MAIDSAFE_CRUX_CRC32C_SSE42)
+    static const bool result = crc32c_detail::has_sse42();
+    return result;
+#elif defined(MAIDSAFE_CRUX_CRC32C_ARMV8)
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline std::uint32_t crc32c::software(std::uint32_t state,
+                                      const std::uint8_t *data,
+                                      std::size_t size)
+{
+    const auto& table = crc32c_detail::table().entries;
+
+    for (; size >= 8; size -= 8)
+    {
+        const auto low = state ^ crc32c_detail::load_le32(data);
+        const auto high = crc32c_detail::load_le32(data + 4);
+        state = table[7][low & 0xFF]
+            ^ table[6][(low >> 8) & 0xFF]
+            ^ table[5][(low >> 16) & 0xFF]
+            ^ table[4][low >> 24]
+            ^ table[3][high & 0xFF]
+            ^ table[2][(high >> 8) & 0xFF]
+            ^ table[1][(high >> 16) & 0xFF]
+            ^ table[0][high >> 24];
+        data += 8;
+    }
+    for (; size > 0; --size)
+    {
+        state = table[0][(state ^ *data++) & 0xFF] ^ (state >> 8);
+    }
+    return state;
+}
+
+inline std::uint32_t crc32c::hardware(std::uint32_t state,
+                                      const std::uint8_t *data,
+                                      std::size_t size)
+{
+#if defined(MAIDSAFE_CRUX_CRC32C_SSE42)
+    return crc32c_detail::sse42(state, data, size);
+#elif defined(MAIDSAFE_CRUX_CRC32C_ARMV8)
+    return crc32c_detail::armv8(state, data, size);
+#else
+    return software(state, data, size);
+#endif
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_CRC32C_HPP
@@ -0,0 +1,365 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_CRYPTO_HPP
+#define MAIDSAFE_CRUX_DETAIL_CRYPTO_HPP
+
+// Encryption is only available if OpenSSL is, which the build announces by
+// defining MAIDSAFE_CRUX_USE_OPENSSL.
+#if defined(MAIDSAFE_CRUX_USE_OPENSSL)
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <maidsafe/crux/detail/header_constants.hpp>
+
+typedef struct evp_pkey_st EVP_PKEY;
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// Ephemeral X25519 key pair of one side of a handshake.
+class key_exchange
+{
+public:
+    static const std::size_t key_size = 32;
+
+    using public_key_type = std::array<std::uint8_t, key_size>;
+    using secret_key_type = std::array<std::uint8_t, key_size>;
+
+    key_exchange();
+    ~key_exchange();
+    key_exchange(const key_exchange&) = delete;
+    key_exchange& operator=(const key_exchange&) = delete;
+
+    // False if no key pair could be generated
+    bool valid() const;
+
+    const public_key_type& public_key() const;
+
+    // Derive a key for each direction from the public key of the peer.
+    // The connecting side is the initiator. Fails on malformed keys.
+    bool derive(const std::uint8_t *peer_public_key,
+                bool initiator,
+                secret_key_type& send_key,
+                secret_key_type& receive_key) const;
+
+private:
+    EVP_PKEY *pair;
+    public_key_type public_value;
+};
+
+// ChaCha20-Poly1305 for the packets of one connection, with a key for each
+// direction.
+//
+// The header of a packet is authenticated but stays in the clear, because
+// the multiplexer needs it to find the connection. The payload is encrypted
+// in place and followed by the packet counter, from which the nonce is
+// made, and the authentication tag. The counter is never reused with the
+// same key, not even by retransmissions.
+class aead
+{
+public:
+    static const std::size_t key_size = key_exchange::key_size;
+    static const std::size_t counter_size = sizeof(std::uint64_t);
+    static const std::size_t tag_size = 16;
+    static const std::size_t overhead = counter_size + tag_size;
+
+    using key_type = key_exchange::secret_key_type;
+
+    // A packet for the batch operations. The data must have room for the
+    // overhead after size bytes when sealing, and size includes the
+    // overhead when opening.
+    struct packet
+    {
+        const std::uint8_t *header;
+        std::size_t header_size;
+        std::uint8_t *data;
+        std::size_t size;
+        // Set by open()
+        bool authentic;
+    };
+
+    aead(const key_type& send_key, const key_type& receive_key);
+    ~aead();
+    aead(const aead&) = delete;
+    aead& operator=(const aead&) = delete;
+
+    // False if the ciphers could not be set up
+    bool valid() const;
+
+    // Encrypt size bytes of data in place and append the overhead
+    void seal(const std::uint8_t *header, std::size_t header_size,
+              std::uint8_t *data, std::size_t size);
+
+    // Decrypt in place. The plaintext is the first size - overhead bytes.
+    bool open(const std::uint8_t *header, std::size_t header_size,
+              std::uint8_t *data, std::size_t size);
+
+    // Batches reuse the key schedules like the single packet operations,
+    // but also save the calls in between. open() returns the number of
+    // authentic packets.
+    void seal(packet *packets, std::size_t count);
+    std::size_t open(packet *packets, std::size_t count);
+
+private:
+    using nonce_type = std::array<std::uint8_t, 12>;
+
+    static nonce_type make_nonce(std::uint64_t counter);
+
+    EVP_CIPHER_CTX *sealer;
+    EVP_CIPHER_CTX *opener;
+    std::uint64_t next_counter;
+};
+
+static_assert(key_exchange::key_size == header::constant::public_key_size,
+              "Public keys must match the header constants");
+static_assert(aead::overhead == header::constant::encryption_size,
+              "Encryption overhead must match the header constants");
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#include <cassert>
+#include <cstring>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+inline key_exchange::key_exchange()
+    : pair(nullptr)
+{
+    public_value.fill(0);
+
+    EVP_PKEY_CTX *context = EVP_PKEY_CTX_new_id(EVP_PKEY_X25519, nullptr);
+    if (!context)
+        return;
+
+    if (EVP_PKEY_keygen_init(context) <= 0
+        || EVP_PKEY_keygen(context, &pair) <= 0)
+    {
+        pair = nullptr;
+    }
+    EVP_PKEY_CTX_free(context);
+
+    std::size_t size = public_value.size();
+    if (pair
+        && (EVP_PKEY_get_raw_public_key(pair, public_value.data(), &size) <= 0
+            || size != public_value.size()))
+    {
+        EVP_PKEY_free(pair);
+        pair = nullptr;
+    }
+}
+
+inline key_exchange::~key_exchange()
+{
+    EVP_PKEY_free(pair);
+}
+
+inline bool key_exchange::valid() const
+{
+    return pair != nullptr;
+}
+
+inline const key_exchange::public_key_type& key_exchange::public_key() const
+{
+    return public_value;
+}
+
+inline bool key_exchange::derive(const std::uint8_t *peer_public_key,
+                                 bool initiator,
+                                 secret_key_type& send_key,
+                                 secret_key_type& receive_key) const
+{
+    if (!pair)
+        return false;
+
+    EVP_PKEY *peer = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, nullptr,
+                                                 peer_public_key, key_size);
+    if (!peer)
+        return false;
+
+    std::array<std::uint8_t, key_size> shared;
+    std::size_t shared_size = shared.size();
+
+    EVP_PKEY_CTX *context = EVP_PKEY_CTX_new(pair, nullptr);
+    const bool agreed = context
+        && EVP_PKEY_derive_init(context) > 0
+        && EVP_PKEY_derive_set_peer(context, peer) > 0
+        && EVP_PKEY_derive(context, shared.data(), &shared_size) > 0
+        && shared_size == shared.size();
+    EVP_PKEY_CTX_free(context);
+    EVP_PKEY_free(peer);
+
+    if (!agreed)
+        return false;
+
+    // Both public keys go into the derivation, the initiator's first, so
+    // that the keys are bound to this particular exchange.
+    std::array<std::uint8_t, 4 + 2 * key_size> info;
+    std::memcpy(info.data(), "crux", 4);
+    std::memcpy(info.data() + 4,
+                initiator ? public_value.data() : peer_public_key, key_size);
+    std::memcpy(info.data() + 4 + key_size,
+                initiator ? peer_public_key : public_value.data(), key_size);
+
+    // Initiator to responder, followed by responder to initiator
+    std::array<std::uint8_t, 2 * key_size> keys;
+    std::size_t keys_size = keys.size();
+
+    context = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+    const bool derived = context
+        && EVP_PKEY_derive_init(context) > 0
+        && EVP_PKEY_CTX_set_hkdf_md(context, EVP_sha256()) > 0
+        && EVP_PKEY_CTX_set1_hkdf_key(context, shared.data(), int(shared.size())) > 0
+        && EVP_PKEY_CTX_add1_hkdf_info(context, info.data(), int(info.size())) > 0
+        && EVP_PKEY_derive(context, keys.data(), &keys_size) > 0
+        && keys_size == keys.size();
+    EVP_PKEY_CTX_free(context);
+
+    if (!derived)
+        return false;
+
+    std::memcpy(initiator ? send_key.data() : receive_key.data(),
+                keys.data(), key_size);
+    std::memcpy(initiator ? receive_key.data() : send_key.data(),
+                keys.data() + key_size, key_size);
+    return true;
+}
+
+inline aead::aead(const key_type& send_key, const key_type& receive_key)
+    : sealer(EVP_CIPHER_CTX_new())
+    , opener(EVP_CIPHER_CTX_new())
+    , next_counter(0)
+{
+    // The key schedules are set up once, and only the nonce changes
+    // from packet to packet.
+    if (!sealer || !opener
+        || EVP_EncryptInit_ex(sealer, EVP_chacha20_poly1305(), nullptr, send_key.data(), nullptr) <= 0
+        || EVP_DecryptInit_ex(opener, EVP_chacha20_poly1305(), nullptr, receive_key.data(), nullptr) <= 0)
+    {
+        EVP_CIPHER_CTX_free(sealer);
+        EVP_CIPHER_CTX_free(opener);
+        sealer = nullptr;
+        opener = nullptr;
+    }
+}
+
+inline aead::~aead()
+{
+    EVP_CIPHER_CTX_free(sealer);
+    EVP_CIPHER_CTX_free(opener);
+}
+
+inline bool aead::valid() const
+{
+    return sealer != nullptr;
+}
+
+inline aead::nonce_type aead::make_nonce(std::uint64_t counter)
+{
+    nonce_type nonce;
+    nonce.fill(0);
+    for (std::size_t i = 0; i < counter_size; ++i)
+    {
+        nonce[nonce.size() - 1 - i] = static_cast<std::uint8_t>(counter >> (8 * i));
+    }
+    return nonce;
+}
+
+inline void aead::seal(const std::uint8_t *header, std::size_t header_size,
+                       std::uint8_t *data, std::size_t size)
+{
+    packet single = { header, header_size, data, size, false };
+    seal(&single, 1);
+}
+
+inline bool aead::open(const std::uint8_t *header, std::size_t header_size,
+                       std::uint8_t *data, std::size_t size)
+{
+    packet single = { header, header_size, data, size, false };
+    return open(&single, 1) == 1;
+}
+
+inline void aead::seal(packet *packets, std::size_t count)
+{
+    assert(valid());
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto& current = packets[i];
+        const auto counter = next_counter++;
+        const auto nonce = make_nonce(counter);
+
+        int length = 0;
+        EVP_EncryptInit_ex(sealer, nullptr, nullptr, nullptr, nonce.data());
+        EVP_EncryptUpdate(sealer, nullptr, &length, current.header, int(current.header_size));
+        EVP_EncryptUpdate(sealer, current.data, &length, current.data, int(current.size));
+        EVP_EncryptFinal_ex(sealer, current.data + current.size, &length);
+
+        auto trailer = current.data + current.size;
+        std::memcpy(trailer, nonce.data() + nonce.size() - counter_size, counter_size);
+        EVP_CIPHER_CTX_ctrl(sealer, EVP_CTRL_AEAD_GET_TAG, int(tag_size), trailer + counter_size);
+    }
+}
+
+inline std::size_t aead::open(packet *packets, std::size_t count)
+{
+    assert(valid());
+
+    std::size_t authentic = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto& current = packets[i];
+        current.authentic = false;
+        if (current.size < overhead)
+            continue;
+
+        const auto size = current.size - overhead;
+        auto trailer = current.data + size;
+
+        nonce_type nonce;
+        nonce.fill(0);
+        std::memcpy(nonce.data() + nonce.size() - counter_size, trailer, counter_size);
+
+        int length = 0;
+        EVP_DecryptInit_ex(opener, nullptr, nullptr, nullptr, nonce.data());
+        EVP_DecryptUpdate(opener, nullptr, &length, current.header, int(current.header_size));
+        EVP_DecryptUpdate(opener, current.data, &length, current.data, int(size));
+        EVP_CIPHER_CTX_ctrl(opener, EVP_CTRL_AEAD_SET_TAG, int(tag_size), trailer + counter_size);
+        if (EVP_DecryptFinal_ex(opener, current.data + size, &length) > 0)
+        {
+            current.authentic = true;
+            ++authentic;
+        }
+    }
+    return authentic;
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // defined(MAIDSAFE_CRUX_USE_OPENSSL)
+
+#endif // MAIDSAFE_CRUX_DETAIL_CRYPTO_HPP
@@ -42,6 +42,9 @@ public:
     boost::optional<composite_type> front();
 
     void insert(const value_type&);
+    // Insert every item from first to last. The range must follow on from
+    // the cumulative entry, so it is stored as its last item alone.
+    void insert(const value_type& first, const value_type& last);
 
 private:
     void prune();
@@ -55,6 +58,7 @@ private:
 } // namespace maidsafe
 
 #include <algorithm>
+#include <cassert>
 
 namespace maidsafe
 {
@@ -88,6 +92,19 @@ void cumulative_set<SequenceType, FieldType>::insert(const value_type& item)
     assert(!container.empty());
 }
 
+template <typename SequenceType, typename FieldType>
+void cumulative_set<SequenceType, FieldType>::insert(const value_type& first,
+                                                     const value_type& last)
+{
+    assert(container.empty() || container.begin()->distance(first) == 1);
+    assert(first.distance(last) >= 0);
+    static_cast<void>(first);
+
+    container.erase(container.begin(), container.upper_bound(last));
+    container.insert(last);
+    prune();
+}
+
 template <typename SequenceType, typename FieldType>
 void cumulative_set<SequenceType, FieldType>::prune()
 {
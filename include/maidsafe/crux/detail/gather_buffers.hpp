@@ -0,0 +1,264 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_GATHER_BUFFERS_HPP
+#define MAIDSAFE_CRUX_DETAIL_GATHER_BUFFERS_HPP
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <boost/asio/buffer.hpp>
+
+#if !defined(_WIN32)
+# include <sys/uio.h>
+#endif
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+#if defined(_WIN32)
+struct iovec_type
+{
+    void *iov_base;
+    std::size_t iov_len;
+};
+#else
+using iovec_type = ::iovec;
+#endif
+
+// A fixed number of buffers, flattened once from any number of buffer
+// sequences into an inline array of iovecs. It is a ConstBufferSequence for
+// asio, and the iovecs can be handed to sendmsg() or sendmmsg() as they
+// are. Empty buffers are left out.
+template <std::size_t Capacity>
+class gather_buffers
+{
+public:
+    using value_type = boost::asio::const_buffer;
+
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = boost::asio::const_buffer;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type *;
+        using reference = value_type;
+
+        const_iterator& operator++();    // pre-increment
+        const_iterator  operator++(int); // post-increment
+        const_iterator& operator--();    // pre-decrement
+        const_iterator  operator--(int); // post-decrement
+
+        value_type operator*() const;
+
+        bool operator==(const_iterator) const;
+        bool operator!=(const_iterator) const;
+
+    private:
+        friend gather_buffers;
+
+        explicit const_iterator(const iovec_type *current)
+            : current(current)
+        {}
+
+    private:
+        const iovec_type *current;
+    };
+
+    gather_buffers();
+
+    // False, with nothing added, if the buffers do not fit
+    bool push_back(const boost::asio::const_buffer&);
+    template <typename ConstBufferSequence>
+    bool append(const ConstBufferSequence&);
+
+    void clear();
+
+    bool empty() const;
+    std::size_t size() const;
+    static std::size_t capacity();
+
+    // Total number of bytes
+    std::size_t bytes() const;
+
+    const iovec_type *data() const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+private:
+    std::array<iovec_type, Capacity> vectors;
+    std::size_t count;
+    std::size_t total;
+};
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+template <std::size_t Capacity>
+typename gather_buffers<Capacity>::const_iterator&
+gather_buffers<Capacity>::const_iterator::operator++()
+{
+    ++current;
+    return *this;
+}
+
+template <std::size_t Capacity>
+typename gather_buffers<Capacity>::const_iterator
+gather_buffers<Capacity>::const_iterator::operator++(int)
+{
+    return const_iterator(current++);
+}
+
+template <std::size_t Capacity>
+typename gather_buffers<Capacity>::const_iterator&
+gather_buffers<Capacity>::const_iterator::operator--()
+{
+    --current;
+    return *this;
+}
+
+template <std::size_t Capacity>
+typename gather_buffers<Capacity>::const_iterator
+gather_buffers<Capacity>::const_iterator::operator--(int)
+{
+    return const_iterator(current--);
+}
+
+template <std::size_t Capacity>
+typename gather_buffers<Capacity>::value_type
+gather_buffers<Capacity>::const_iterator::operator*() const
+{
+    return value_type(current->iov_base, current->iov_len);
+}
+
+template <std::size_t Capacity>
+bool gather_buffers<Capacity>::const_iterator::operator==(const_iterator other) const
+{
+    return current == other.current;
+}
+
+template <std::size_t Capacity>
+bool gather_buffers<Capacity>::const_iterator::operator!=(const_iterator other) const
+{
+    return current != other.current;
+}
+
+template <std::size_t Capacity>
+gather_buffers<Capacity>::gather_buffers()
+    : count(0)
+    , total(0)
+{
+}
+
+template <std::size_t Capacity>
+bool gather_buffers<Capacity>::push_back(const boost::asio::const_buffer& buffer)
+{
+    const auto size = boost::asio::buffer_size(buffer);
+    if (size == 0)
+        return true;
+    if (count == Capacity)
+        return false;
+
+    auto& vector = vectors[count++];
+    // iovecs are shared by sending and receiving, hence not const
+    vector.iov_base = const_cast<void *>(boost::asio::buffer_cast<const void *>(buffer));
+    vector.iov_len = size;
+    total += size;
+    return true;
+}
+
+template <std::size_t Capacity>
+template <typename ConstBufferSequence>
+bool gather_buffers<Capacity>::append(const ConstBufferSequence& buffers)
+{
+    const auto old_count = count;
+    const auto old_total = total;
+    for (const auto& buffer : buffers)
+    {
+        if (!push_back(boost::asio::const_buffer(buffer)))
+        {
+            count = old_count;
+            total = old_total;
+            return false;
+        }
+    }
+    return true;
+}
+
+template <std::size_t Capacity>
+void gather_buffers<Capacity>::clear()
+{
+    count = 0;
+    total = 0;
+}
+
+template <std::size_t Capacity>
+bool gather_buffers<Capacity>::empty() const
+{
+    return count == 0;
+}
+
+template <std::size_t Capacity>
+std::size_t gather_buffers<Capacity>::size() const
+{
+    return count;
+}
+
+template <std::size_t Capacity>
+std::size_t gather_buffers<Capacity>::capacity()
+{
+    return Capacity;
+}
+
+template <std::size_t Capacity>
+std::size_t gather_buffers<Capacity>::bytes() const
+{
+    return total;
+}
+
+template <std::size_t Capacity>
+const iovec_type *gather_buffers<Capacity>::data() const
+{
+    return vectors.data();
+}
+
+template <std::size_t Capacity>
+typename gather_buffers<Capacity>::const_iterator
+gather_buffers<Capacity>::begin() const
+{
+    return const_iterator(vectors.data());
+}
+
+template <std::size_t Capacity>
+typename gather_buffers<Capacity>::const_iterator
+gather_buffers<Capacity>::end() const
+{
+    return const_iterator(vectors.data() + count);
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_GATHER_BUFFERS_HPP
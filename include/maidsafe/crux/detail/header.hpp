@@ -29,14 +29,17 @@ using sequence_type = sequence_number<std::uint32_t>;
 
 struct handshake {
     std::size_t                    retransmission_count;
+    std::uint16_t                  options;
     std::uint16_t                  version;
     sequence_type                  initial_sequence_number;
     boost::optional<sequence_type> ack;
 
     handshake( std::size_t                    retransmission_count
              , sequence_type                  initial_sequence_number
-             , boost::optional<sequence_type> ack)
+             , boost::optional<sequence_type> ack
+             , std::uint16_t                  options = 0)
         : retransmission_count(retransmission_count)
+        , options(options & header::constant::mask_options)
         , version(header::constant::version)
         , initial_sequence_number(initial_sequence_number)
         , ack(ack)
@@ -44,6 +47,7 @@ struct handshake {
 
     handshake(std::uint16_t type, detail::decoder& decoder)
         : retransmission_count(type & 3)
+        , options(type & header::constant::mask_options)
         , version(decoder.get<std::uint16_t>())
         , initial_sequence_number(decoder.get<std::uint32_t>())
     {
@@ -57,6 +61,7 @@ struct handshake {
     void encode(detail::encoder& encoder) const {
         encoder.put<std::uint16_t>(
             header::constant::type_handshake
+            | options
             | static_cast<std::uint16_t>(std::min<std::size_t>(3, retransmission_count))
             | (ack ? header::constant::ack_type_cumulative : header::constant::ack_type_none));
         encoder.put<std::uint16_t>(version);
@@ -67,60 +72,81 @@ struct handshake {
 
 struct keepalive {
     std::size_t                    retransmission_count;
-    std::uint16_t                  dummy;
+    std::uint16_t                  options;
+    std::uint16_t                  connection_id;
     sequence_type                  sequence_number;
     boost::optional<sequence_type> ack;
+    // Challenges and their responses carry a nonce instead of an ack
+    std::uint32_t                  nonce;
 
     keepalive( std::size_t                    retransmission_count
              , sequence_type                  sequence_number
-             , boost::optional<sequence_type> ack)
+             , boost::optional<sequence_type> ack
+             , std::uint16_t                  connection_id = 0
+             , std::uint16_t                  options = 0
+             , std::uint32_t                  nonce = 0)
         : retransmission_count(retransmission_count)
-        , dummy(0)
+        , options(options & header::constant::mask_options)
+        , connection_id(connection_id)
         , sequence_number(sequence_number)
         , ack(ack)
-    {}
+        , nonce(nonce)
+    {
+        assert(!ack || !nonce);
+    }
 
     keepalive(std::uint16_t type, detail::decoder& decoder)
         : retransmission_count(3 & type)
-        , dummy(decoder.get<std::uint16_t>())
+        , options(type & header::constant::mask_options)
+        , connection_id(decoder.get<std::uint16_t>())
         , sequence_number(decoder.get<std::uint32_t>())
+        , nonce(0)
     {
         assert((type & header::constant::mask_type) == header::constant::type_keepalive);
 
         if (type & header::constant::mask_ack) {
             ack = sequence_type(decoder.get<std::uint32_t>());
         }
+        else {
+            nonce = decoder.get<std::uint32_t>();
+        }
     }
 
     void encode(detail::encoder& encoder) const {
         encoder.put<std::uint16_t>(
             header::constant::type_keepalive
+            | options
             | static_cast<std::uint16_t>(std::min<std::size_t>(3, retransmission_count))
             | (ack ? header::constant::ack_type_cumulative : header::constant::ack_type_none));
-        encoder.put<std::uint16_t>(0);
+        encoder.put<std::uint16_t>(connection_id);
         encoder.put<std::uint32_t>(sequence_number.value());
-        encoder.put<std::uint32_t>(ack ? ack->value() : 0);
+        encoder.put<std::uint32_t>(ack ? ack->value() : nonce);
     }
 };
 
 struct data {
     std::uint16_t                  retransmission_count;
-    std::uint16_t                  dummy;
+    std::uint16_t                  options;
+    std::uint16_t                  connection_id;
     sequence_type                  sequence_number;
     boost::optional<sequence_type> ack;
 
     data( std::uint16_t                  retransmission_count
         , sequence_type                  sequence_number
-        , boost::optional<sequence_type> ack)
+        , boost::optional<sequence_type> ack
+        , std::uint16_t                  connection_id = 0
+        , std::uint16_t                  options = 0)
             : retransmission_count(retransmission_count)
-            , dummy(0)
+            , options(options & header::constant::mask_options)
+            , connection_id(connection_id)
             , sequence_number(sequence_number)
             , ack(ack)
     { }
 
     data(std::uint16_t type, detail::decoder& decoder)
         : retransmission_count(type & 3)
-        , dummy(decoder.get<std::uint16_t>())
+        , options(type & header::constant::mask_options)
+        , connection_id(decoder.get<std::uint16_t>())
         , sequence_number(decoder.get<std::uint32_t>())
     {
         assert((type & header::constant::mask_type) == header::constant::type_data);
@@ -134,9 +160,52 @@ struct data {
     void encode(detail::encoder& encoder) const {
         encoder.put<std::uint16_t>(
             header::constant::type_data
+            | options
+            | static_cast<std::uint16_t>(std::min<std::size_t>(3, retransmission_count))
+            | (ack ? header::constant::ack_type_cumulative : header::constant::ack_type_none));
+        encoder.put<std::uint16_t>(connection_id);
+        encoder.put<std::uint32_t>(sequence_number.value());
+        encoder.put<std::uint32_t>(ack ? ack->value() : 0);
+    }
+};
+
+// Sent in reply to a handshake that is refused, or to a peer whose
+// connection is being evicted. It carries no state of its own so that
+// refusals stay cheap under load.
+struct shutdown {
+    std::size_t                    retransmission_count;
+    std::uint16_t                  connection_id;
+    sequence_type                  sequence_number;
+    boost::optional<sequence_type> ack;
+
+    shutdown( std::size_t                    retransmission_count
+            , sequence_type                  sequence_number
+            , boost::optional<sequence_type> ack
+            , std::uint16_t                  connection_id = 0)
+        : retransmission_count(retransmission_count)
+        , connection_id(connection_id)
+        , sequence_number(sequence_number)
+        , ack(ack)
+    {}
+
+    shutdown(std::uint16_t type, detail::decoder& decoder)
+        : retransmission_count(type & 3)
+        , connection_id(decoder.get<std::uint16_t>())
+        , sequence_number(decoder.get<std::uint32_t>())
+    {
+        assert((type & header::constant::mask_type) == header::constant::type_shutdown);
+
+        if (type & header::constant::mask_ack) {
+            ack = sequence_type(decoder.get<std::uint32_t>());
+        }
+    }
+
+    void encode(detail::encoder& encoder) const {
+        encoder.put<std::uint16_t>(
+            header::constant::type_shutdown
             | static_cast<std::uint16_t>(std::min<std::size_t>(3, retransmission_count))
             | (ack ? header::constant::ack_type_cumulative : header::constant::ack_type_none));
-        encoder.put<std::uint16_t>(0);
+        encoder.put<std::uint16_t>(connection_id);
         encoder.put<std::uint32_t>(sequence_number.value());
         encoder.put<std::uint32_t>(ack ? ack->value() : 0);
     }
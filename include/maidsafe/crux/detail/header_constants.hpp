@@ -25,17 +25,32 @@ namespace header
 namespace constant
 {
 
-const std::size_t version = 0;
+// Handshakes of another version are ignored. Version 1 changed keepalives,
+// which no longer use up a sequence number but carry the next one, and has
+// packets that were received before acknowledged again. A version 0 peer
+// would take the first data packet after one of our keepalives for a
+// duplicate. Version 1 handshakes also end with a connection identifier,
+// and keepalives may challenge a new endpoint of the peer. A skip stands for
+// every message up to its sequence number.
+const std::size_t version = 1;
 
 const std::size_t size =
     sizeof(std::uint16_t) // type
-    + sizeof(std::uint16_t) // ack-field
+    + sizeof(std::uint16_t) // version or connection identifier
     + sizeof(std::uint32_t) // sequence number
     + sizeof(std::uint32_t); // ack sequence number
 
+// CRC-32C trailer of keepalive and data packets, if agreed on.
+const std::size_t checksum_size = sizeof(std::uint32_t);
+
+// Packet counter and authentication tag that follow the payload of
+// keepalive and data packets, if encryption is agreed on.
+const std::size_t encryption_size = sizeof(std::uint64_t) + 16;
+
 const std::uint16_t mask_type = 0XF800;
 const std::uint16_t mask_retransmission = 0x0003;
 const std::uint16_t mask_ack = 0x000C;
+const std::uint16_t mask_options = 0x07F0;
 
 const std::uint16_t type_data = 0xC000;
 const std::uint16_t type_handshake = 0xC800;
@@ -45,6 +60,44 @@ const std::uint16_t type_keepalive = 0xD800;
 const std::uint16_t ack_type_none = 0x0000;
 const std::uint16_t ack_type_cumulative = 0x0004;
 
+// Handshake options. The connecting side offers them, and the accepting side
+// echoes those it agrees to.
+const std::uint16_t option_shared_memory = 0x0010;
+const std::uint16_t option_checksum = 0x0040;
+// The payload of the handshake starts with a public key.
+const std::uint16_t option_encryption = 0x0080;
+// The payload of the handshake ends with the identifier of the compression
+// dictionary, which must be the same on both sides.
+const std::uint16_t option_compression = 0x0100;
+// Keepalive and data packets may have compact headers.
+const std::uint16_t option_compact_header = 0x0200;
+
+const std::size_t public_key_size = 32;
+const std::size_t dictionary_id_size = sizeof(std::uint32_t);
+
+// The payload of the handshake ends with the connection identifier that the
+// sender expects in the keepalive and data packets of the peer.
+const std::size_t connection_id_size = sizeof(std::uint16_t);
+
+// Keepalive options.
+//
+// A packet of the connection has come from an endpoint that the receiver
+// has not heard the peer at before. The receiver does not send anything
+// else there until the peer has echoed the nonce from that endpoint. The
+// nonce takes the place of the ack.
+const std::uint16_t option_challenge = 0x0100;
+// Echo of a challenge, with the nonce in place of the ack.
+const std::uint16_t option_response = 0x0200;
+
+// Data options.
+//
+// The sender has given up on every message that has not been acknowledged
+// up to this sequence number, so the packet carries no payload. The
+// receiver acknowledges it and moves on without delivering anything.
+const std::uint16_t option_skip = 0x0020;
+// The payload is compressed.
+const std::uint16_t option_compressed = 0x0040;
+
 } // namespace constant
 
 using data_type = std::array<std::uint8_t, header::constant::size>;
@@ -0,0 +1,218 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_HEADER_VIEW_HPP
+#define MAIDSAFE_CRUX_DETAIL_HEADER_VIEW_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <boost/optional.hpp>
+#include <maidsafe/crux/detail/header_constants.hpp>
+#include <maidsafe/crux/detail/sequence_number.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// Big-endian loads from unaligned memory
+std::uint16_t load_big16(const std::uint8_t *input);
+std::uint32_t load_big32(const std::uint8_t *input);
+
+namespace header
+{
+
+// Read-only view of a received full header. All fields are at fixed offsets,
+// so the header is validated in one pass when the view is constructed and
+// fields are loaded on demand without going through a decoder.
+//
+// A view is valid if the header is long enough, of a known type and ack
+// type, and, for handshakes, of our version. Fields of an invalid view must
+// not be used.
+class view
+{
+public:
+    using sequence_type = detail::sequence_number<std::uint32_t>;
+
+    static constexpr std::size_t offset_type = 0;
+    // Version of handshakes, connection identifier of other packets
+    static constexpr std::size_t offset_field = offset_type + sizeof(std::uint16_t);
+    static constexpr std::size_t offset_sequence = offset_field + sizeof(std::uint16_t);
+    static constexpr std::size_t offset_ack = offset_sequence + sizeof(std::uint32_t);
+
+    static_assert(offset_ack + sizeof(std::uint32_t) == constant::size,
+                  "Offsets must cover the header");
+
+    view(const std::uint8_t *data, std::size_t size);
+    explicit view(const data_type& data);
+
+    bool is_valid() const;
+
+    // One of the constant::type_ values
+    std::uint16_t type() const;
+    std::uint16_t options() const;
+    std::size_t retransmission_count() const;
+
+    std::uint16_t version() const;
+    std::uint16_t connection_id() const;
+    sequence_type sequence_number() const;
+    boost::optional<sequence_type> ack() const;
+    // Nonce of a keepalive challenge or response, which has no ack
+    std::uint32_t nonce() const;
+
+private:
+    const std::uint8_t *data;
+    std::uint16_t word;
+    bool valid;
+};
+
+} // namespace header
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#include <cstring>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+#if defined(__GNUC__)
+#  define MAIDSAFE_CRUX_BSWAP16(x) __builtin_bswap16(x)
+#  define MAIDSAFE_CRUX_BSWAP32(x) __builtin_bswap32(x)
+#  define MAIDSAFE_CRUX_LITTLE_ENDIAN (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#elif defined(_MSC_VER)
+#  include <stdlib.h>
+#  define MAIDSAFE_CRUX_BSWAP16(x) _byteswap_ushort(x)
+#  define MAIDSAFE_CRUX_BSWAP32(x) _byteswap_ulong(x)
+#  define MAIDSAFE_CRUX_LITTLE_ENDIAN 1
+#endif
+
+inline std::uint16_t load_big16(const std::uint8_t *input)
+{
+#if defined(MAIDSAFE_CRUX_BSWAP16)
+    std::uint16_t result;
+    std::memcpy(&result, input, sizeof(result));
+#  if MAIDSAFE_CRUX_LITTLE_ENDIAN
+    result = MAIDSAFE_CRUX_BSWAP16(result);
+#  endif
+    return result;
+#else
+    return std::uint16_t((std::uint16_t(input[0]) << 8) | input[1]);
+#endif
+}
+
+inline std::uint32_t load_big32(const std::uint8_t *input)
+{
+#if defined(MAIDSAFE_CRUX_BSWAP32)
+    std::uint32_t result;
+    std::memcpy(&result, input, sizeof(result));
+#  if MAIDSAFE_CRUX_LITTLE_ENDIAN
+    result = MAIDSAFE_CRUX_BSWAP32(result);
+#  endif
+    return result;
+#else
+    return (std::uint32_t(input[0]) << 24)
+        | (std::uint32_t(input[1]) << 16)
+        | (std::uint32_t(input[2]) << 8)
+        | std::uint32_t(input[3]);
+#endif
+}
+
+#undef MAIDSAFE_CRUX_BSWAP16
+#undef MAIDSAFE_CRUX_BSWAP32
+#undef MAIDSAFE_CRUX_LITTLE_ENDIAN
+
+namespace header
+{
+
+inline view::view(const std::uint8_t *input, std::size_t size)
+{
+    // Short headers are looked at through an all-zero one, which is not a
+    // known type, so that nothing beyond the input is ever read.
+    static const data_type empty = {{}};
+    const bool long_enough = (size >= constant::size);
+    data = long_enough ? input : empty.data();
+    word = load_big16(data + offset_type);
+
+    // All types have the two high bits set and the third one clear, and
+    // only two ack types are defined.
+    const std::uint16_t kind = word & constant::mask_type;
+    const bool known_type = ((word & 0xE000) == 0xC000);
+    const bool known_ack = ((word & constant::mask_ack) & ~constant::ack_type_cumulative) == 0;
+    const bool known_version = (kind != constant::type_handshake)
+        | (load_big16(data + offset_field) == constant::version);
+
+    valid = long_enough & known_type & known_ack & known_version;
+}
+
+inline view::view(const data_type& input)
+    : view(input.data(), input.size())
+{
+}
+
+inline bool view::is_valid() const
+{
+    return valid;
+}
+
+inline std::uint16_t view::type() const
+{
+    return word & constant::mask_type;
+}
+
+inline std::uint16_t view::options() const
+{
+    return word & constant::mask_options;
+}
+
+inline std::size_t view::retransmission_count() const
+{
+    return word & constant::mask_retransmission;
+}
+
+inline std::uint16_t view::version() const
+{
+    return load_big16(data + offset_field);
+}
+
+inline std::uint16_t view::connection_id() const
+{
+    return load_big16(data + offset_field);
+}
+
+inline view::sequence_type view::sequence_number() const
+{
+    return sequence_type(load_big32(data + offset_sequence));
+}
+
+inline boost::optional<view::sequence_type> view::ack() const
+{
+    if (word & constant::mask_ack)
+        return sequence_type(load_big32(data + offset_ack));
+    return boost::none;
+}
+
+inline std::uint32_t view::nonce() const
+{
+    return load_big32(data + offset_ack);
+}
+
+} // namespace header
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_HEADER_VIEW_HPP
@@ -0,0 +1,219 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_IMPL_COMPACT_HEADER_IPP
+#define MAIDSAFE_CRUX_DETAIL_IMPL_COMPACT_HEADER_IPP
+
+#include <algorithm>
+#include <maidsafe/crux/detail/compact_header.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+namespace header
+{
+namespace compact
+{
+
+const std::uint8_t mask_marker = 0xC0;
+const std::uint8_t marker = 0x80;
+const std::uint8_t flag_keepalive = 0x20;
+const std::uint8_t flag_ack = 0x10;
+const std::uint8_t mask_retransmission = 0x0C;
+const std::uint8_t flag_compressed = 0x02;
+const std::uint8_t flag_skip = 0x01;
+
+MAIDSAFE_CRUX_DECL bool is_compact(std::uint8_t first)
+{
+    return (first & mask_marker) == marker;
+}
+
+MAIDSAFE_CRUX_DECL std::size_t width(std::uint32_t span)
+{
+    // Distances of up to half the window are restored correctly
+    std::size_t result = min_width;
+    while (result < max_width && span >= (std::uint32_t(1) << (7 * result - 1)))
+    {
+        ++result;
+    }
+    return result;
+}
+
+inline std::uint32_t load32(const std::uint8_t *input)
+{
+    return (std::uint32_t(input[0]) << 24)
+        | (std::uint32_t(input[1]) << 16)
+        | (std::uint32_t(input[2]) << 8)
+        | std::uint32_t(input[3]);
+}
+
+inline void store32(std::uint32_t value, std::uint8_t *output)
+{
+    output[0] = std::uint8_t(value >> 24);
+    output[1] = std::uint8_t(value >> 16);
+    output[2] = std::uint8_t(value >> 8);
+    output[3] = std::uint8_t(value);
+}
+
+inline std::uint8_t *put_truncated(std::uint32_t value,
+                                   std::size_t width,
+                                   std::uint8_t *output)
+{
+    for (std::size_t i = 1; i < width; ++i)
+    {
+        *output++ = std::uint8_t(0x80 | (value & 0x7F));
+        value >>= 7;
+    }
+    *output++ = std::uint8_t(value & 0x7F);
+    return output;
+}
+
+// Returns the number of bytes read, or zero if malformed
+inline std::size_t get_truncated(const std::uint8_t *input,
+                                 std::size_t size,
+                                 std::uint32_t& value,
+                                 std::size_t& bits)
+{
+    value = 0;
+    for (std::size_t i = 0; i < std::min(size, max_width); ++i)
+    {
+        value |= std::uint32_t(input[i] & 0x7F) << (7 * i);
+        if (!(input[i] & 0x80))
+        {
+            bits = std::min<std::size_t>(7 * (i + 1), 32);
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+MAIDSAFE_CRUX_DECL sequence_type restore(std::uint32_t truncated,
+                             std::size_t bits,
+                             sequence_type reference)
+{
+    if (bits >= 32)
+        return sequence_type(truncated);
+
+    const std::uint32_t window = std::uint32_t(1) << bits;
+    std::uint32_t delta = (truncated - reference.value()) & (window - 1);
+    if (delta >= window / 2)
+    {
+        delta -= window; // Behind the reference, modulo 2^32
+    }
+    return sequence_type(reference.value() + delta);
+}
+
+MAIDSAFE_CRUX_DECL std::size_t encode(const data_type& full,
+                          std::size_t sequence_width,
+                          std::uint8_t *output)
+{
+    const std::uint16_t type = (std::uint16_t(full[0]) << 8) | full[1];
+
+    std::uint8_t flags = marker;
+    switch (type & constant::mask_type)
+    {
+    case constant::type_keepalive:
+        flags |= flag_keepalive;
+        break;
+    case constant::type_data:
+        break;
+    default:
+        return 0;
+    }
+
+    const std::uint16_t options = type & constant::mask_options;
+    if (options & ~(constant::option_skip | constant::option_compressed))
+        return 0;
+    if (options & constant::option_skip)
+        flags |= flag_skip;
+    if (options & constant::option_compressed)
+        flags |= flag_compressed;
+
+    const bool has_ack = (type & constant::mask_ack) != constant::ack_type_none;
+    if (has_ack)
+        flags |= flag_ack;
+    flags |= std::uint8_t((type & constant::mask_retransmission) << 2);
+
+    auto current = output;
+    *current++ = flags;
+    *current++ = full[2];
+    *current++ = full[3];
+    current = put_truncated(load32(full.data() + 4), sequence_width, current);
+    if (has_ack)
+    {
+        current = put_truncated(load32(full.data() + 8), ack_width, current);
+    }
+    return current - output;
+}
+
+MAIDSAFE_CRUX_DECL std::size_t decode(const std::uint8_t *input,
+                          std::size_t size,
+                          sequence_type expected,
+                          sequence_type last_sent,
+                          data_type& full)
+{
+    if (size < min_size || !is_compact(input[0]))
+        return 0;
+
+    const std::uint8_t flags = input[0];
+    std::uint16_t type = (flags & flag_keepalive)
+        ? constant::type_keepalive
+        : constant::type_data;
+    if (flags & (flag_skip | flag_compressed))
+    {
+        if (flags & flag_keepalive)
+            return 0;
+        if (flags & flag_skip)
+            type |= constant::option_skip;
+        if (flags & flag_compressed)
+            type |= constant::option_compressed;
+    }
+    type |= (flags & mask_retransmission) >> 2;
+
+    std::size_t length = 3;
+    std::uint32_t truncated = 0;
+    std::size_t bits = 0;
+
+    auto used = get_truncated(input + length, size - length, truncated, bits);
+    if (used == 0)
+        return 0;
+    length += used;
+    const auto sequence = restore(truncated, bits, expected);
+
+    std::uint32_t ack = 0;
+    if (flags & flag_ack)
+    {
+        used = get_truncated(input + length, size - length, truncated, bits);
+        if (used == 0)
+            return 0;
+        length += used;
+        ack = restore(truncated, bits, last_sent).value();
+        type |= constant::ack_type_cumulative;
+    }
+
+    full[0] = std::uint8_t(type >> 8);
+    full[1] = std::uint8_t(type);
+    full[2] = input[1];
+    full[3] = input[2];
+    store32(sequence.value(), full.data() + 4);
+    store32(ack, full.data() + 8);
+    return length;
+}
+
+} // namespace compact
+} // namespace header
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_IMPL_COMPACT_HEADER_IPP
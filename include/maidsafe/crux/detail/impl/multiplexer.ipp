@@ -0,0 +1,1238 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_IMPL_MULTIPLEXER_IPP
+#define MAIDSAFE_CRUX_DETAIL_IMPL_MULTIPLEXER_IPP
+
+#include <maidsafe/crux/detail/multiplexer.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+MAIDSAFE_CRUX_DECL multiplexer::multiplexer(next_layer_type&& udp_socket)
+    : udp_socket(std::move(udp_socket))
+    , pool(buffer_pool::create(constant::buffer_pool_capacity))
+    , unused_templates(std::make_shared<template_list>())
+    , connection_limit(std::numeric_limits<std::size_t>::max())
+    , policy(admission_policy::refuse)
+    , receive_calls(0)
+    , receiving(false)
+{
+}
+
+MAIDSAFE_CRUX_DECL multiplexer::~multiplexer()
+{
+    assert(sockets.empty());
+    assert(connection_ids.empty());
+    assert(acceptor_queue.empty());
+    assert(acceptor_factories.empty());
+    assert(receive_calls == 0);
+
+    // FIXME: Clean up
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::add(socket_base *socket)
+{
+    assert(socket);
+
+    auto where = sockets.find(socket->remote_endpoint());
+    if (where != sockets.end()) {
+        return;
+    }
+
+    activity.push_front(socket);
+    sockets.insert(socket_map::value_type(socket->remote_endpoint(),
+                                          socket_entry{socket, activity.begin(), false}));
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::remove(socket_base *socket)
+{
+    assert(socket);
+
+    auto where = sockets.find(socket->remote_endpoint());
+    if (where != sockets.end() && where->second.socket == socket) {
+        if (where->second.persistent) {
+            stop_receive();
+        }
+        activity.erase(where->second.activity);
+        sockets.erase(where);
+    }
+    remove_connection_id(socket->local_connection_id(), socket);
+    validations.erase(socket);
+
+    // Keep the local endpoint open while an acceptor is still waiting on it.
+    if (sockets.empty() && (acceptors() == 0)) {
+        next_layer().close();
+    }
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::keep_receiving(socket_base *socket)
+{
+    assert(socket);
+
+    auto where = sockets.find(socket->remote_endpoint());
+    if (where == sockets.end() || where->second.socket != socket
+        || where->second.persistent) {
+        return;
+    }
+
+    where->second.persistent = true;
+    start_receive();
+}
+
+MAIDSAFE_CRUX_DECL bool multiplexer::add_connection_id(std::uint16_t id, socket_base *socket)
+{
+    assert(socket);
+
+    if (id == 0) {
+        return false;
+    }
+    return connection_ids.insert(connection_id_map::value_type(id, socket)).second;
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::remove_connection_id(std::uint16_t id, socket_base *socket)
+{
+    auto where = connection_ids.find(id);
+    if (where != connection_ids.end() && where->second == socket) {
+        connection_ids.erase(where);
+    }
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::max_connections(std::size_t value)
+{
+    connection_limit = value;
+}
+
+MAIDSAFE_CRUX_DECL std::size_t multiplexer::max_connections() const
+{
+    return connection_limit;
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::admission(admission_policy value)
+{
+    policy = value;
+}
+
+MAIDSAFE_CRUX_DECL admission_policy multiplexer::admission() const
+{
+    return policy;
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::buffer_memory(const arena::options& settings)
+{
+    pool = buffer_pool::create(constant::buffer_pool_capacity, settings);
+}
+
+MAIDSAFE_CRUX_DECL const buffer_pool& multiplexer::buffers() const
+{
+    return *pool;
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::capture(std::shared_ptr<capture_writer> writer)
+{
+    recorder = std::move(writer);
+    if (recorder)
+    {
+        boost::system::error_code error;
+        recorder_endpoint = next_layer().local_endpoint(error);
+    }
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::record_received(std::size_t datagram_size,
+                                  const endpoint_type& remote_endpoint)
+{
+    // Peeked, so that the datagram is left for the receive proper
+    auto datagram = pool->acquire(datagram_size);
+    endpoint_type sender;
+    boost::system::error_code error;
+    const auto size = next_layer().receive_from(boost::asio::buffer(*datagram),
+                                                sender,
+                                                next_layer_type::message_peek,
+                                                error);
+    if (!error)
+    {
+        recorder->write(remote_endpoint,
+                        recorder_endpoint,
+                        boost::asio::buffer(*datagram, size));
+    }
+}
+
+MAIDSAFE_CRUX_DECL const admission_statistics& multiplexer::statistics() const
+{
+    return admission_stats;
+}
+
+MAIDSAFE_CRUX_DECL std::size_t multiplexer::connections() const
+{
+    return sockets.size();
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::disable_accept_requests_from(acceptor& accept) {
+    auto i = acceptor_queue.begin();
+
+    while (i != acceptor_queue.end()) {
+        if (std::get<0>(**i) == &accept) {
+            auto socket  = std::get<1>(**i);
+            auto handler = std::move(std::get<2>(**i));
+            get_io_service().post([handler]() {
+                    handler(boost::asio::error::operation_aborted);
+                    });
+            stop_receive();
+            socket->close();
+            acceptor_queue.erase(i++);
+        }
+        else {
+            ++i;
+        }
+    }
+
+    auto j = acceptor_factories.begin();
+
+    while (j != acceptor_factories.end()) {
+        if (std::get<0>(**j) == &accept) {
+            auto handler = std::move(std::get<2>(**j));
+            get_io_service().post([handler]() {
+                    handler(boost::asio::error::operation_aborted);
+                    });
+            stop_receive();
+            acceptor_factories.erase(j++);
+        }
+        else {
+            ++j;
+        }
+    }
+
+    if (sockets.empty() && (acceptors() == 0)) {
+        next_layer().close();
+    }
+}
+
+MAIDSAFE_CRUX_DECL
+std::shared_ptr<multiplexer::data_template>
+multiplexer::make_data_template(sequence_type sequence,
+                                std::uint16_t connection_id)
+{
+    std::unique_ptr<data_template> packet;
+    if (unused_templates->empty())
+    {
+        packet.reset(new data_template);
+    }
+    else
+    {
+        packet = std::move(unused_templates->back());
+        unused_templates->pop_back();
+    }
+
+    detail::encoder encoder(packet->header.data(), packet->header.size());
+    header::data(0, sequence, boost::none, connection_id).encode(encoder);
+    packet->options = 0;
+
+    // Released templates let go of the payload before they are kept
+    std::weak_ptr<template_list> owner = unused_templates;
+    return std::shared_ptr<data_template>(packet.release(),
+                                          [owner](data_template *released)
+                                          {
+                                              std::unique_ptr<data_template> entry(released);
+                                              entry->payload.clear();
+                                              entry->storage.reset();
+                                              auto unused = owner.lock();
+                                              if (unused && unused->size() < constant::buffer_pool_capacity)
+                                              {
+                                                  unused->push_back(std::move(entry));
+                                              }
+                                          });
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::finish_frame(frame_type& frame, std::size_t compact)
+{
+    frame.size = (compact > 0)
+        ? header::compact::encode(frame.header, compact, frame.wire.data())
+        : 0;
+    if (frame.size == 0)
+    {
+        std::copy(frame.header.begin(), frame.header.end(), frame.wire.begin());
+        frame.size = header_size;
+    }
+}
+
+MAIDSAFE_CRUX_DECL multiplexer::endpoint_type multiplexer::local_loopback_endpoint() const {
+    namespace ip = boost::asio::ip;
+    auto local = next_layer().local_endpoint();
+
+    if (local.address().is_v4()) {
+        return endpoint_type(ip::address_v4::loopback(), local.port());
+    }
+    else {
+        return endpoint_type(ip::address_v6::loopback(), local.port());
+    }
+}
+
+MAIDSAFE_CRUX_DECL std::size_t multiplexer::acceptors() const
+{
+    return acceptor_queue.size() + acceptor_factories.size();
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::start_receive()
+{
+    // Each socket and acceptor may invoke only one receive call at a time.
+    // Since both, a socket and an acceptor may invoke this function
+    // from inside a handler, and since the 'receive_calls' counter gets
+    // decreased only after handlers are executed we need to allow an
+    // error by 2.
+    assert(receive_calls < sockets.size() + acceptors() + 2U);
+
+    if (receive_calls++ == 0)
+    {
+        do_start_receive();
+    }
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::stop_receive()
+{
+    // Each socket may invoke only one receive call at a time.
+    assert(receive_calls > 0);
+    assert(receive_calls <= sockets.size() + acceptors() + 1U);
+
+    if (--receive_calls == 0)
+    {
+        // The fact that we're here means that the last socket that
+        // was receiving just got closed. To prevent the io_service
+        // from blocking, we fulfill the last receive request by
+        // sending ourself an empty packet.
+        auto self = shared_from_this();
+        next_layer().async_send_to
+            ( boost::asio::buffer(static_cast<char*>(nullptr), 0)
+            , local_loopback_endpoint()
+            , [self](boost::system::error_code, std::size_t) {});
+    }
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::do_start_receive()
+{
+    if (receiving) return;
+    receiving = true;
+
+    auto self(shared_from_this());
+
+    // We need to read with at least one zero sized buffer to
+    // get the remote_endpoint information.
+    next_layer().async_receive_from
+        (boost::asio::buffer(static_cast<char*>(nullptr), 0),
+         next_remote_endpoint,
+         std::remove_reference<decltype(next_layer())>::type::message_peek,
+         [self]
+         (boost::system::error_code error, std::size_t /*size*/) mutable
+         {
+            // The size parameter is useless here because what we get
+            // is min(buffer_size, datagram_size) and our buffer size is 0.
+            self->receiving = false;
+            self->process_peek(error, self->next_remote_endpoint);
+         });
+}
+
+MAIDSAFE_CRUX_DECL void multiplexer::discard_message() {
+    boost::system::error_code error;
+    endpoint_type remote_endpoint;
+    next_layer().receive_from
+        ( boost::asio::buffer(static_cast<char*>(nullptr), 0)
+        , remote_endpoint, next_layer_type::message_flags(), error );
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::process_peek(boost::system::error_code error,
+                               endpoint_type remote_endpoint)
+{
+    namespace asio = boost::asio;
+
+    if (!next_layer().is_open()) return;
+
+    if (receive_calls == 0) {
+        // We've received our own empty message to fullfill the last receive
+        // request or we've received someone's else's message while doing so.
+        discard_message();
+        return;
+    }
+
+    assert(receive_calls <= sockets.size() + acceptors() + 1U);
+
+    switch (error.value())
+    {
+    case 0:
+        // Continue below
+        break;
+#if defined(BOOST_ASIO_WINDOWS)
+    case ERROR_MORE_DATA:
+        // Continue below
+        break;
+#endif // defined(BOOST_ASIO_WINDOWS)
+
+    case boost::asio::error::operation_aborted:
+        discard_message();
+        --receive_calls;
+        return;
+
+    default:
+        // Since we're here a socket must have been receiving
+        // and its receive request must be fulfilled, so we
+        // must start receiving again.
+        discard_message();
+        do_start_receive();
+        return;
+    }
+
+    auto recipient = sockets.find(remote_endpoint);
+
+    next_layer_type::bytes_readable command(true);
+    next_layer().io_control(command);
+    std::size_t datagram_size = command.get();
+
+    if (recorder && (datagram_size > 0)) {
+        record_received(datagram_size, remote_endpoint);
+    }
+
+    // Compact headers are shorter, and only known connections use them,
+    // although possibly from an endpoint that is not known yet.
+    const std::size_t min_size = ((recipient == sockets.end())
+                                  || recipient->second.socket->has_compact_header())
+        ? header::compact::min_size
+        : header_size;
+
+    if (datagram_size < min_size) {
+        // Our empty packet, corrupted packet or someone is being silly.
+        discard_message();
+        do_start_receive();
+        return;
+    }
+
+    // Zeroed so that a failed receive leaves no header to speak of
+    header::data_type header_data = {{}};
+    std::size_t payload_size = (datagram_size > header_size) ? datagram_size - header_size : 0;
+
+    // FIXME: gather-read (header, body)
+    // FIXME: Receive several datagrams per call and decode their headers
+    //        together, one array per field.
+    // FIXME: Make socket.receive_from commands async.
+    if (recipient == sockets.end())
+    {
+        establish_connection(datagram_size, remote_endpoint);
+    }
+    else
+    {
+        auto& entry        = recipient->second;
+        auto& crux_socket  = *entry.socket;
+        auto* recv_buffers = crux_socket.get_recv_buffers();
+
+        activity.splice(activity.begin(), activity, entry.activity);
+
+        if (entry.persistent) {
+            // Stay ready for the next packet, even if the socket is closed
+            // by this one and thereby gives up its receive call.
+            ++receive_calls;
+        }
+
+        std::shared_ptr<buffer_type> payload;
+        bool corrupted = false;
+
+        if (crux_socket.has_checksum()
+            || crux_socket.has_encryption()
+            || crux_socket.has_compression()
+            || crux_socket.has_compact_header()
+            || (crux_socket.state() != socket_base::connectivity::established)) {
+            // Trailers cover the whole datagram, so it is received in one
+            // piece and checked before anything else looks at it. This
+            // also keeps handshakes out of the receive buffers.
+            const bool compact = crux_socket.has_compact_header();
+            if (compact) {
+                // The size of the header is only known once it is decoded
+                payload = pool->acquire(datagram_size);
+
+                next_layer().receive_from
+                    ( asio::buffer(*payload)
+                      , remote_endpoint
+                      , next_layer_type::message_flags()
+                      , error );
+            }
+            else {
+                payload = pool->acquire(payload_size);
+
+                next_layer().receive_from
+                    ( concatenate( asio::buffer(header_data)
+                                   , asio::buffer(*payload))
+                      , remote_endpoint
+                      , next_layer_type::message_flags()
+                      , error );
+            }
+
+            if (!error
+                && !((!compact || take_header(&crux_socket, *payload, header_data))
+                     && unwrap(crux_socket, header_data, *payload)
+                     && expand(crux_socket, header_data, recv_buffers, payload, payload_size))) {
+                // Damaged or forged on the way. The socket is still waiting for the
+                // retransmission, so keep receiving for it.
+                corrupted = true;
+                if (!entry.persistent) {
+                    ++receive_calls;
+                }
+            }
+            else if (payload) {
+                payload_size = payload->size();
+                if (recv_buffers) {
+                    asio::buffer_copy(*recv_buffers, asio::buffer(*payload));
+                    payload.reset();
+                }
+            }
+        }
+        else if (recv_buffers) {
+            // Copy the buffer descriptors because the receive operation is
+            // still pending if this turns out to be a keepalive.
+            next_layer().receive_from
+                ( concatenate( asio::buffer(header_data)
+                               , *recv_buffers)
+                  , remote_endpoint
+                  , next_layer_type::message_flags()
+                  , error );
+        }
+        else {
+            payload = std::make_shared<buffer_type>(payload_size);
+
+            next_layer().receive_from
+                ( concatenate( asio::buffer(header_data)
+                               , asio::buffer(*payload))
+                  , remote_endpoint
+                  , next_layer_type::message_flags()
+                  , error );
+        }
+
+        const header::view view(header_data);
+        if (!corrupted && !error && !view.is_valid()) {
+            // Malformed or from a version we do not speak
+            corrupted = true;
+            if (!entry.persistent) {
+                ++receive_calls;
+            }
+        }
+
+        if (!corrupted) {
+            dispatch(crux_socket, view, remote_endpoint, error, payload_size, payload);
+        }
+    }
+
+    if (--receive_calls > 0) {
+        do_start_receive();
+    }
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::establish_connection(std::size_t datagram_size,
+                                       endpoint_type remote_endpoint)
+{
+    header::data_type header_data;
+    auto payload = std::make_shared<buffer_type>(datagram_size);
+
+    boost::system::error_code error;
+    auto size = next_layer().receive_from(boost::asio::buffer(*payload),
+                                          remote_endpoint,
+                                          next_layer_type::message_flags(),
+                                          error);
+    if (error)
+    {
+        // Ignore errors on new connections
+        return;
+    }
+    payload->resize(size);
+    if (!take_header(nullptr, *payload, header_data)
+        || !header::view(header_data).is_valid())
+    {
+        // Ignore datagrams with incomplete or malformed header, and keep
+        // receiving for whoever was waiting for a proper one.
+        ++receive_calls;
+        return;
+    }
+
+    if (migrate_connection(header_data, remote_endpoint, payload))
+    {
+        return;
+    }
+
+    if (acceptor_queue.empty())
+    {
+        if (!acceptor_factories.empty())
+        {
+            spawn_connection(header_data, remote_endpoint, payload);
+        }
+        // Ignore handshakes that we did not expect.
+        // FIXME: Should we enqueue the most recent requests?
+        return;
+    }
+
+    auto& input = acceptor_queue.front();
+    auto socket = std::get<1>(*input);
+
+    const header::view view(header_data);
+    switch (view.type())
+    {
+    case header::constant::type_handshake:
+        if (!admit(remote_endpoint, view))
+        {
+            // The acceptor is still waiting for a connection.
+            ++receive_calls;
+            return;
+        }
+        process_handshake(*socket, remote_endpoint, view, payload);
+        break;
+
+    case header::constant::type_keepalive:
+        // FIXME: Detect denial-of-service attacks
+        process_keepalive(*socket, view);
+        break;
+
+    default:
+        // Other packets from unknown remote endpoints may arrive because:
+        //   1) The initial handshake was lost in transmission. The handshake
+        //      will be retransmitted later, and so will any packet we ignore.
+        //   2) Denial-of-service attack, which we will ignore.
+        return;
+    }
+
+    if (socket->state() == socket_base::connectivity::established)
+    {
+        boost::system::error_code success;
+        auto input = std::move(acceptor_queue.front());
+        acceptor_queue.pop_front();
+        process_accept(success,
+                       std::get<2>(*input));
+        --receive_calls;
+    }
+    else {
+        ++receive_calls;
+    }
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::spawn_connection(const header::data_type& header_data,
+                                   endpoint_type remote_endpoint,
+                                   std::shared_ptr<buffer_type> payload)
+{
+    // The factory keeps listening for further handshakes.
+    ++receive_calls;
+
+    const header::view view(header_data);
+    if (view.type() != header::constant::type_handshake)
+    {
+        return;
+    }
+
+    if (!admit(remote_endpoint, view))
+    {
+        return;
+    }
+
+    // Take turns if several acceptors share the local endpoint.
+    acceptor_factories.splice(acceptor_factories.end(),
+                              acceptor_factories,
+                              acceptor_factories.begin());
+    auto socket = std::get<1>(*acceptor_factories.back())();
+    if (!socket)
+    {
+        return;
+    }
+
+    // Unlike sockets from the acceptor queue, the new socket is added
+    // right away so that concurrent handshakes do not interfere with
+    // each other.
+    socket->remote_endpoint(remote_endpoint);
+    add(socket);
+
+    process_handshake(*socket, remote_endpoint, view, payload);
+}
+
+MAIDSAFE_CRUX_DECL
+bool multiplexer::migrate_connection(const header::data_type& header_data,
+                                     endpoint_type remote_endpoint,
+                                     std::shared_ptr<buffer_type> payload)
+{
+    namespace asio = boost::asio;
+
+    const header::view view(header_data);
+    if (view.type() != header::constant::type_keepalive
+        && view.type() != header::constant::type_data)
+    {
+        return false;
+    }
+    const auto sequence = view.sequence_number();
+    const auto connection_id = view.connection_id();
+
+    auto candidate = connection_ids.find(connection_id);
+    if (connection_id == 0 || candidate == connection_ids.end())
+    {
+        return false;
+    }
+
+    auto& socket = *candidate->second;
+    auto where = sockets.find(socket.remote_endpoint());
+    if (where == sockets.end() || where->second.socket != &socket)
+    {
+        // Not connected yet
+        return false;
+    }
+
+    const bool response = (view.type() == header::constant::type_keepalive)
+        && (view.options() & header::constant::option_response);
+    // Skips stand for every message up to their sequence number
+    const bool skip = (view.type() == header::constant::type_data)
+        && (view.options() & header::constant::option_skip);
+
+    auto* recv_buffers = socket.get_recv_buffers();
+    std::size_t payload_size = payload->size();
+    if (socket.state() != socket_base::connectivity::established
+        || !(response
+             || socket.is_expected_packet(sequence)
+             || (skip && socket.is_expected_skip(sequence)))
+        || !unwrap(socket, header_data, *payload)
+        || !expand(socket, header_data, recv_buffers, payload, payload_size))
+    {
+        // Most likely a stale, damaged or spoofed packet. The socket is still
+        // waiting for the packet it expects, so keep receiving for it.
+        ++receive_calls;
+        return true;
+    }
+
+    if (!socket.has_encryption())
+    {
+        auto& validation = validations[&socket];
+        if (validation.endpoints.empty())
+        {
+            // Where the handshake came from
+            validation.endpoints.insert(socket.remote_endpoint());
+        }
+
+        if (response)
+        {
+            if ((remote_endpoint == validation.challenged)
+                && (view.nonce() == validation.nonce))
+            {
+                validation.endpoints.insert(remote_endpoint);
+                validation.challenged = endpoint_type();
+                move_socket(socket, remote_endpoint);
+            }
+            ++receive_calls;
+            return true;
+        }
+
+        if (!validation.endpoints.count(remote_endpoint))
+        {
+            // The packet may be forged, so it is dropped and the peer is
+            // challenged to show that it is really there. It retransmits
+            // the packet once the connection has followed it.
+            if (remote_endpoint != validation.challenged)
+            {
+                auto& owner = asio::use_service<detail::service>(get_io_service());
+                validation.challenged = remote_endpoint;
+                validation.nonce = owner.random_nonce();
+            }
+            send_challenge(socket,
+                           remote_endpoint,
+                           header::constant::option_challenge,
+                           validation.nonce);
+            ++receive_calls;
+            return true;
+        }
+    }
+    else if (response)
+    {
+        // Authenticated packets need no challenge
+        ++receive_calls;
+        return true;
+    }
+
+    // The peer has moved to where it has been before, or the packet could
+    // only have come from it, so send everything from now on to where the
+    // packet came from.
+    if (move_socket(socket, remote_endpoint))
+    {
+        ++receive_calls;
+    }
+
+    if (payload)
+    {
+        payload_size = payload->size();
+        if (recv_buffers && (view.type() == header::constant::type_data))
+        {
+            asio::buffer_copy(*recv_buffers, asio::buffer(*payload));
+            payload.reset();
+        }
+    }
+
+    dispatch(socket, view, remote_endpoint,
+             boost::system::error_code(), payload_size, payload);
+    return true;
+}
+
+MAIDSAFE_CRUX_DECL
+bool multiplexer::move_socket(socket_base& socket,
+                              const endpoint_type& remote_endpoint)
+{
+    auto where = sockets.find(socket.remote_endpoint());
+    assert(where != sockets.end() && where->second.socket == &socket);
+
+    auto entry = where->second;
+    sockets.erase(where);
+    sockets.insert(socket_map::value_type(remote_endpoint, entry));
+    activity.splice(activity.begin(), activity, entry.activity);
+    socket.remote_endpoint(remote_endpoint);
+    return entry.persistent;
+}
+
+MAIDSAFE_CRUX_DECL
+bool multiplexer::take_header(socket_base *socket,
+                              buffer_type& datagram,
+                              header::data_type& header_data)
+{
+    const auto data = reinterpret_cast<const std::uint8_t *>(datagram.data());
+    std::size_t length = 0;
+
+    if (datagram.size() >= header::compact::min_size
+        && header::compact::is_compact(data[0]))
+    {
+        if (!socket)
+        {
+            // A connection that has moved
+            const auto candidate = connection_ids.find
+                ((std::uint16_t(data[1]) << 8) | data[2]);
+            if (candidate != connection_ids.end())
+            {
+                socket = candidate->second;
+            }
+        }
+        if (!socket || !socket->has_compact_header())
+        {
+            return false;
+        }
+        length = header::compact::decode(data,
+                                         datagram.size(),
+                                         socket->expected_sequence(),
+                                         socket->last_sent_sequence(),
+                                         header_data);
+        if (length == 0)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        if (datagram.size() < header_size)
+        {
+            return false;
+        }
+        std::copy(data, data + header_size, header_data.begin());
+        length = header_size;
+    }
+
+    datagram.erase(datagram.begin(), datagram.begin() + length);
+    return true;
+}
+
+MAIDSAFE_CRUX_DECL
+bool multiplexer::unwrap(socket_base& socket,
+                         const header::data_type& header_data,
+                         buffer_type& payload)
+{
+    const auto type = ((std::uint16_t(header_data[0]) << 8) | header_data[1])
+        & header::constant::mask_type;
+    if (type == header::constant::type_handshake
+        || (type == header::constant::type_shutdown && !socket.has_encryption()))
+    {
+        // Handshakes are sent before anything is agreed on, and shutdowns
+        // may come from a multiplexer that knows nothing about the socket
+        // until keys have been agreed on.
+        return true;
+    }
+
+    if (socket.has_checksum() && !verify_checksum(header_data, payload))
+    {
+        return false;
+    }
+
+#if defined(MAIDSAFE_CRUX_USE_OPENSSL)
+    if (socket.has_encryption())
+    {
+        if (!socket.cipher->open(header_data.data(),
+                                 header_data.size(),
+                                 reinterpret_cast<std::uint8_t *>(payload.data()),
+                                 payload.size()))
+        {
+            return false;
+        }
+        payload.resize(payload.size() - aead::overhead);
+    }
+#endif
+    return true;
+}
+
+MAIDSAFE_CRUX_DECL
+bool multiplexer::expand(socket_base& socket,
+                         const header::data_type& header_data,
+                         std::vector<boost::asio::mutable_buffer> *recv_buffers,
+                         std::shared_ptr<buffer_type>& payload,
+                         std::size_t& payload_size)
+{
+    namespace asio = boost::asio;
+
+    const auto type = (std::uint16_t(header_data[0]) << 8) | header_data[1];
+    if ((type & header::constant::mask_type) != header::constant::type_data
+        || !(type & header::constant::option_compressed))
+    {
+        return true;
+    }
+    if (!socket.has_compression())
+    {
+        return false;
+    }
+
+    const auto input = reinterpret_cast<const std::uint8_t *>(payload->data());
+    const auto size = compression::decompressed_size(input, payload->size());
+    if (size == compression::invalid)
+    {
+        return false;
+    }
+
+    if (recv_buffers
+        && recv_buffers->size() == 1
+        && asio::buffer_size(recv_buffers->front()) >= size)
+    {
+        // Saves copying the message once more
+        auto output = asio::buffer_cast<std::uint8_t *>(recv_buffers->front());
+        if (compression::decompress(input, payload->size(), output, size,
+                                    socket.dictionary) != size)
+        {
+            return false;
+        }
+        payload.reset();
+        payload_size = size;
+        return true;
+    }
+
+    auto expanded = pool->acquire(size);
+    if (compression::decompress(input, payload->size(),
+                                reinterpret_cast<std::uint8_t *>(expanded->data()), size,
+                                socket.dictionary) != size)
+    {
+        return false;
+    }
+    payload = std::move(expanded);
+    payload_size = size;
+    return true;
+}
+
+MAIDSAFE_CRUX_DECL
+bool multiplexer::verify_checksum(const header::data_type& header_data,
+                                  buffer_type& payload)
+{
+    if (payload.size() < header::constant::checksum_size)
+    {
+        return false;
+    }
+    const auto size = payload.size() - header::constant::checksum_size;
+
+    crc32c crc;
+    crc.update(header_data.data(), header_data.size());
+    crc.update(payload.data(), size);
+
+    // The trailer follows the payload, so it need not be aligned
+    const auto trailer = reinterpret_cast<const std::uint8_t *>(payload.data()) + size;
+    const std::uint32_t expected = (std::uint32_t(trailer[0]) << 24)
+        | (std::uint32_t(trailer[1]) << 16)
+        | (std::uint32_t(trailer[2]) << 8)
+        | std::uint32_t(trailer[3]);
+    if (expected != crc.value())
+    {
+        return false;
+    }
+    payload.resize(size);
+    return true;
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::dispatch(socket_base& socket,
+                           const header::view& view,
+                           endpoint_type remote_endpoint,
+                           const boost::system::error_code& error,
+                           std::size_t payload_size,
+                           std::shared_ptr<buffer_type> payload)
+{
+    // Malformed headers are rejected before getting here, except when the
+    // receive itself failed and there is no header to speak of.
+    switch (view.is_valid() ? view.type() : header::constant::type_data)
+    {
+    case header::constant::type_handshake:
+        process_handshake(socket, remote_endpoint, view, payload);
+        break;
+
+    case header::constant::type_keepalive:
+        process_keepalive(socket, view);
+        break;
+
+    case header::constant::type_data:
+        process_data(socket, view, error, payload_size, payload);
+        break;
+
+    case header::constant::type_shutdown:
+        process_shutdown(socket, view);
+        break;
+    }
+}
+
+MAIDSAFE_CRUX_DECL
+bool multiplexer::admit(const endpoint_type& remote_endpoint,
+                        const header::view& view)
+{
+    auto& owner = boost::asio::use_service<detail::service>(get_io_service());
+    // Counting across local endpoints takes time in proportion to their
+    // number, so it is only done if there is a limit to enforce
+    const bool limited = (owner.max_connections() != std::numeric_limits<std::size_t>::max());
+
+    while ((connections() >= connection_limit)
+           || (limited && (owner.connections() >= owner.max_connections())))
+    {
+        if ((policy != admission_policy::evict_idle) || !evict_idle_socket())
+        {
+            ++admission_stats.refused;
+            send_shutdown(remote_endpoint, view.sequence_number());
+            return false;
+        }
+    }
+    ++admission_stats.accepted;
+    return true;
+}
+
+MAIDSAFE_CRUX_DECL
+bool multiplexer::evict_idle_socket()
+{
+    // Only established connections are candidates, others are still
+    // handshaking and have not been idle for long.
+    auto victim = std::find_if(activity.rbegin(), activity.rend(),
+                               [](socket_base *socket)
+                               {
+                                   return socket->state() == socket_base::connectivity::established;
+                               });
+    if (victim == activity.rend())
+    {
+        return false;
+    }
+
+    auto socket = *victim;
+    ++admission_stats.evicted;
+    // Told apart from a close by the application. Closing tells the peer.
+    socket->abort_operations(boost::asio::error::connection_reset);
+    socket->close();
+    return true;
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::send_shutdown(socket_base& socket)
+{
+    send_shutdown(socket.remote_endpoint(), boost::none, &socket);
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::send_shutdown(const endpoint_type& remote_endpoint,
+                                boost::optional<ack_sequence_type> ack,
+                                socket_base *socket)
+{
+    // Refusals are sent synchronously from a stack buffer so that no state
+    // is kept for remote endpoints we do not want to talk to.
+    std::array<std::uint8_t,
+               header_size
+               + header::constant::encryption_size
+               + header::constant::checksum_size> datagram;
+    detail::encoder encoder(datagram.data(), header_size);
+    std::size_t size = header_size;
+
+    if (!socket)
+    {
+        header::shutdown(0, sequence_type(), ack).encode(encoder);
+    }
+    else
+    {
+        // The peer only believes a shutdown with its connection identifier
+        // and a sequence number that it is about to see from us. It is also
+        // sealed with the keys of the connection, if any.
+        header::shutdown(0,
+                         socket->last_sent_sequence().next(),
+                         boost::none,
+                         socket->remote_connection_id()).encode(encoder);
+#if defined(MAIDSAFE_CRUX_USE_OPENSSL)
+        if (socket->has_encryption())
+        {
+            socket->cipher->seal(datagram.data(), header_size, datagram.data() + size, 0);
+            size += header::constant::encryption_size;
+        }
+#endif
+        if (socket->has_checksum())
+        {
+            crc32c crc;
+            crc.update(datagram.data(), size);
+            detail::encoder trailer(datagram.data() + size, header::constant::checksum_size);
+            trailer.put<std::uint32_t>(crc.value());
+            size += header::constant::checksum_size;
+        }
+    }
+
+    if (recorder)
+    {
+        recorder->write(recorder_endpoint, remote_endpoint, boost::asio::buffer(datagram, size));
+    }
+
+    boost::system::error_code error;
+    next_layer().send_to(boost::asio::buffer(datagram, size),
+                         remote_endpoint,
+                         next_layer_type::message_flags(),
+                         error);
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::send_challenge(socket_base& socket,
+                                 const endpoint_type& remote_endpoint,
+                                 std::uint16_t options,
+                                 std::uint32_t nonce)
+{
+    // Sent synchronously like refusals, and always with a full header as
+    // compact ones have no room for the options. Only connections without
+    // encryption challenge their peers.
+    assert(!socket.has_encryption());
+
+    std::array<std::uint8_t, header_size + header::constant::checksum_size> datagram;
+    detail::encoder encoder(datagram.data(), header_size);
+    header::keepalive(0,
+                      socket.last_sent_sequence().next(),
+                      boost::none,
+                      socket.remote_connection_id(),
+                      options,
+                      nonce).encode(encoder);
+
+    std::size_t size = header_size;
+    if (socket.has_checksum())
+    {
+        crc32c crc;
+        crc.update(datagram.data(), header_size);
+        detail::encoder trailer(datagram.data() + size, header::constant::checksum_size);
+        trailer.put<std::uint32_t>(crc.value());
+        size += header::constant::checksum_size;
+    }
+
+    if (recorder)
+    {
+        recorder->write(recorder_endpoint, remote_endpoint, boost::asio::buffer(datagram, size));
+    }
+
+    boost::system::error_code error;
+    next_layer().send_to(boost::asio::buffer(datagram, size),
+                         remote_endpoint,
+                         next_layer_type::message_flags(),
+                         error);
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::process_handshake(socket_base& socket,
+                                    endpoint_type remote_endpoint,
+                                    const header::view& view,
+                                    std::shared_ptr<buffer_type> payload)
+{
+    // Handshakes cannot be authenticated, so once keys have been agreed on
+    // they may only get a repeated handshake answered.
+    const bool agreed = socket.has_encryption();
+
+    socket.process_handshake(view.sequence_number(), remote_endpoint,
+                             view.options(), payload);
+
+    if (agreed)
+    {
+        return;
+    }
+
+    if (auto ack = view.ack())
+    {
+        socket.process_acknowledgement(*ack);
+    }
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::process_keepalive(socket_base& socket,
+                                    const header::view& view)
+{
+    if ((view.options() & header::constant::option_challenge)
+        && !socket.has_encryption())
+    {
+        // Answer from this local endpoint, which the challenge was sent to
+        send_challenge(socket,
+                       socket.remote_endpoint(),
+                       header::constant::option_response,
+                       view.nonce());
+    }
+
+    socket.process_keepalive(view.sequence_number());
+
+    if (auto ack = view.ack())
+    {
+        socket.process_acknowledgement(*ack);
+    }
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::process_shutdown(socket_base& socket,
+                                   const header::view& view)
+{
+    socket.process_shutdown(view.connection_id(), view.sequence_number(), view.ack());
+}
+
+MAIDSAFE_CRUX_DECL
+void multiplexer::process_data(socket_base& socket,
+                               const header::view& view,
+                               const boost::system::error_code& error,
+                               std::size_t payload_size,
+                               std::shared_ptr<buffer_type> payload)
+{
+    if (view.options() & header::constant::option_skip)
+    {
+        socket.process_skip(view.sequence_number());
+    }
+    else
+    {
+        socket.process_data(error, payload_size, payload, view.sequence_number());
+    }
+
+    if (auto ack = view.ack())
+    {
+        socket.process_acknowledgement(*ack);
+    }
+}
+
+MAIDSAFE_CRUX_DECL multiplexer::next_layer_type& multiplexer::next_layer()
+{
+    return udp_socket;
+}
+
+MAIDSAFE_CRUX_DECL const multiplexer::next_layer_type& multiplexer::next_layer() const
+{
+    return udp_socket;
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_IMPL_MULTIPLEXER_IPP
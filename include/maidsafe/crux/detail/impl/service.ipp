@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_IMPL_SERVICE_IPP
+#define MAIDSAFE_CRUX_DETAIL_IMPL_SERVICE_IPP
+
+#include <limits>
+#include <maidsafe/crux/detail/service.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+MAIDSAFE_CRUX_DECL service::service(boost::asio::io_service& io)
+    : boost::asio::io_service::service(io),
+      connection_limit(std::numeric_limits<std::size_t>::max()),
+      distribution(std::numeric_limits<std::uint32_t>::min(),
+                   std::numeric_limits<std::uint32_t>::max())
+{
+    std::random_device device;
+    generator.seed(device());
+}
+
+MAIDSAFE_CRUX_DECL std::shared_ptr<detail::multiplexer> service::add(endpoint_type local_endpoint)
+{
+    using next_layer_type = detail::multiplexer::next_layer_type;
+
+    // FIXME: Thread-safety
+    std::shared_ptr<detail::multiplexer> result;
+    auto where = multiplexers.lower_bound(local_endpoint);
+    if ((where == multiplexers.end()) || (multiplexers.key_comp()(local_endpoint, where->first)))
+    {
+        // Multiplexer for local endpoint does not exists
+
+        next_layer_type socket(get_io_service(), local_endpoint);
+
+        // local_endpoint changes if ephemeral port is used.
+        local_endpoint = socket.local_endpoint();
+
+        result = detail::multiplexer::create(std::move(socket));
+        result->buffer_memory(memory_options);
+        result->capture(recorder);
+
+        where = multiplexers.insert(where,
+                                    multiplexer_map::value_type
+                                        ( local_endpoint
+                                        , result));
+    }
+    else
+    {
+        result = where->second.lock();
+        if (!result)
+        {
+            // This can happen if an acceptor has failed
+            // Reassign if empty
+            next_layer_type socket(get_io_service(), local_endpoint);
+
+            assert(local_endpoint == socket.local_endpoint());
+
+            result = detail::multiplexer::create(std::move(socket));
+            result->buffer_memory(memory_options);
+            result->capture(recorder);
+
+            where->second = result;
+        }
+    }
+    return result;
+}
+
+MAIDSAFE_CRUX_DECL void service::remove(const endpoint_type& local_endpoint)
+{
+    // FIXME: Thread-safety
+    auto where = multiplexers.find(local_endpoint);
+    if (where != multiplexers.end())
+    {
+        // Only remove if multiplexer is unused
+        if (!where->second.lock())
+        {
+            multiplexers.erase(where);
+        }
+    }
+}
+
+MAIDSAFE_CRUX_DECL void service::max_connections(std::size_t value)
+{
+    connection_limit = value;
+}
+
+MAIDSAFE_CRUX_DECL std::size_t service::max_connections() const
+{
+    return connection_limit;
+}
+
+MAIDSAFE_CRUX_DECL void service::buffer_memory(const arena::options& value)
+{
+    memory_options = value;
+}
+
+MAIDSAFE_CRUX_DECL const arena::options& service::buffer_memory() const
+{
+    return memory_options;
+}
+
+MAIDSAFE_CRUX_DECL void service::capture(std::shared_ptr<capture_writer> writer)
+{
+    recorder = std::move(writer);
+    for (const auto& entry : multiplexers)
+    {
+        if (auto multiplexer = entry.second.lock())
+        {
+            multiplexer->capture(recorder);
+        }
+    }
+}
+
+MAIDSAFE_CRUX_DECL std::size_t service::connections() const
+{
+    std::size_t result = 0;
+    for (const auto& entry : multiplexers)
+    {
+        if (auto multiplexer = entry.second.lock())
+        {
+            result += multiplexer->connections();
+        }
+    }
+    return result;
+}
+
+MAIDSAFE_CRUX_DECL std::uint32_t service::random()
+{
+    if (!preset_sequences.empty())
+    {
+        const auto result = preset_sequences.front();
+        preset_sequences.pop_front();
+        return result;
+    }
+    return distribution(generator);
+}
+
+MAIDSAFE_CRUX_DECL void service::seed(std::uint32_t value)
+{
+    generator.seed(value);
+    distribution.reset();
+}
+
+MAIDSAFE_CRUX_DECL void service::initial_sequences(std::deque<std::uint32_t> values)
+{
+    preset_sequences = std::move(values);
+}
+
+MAIDSAFE_CRUX_DECL std::uint32_t service::random_nonce()
+{
+    return distribution(generator);
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_IMPL_SERVICE_IPP
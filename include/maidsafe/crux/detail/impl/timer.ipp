@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_IMPL_TIMER_IPP
+#define MAIDSAFE_CRUX_DETAIL_IMPL_TIMER_IPP
+
+#include <maidsafe/crux/detail/timer.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+MAIDSAFE_CRUX_DECL
+timer::timer(boost::asio::io_service& ios)
+    : state(stopped)
+    , asio_timer(ios)
+    , was_destroyed(std::make_shared<bool>(false))
+{}
+
+MAIDSAFE_CRUX_DECL
+timer::~timer() {
+    stop();
+    *was_destroyed = true;
+}
+
+MAIDSAFE_CRUX_DECL
+void timer::set_period(const duration_type& duration) {
+    period_duration = duration;
+}
+
+MAIDSAFE_CRUX_DECL void timer::start() {
+    switch (state) {
+        case stopped: do_start();
+                      break;
+        case running: stop();
+                      start();
+                      break;
+        case executing: do_start();
+                        break;
+        case canceling_to_stop: state = canceling_to_start;
+                                break;
+        case canceling_to_start: break;
+        case canceling_to_ff: state = canceling_to_start;
+                              break;
+    }
+}
+
+MAIDSAFE_CRUX_DECL void timer::stop() {
+    switch (state) {
+        case stopped: break;
+        case running: state = canceling_to_stop;
+                      asio_timer.cancel();
+                      break;
+        case executing: state = stopped;
+                        break;
+        case canceling_to_stop: break;
+        case canceling_to_start: state = canceling_to_stop;
+                                 break;
+        case canceling_to_ff: state = canceling_to_stop;
+                              break;
+    }
+}
+
+MAIDSAFE_CRUX_DECL void timer::fast_forward() {
+    start();
+    stop();
+    state = canceling_to_ff;
+}
+
+MAIDSAFE_CRUX_DECL
+void timer::do_start() {
+    state = running;
+    asio_timer.expires_from_now(period_duration);
+
+    auto was_destroyed_copy = was_destroyed;
+
+    asio_timer.async_wait(
+            [=](const boost::system::error_code&) {
+              if (*was_destroyed_copy) return;
+              do_handle_tick();
+            });
+}
+
+MAIDSAFE_CRUX_DECL void timer::do_handle_tick() {
+    switch (state) {
+        case stopped: return;
+        case running: break;
+        case executing: assert(0); break;
+        case canceling_to_stop: state = stopped;
+                                return;
+        case canceling_to_start: do_start();
+                                 return;
+        case canceling_to_ff: break;
+    }
+
+    state = executing;
+
+    if (handler) {
+        // The handler execution may destroy this timer
+        // object or it may set the handler to a new value.
+        auto was_destroyed_copy = was_destroyed;
+
+        auto local_handler = std::move(handler);
+
+        local_handler();
+
+        // Has the handler destroyed this object?
+        if (*was_destroyed_copy) return;
+
+        if (!handler) {
+            handler = std::move(local_handler);
+        }
+    }
+
+    if (state == executing) {
+        state = stopped;
+    }
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_IMPL_TIMER_IPP
@@ -0,0 +1,680 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_LOCAL_CHANNEL_HPP
+#define MAIDSAFE_CRUX_DETAIL_LOCAL_CHANNEL_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/system/error_code.hpp>
+#include <maidsafe/crux/detail/clock.hpp>
+#include <maidsafe/crux/detail/constants.hpp>
+#include <maidsafe/crux/detail/receive_input_type.hpp>
+#include <maidsafe/crux/detail/shared_ring.hpp>
+#include <maidsafe/crux/detail/timer.hpp>
+
+#if defined(BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR)
+# define MAIDSAFE_CRUX_HAS_LOCAL_CHANNEL 1
+# include <boost/asio/posix/stream_descriptor.hpp>
+#endif
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// Shared memory transport between two sockets on the same host.
+//
+// Each direction is a shared_ring in a POSIX shared memory segment. A side
+// that runs out of data or space flags it in the ring and waits on its own
+// named pipe, which the other side writes a byte to when it makes progress.
+// The accepting side creates the segment and the pipes during the handshake,
+// and the connecting side attaches to them before acknowledging it.
+//
+// Neither the pipes nor the segment tell when the other side has crashed,
+// so each side regularly records a heartbeat in the segment, and treats the
+// other side as closed once its heartbeat is older than the timeout.
+class local_channel : public std::enable_shared_from_this<local_channel>
+{
+public:
+    using endpoint_type = boost::asio::ip::udp::endpoint;
+    using handler_type = std::function<void (const boost::system::error_code&, std::size_t)>;
+    using time_point = detail::clock::time_point;
+    using duration_type = detail::timer::duration_type;
+
+    // Whether two endpoints can share memory.
+    static bool is_same_host(const endpoint_type& local,
+                             const endpoint_type& remote);
+
+    // Name of the channel between a connecting and an accepting endpoint.
+    static std::string make_name(const endpoint_type& connector,
+                                 const endpoint_type& acceptor,
+                                 std::uint32_t nonce);
+
+    // Returns an empty pointer if the channel could not be set up.
+    static std::shared_ptr<local_channel> create(boost::asio::io_service&,
+                                                 const std::string& name,
+                                                 const duration_type& timeout
+                                                 = constant::keepalive_timeout);
+    static std::shared_ptr<local_channel> attach(boost::asio::io_service&,
+                                                 const std::string& name,
+                                                 const duration_type& timeout
+                                                 = constant::keepalive_timeout);
+
+    ~local_channel();
+
+    // Whether the connecting side has attached to a created channel.
+    bool is_attached() const;
+
+    // Remove the channel from the file system once both sides have it open.
+    void unlink();
+
+    template <typename ConstBufferSequence>
+    void async_send(const ConstBufferSequence& buffers, handler_type handler);
+
+    // The handler completes with timed_out if no message has arrived by
+    // the deadline, which is checked when expire() is called.
+    template <typename MutableBufferSequence>
+    void async_receive(const MutableBufferSequence& buffers,
+                       const time_point& deadline,
+                       handler_type handler);
+
+    // Complete the receives whose deadline has passed
+    void expire(const time_point& now);
+
+    // Earliest deadline of a pending receive, or the maximum if none
+    time_point next_deadline() const;
+
+    // Fail pending operations with the error and tell the other side.
+    void close(const boost::system::error_code& error);
+
+private:
+    local_channel(boost::asio::io_service&,
+                  const std::string& name,
+                  bool owner,
+                  const duration_type& timeout);
+
+#if defined(MAIDSAFE_CRUX_HAS_LOCAL_CHANNEL)
+    struct segment
+    {
+        std::atomic<std::uint32_t> attached;
+        std::atomic<std::uint32_t> closed[2];
+        // Clock ticks of the latest heartbeat of either side
+        std::atomic<std::int64_t> heartbeat[2];
+        // Indexed by the sending side.
+        shared_ring::control rings[2];
+    };
+
+    struct send_operation
+    {
+        std::vector<boost::asio::const_buffer> buffers;
+        handler_type handler;
+    };
+
+    bool open();
+    std::size_t segment_size() const;
+    std::string memory_name() const;
+    std::string doorbell_name(std::size_t side) const;
+
+    void beat();
+    void pump();
+    bool transfer();
+    void wait_for_doorbell();
+    void ring_doorbell();
+    void fail_all(const boost::system::error_code& error);
+
+private:
+    boost::asio::io_service& io;
+    const std::string name;
+    // The creating side sends on ring 0, the attaching side on ring 1.
+    const std::size_t side;
+    bool linked;
+    bool closed;
+    bool waiting;
+
+    const duration_type timeout;
+    detail::timer heartbeat_timer;
+
+    void* memory;
+    segment* shared;
+    std::unique_ptr<shared_ring> inbound;
+    std::unique_ptr<shared_ring> outbound;
+
+    boost::asio::posix::stream_descriptor doorbell;
+    int peer_doorbell;
+    std::array<char, 64> doorbell_buffer;
+
+    std::deque<std::unique_ptr<receive_input_type>> receives;
+    std::queue<send_operation> sends;
+#endif
+};
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#include <algorithm>
+#include <boost/asio/error.hpp>
+
+#if defined(MAIDSAFE_CRUX_HAS_LOCAL_CHANNEL)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+inline bool local_channel::is_same_host(const endpoint_type& local,
+                                        const endpoint_type& remote)
+{
+    return remote.address().is_loopback()
+        || (remote.address() == local.address());
+}
+
+inline std::string local_channel::make_name(const endpoint_type& connector,
+                                            const endpoint_type& acceptor,
+                                            std::uint32_t nonce)
+{
+    return "crux-" + std::to_string(connector.port())
+        + "-" + std::to_string(acceptor.port())
+        + "-" + std::to_string(nonce);
+}
+
+#if defined(MAIDSAFE_CRUX_HAS_LOCAL_CHANNEL)
+
+inline local_channel::local_channel(boost::asio::io_service& io,
+                                    const std::string& name,
+                                    bool owner,
+                                    const duration_type& timeout)
+    : io(io)
+    , name(name)
+    , side(owner ? 0 : 1)
+    , linked(false)
+    , closed(false)
+    , waiting(false)
+    , timeout(timeout)
+    , heartbeat_timer(io, [this]() { beat(); })
+    , memory(MAP_FAILED)
+    , shared(nullptr)
+    , doorbell(io)
+    , peer_doorbell(-1)
+{
+}
+
+inline std::shared_ptr<local_channel>
+local_channel::create(boost::asio::io_service& io,
+                      const std::string& name,
+                      const duration_type& timeout)
+{
+    std::shared_ptr<local_channel> channel(new local_channel(io, name, true, timeout));
+    if (!channel->open())
+    {
+        return nullptr;
+    }
+    channel->beat();
+    return channel;
+}
+
+inline std::shared_ptr<local_channel>
+local_channel::attach(boost::asio::io_service& io,
+                      const std::string& name,
+                      const duration_type& timeout)
+{
+    std::shared_ptr<local_channel> channel(new local_channel(io, name, false, timeout));
+    if (!channel->open())
+    {
+        return nullptr;
+    }
+    channel->beat();
+    channel->shared->attached.store(1, std::memory_order_release);
+    return channel;
+}
+
+inline local_channel::~local_channel()
+{
+    if (peer_doorbell >= 0)
+    {
+        ::close(peer_doorbell);
+    }
+    if (memory != MAP_FAILED)
+    {
+        ::munmap(memory, segment_size());
+    }
+    unlink();
+}
+
+inline std::size_t local_channel::segment_size() const
+{
+    return sizeof(segment) + 2 * constant::shared_memory_ring_size;
+}
+
+inline std::string local_channel::memory_name() const
+{
+    return "/" + name;
+}
+
+inline std::string local_channel::doorbell_name(std::size_t which) const
+{
+    return "/tmp/" + name + "." + std::to_string(which);
+}
+
+inline bool local_channel::open()
+{
+    const bool owner = (side == 0);
+
+    int fd = ::shm_open(memory_name().c_str(),
+                        owner ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR,
+                        0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (owner)
+    {
+        linked = true;
+        if (::ftruncate(fd, segment_size()) != 0
+            || ::mkfifo(doorbell_name(0).c_str(), 0600) != 0
+            || ::mkfifo(doorbell_name(1).c_str(), 0600) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+    }
+    else
+    {
+        struct stat status;
+        if (::fstat(fd, &status) != 0
+            || static_cast<std::size_t>(status.st_size) < segment_size())
+        {
+            ::close(fd);
+            return false;
+        }
+    }
+
+    memory = ::mmap(nullptr, segment_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+    {
+        return false;
+    }
+
+    shared = static_cast<segment*>(memory);
+    if (owner)
+    {
+        new (shared) segment;
+        shared->attached.store(0, std::memory_order_relaxed);
+        shared->closed[0].store(0, std::memory_order_relaxed);
+        shared->closed[1].store(0, std::memory_order_relaxed);
+        // The other side has until the timeout to attach
+        const auto now = clock::now().time_since_epoch().count();
+        shared->heartbeat[0].store(now, std::memory_order_relaxed);
+        shared->heartbeat[1].store(now, std::memory_order_relaxed);
+        shared_ring::initialize(&shared->rings[0]);
+        shared_ring::initialize(&shared->rings[1]);
+    }
+
+    auto data = static_cast<char*>(memory) + sizeof(segment);
+    const auto capacity = constant::shared_memory_ring_size;
+    outbound.reset(new shared_ring(&shared->rings[side],
+                                   data + side * capacity,
+                                   capacity));
+    inbound.reset(new shared_ring(&shared->rings[1 - side],
+                                  data + (1 - side) * capacity,
+                                  capacity));
+
+    // Opening a named pipe for both reading and writing never blocks, and
+    // it keeps the pipe usable regardless of which side opens it first.
+    int own = ::open(doorbell_name(side).c_str(), O_RDWR | O_NONBLOCK);
+    if (own < 0)
+    {
+        return false;
+    }
+    boost::system::error_code error;
+    doorbell.assign(own, error);
+    if (error)
+    {
+        ::close(own);
+        return false;
+    }
+
+    peer_doorbell = ::open(doorbell_name(1 - side).c_str(), O_RDWR | O_NONBLOCK);
+    return peer_doorbell >= 0;
+}
+
+inline bool local_channel::is_attached() const
+{
+    return shared && shared->attached.load(std::memory_order_acquire);
+}
+
+inline void local_channel::unlink()
+{
+    if (!linked) return;
+    linked = false;
+
+    ::shm_unlink(memory_name().c_str());
+    ::unlink(doorbell_name(0).c_str());
+    ::unlink(doorbell_name(1).c_str());
+}
+
+template <typename ConstBufferSequence>
+void local_channel::async_send(const ConstBufferSequence& buffers,
+                               handler_type handler)
+{
+    if (closed)
+    {
+        io.post([handler]() { handler(boost::asio::error::operation_aborted, 0); });
+        return;
+    }
+
+    if (boost::asio::buffer_size(buffers) > outbound->max_message_size())
+    {
+        io.post([handler]() { handler(boost::asio::error::message_size, 0); });
+        return;
+    }
+
+    send_operation operation;
+    for (const auto& buffer : buffers)
+    {
+        operation.buffers.push_back(buffer);
+    }
+    operation.handler = std::move(handler);
+    sends.push(std::move(operation));
+
+    pump();
+}
+
+template <typename MutableBufferSequence>
+void local_channel::async_receive(const MutableBufferSequence& buffers,
+                                  const time_point& deadline,
+                                  handler_type handler)
+{
+    if (closed)
+    {
+        io.post([handler]() { handler(boost::asio::error::operation_aborted, 0); });
+        return;
+    }
+
+    std::unique_ptr<receive_input_type>
+        operation(new receive_input_type(buffers, std::move(handler)));
+    operation->deadline = deadline;
+    receives.emplace_back(std::move(operation));
+
+    pump();
+}
+
+inline void local_channel::expire(const time_point& now)
+{
+    auto where = receives.begin();
+    while (where != receives.end())
+    {
+        if ((*where)->deadline <= now)
+        {
+            auto handler = std::move((*where)->handler);
+            where = receives.erase(where);
+            io.post([handler]() { handler(boost::asio::error::timed_out, 0); });
+        }
+        else
+        {
+            ++where;
+        }
+    }
+}
+
+inline local_channel::time_point local_channel::next_deadline() const
+{
+    auto result = time_point::max();
+    for (const auto& operation : receives)
+    {
+        result = std::min(result, operation->deadline);
+    }
+    return result;
+}
+
+inline void local_channel::close(const boost::system::error_code& error)
+{
+    if (closed) return;
+    closed = true;
+
+    shared->closed[side].store(1, std::memory_order_release);
+    ring_doorbell();
+
+    heartbeat_timer.stop();
+    boost::system::error_code ignored;
+    doorbell.cancel(ignored);
+
+    fail_all(error);
+}
+
+inline void local_channel::beat()
+{
+    const auto now = clock::now().time_since_epoch().count();
+    shared->heartbeat[side].store(now, std::memory_order_relaxed);
+
+    const auto peer = shared->heartbeat[1 - side].load(std::memory_order_relaxed);
+    if (clock::duration(now - peer) > timeout)
+    {
+        // The other side went away without closing, so close on its behalf.
+        shared->closed[1 - side].store(1, std::memory_order_release);
+        pump();
+        return;
+    }
+
+    // Several heartbeats fit into the timeout, so a late one is no reason
+    // to give up on the other side.
+    heartbeat_timer.set_period(timeout / 4);
+    heartbeat_timer.start();
+}
+
+inline void local_channel::pump()
+{
+    if (closed) return;
+
+    for (;;)
+    {
+        // Anything the other side sent before closing is still delivered.
+        const bool peer_closed = shared->closed[1 - side].load(std::memory_order_acquire);
+
+        while (transfer()) {}
+
+        if (closed)
+        {
+            // The other side has broken the ring
+            return;
+        }
+
+        if (peer_closed)
+        {
+            fail_all(boost::asio::error::connection_reset);
+            return;
+        }
+
+        if (receives.empty() && sends.empty())
+        {
+            return;
+        }
+
+        // Announce that we are about to wait, and check again in case the
+        // other side made progress before it could see the announcement.
+        if (!receives.empty()) inbound->wait_for_data();
+        if (!sends.empty()) outbound->wait_for_space();
+
+        if (!transfer()) break;
+    }
+
+    if (!closed)
+    {
+        wait_for_doorbell();
+    }
+}
+
+inline bool local_channel::transfer()
+{
+    bool received = false;
+    while (!receives.empty())
+    {
+        std::size_t size = 0;
+        boost::system::error_code error;
+        if (!inbound->pop(receives.front()->buffers, size, error))
+        {
+            if (error)
+            {
+                close(error);
+                return false;
+            }
+            break;
+        }
+        auto handler = std::move(receives.front()->handler);
+        receives.pop_front();
+        // Truncated messages complete with message_size
+        io.post([handler, error, size]() { handler(error, size); });
+        received = true;
+    }
+    if (received && inbound->producer_needs_wakeup())
+    {
+        ring_doorbell();
+    }
+
+    bool sent = false;
+    while (!sends.empty())
+    {
+        auto& operation = sends.front();
+        if (!outbound->push(operation.buffers))
+        {
+            break;
+        }
+        auto handler = std::move(operation.handler);
+        auto size = boost::asio::buffer_size(operation.buffers);
+        sends.pop();
+        io.post([handler, size]() { handler(boost::system::error_code(), size); });
+        sent = true;
+    }
+    if (sent && outbound->consumer_needs_wakeup())
+    {
+        ring_doorbell();
+    }
+
+    return received || sent;
+}
+
+inline void local_channel::wait_for_doorbell()
+{
+    if (waiting) return;
+    waiting = true;
+
+    auto self = shared_from_this();
+    doorbell.async_read_some
+        (boost::asio::buffer(doorbell_buffer),
+         [self](const boost::system::error_code&, std::size_t)
+         {
+             self->waiting = false;
+             self->pump();
+         });
+}
+
+inline void local_channel::ring_doorbell()
+{
+    // A full pipe already holds a pending wakeup, so errors are ignored.
+    const char signal = 0;
+    auto result = ::write(peer_doorbell, &signal, sizeof(signal));
+    static_cast<void>(result);
+}
+
+inline void local_channel::fail_all(const boost::system::error_code& error)
+{
+    while (!receives.empty())
+    {
+        auto handler = std::move(receives.front()->handler);
+        receives.pop_front();
+        io.post([handler, error]() { handler(error, 0); });
+    }
+    while (!sends.empty())
+    {
+        auto handler = std::move(sends.front().handler);
+        sends.pop();
+        io.post([handler, error]() { handler(error, 0); });
+    }
+}
+
+#else // defined(MAIDSAFE_CRUX_HAS_LOCAL_CHANNEL)
+
+// Shared memory is not supported on this platform, so channels are never
+// negotiated.
+
+inline local_channel::local_channel(boost::asio::io_service&,
+                                    const std::string&,
+                                    bool,
+                                    const duration_type&)
+{
+}
+
+inline std::shared_ptr<local_channel>
+local_channel::create(boost::asio::io_service&, const std::string&, const duration_type&)
+{
+    return nullptr;
+}
+
+inline std::shared_ptr<local_channel>
+local_channel::attach(boost::asio::io_service&, const std::string&, const duration_type&)
+{
+    return nullptr;
+}
+
+inline local_channel::~local_channel() {}
+inline bool local_channel::is_attached() const { return false; }
+inline void local_channel::unlink() {}
+inline void local_channel::close(const boost::system::error_code&) {}
+
+template <typename ConstBufferSequence>
+void local_channel::async_send(const ConstBufferSequence&, handler_type)
+{
+    assert(false);
+}
+
+template <typename MutableBufferSequence>
+void local_channel::async_receive(const MutableBufferSequence&,
+                                  const time_point&,
+                                  handler_type)
+{
+    assert(false);
+}
+
+inline void local_channel::expire(const time_point&) {}
+
+inline local_channel::time_point local_channel::next_deadline() const
+{
+    return time_point::max();
+}
+
+#endif // defined(MAIDSAFE_CRUX_HAS_LOCAL_CHANNEL)
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_LOCAL_CHANNEL_HPP
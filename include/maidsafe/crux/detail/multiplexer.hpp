@@ -12,21 +12,34 @@
 #define MAIDSAFE_CRUX_DETAIL_MULTIPLEXER_HPP
 
 #include <atomic>
+#include <limits>
 #include <memory>
 #include <functional>
 #include <queue>
 #include <map>
+#include <set>
 #include <list>
 #include <queue>
 #include <tuple>
+#include <vector>
 
 #include <boost/optional.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/udp.hpp>
 
+#include <maidsafe/crux/admission.hpp>
 #include <maidsafe/crux/detail/buffer.hpp>
+#include <maidsafe/crux/detail/buffer_pool.hpp>
+#include <maidsafe/crux/detail/capture.hpp>
+#include <maidsafe/crux/detail/clock.hpp>
+#include <maidsafe/crux/detail/compact_header.hpp>
+#include <maidsafe/crux/detail/compression.hpp>
+#include <maidsafe/crux/detail/config.hpp>
+#include <maidsafe/crux/detail/constants.hpp>
+#include <maidsafe/crux/detail/gather_buffers.hpp>
 #include <maidsafe/crux/detail/header.hpp>
+#include <maidsafe/crux/detail/header_view.hpp>
 #include <maidsafe/crux/detail/socket_base.hpp>
 
 namespace maidsafe
@@ -39,8 +52,6 @@ class acceptor;
 namespace detail
 {
 
-class decoder;
-
 // FIXME: Thread-safety (strand?)
 
 class multiplexer : public std::enable_shared_from_this<multiplexer>
@@ -49,12 +60,33 @@ class multiplexer : public std::enable_shared_from_this<multiplexer>
 
 public:
     using protocol_type = boost::asio::ip::udp;
+#if defined(MAIDSAFE_CRUX_SIMULATION)
+    using next_layer_type = simulation::datagram_socket;
+#else
     using next_layer_type = protocol_type::socket;
+#endif
     using endpoint_type = protocol_type::endpoint;
     using buffer_type = detail::buffer;
     using sequence_type = socket_base::sequence_type;
     using ack_sequence_type = socket_base::ack_sequence_type;
 
+    // A data packet whose header is encoded once. Each transmission patches
+    // the retransmission count and ack into the full header, and gathers the
+    // header as sent, the payload and the checksum into one datagram. The
+    // payload is not copied: it refers to the buffers of the caller, which
+    // stay valid until the message is acknowledged, or to the compressed or
+    // flattened message, which the template holds on to.
+    struct data_template
+    {
+        header::data_type header;
+        std::uint16_t options;
+        gather_buffers<constant::max_gather_buffers - 2> payload;
+        std::shared_ptr<buffer_type> storage;
+        // The header as sent followed by the checksum trailer
+        std::array<std::uint8_t,
+                   header::compact::max_size + header::constant::checksum_size> wire;
+    };
+
     template <typename... Types>
     static std::shared_ptr<multiplexer> create(Types&&...);
 
@@ -63,6 +95,17 @@ public:
     void add(socket_base *);
     void remove(socket_base *);
 
+    // Receive on behalf of an added socket until it is removed, regardless
+    // of its own receive calls. Used for sockets that may be reached over
+    // several paths, and which therefore cannot tell which multiplexer the
+    // next packet arrives on.
+    void keep_receiving(socket_base *);
+
+    // Claim a connection identifier for the socket. Returns false if the
+    // identifier is zero or already in use on this local endpoint.
+    bool add_connection_id(std::uint16_t, socket_base *);
+    void remove_connection_id(std::uint16_t, socket_base *);
+
     template <typename AcceptorType,
               typename SocketType,
               typename AcceptHandler>
@@ -70,13 +113,33 @@ public:
                       SocketType&,
                       AcceptHandler&& handler);
 
-    template <typename ConstBufferSequence,
-              typename WriteHandler>
-    void send_data(ConstBufferSequence&& buffers,
+    // Accept connections until disabled, creating a new socket for each
+    // handshake from an unknown remote endpoint.
+    template <typename AcceptorType,
+              typename SocketFactory,
+              typename AcceptHandler>
+    void async_accept_each(AcceptorType&,
+                           SocketFactory&& factory,
+                           AcceptHandler&& handler);
+
+    // The options and payload of the template are left for the caller to
+    // fill in. Templates are reused once released.
+    std::shared_ptr<data_template> make_data_template(sequence_type sequence,
+                                                      std::uint16_t connection_id);
+
+    // Refer the payload of the template to the buffers, or to a copy of
+    // them from the pool if there are too many to gather.
+    template <typename ConstBufferSequence>
+    void set_payload(data_template&, const ConstBufferSequence&);
+
+    template <typename WriteHandler>
+    void send_data(const std::shared_ptr<data_template>& packet,
                    const endpoint_type& endpoint,
-                   sequence_type sequence,
                    boost::optional<ack_sequence_type> ack,
                    std::uint16_t retransmission_count,
+                   std::size_t compact,
+                   bool checksum,
+                   std::shared_ptr<aead> cipher,
                    WriteHandler&& handler);
 
     template <typename ConnectHandler>
@@ -84,6 +147,8 @@ public:
                         sequence_type initial,
                         boost::optional<ack_sequence_type> ack,
                         std::size_t retransmission_count,
+                        std::uint16_t options,
+                        const buffer_type& payload,
                         ConnectHandler&& handler);
 
     template <typename ConnectHandler>
@@ -91,8 +156,15 @@ public:
                         sequence_type sequence,
                         boost::optional<ack_sequence_type> ack,
                         std::size_t retransmission_count,
+                        std::uint16_t connection_id,
+                        std::size_t compact,
+                        bool checksum,
+                        std::shared_ptr<aead> cipher,
                         ConnectHandler&& handler);
 
+    // Tell the peer of an established socket that it is closing
+    void send_shutdown(socket_base&);
+
     void start_receive();
     void stop_receive();
 
@@ -101,7 +173,39 @@ public:
 
     void disable_accept_requests_from(acceptor&);
 
+    // Admission control for connections on this local endpoint
+    void max_connections(std::size_t);
+    std::size_t max_connections() const;
+    void admission(admission_policy);
+    admission_policy admission() const;
+    const admission_statistics& statistics() const;
+
+    // Backing of the datagram buffers. Buffers in use keep their memory.
+    void buffer_memory(const arena::options&);
+    const buffer_pool& buffers() const;
+
+    // Record every datagram sent and received on this local endpoint, or
+    // stop recording if empty
+    void capture(std::shared_ptr<capture_writer>);
+
+    std::size_t connections() const;
+
 private:
+    // The full header, which the trailers are computed over, and the header
+    // as sent followed by room for the checksum trailer
+    struct frame_type
+    {
+        header::data_type header;
+        std::array<std::uint8_t,
+                   header::compact::max_size + header::constant::checksum_size> wire;
+        std::size_t size;
+    };
+
+    // Compact unless compact is zero or the header cannot be compacted
+    template <typename Header>
+    static void make_frame(frame_type&, const Header&, std::size_t compact);
+    static void finish_frame(frame_type&, std::size_t compact);
+
     multiplexer(next_layer_type&& udp_socket);
 
     void do_start_receive();
@@ -109,12 +213,72 @@ private:
     void process_peek(boost::system::error_code, endpoint_type);
 
     void establish_connection(std::size_t, endpoint_type);
-
-    void process_handshake(socket_base&, endpoint_type, std::uint16_t, detail::decoder&);
-    void process_keepalive(socket_base&, std::uint16_t, detail::decoder&);
+    void spawn_connection(const header::data_type&,
+                          endpoint_type,
+                          std::shared_ptr<buffer_type>);
+    bool migrate_connection(const header::data_type&,
+                            endpoint_type,
+                            std::shared_ptr<buffer_type>);
+    // Sends everything for the connected socket to the remote endpoint from
+    // now on. Returns whether the socket is received for persistently.
+    bool move_socket(socket_base&, const endpoint_type&);
+
+    // Takes the header off the front of a datagram that has been received
+    // in one piece, and restores it if it is compact. The socket is found by
+    // the connection identifier of a compact header if null. False if the
+    // header is malformed.
+    bool take_header(socket_base *, buffer_type& datagram, header::data_type&);
+
+    // Checks and removes the trailers of a packet for the socket, as far
+    // as the socket has agreed on them. False if the packet is damaged or
+    // forged.
+    bool unwrap(socket_base&, const header::data_type&, buffer_type& payload);
+    bool verify_checksum(const header::data_type&, buffer_type& payload);
+
+    // Decompresses a compressed data packet straight into the receive
+    // buffers if they are a single buffer that is large enough, and into
+    // a new payload otherwise. False if the packet is malformed.
+    bool expand(socket_base&,
+                const header::data_type&,
+                std::vector<boost::asio::mutable_buffer> *recv_buffers,
+                std::shared_ptr<buffer_type>& payload,
+                std::size_t& payload_size);
+
+    // Sends a keepalive or data packet of an encrypted connection, which
+    // is copied into a buffer from the pool to be encrypted in place.
+    template <typename ConstBufferSequence,
+              typename WriteHandler>
+    void send_sealed(const frame_type& frame,
+                     const ConstBufferSequence& buffers,
+                     const endpoint_type& endpoint,
+                     bool checksum,
+                     aead& cipher,
+                     WriteHandler&& handler);
+
+    // Sends on the UDP socket, and records the datagram if capturing
+    template <typename ConstBufferSequence,
+              typename WriteHandler>
+    void send_datagram(const ConstBufferSequence& buffers,
+                       const endpoint_type& endpoint,
+                       WriteHandler&& handler);
+    // Records the datagram that is next in line on the UDP socket
+    void record_received(std::size_t datagram_size, const endpoint_type&);
+
+    void dispatch(socket_base&,
+                  const header::view&,
+                  endpoint_type,
+                  const boost::system::error_code&,
+                  std::size_t,
+                  std::shared_ptr<buffer_type>);
+
+    void process_handshake(socket_base&,
+                           endpoint_type,
+                           const header::view&,
+                           std::shared_ptr<buffer_type>);
+    void process_keepalive(socket_base&, const header::view&);
+    void process_shutdown(socket_base&, const header::view&);
     void process_data(socket_base&,
-                      std::uint16_t,
-                      detail::decoder&,
+                      const header::view&,
                       const boost::system::error_code&,
                       std::size_t,
                       std::shared_ptr<buffer_type>);
@@ -129,15 +293,74 @@ private:
 
     endpoint_type local_loopback_endpoint() const;
 
+    std::size_t acceptors() const;
+
     void discard_message();
 
+    bool admit(const endpoint_type&, const header::view&);
+    bool evict_idle_socket();
+    // Sent on behalf of the socket, if any, with its trailers
+    void send_shutdown(const endpoint_type&,
+                       boost::optional<ack_sequence_type>,
+                       socket_base * = nullptr);
+    // Sends a keepalive challenge or response of the socket
+    void send_challenge(socket_base&,
+                        const endpoint_type&,
+                        std::uint16_t options,
+                        std::uint32_t nonce);
+
 private:
     next_layer_type udp_socket;
-
-    using socket_map = std::map<endpoint_type, socket_base *>;
+    std::shared_ptr<buffer_pool> pool;
+    // Data templates go back here once the last reference to them is gone,
+    // so that messages do not cost an allocation each. Templates may
+    // outlive the multiplexer.
+    using template_list = std::vector<std::unique_ptr<data_template>>;
+    std::shared_ptr<template_list> unused_templates;
+    std::shared_ptr<capture_writer> recorder;
+    // Our side of the recorded datagrams
+    endpoint_type recorder_endpoint;
+
+    // Sockets ordered from the most recently to the least recently active.
+    using activity_list = std::list<socket_base *>;
+    activity_list activity;
+
+    struct socket_entry
+    {
+        socket_base *socket;
+        activity_list::iterator activity;
+        bool persistent;
+    };
+    using socket_map = std::map<endpoint_type, socket_entry>;
     socket_map sockets;
 
+    // Sockets by the connection identifier that peers put in their packets,
+    // used to follow a peer whose endpoint has changed.
+    using connection_id_map = std::map<std::uint16_t, socket_base *>;
+    connection_id_map connection_ids;
+
+    // Anyone can put a connection identifier into a packet, so unencrypted
+    // connections only follow their peer to endpoints that it has shown to
+    // receive at by echoing a nonce.
+    struct validation_type
+    {
+        std::set<endpoint_type> endpoints;
+        // The endpoint that was challenged last
+        endpoint_type challenged;
+        std::uint32_t nonce;
+    };
+    std::map<socket_base *, validation_type> validations;
+
+    std::size_t connection_limit;
+    admission_policy policy;
+    admission_statistics admission_stats;
+
     std::atomic<std::size_t> receive_calls;
+    // Whether a receive operation is outstanding on the UDP socket. The
+    // empty packet sent by stop_receive() may still be in flight when the
+    // next start_receive() comes along, in which case we must not issue a
+    // second concurrent receive.
+    bool receiving;
 
     // FIXME: Move to acceptor class
     // FIXME: Bounded queue with pending accept requests? (like listen() backlog)
@@ -145,6 +368,10 @@ private:
     using accept_input_type = std::tuple<acceptor*, socket_base *, accept_handler_type>;
     std::list<std::unique_ptr<accept_input_type>> acceptor_queue;
 
+    using socket_factory_type = std::function<socket_base *()>;
+    using accept_factory_type = std::tuple<acceptor*, socket_factory_type, accept_handler_type>;
+    std::list<std::unique_ptr<accept_factory_type>> acceptor_factories;
+
     endpoint_type next_remote_endpoint;
 };
 
@@ -158,8 +385,10 @@ private:
 #include <boost/asio/buffer.hpp>
 #include <maidsafe/crux/detail/socket_base.hpp>
 #include <maidsafe/crux/detail/concatenate.hpp>
+#include <maidsafe/crux/detail/crc32c.hpp>
+#include <maidsafe/crux/detail/crypto.hpp>
 #include <maidsafe/crux/detail/encoder.hpp>
-#include <maidsafe/crux/detail/decoder.hpp>
+#include <maidsafe/crux/detail/service.hpp>
 
 namespace maidsafe
 {
@@ -175,39 +404,6 @@ std::shared_ptr<multiplexer> multiplexer::create(Types&&... args)
     return self;
 }
 
-inline multiplexer::multiplexer(next_layer_type&& udp_socket)
-    : udp_socket(std::move(udp_socket))
-    , receive_calls(0)
-{
-}
-
-inline multiplexer::~multiplexer()
-{
-    assert(sockets.empty());
-    assert(acceptor_queue.empty());
-    assert(receive_calls == 0);
-
-    // FIXME: Clean up
-}
-
-inline void multiplexer::add(socket_base *socket)
-{
-    assert(socket);
-
-    sockets.insert(socket_map::value_type(socket->remote_endpoint(), socket));
-}
-
-inline void multiplexer::remove(socket_base *socket)
-{
-    assert(socket);
-
-    sockets.erase(socket->remote_endpoint());
-
-    if (sockets.empty()) {
-        next_layer().close();
-    }
-}
-
 template <typename AcceptorType,
           typename SocketType,
           typename AcceptHandler>
@@ -223,25 +419,20 @@ void multiplexer::async_accept(AcceptorType& acceptor,
     start_receive();
 }
 
-inline
-void multiplexer::disable_accept_requests_from(acceptor& accept) {
-    auto i = acceptor_queue.begin();
+template <typename AcceptorType,
+          typename SocketFactory,
+          typename AcceptHandler>
+void multiplexer::async_accept_each(AcceptorType& acceptor,
+                                    SocketFactory&& factory,
+                                    AcceptHandler&& handler)
+{
+    std::unique_ptr<accept_factory_type> operation
+        (new accept_factory_type(&acceptor,
+                                 std::forward<SocketFactory>(factory),
+                                 std::forward<AcceptHandler>(handler)));
+    acceptor_factories.emplace_back(std::move(operation));
 
-    while (i != acceptor_queue.end()) {
-        if (std::get<0>(**i) == &accept) {
-            auto socket  = std::get<1>(**i);
-            auto handler = std::move(std::get<2>(**i));
-            get_io_service().post([handler]() {
-                    handler(boost::asio::error::operation_aborted);
-                    });
-            stop_receive();
-            socket->close();
-            acceptor_queue.erase(i++);
-        }
-        else {
-            ++i;
-        }
-    }
+    start_receive();
 }
 
 template <typename AcceptHandler>
@@ -256,17 +447,21 @@ void multiplexer::send_handshake(const endpoint_type& remote_endpoint,
                                  sequence_type initial,
                                  boost::optional<ack_sequence_type> ack,
                                  std::size_t retransmission_count,
+                                 std::uint16_t options,
+                                 const buffer_type& payload,
                                  ConnectHandler&& handler)
 {
-    auto header = std::make_shared<header::data_type>();
-    detail::encoder encoder(header->data(), header->size());
-    header::handshake(retransmission_count, initial, ack).encode(encoder);
-    next_layer().async_send_to
-        (boost::asio::buffer(*header),
+    auto datagram = pool->acquire(header_size + payload.size());
+    detail::encoder encoder(datagram->data(), datagram->data() + datagram->size());
+    header::handshake(retransmission_count, initial, ack, options).encode(encoder);
+    std::copy(payload.begin(), payload.end(), datagram->begin() + header_size);
+
+    send_datagram
+        (boost::asio::buffer(*datagram),
          remote_endpoint,
-         [handler, header] (boost::system::error_code error, std::size_t length) mutable
+         [handler, datagram] (boost::system::error_code error, std::size_t length) mutable
          {
-             assert(length == header->size());
+             assert(error || length == datagram->size());
              static_cast<void>(length);
              handler(error);
          });
@@ -277,365 +472,210 @@ void multiplexer::send_keepalive(const endpoint_type& remote_endpoint,
                                  sequence_type sequence,
                                  boost::optional<ack_sequence_type> ack,
                                  std::size_t retransmission_count,
+                                 std::uint16_t connection_id,
+                                 std::size_t compact,
+                                 bool checksum,
+                                 std::shared_ptr<aead> cipher,
                                  ConnectHandler&& handler)
 {
-    auto header = std::make_shared<header::data_type>();
-    detail::encoder encoder(header->data(), header->size());
-    header::keepalive(retransmission_count, sequence, ack).encode(encoder);
-
-    next_layer().async_send_to
-        (boost::asio::buffer(*header),
-         remote_endpoint,
-         [handler, header] (boost::system::error_code error, std::size_t length) mutable
-         {
-             assert(length == header->size());
-             static_cast<void>(length);
-             handler(error);
-         });
-}
-
-template <typename ConstBufferSequence,
-          typename WriteHandler>
-void multiplexer::send_data(ConstBufferSequence&& buffers,
-                            const endpoint_type& endpoint,
-                            sequence_type sequence,
-                            boost::optional<ack_sequence_type> ack,
-                            std::uint16_t retransmission_count,
-                            WriteHandler&& handler)
-{
-    auto header = std::make_shared<header::data_type>();
-    detail::encoder encoder(header->data(), header->size());
-    header::data(retransmission_count, sequence, ack).encode(encoder);
+    auto frame = std::make_shared<frame_type>();
+    make_frame(*frame,
+               header::keepalive(retransmission_count, sequence, ack, connection_id),
+               compact);
 
-    next_layer().async_send_to
-        (concatenate(boost::asio::buffer(*header),
-                     std::forward<ConstBufferSequence>(buffers)),
-         endpoint,
-         [handler, header](const boost::system::error_code& error, std::size_t size) mutable
-         {
-             const auto bytes_transferred = (size >= header_size) ? size - header_size : 0;
-             handler(error, bytes_transferred);
-        });
-}
-
-inline multiplexer::endpoint_type multiplexer::local_loopback_endpoint() const {
-    namespace ip = boost::asio::ip;
-    auto local = next_layer().local_endpoint();
-
-    if (local.address().is_v4()) {
-        return endpoint_type(ip::address_v4::loopback(), local.port());
-    }
-    else {
-        return endpoint_type(ip::address_v6::loopback(), local.port());
-    }
-}
-
-inline void multiplexer::start_receive()
-{
-    // Each socket and acceptor may invoke only one receive call at a time.
-    // Since both, a socket and an acceptor may invoke this function
-    // from inside a handler, and since the 'receive_calls' counter gets
-    // decreased only after handlers are executed we need to allow an
-    // error by 2.
-    assert(receive_calls < sockets.size() + acceptor_queue.size() + 2U);
-
-    if (receive_calls++ == 0)
+    if (cipher)
     {
-        do_start_receive();
+        send_sealed(*frame,
+                    std::vector<boost::asio::const_buffer>(),
+                    remote_endpoint,
+                    checksum,
+                    *cipher,
+                    [handler] (boost::system::error_code error, std::size_t) mutable
+                    {
+                        handler(error);
+                    });
+        return;
     }
-}
 
-inline void multiplexer::stop_receive()
-{
-    // Each socket may invoke only one receive call at a time.
-    assert(receive_calls > 0);
-    assert(receive_calls <= sockets.size() + acceptor_queue.size() + 1U);
-
-    if (--receive_calls == 0)
+    std::size_t size = frame->size;
+    if (checksum)
     {
-        // The fact that we're here means that the last socket that
-        // was receiving just got closed. To prevent the io_service
-        // from blocking, we fulfill the last receive request by
-        // sending ourself an empty packet.
-        auto self = shared_from_this();
-        next_layer().async_send_to
-            ( boost::asio::buffer(static_cast<char*>(nullptr), 0)
-            , local_loopback_endpoint()
-            , [self](boost::system::error_code, std::size_t) {});
+        crc32c crc;
+        crc.update(frame->header.data(), header_size);
+        detail::encoder encoder(frame->wire.data() + size, header::constant::checksum_size);
+        encoder.put<std::uint32_t>(crc.value());
+        size += header::constant::checksum_size;
     }
-}
 
-inline void multiplexer::do_start_receive()
-{
-    auto self(shared_from_this());
-
-    // We need to read with at least one zero sized buffer to
-    // get the remote_endpoint information.
-    next_layer().async_receive_from
-        (boost::asio::buffer(static_cast<char*>(nullptr), 0),
-         next_remote_endpoint,
-         std::remove_reference<decltype(next_layer())>::type::message_peek,
-         [self]
-         (boost::system::error_code error, std::size_t /*size*/) mutable
+    send_datagram
+        (boost::asio::buffer(frame->wire, size),
+         remote_endpoint,
+         [handler, frame, size] (boost::system::error_code error, std::size_t length) mutable
          {
-            // The size parameter is useless here because what we get
-            // is min(buffer_size, datagram_size) and our buffer size is 0.
-            self->process_peek(error, self->next_remote_endpoint);
+             assert(length == size);
+             static_cast<void>(length);
+             handler(error);
          });
 }
 
-inline void multiplexer::discard_message() {
-    boost::system::error_code error;
-    endpoint_type remote_endpoint;
-    next_layer().receive_from
-        ( boost::asio::buffer(static_cast<char*>(nullptr), 0)
-        , remote_endpoint, next_layer_type::message_flags(), error );
-}
-
-inline
-void multiplexer::process_peek(boost::system::error_code error,
-                               endpoint_type remote_endpoint)
+template <typename ConstBufferSequence>
+void multiplexer::set_payload(data_template& packet,
+                              const ConstBufferSequence& buffers)
 {
-    namespace asio = boost::asio;
-
-    if (!next_layer().is_open()) return;
-
-    if (receive_calls == 0) {
-        // We've received our own empty message to fullfill the last receive
-        // request or we've received someone's else's message while doing so.
-        discard_message();
-        return;
-    }
-
-    assert(receive_calls <= sockets.size() + acceptor_queue.size() + 1U);
-
-    switch (error.value())
+    if (packet.payload.append(buffers))
     {
-    case 0:
-        // Continue below
-        break;
-#if defined(BOOST_ASIO_WINDOWS)
-    case ERROR_MORE_DATA:
-        // Continue below
-        break;
-#endif // defined(BOOST_ASIO_WINDOWS)
-
-    case boost::asio::error::operation_aborted:
-        discard_message();
-        --receive_calls;
-        return;
-
-    default:
-        // Since we're here a socket must have been receiving
-        // and its receive request must be fulfilled, so we
-        // must start receiving again.
-        discard_message();
-        do_start_receive();
         return;
     }
 
-    auto recipient = sockets.find(remote_endpoint);
-
-    next_layer_type::bytes_readable command(true);
-    next_layer().io_control(command);
-    std::size_t datagram_size = command.get();
-
-    if (datagram_size < header_size) {
-        // Our empty packet, corrupted packet or someone is being silly.
-        discard_message();
-        do_start_receive();
-        return;
-    }
-
-    header::data_type header_data;
-    std::size_t payload_size = datagram_size - header_size;
-
-    // FIXME: gather-read (header, body)
-    // FIXME: Make socket.receive_from commands async.
-    if (recipient == sockets.end())
-    {
-        establish_connection(payload_size, remote_endpoint);
-    }
-    else
-    {
-        auto& crux_socket  = *(*recipient).second;
-        auto* recv_buffers = crux_socket.get_recv_buffers();
-
-        std::shared_ptr<buffer_type> payload;
-
-        if (recv_buffers) {
-            next_layer().receive_from
-                ( concatenate( asio::buffer(header_data)
-                               , std::move(*recv_buffers))
-                  , remote_endpoint
-                  , next_layer_type::message_flags()
-                  , error );
-        }
-        else {
-            payload = std::make_shared<buffer_type>(payload_size);
-
-            next_layer().receive_from
-                ( concatenate( asio::buffer(header_data)
-                               , asio::buffer(*payload))
-                  , remote_endpoint
-                  , next_layer_type::message_flags()
-                  , error );
-        }
-
-        detail::decoder decoder(header_data.data(), header_data.data() + header_data.size());
-        auto type = decoder.get<std::uint16_t>();
-        switch (type & header::constant::mask_type)
-        {
-        case header::constant::type_handshake:
-            process_handshake(crux_socket, remote_endpoint, type, decoder);
-            break;
-
-        case header::constant::type_keepalive:
-            process_keepalive(crux_socket, type, decoder);
-            break;
-
-        case header::constant::type_data:
-            process_data(crux_socket, type, decoder, error, payload_size, payload);
-            break;
-
-        default:
-            assert(false);
-            break;
-        }
-    }
-
-    if (--receive_calls > 0) {
-        do_start_receive();
-    }
+    packet.storage = pool->acquire(boost::asio::buffer_size(buffers));
+    boost::asio::buffer_copy(boost::asio::buffer(*packet.storage), buffers);
+    packet.payload.push_back(boost::asio::buffer(*packet.storage));
 }
 
-inline
-void multiplexer::establish_connection(std::size_t payload_size,
-                                       endpoint_type remote_endpoint)
+template <typename WriteHandler>
+void multiplexer::send_data(const std::shared_ptr<data_template>& packet,
+                            const endpoint_type& endpoint,
+                            boost::optional<ack_sequence_type> ack,
+                            std::uint16_t retransmission_count,
+                            std::size_t compact,
+                            bool checksum,
+                            std::shared_ptr<aead> cipher,
+                            WriteHandler&& handler)
 {
-    header::data_type header_data;
-    auto payload = std::make_shared<buffer_type>(payload_size);
-
-    boost::system::error_code error;
-    auto size = next_layer().receive_from(concatenate(boost::asio::buffer(header_data),
-                                                      boost::asio::buffer(*payload)),
-                                          remote_endpoint,
-                                          next_layer_type::message_flags(),
-                                          error);
-    if (error)
-    {
-        // Ignore errors on new connections
-        return;
-    }
-    if (size < header_data.size())
-    {
-        // Ignore datagrams with incomplete header
-        return;
-    }
+    namespace asio = boost::asio;
 
-    if (acceptor_queue.empty())
+    // Patch the fields that change from one transmission to the next
+    auto& full = packet->header;
+    const std::uint16_t type = header::constant::type_data
+        | packet->options
+        | std::min<std::uint16_t>(3, retransmission_count)
+        | (ack ? header::constant::ack_type_cumulative : header::constant::ack_type_none);
+    detail::encoder type_encoder(full.data() + header::view::offset_type, sizeof(type));
+    type_encoder.put<std::uint16_t>(type);
+    detail::encoder ack_encoder(full.data() + header::view::offset_ack, sizeof(std::uint32_t));
+    ack_encoder.put<std::uint32_t>(ack ? ack->value() : 0);
+
+    frame_type frame;
+    frame.header = full;
+    finish_frame(frame, compact);
+
+    if (cipher)
     {
-        // Ignore handshakes that we did not expect.
-        // FIXME: Should we enqueue the most recent requests?
+        // Sealed into a buffer of its own, because every transmission
+        // needs a new packet counter.
+        send_sealed(frame,
+                    packet->payload,
+                    endpoint,
+                    checksum,
+                    *cipher,
+                    std::forward<WriteHandler>(handler));
         return;
     }
 
-    auto& input = acceptor_queue.front();
-    auto socket = std::get<1>(*input);
+    auto& wire = packet->wire;
+    std::copy(frame.wire.begin(), frame.wire.begin() + frame.size, wire.begin());
 
-    detail::decoder decoder(header_data.data(), header_data.data() + header_data.size());
-    auto type = decoder.get<std::uint16_t>();
-    switch (type & header::constant::mask_type)
+    std::size_t trailer_size = 0;
+    if (checksum)
     {
-    case header::constant::type_handshake:
-        process_handshake(*socket, remote_endpoint, type, decoder);
-        break;
-
-    case header::constant::type_keepalive:
-        // FIXME: Detect denial-of-service attacks
-        process_keepalive(*socket, type, decoder);
-        break;
-
-    default:
-        // Other packets from unknown remote endpoints may arrive because:
-        //   1) The initial handshake was lost in transmission. The handshake
-        //      will be retransmitted later, and so will any packet we ignore.
-        //   2) Denial-of-service attack, which we will ignore.
-        return;
+        crc32c crc;
+        crc.update(full.data(), header_size);
+        crc.update(packet->payload);
+        detail::encoder encoder(wire.data() + frame.size, header::constant::checksum_size);
+        encoder.put<std::uint32_t>(crc.value());
+        trailer_size = header::constant::checksum_size;
     }
 
-    if (socket->state() == socket_base::connectivity::established)
-    {
-        boost::system::error_code success;
-        auto input = std::move(acceptor_queue.front());
-        acceptor_queue.pop_front();
-        process_accept(success,
-                       std::get<2>(*input));
-        --receive_calls;
-    }
-    else {
-        ++receive_calls;
-    }
+    // The template leaves two buffers for the header and the trailer
+    gather_buffers<constant::max_gather_buffers> datagram;
+    datagram.push_back(asio::buffer(wire.data(), frame.size));
+    datagram.append(packet->payload);
+    datagram.push_back(asio::buffer(wire.data() + frame.size, trailer_size));
+
+    const auto overhead = frame.size + trailer_size;
+    send_datagram
+        (datagram,
+         endpoint,
+         [handler, packet, overhead](const boost::system::error_code& error, std::size_t size) mutable
+         {
+             handler(error, (size >= overhead) ? size - overhead : 0);
+         });
 }
 
-inline
-void multiplexer::process_handshake(socket_base& socket,
-                                    endpoint_type remote_endpoint,
-                                    std::uint16_t type,
-                                    detail::decoder& decoder)
+template <typename ConstBufferSequence,
+          typename WriteHandler>
+void multiplexer::send_sealed(const frame_type& frame,
+                              const ConstBufferSequence& buffers,
+                              const endpoint_type& endpoint,
+                              bool checksum,
+                              aead& cipher,
+                              WriteHandler&& handler)
 {
-    header::handshake msg(type, decoder);
-    socket.process_handshake(msg.initial_sequence_number, remote_endpoint);
+#if defined(MAIDSAFE_CRUX_USE_OPENSSL)
+    namespace asio = boost::asio;
 
-    if (msg.ack)
-    {
-        socket.process_acknowledgement(*msg.ack);
-    }
-}
+    const auto payload_size = asio::buffer_size(buffers);
+    const auto checksum_size = checksum ? header::constant::checksum_size : 0;
 
-inline
-void multiplexer::process_keepalive(socket_base& socket,
-                                    std::uint16_t type,
-                                    detail::decoder& decoder)
-{
-    header::keepalive msg(type, decoder);
-    socket.process_keepalive(msg.sequence_number);
+    auto datagram = pool->acquire(frame.size + payload_size + aead::overhead + checksum_size);
+    auto data = reinterpret_cast<std::uint8_t *>(datagram->data());
+
+    std::copy(frame.wire.begin(), frame.wire.begin() + frame.size, data);
+    asio::buffer_copy(asio::buffer(data + frame.size, payload_size), buffers);
+    cipher.seal(frame.header.data(), header_size, data + frame.size, payload_size);
 
-    if (msg.ack)
+    if (checksum)
     {
-        socket.process_acknowledgement(*msg.ack);
+        const auto size = datagram->size() - checksum_size;
+        crc32c crc;
+        crc.update(frame.header.data(), header_size);
+        crc.update(data + frame.size, size - frame.size);
+        detail::encoder encoder(data + size, checksum_size);
+        encoder.put<std::uint32_t>(crc.value());
     }
+
+    send_datagram
+        (asio::buffer(*datagram),
+         endpoint,
+         [handler, datagram, payload_size](const boost::system::error_code& error, std::size_t size) mutable
+         {
+             handler(error, (size == datagram->size()) ? payload_size : 0);
+         });
+#else
+    // Encryption is never agreed on without a crypto implementation
+    assert(false);
+#endif
 }
 
-inline
-void multiplexer::process_data(socket_base& socket,
-                               std::uint16_t type,
-                               detail::decoder& decoder,
-                               const boost::system::error_code& error,
-                               std::size_t payload_size,
-                               std::shared_ptr<buffer_type> payload)
+template <typename ConstBufferSequence,
+          typename WriteHandler>
+void multiplexer::send_datagram(const ConstBufferSequence& buffers,
+                                const endpoint_type& endpoint,
+                                WriteHandler&& handler)
 {
-    header::data msg(type, decoder);
-    socket.process_data(error, payload_size, payload, msg.sequence_number);
-
-    if (msg.ack)
+    if (recorder)
     {
-        socket.process_acknowledgement(*msg.ack);
+        recorder->write(recorder_endpoint, endpoint, buffers);
     }
+    next_layer().async_send_to(buffers, endpoint, std::forward<WriteHandler>(handler));
 }
 
-inline multiplexer::next_layer_type& multiplexer::next_layer()
+template <typename Header>
+void multiplexer::make_frame(frame_type& frame,
+                             const Header& message,
+                             std::size_t compact)
 {
-    return udp_socket;
-}
-
-inline const multiplexer::next_layer_type& multiplexer::next_layer() const
-{
-    return udp_socket;
+    detail::encoder encoder(frame.header.data(), frame.header.size());
+    message.encode(encoder);
+    finish_frame(frame, compact);
 }
 
 } // namespace detail
 } // namespace crux
 } // namespace maidsafe
 
+#if defined(MAIDSAFE_CRUX_HEADER_ONLY)
+# include <maidsafe/crux/detail/impl/multiplexer.ipp>
+#endif
+
 #endif // MAIDSAFE_CRUX_DETAIL_MULTIPLEXER_HPP
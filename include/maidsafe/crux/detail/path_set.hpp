@@ -0,0 +1,225 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_PATH_SET_HPP
+#define MAIDSAFE_CRUX_DETAIL_PATH_SET_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// Delivery statistics of the paths of a connection, used to decide which
+// path each transmission goes over.
+//
+// Paths are identified by their index. A path is preferred if it is
+// expected to deliver the soonest, which is its smoothed round-trip time
+// inflated by its loss rate. Paths that have not been measured yet are
+// preferred over everything else so that they get measured.
+class path_set
+{
+public:
+    using duration_type = std::chrono::steady_clock::duration;
+
+    // Number of consecutive send failures after which a path is considered
+    // down and only used if all other paths are down as well.
+    static const std::size_t failure_limit = 3;
+
+    std::size_t add();
+    std::size_t size() const;
+    bool empty() const;
+
+    // The path for a first transmission
+    std::size_t select() const;
+    // The path for a retransmission, which avoids the path that the
+    // previous transmission went over if there is a choice.
+    std::size_t select(std::size_t previous) const;
+
+    void on_acknowledged(std::size_t path);
+    void on_acknowledged(std::size_t path, duration_type roundtrip_time);
+    void on_lost(std::size_t path);
+    void on_error(std::size_t path);
+
+    duration_type roundtrip_time(std::size_t path) const;
+    double loss_rate(std::size_t path) const;
+    bool is_down(std::size_t path) const;
+
+private:
+    struct path_type
+    {
+        bool measured = false;
+        duration_type roundtrip_time = duration_type::zero();
+        double loss_rate = 0.0;
+        std::size_t failures = 0;
+    };
+
+    double cost(const path_type&) const;
+    std::size_t best(std::size_t excluded) const;
+
+    std::vector<path_type> paths;
+};
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#include <algorithm>
+#include <cassert>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+inline std::size_t path_set::add()
+{
+    paths.push_back(path_type());
+    return paths.size() - 1;
+}
+
+inline std::size_t path_set::size() const
+{
+    return paths.size();
+}
+
+inline bool path_set::empty() const
+{
+    return paths.empty();
+}
+
+inline std::size_t path_set::select() const
+{
+    return best(paths.size());
+}
+
+inline std::size_t path_set::select(std::size_t previous) const
+{
+    return (paths.size() > 1) ? best(previous) : previous;
+}
+
+inline void path_set::on_acknowledged(std::size_t path)
+{
+    assert(path < paths.size());
+
+    auto& entry = paths[path];
+    entry.failures = 0;
+    entry.loss_rate -= entry.loss_rate / 8;
+}
+
+inline void path_set::on_acknowledged(std::size_t path,
+                                      duration_type roundtrip_time)
+{
+    assert(path < paths.size());
+
+    auto& entry = paths[path];
+    if (entry.measured)
+    {
+        // RFC 6298, section 2.3
+        entry.roundtrip_time += (roundtrip_time - entry.roundtrip_time) / 8;
+    }
+    else
+    {
+        entry.roundtrip_time = roundtrip_time;
+        entry.measured = true;
+    }
+    on_acknowledged(path);
+}
+
+inline void path_set::on_lost(std::size_t path)
+{
+    assert(path < paths.size());
+
+    auto& entry = paths[path];
+    entry.loss_rate += (1.0 - entry.loss_rate) / 8;
+}
+
+inline void path_set::on_error(std::size_t path)
+{
+    assert(path < paths.size());
+
+    ++paths[path].failures;
+    on_lost(path);
+}
+
+inline path_set::duration_type path_set::roundtrip_time(std::size_t path) const
+{
+    assert(path < paths.size());
+    return paths[path].roundtrip_time;
+}
+
+inline double path_set::loss_rate(std::size_t path) const
+{
+    assert(path < paths.size());
+    return paths[path].loss_rate;
+}
+
+inline bool path_set::is_down(std::size_t path) const
+{
+    assert(path < paths.size());
+    return paths[path].failures >= failure_limit;
+}
+
+inline double path_set::cost(const path_type& entry) const
+{
+    if (!entry.measured)
+    {
+        return 0.0;
+    }
+    // Expected time until delivery if every loss costs a retransmission
+    const double delivery = 1.0 - std::min(entry.loss_rate, 0.99);
+    return static_cast<double>(entry.roundtrip_time.count()) / delivery;
+}
+
+inline std::size_t path_set::best(std::size_t excluded) const
+{
+    assert(!paths.empty());
+
+    std::size_t result = paths.size();
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+        if (i == excluded)
+            continue;
+        if (result == paths.size())
+        {
+            result = i;
+            continue;
+        }
+
+        const auto& candidate = paths[i];
+        const auto& current = paths[result];
+        if (is_down(result) != is_down(i))
+        {
+            if (is_down(result)) result = i;
+        }
+        else if (is_down(i))
+        {
+            if (candidate.failures < current.failures) result = i;
+        }
+        else if (cost(candidate) < cost(current))
+        {
+            result = i;
+        }
+    }
+    return (result == paths.size()) ? 0 : result;
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_PATH_SET_HPP
@@ -11,10 +11,12 @@
 #ifndef MAIDSAFE_CRUX_DETAIL_RECEIVE_INPUT_TYPE_HPP
 #define MAIDSAFE_CRUX_DETAIL_RECEIVE_INPUT_TYPE_HPP
 
+#include <chrono>
 #include <functional>
 #include <boost/asio/buffer.hpp>
 #include <boost/system/system_error.hpp>
 #include <maidsafe/crux/detail/buffer.hpp>
+#include <maidsafe/crux/detail/clock.hpp>
 
 namespace maidsafe { namespace crux { namespace detail {
 
@@ -25,6 +27,7 @@ struct receive_input_type
 
     read_handler_type                        handler;
     std::vector<boost::asio::mutable_buffer> buffers;
+    detail::clock::time_point                deadline;
 
     template<class MutableBufferSequence>
     receive_input_type( const MutableBufferSequence& payload_buffers
@@ -40,6 +43,7 @@ receive_input_type::receive_input_type( const MutableBufferSequence& payload_buf
                                       , read_handler_type&& handler)
     : handler(std::move(handler))
     , buffers(boost::asio::buffer_size(payload_buffers))
+    , deadline(detail::clock::time_point::max())
 {
     std::size_t i = 0;
     for (const auto& buffer : payload_buffers) {
@@ -11,13 +11,21 @@
 #ifndef MAIDSAFE_CRUX_DETAIL_SEQUENCE_NUMBER_HPP
 #define MAIDSAFE_CRUX_DETAIL_SEQUENCE_NUMBER_HPP
 
-#include <stdexcept>
+#include <cassert>
 #include <type_traits>
 #include <boost/config.hpp>
 #include <boost/integer_traits.hpp>
 
 namespace maidsafe { namespace crux { namespace detail {
 
+// Sequence numbers in a power-of-two range, compared and subtracted with
+// serial number arithmetic (RFC 1982): numbers less than half the range
+// ahead are greater, and the others are less. Of two numbers exactly half
+// the range apart, the numerically smaller one is greater.
+//
+// All operations are branch-free and never throw. Values are only checked
+// against the range in debug builds, so values received from others must
+// be validated where they are decoded.
 template< typename NumericType
         , NumericType Max = boost::integer_traits<NumericType>::const_max
         >
@@ -26,6 +34,8 @@ class sequence_number {
     static_assert( std::is_integral<NumericType>::value
                    && std::is_unsigned<NumericType>::value
                  , "NumericType must be an unsigned integral type");
+    static_assert( (Max & (Max + 1U)) == 0
+                 , "Max must be one less than a power of two");
 
 public:
     using value_type = NumericType;
@@ -34,25 +44,27 @@ public:
     BOOST_STATIC_CONSTEXPR value_type middle_value = Max/2U;
 
 public:
-    sequence_number();
-    sequence_number(const sequence_number&);
-    explicit sequence_number(NumericType);
+    BOOST_CONSTEXPR sequence_number() BOOST_NOEXCEPT;
+    BOOST_CONSTEXPR explicit sequence_number(NumericType) BOOST_NOEXCEPT;
+
+    sequence_number& operator++() BOOST_NOEXCEPT;    // pre-increment
+    sequence_number  operator++(int) BOOST_NOEXCEPT; // post-increment
 
-    sequence_number& operator=(const sequence_number&);
-    sequence_number& operator++();    // pre-increment
-    sequence_number  operator++(int); // post-increment
+    BOOST_CONSTEXPR bool operator<(const sequence_number&) const BOOST_NOEXCEPT;
+    BOOST_CONSTEXPR bool operator>(const sequence_number&) const BOOST_NOEXCEPT;
+    BOOST_CONSTEXPR bool operator==(const sequence_number&) const BOOST_NOEXCEPT;
+    BOOST_CONSTEXPR bool operator!=(const sequence_number&) const BOOST_NOEXCEPT;
+    BOOST_CONSTEXPR bool operator==(const NumericType&) const BOOST_NOEXCEPT;
 
-    bool operator<(const sequence_number&) const;
-    bool operator>(const sequence_number&) const;
-    bool operator==(const sequence_number&) const;
-    bool operator!=(const sequence_number&) const;
-    bool operator==(const NumericType&) const;
+    BOOST_CONSTEXPR difference_type distance(const sequence_number&) const BOOST_NOEXCEPT;
 
-    difference_type distance(const sequence_number&) const;
+    BOOST_CONSTEXPR sequence_number next() const BOOST_NOEXCEPT;
 
-    sequence_number next() const;
+    BOOST_CONSTEXPR value_type value() const BOOST_NOEXCEPT { return n; }
 
-    value_type value() const { return n; }
+private:
+    // Distance from this to other in the range, counting upwards
+    BOOST_CONSTEXPR value_type ahead(const sequence_number& other) const BOOST_NOEXCEPT;
 
 private:
     value_type n;
@@ -63,124 +75,97 @@ private:
 namespace maidsafe { namespace crux { namespace detail {
 
 template<typename NumericType, NumericType Max>
-sequence_number<NumericType, Max>::sequence_number()
+BOOST_CONSTEXPR
+sequence_number<NumericType, Max>::sequence_number() BOOST_NOEXCEPT
     : n(0)
 {
 }
 
 template<typename NumericType, NumericType Max>
-sequence_number<NumericType, Max>::sequence_number(const sequence_number& other)
-    : n(other.n)
-{
-    if (n > max_value)
-        throw std::runtime_error("invalid value");
-}
-
-template<typename NumericType, NumericType Max>
-sequence_number<NumericType, Max>::sequence_number(NumericType n)
-    : n(n)
+BOOST_CONSTEXPR
+sequence_number<NumericType, Max>::sequence_number(NumericType n) BOOST_NOEXCEPT
+    : n((assert(n <= max_value), n))
 {
-    if (n > max_value)
-        throw std::runtime_error("invalid value");
 }
 
 template<typename NumericType, NumericType Max>
 sequence_number<NumericType, Max>&
-sequence_number<NumericType, Max>::operator=(const sequence_number& other)
-{
-    if (this != &other)
-    {
-        n = other.n;
-    }
+sequence_number<NumericType, Max>::operator++() BOOST_NOEXCEPT {
+    n = static_cast<value_type>((n + 1U) & max_value);
     return *this;
 }
 
 template<typename NumericType, NumericType Max>
-sequence_number<NumericType, Max>&
-sequence_number<NumericType, Max>::operator++() {
-    if (n < max_value) { ++n; } else { n = 0; }
-    return *this;
+BOOST_CONSTEXPR
+sequence_number<NumericType, Max>
+sequence_number<NumericType, Max>::next() const BOOST_NOEXCEPT {
+    return sequence_number(static_cast<value_type>((n + 1U) & max_value));
 }
 
 template<typename NumericType, NumericType Max>
 sequence_number<NumericType, Max>
-sequence_number<NumericType, Max>::next() const {
-    sequence_number ret(n);
-    return ++ret;
+sequence_number<NumericType, Max>::operator++(int) BOOST_NOEXCEPT {
+    const sequence_number old = *this;
+    ++*this;
+    return old;
 }
 
 template<typename NumericType, NumericType Max>
-sequence_number<NumericType, Max>
-sequence_number<NumericType, Max>::operator++(int) {
-    NumericType old_n = n;
-    if (n < max_value) { ++n; } else { n = 0; }
-    return sequence_number(old_n);
+BOOST_CONSTEXPR
+typename sequence_number<NumericType, Max>::value_type
+sequence_number<NumericType, Max>::ahead(const sequence_number& other) const BOOST_NOEXCEPT
+{
+    return static_cast<value_type>((other.n - n) & max_value);
 }
 
 template<typename NumericType, NumericType Max>
-bool sequence_number<NumericType, Max>::operator<(const sequence_number& other) const
+BOOST_CONSTEXPR
+bool sequence_number<NumericType, Max>::operator<(const sequence_number& other) const BOOST_NOEXCEPT
 {
-    return ((other.n > n) && (other.n - n <= middle_value))
-        || ((other.n < n) && (n - other.n >  middle_value));
+    return (ahead(other) != 0)
+        & ((ahead(other) <= middle_value)
+           | ((ahead(other) == middle_value + 1U) & (n > other.n)));
 }
 
 template<typename NumericType, NumericType Max>
-bool sequence_number<NumericType, Max>::operator>(const sequence_number& other) const
+BOOST_CONSTEXPR
+bool sequence_number<NumericType, Max>::operator>(const sequence_number& other) const BOOST_NOEXCEPT
 {
     return other < *this;
 }
 
 template<typename NumericType, NumericType Max>
-bool sequence_number<NumericType, Max>::operator==(const sequence_number& other) const
+BOOST_CONSTEXPR
+bool sequence_number<NumericType, Max>::operator==(const sequence_number& other) const BOOST_NOEXCEPT
 {
     return n == other.n;
 }
 
 template<typename NumericType, NumericType Max>
-bool sequence_number<NumericType, Max>::operator!=(const sequence_number& other) const
+BOOST_CONSTEXPR
+bool sequence_number<NumericType, Max>::operator!=(const sequence_number& other) const BOOST_NOEXCEPT
 {
     return n != other.n;
 }
 
 template<typename NumericType, NumericType Max>
-bool sequence_number<NumericType, Max>::operator==(const NumericType& other) const
+BOOST_CONSTEXPR
+bool sequence_number<NumericType, Max>::operator==(const NumericType& other) const BOOST_NOEXCEPT
 {
     return n == other;
 }
 
 template<typename NumericType, NumericType Max>
+BOOST_CONSTEXPR
 typename sequence_number<NumericType, Max>::difference_type
-sequence_number<NumericType, Max>::distance(const sequence_number& other) const
+sequence_number<NumericType, Max>::distance(const sequence_number& other) const BOOST_NOEXCEPT
 {
-    if (other.n > n)
-    {
-        const value_type diff = other.n - n;
-        if (diff > middle_value)
-        {
-            const value_type v = max_value - diff + 1;
-            return -static_cast<difference_type>(v);
-        }
-        else
-        {
-            return diff;
-        }
-    }
-    else
-    {
-        const value_type diff = n - other.n;
-        if (diff > middle_value)
-        {
-            const value_type v = max_value - diff + 1;
-            return (v > middle_value) ? -static_cast<difference_type>(v) : v;
-        }
-        else
-        {
-            return -static_cast<difference_type>(diff);
-        }
-    }
+    // Sign extension from the width of the range: distances from half the
+    // range upwards are backwards.
+    return static_cast<difference_type>
+        (static_cast<value_type>((ahead(other) ^ (middle_value + 1U)) - (middle_value + 1U)));
 }
 
 }}} // namespace maidsafe::crux::detail
 
 #endif // ifndef MAIDSAFE_CRUX_DETAIL_SEQUENCE_NUMBER_HPP
-
@@ -11,11 +11,15 @@
 #ifndef MAIDSAFE_CRUX_DETAIL_SERVICE_HPP
 #define MAIDSAFE_CRUX_DETAIL_SERVICE_HPP
 
+#include <deque>
 #include <memory>
 #include <map>
 #include <random>
 #include <boost/asio/io_service.hpp>
+#include <maidsafe/crux/detail/config.hpp>
 #include <maidsafe/crux/endpoint.hpp>
+#include <maidsafe/crux/detail/arena.hpp>
+#include <maidsafe/crux/detail/capture.hpp>
 
 namespace maidsafe
 {
@@ -39,7 +43,28 @@ public:
     std::shared_ptr<detail::multiplexer> add(endpoint_type local_endpoint);
     void remove(const endpoint_type& local_endpoint);
 
+    // Limit the number of connections across all local endpoints
+    void max_connections(std::size_t);
+    std::size_t max_connections() const;
+    std::size_t connections() const;
+
+    // Backing of the datagram buffers of local endpoints added afterwards
+    void buffer_memory(const arena::options&);
+    const arena::options& buffer_memory() const;
+
+    // Record the datagrams of all local endpoints, including those added
+    // already, or stop recording if empty
+    void capture(std::shared_ptr<capture_writer>);
+
     std::uint32_t random();
+    // Repeatable initial sequence numbers, for simulations
+    void seed(std::uint32_t);
+    // Initial sequence numbers to hand out before random ones, for replaying
+    // the connections of a capture
+    void initial_sequences(std::deque<std::uint32_t>);
+    // Random numbers for connection identifiers and challenges, which are
+    // never preset
+    std::uint32_t random_nonce();
 
     // Required by boost::asio::basic_io_object
     struct implementation_type {};
@@ -54,97 +79,23 @@ private:
 
 private:
     multiplexer_map multiplexers;
+    std::size_t connection_limit;
+    arena::options memory_options;
+    std::shared_ptr<capture_writer> recorder;
 
     std::mt19937 generator;
     std::uniform_int_distribution<std::uint32_t> distribution;
+    std::deque<std::uint32_t> preset_sequences;
 };
 
 } // namespace detail
 } // namespace crux
 } // namespace maidsafe
 
-#include <limits>
 #include <maidsafe/crux/detail/multiplexer.hpp>
 
-namespace maidsafe
-{
-namespace crux
-{
-namespace detail
-{
-
-inline service::service(boost::asio::io_service& io)
-    : boost::asio::io_service::service(io),
-      distribution(std::numeric_limits<std::uint32_t>::min(),
-                   std::numeric_limits<std::uint32_t>::max())
-{
-    std::random_device device;
-    generator.seed(device());
-}
-
-inline std::shared_ptr<detail::multiplexer> service::add(endpoint_type local_endpoint)
-{
-    using next_layer_type = detail::multiplexer::next_layer_type;
-
-    // FIXME: Thread-safety
-    std::shared_ptr<detail::multiplexer> result;
-    auto where = multiplexers.lower_bound(local_endpoint);
-    if ((where == multiplexers.end()) || (multiplexers.key_comp()(local_endpoint, where->first)))
-    {
-        // Multiplexer for local endpoint does not exists
-
-        next_layer_type socket(get_io_service(), local_endpoint);
-
-        // local_endpoint changes if ephemeral port is used.
-        local_endpoint = socket.local_endpoint();
-
-        result = detail::multiplexer::create(std::move(socket));
-
-        where = multiplexers.insert(where,
-                                    multiplexer_map::value_type
-                                        ( local_endpoint
-                                        , result));
-    }
-    else
-    {
-        result = where->second.lock();
-        if (!result)
-        {
-            // This can happen if an acceptor has failed
-            // Reassign if empty
-            next_layer_type socket(get_io_service(), local_endpoint);
-
-            assert(local_endpoint == socket.local_endpoint());
-
-            result = detail::multiplexer::create(std::move(socket));
-
-            where->second = result;
-        }
-    }
-    return result;
-}
-
-inline void service::remove(const endpoint_type& local_endpoint)
-{
-    // FIXME: Thread-safety
-    auto where = multiplexers.find(local_endpoint);
-    if (where != multiplexers.end())
-    {
-        // Only remove if multiplexer is unused
-        if (!where->second.lock())
-        {
-            multiplexers.erase(where);
-        }
-    }
-}
-
-inline std::uint32_t service::random()
-{
-    return distribution(generator);
-}
-
-} // namespace detail
-} // namespace crux
-} // namespace maidsafe
+#if defined(MAIDSAFE_CRUX_HEADER_ONLY)
+# include <maidsafe/crux/detail/impl/service.ipp>
+#endif
 
 #endif // MAIDSAFE_CRUX_DETAIL_SERVICE_HPP
@@ -0,0 +1,269 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_SHARED_RING_HPP
+#define MAIDSAFE_CRUX_DETAIL_SHARED_RING_HPP
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// Single-producer single-consumer ring of length-prefixed messages.
+//
+// The control block and the data area are placed in memory provided by the
+// caller, which may be shared between processes. Positions are free running
+// counters, so the ring is empty when head == tail.
+class shared_ring
+{
+public:
+    struct control
+    {
+        // Written by the producer.
+        alignas(64) std::atomic<std::uint64_t> head;
+        // Written by the consumer.
+        alignas(64) std::atomic<std::uint64_t> tail;
+        // Set by a side that is about to wait for the other one.
+        alignas(64) std::atomic<std::uint32_t> consumer_waiting;
+        std::atomic<std::uint32_t> producer_waiting;
+    };
+
+    // Initialize a control block in fresh memory.
+    static void initialize(control* memory);
+
+    // The capacity must be a power of two.
+    shared_ring(control* memory, char* data, std::size_t capacity);
+
+    // Largest message that is guaranteed to fit in an empty ring.
+    std::size_t max_message_size() const;
+
+    bool empty() const;
+
+    // Returns false if there is not enough room for the message.
+    template <typename ConstBufferSequence>
+    bool push(const ConstBufferSequence& buffers);
+
+    // Returns false if the ring is empty. Messages larger than the buffers
+    // are truncated, as with datagrams, and true is returned with the error
+    // set to message_size. The other side may be buggy or hostile, so the
+    // positions and lengths it leaves in shared memory are checked. If they
+    // are out of bounds, false is returned with the error set, and the ring
+    // must not be used any more.
+    template <typename MutableBufferSequence>
+    bool pop(const MutableBufferSequence& buffers,
+             std::size_t& size,
+             boost::system::error_code& error);
+
+    // Called by the producer after a push. Returns true if the consumer was
+    // waiting and must be woken up.
+    bool consumer_needs_wakeup();
+    // Called by the consumer after a pop.
+    bool producer_needs_wakeup();
+
+    void wait_for_data();
+    void wait_for_space();
+
+private:
+    using length_type = std::uint32_t;
+
+    static const length_type wrap_marker = 0xFFFFFFFF;
+    static const std::size_t alignment = 8;
+
+    static std::uint64_t record_size(std::size_t payload_size);
+
+    control* ctrl;
+    char* data;
+    std::uint64_t mask;
+};
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+inline void shared_ring::initialize(control* memory)
+{
+    new (memory) control;
+    memory->head.store(0, std::memory_order_relaxed);
+    memory->tail.store(0, std::memory_order_relaxed);
+    memory->consumer_waiting.store(0, std::memory_order_relaxed);
+    memory->producer_waiting.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+inline shared_ring::shared_ring(control* memory, char* data, std::size_t capacity)
+    : ctrl(memory)
+    , data(data)
+    , mask(capacity - 1)
+{
+    assert(capacity > 0 && (capacity & mask) == 0);
+}
+
+inline std::uint64_t shared_ring::record_size(std::size_t payload_size)
+{
+    // Records are aligned so a length prefix never straddles the end.
+    return (sizeof(length_type) + payload_size + alignment - 1) & ~std::uint64_t(alignment - 1);
+}
+
+inline std::size_t shared_ring::max_message_size() const
+{
+    // Leave room for a wrap-around gap in front of the record.
+    return (mask + 1) / 2 - sizeof(length_type);
+}
+
+inline bool shared_ring::empty() const
+{
+    return ctrl->head.load(std::memory_order_acquire)
+        == ctrl->tail.load(std::memory_order_relaxed);
+}
+
+template <typename ConstBufferSequence>
+bool shared_ring::push(const ConstBufferSequence& buffers)
+{
+    const std::size_t payload_size = boost::asio::buffer_size(buffers);
+    assert(payload_size <= max_message_size());
+
+    const auto needed = record_size(payload_size);
+    auto head = ctrl->head.load(std::memory_order_relaxed);
+    const auto tail = ctrl->tail.load(std::memory_order_acquire);
+
+    auto offset = head & mask;
+    const auto contiguous = mask + 1 - offset;
+    const auto gap = (contiguous < needed) ? contiguous : 0;
+
+    if (head + gap + needed - tail > mask + 1)
+    {
+        return false;
+    }
+
+    if (gap)
+    {
+        const length_type marker = wrap_marker;
+        std::memcpy(data + offset, &marker, sizeof(marker));
+        head += gap;
+        offset = 0;
+    }
+
+    const auto length = static_cast<length_type>(payload_size);
+    std::memcpy(data + offset, &length, sizeof(length));
+    boost::asio::buffer_copy(boost::asio::buffer(data + offset + sizeof(length),
+                                                 payload_size),
+                             buffers);
+
+    ctrl->head.store(head + needed, std::memory_order_release);
+    return true;
+}
+
+template <typename MutableBufferSequence>
+bool shared_ring::pop(const MutableBufferSequence& buffers,
+                      std::size_t& size,
+                      boost::system::error_code& error)
+{
+    error = boost::system::error_code();
+
+    auto tail = ctrl->tail.load(std::memory_order_relaxed);
+    const auto head = ctrl->head.load(std::memory_order_acquire);
+
+    if (tail == head)
+    {
+        return false;
+    }
+
+    auto offset = tail & mask;
+    if ((head - tail > mask + 1) || (offset % alignment != 0))
+    {
+        error = make_error_code(boost::system::errc::bad_message);
+        return false;
+    }
+
+    length_type length;
+    std::memcpy(&length, data + offset, sizeof(length));
+
+    if (length == wrap_marker)
+    {
+        tail += mask + 1 - offset;
+        offset = 0;
+        if (tail == head || head - tail > mask + 1)
+        {
+            error = make_error_code(boost::system::errc::bad_message);
+            return false;
+        }
+        std::memcpy(&length, data + offset, sizeof(length));
+    }
+
+    // Records never straddle the end, as push() wraps around instead.
+    if ((length > max_message_size())
+        || (record_size(length) > head - tail)
+        || (offset + record_size(length) > mask + 1))
+    {
+        error = make_error_code(boost::system::errc::bad_message);
+        return false;
+    }
+
+    size = boost::asio::buffer_copy(buffers,
+                                    boost::asio::buffer(data + offset + sizeof(length),
+                                                        length));
+    if (size < length)
+    {
+        error = boost::asio::error::message_size;
+    }
+
+    ctrl->tail.store(tail + record_size(length), std::memory_order_release);
+    return true;
+}
+
+inline bool shared_ring::consumer_needs_wakeup()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return ctrl->consumer_waiting.load(std::memory_order_relaxed)
+        && ctrl->consumer_waiting.exchange(0);
+}
+
+inline bool shared_ring::producer_needs_wakeup()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return ctrl->producer_waiting.load(std::memory_order_relaxed)
+        && ctrl->producer_waiting.exchange(0);
+}
+
+inline void shared_ring::wait_for_data()
+{
+    ctrl->consumer_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+inline void shared_ring::wait_for_space()
+{
+    ctrl->producer_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_SHARED_RING_HPP
@@ -0,0 +1,789 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_DETAIL_SIMULATION_HPP
+#define MAIDSAFE_CRUX_DETAIL_SIMULATION_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+#include <boost/config.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+// The parts of a simulation build (MAIDSAFE_CRUX_SIMULATION) that stand in
+// for time and for the network. Protocol time is virtual and only moves
+// when the simulation runs out of handlers to execute, and datagrams travel
+// through memory with a latency and a loss rate, so that runs are fast and
+// repeatable from a seed.
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+namespace simulation
+{
+
+// Steady clock that stands still until it is advanced. There is one clock
+// for the process.
+class virtual_clock
+{
+public:
+    using duration = std::chrono::steady_clock::duration;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<virtual_clock, duration>;
+
+    BOOST_STATIC_CONSTEXPR bool is_steady = true;
+
+    static time_point now() BOOST_NOEXCEPT;
+
+    // Time never goes backwards, so earlier time points are ignored
+    static void advance(time_point);
+
+private:
+    static time_point& current() BOOST_NOEXCEPT;
+};
+
+// Events in virtual time for an io_service. Events that are due at the
+// same time happen in the order they were scheduled.
+class scheduler : public boost::asio::detail::service_base<scheduler>
+{
+public:
+    using time_point = virtual_clock::time_point;
+    using handler_type = std::function<void (const boost::system::error_code&)>;
+    using key_type = std::pair<time_point, std::uint64_t>;
+
+    explicit scheduler(boost::asio::io_service&);
+
+    key_type schedule(time_point, handler_type);
+    // The handler of the event, or an empty one if it has already happened
+    handler_type cancel(const key_type&);
+
+    bool empty() const;
+    time_point next() const;
+
+    // Advances the clock to the earliest event and calls its handler, unless
+    // there is none until the limit. Handlers post what they complete.
+    bool advance(time_point limit);
+
+private:
+    virtual void shutdown_service();
+
+private:
+    std::map<key_type, handler_type> events;
+    std::uint64_t counter;
+};
+
+// Waitable timer with the part of the interface of steady_timer that the
+// protocol uses, which expires in virtual time.
+class timer
+{
+public:
+    using clock_type = virtual_clock;
+    using duration = clock_type::duration;
+    using time_point = clock_type::time_point;
+
+    explicit timer(boost::asio::io_service&);
+    ~timer();
+
+    timer(const timer&) = delete;
+    timer& operator=(const timer&) = delete;
+
+    // Cancels pending waits, like steady_timer does
+    std::size_t expires_from_now(const duration&);
+    std::size_t expires_at(const time_point&);
+    time_point expires_at() const;
+
+    template <typename WaitHandler>
+    void async_wait(WaitHandler&& handler);
+
+    std::size_t cancel();
+
+    boost::asio::io_service& get_io_service();
+
+private:
+    scheduler& events;
+    time_point expiry;
+    std::vector<scheduler::key_type> waits;
+};
+
+// Datagram network in memory, shared by the sockets of an io_service.
+// Datagrams take a minimum latency plus a random jitter, which may reorder
+// them, and are lost at random with the given probability.
+class network : public boost::asio::detail::service_base<network>
+{
+public:
+    using endpoint_type = boost::asio::ip::udp::endpoint;
+    using duration = virtual_clock::duration;
+
+    struct datagram
+    {
+        endpoint_type from;
+        std::vector<char> data;
+    };
+
+    // Per socket state, which outlives a closed socket until the datagrams
+    // on their way to it have arrived
+    struct port
+    {
+        port();
+
+        void deliver(datagram);
+        void close();
+
+        endpoint_type local;
+        bool open;
+        std::deque<datagram> queue;
+        std::function<void (const boost::system::error_code&)> waiting;
+    };
+
+    explicit network(boost::asio::io_service&);
+
+    void seed(std::uint32_t);
+    void latency(duration minimum, duration jitter);
+    // Probability in [0, 1] that a datagram is lost
+    void loss(double probability);
+
+    std::size_t delivered() const;
+    std::size_t dropped() const;
+
+    // Port zero picks an unused port
+    boost::system::error_code bind(const std::shared_ptr<port>&, endpoint_type);
+    void unbind(const port&);
+
+    void send(const endpoint_type& from, const endpoint_type& to, std::vector<char>);
+
+private:
+    virtual void shutdown_service();
+
+    std::shared_ptr<port> find(const endpoint_type&) const;
+
+private:
+    scheduler& events;
+    std::map<endpoint_type, std::shared_ptr<port>> ports;
+    std::uint16_t next_port;
+
+    std::mt19937 generator;
+    duration minimum_latency;
+    duration jitter;
+    double loss_probability;
+
+    std::size_t delivered_count;
+    std::size_t dropped_count;
+};
+
+// Socket on the in-memory network, with the part of the interface of a
+// UDP socket that the multiplexer uses. It is bound on construction and
+// reports errors in the same way.
+class datagram_socket : public boost::asio::socket_base
+{
+public:
+    using protocol_type = boost::asio::ip::udp;
+    using endpoint_type = protocol_type::endpoint;
+
+    datagram_socket(boost::asio::io_service&, const endpoint_type&);
+    datagram_socket(datagram_socket&&);
+    ~datagram_socket();
+
+    boost::asio::io_service& get_io_service();
+
+    endpoint_type local_endpoint() const;
+    endpoint_type local_endpoint(boost::system::error_code&) const;
+    bool is_open() const;
+    void close();
+
+    // Size of the next datagram, as on Linux
+    void io_control(bytes_readable&);
+
+    template <typename MutableBufferSequence>
+    std::size_t receive_from(const MutableBufferSequence&,
+                             endpoint_type&,
+                             message_flags,
+                             boost::system::error_code&);
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_receive_from(const MutableBufferSequence&,
+                            endpoint_type&,
+                            message_flags,
+                            ReadHandler&&);
+
+    template <typename ConstBufferSequence>
+    std::size_t send_to(const ConstBufferSequence&,
+                        const endpoint_type&,
+                        message_flags,
+                        boost::system::error_code&);
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_send_to(const ConstBufferSequence&,
+                       const endpoint_type&,
+                       WriteHandler&&);
+
+private:
+    network& fabric;
+    std::shared_ptr<network::port> state;
+};
+
+} // namespace simulation
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/throw_exception.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+namespace simulation
+{
+
+//-----------------------------------------------------------------------------
+// virtual_clock
+//-----------------------------------------------------------------------------
+
+inline virtual_clock::time_point virtual_clock::now() BOOST_NOEXCEPT
+{
+    return current();
+}
+
+inline void virtual_clock::advance(time_point when)
+{
+    if (current() < when)
+    {
+        current() = when;
+    }
+}
+
+inline virtual_clock::time_point& virtual_clock::current() BOOST_NOEXCEPT
+{
+    static time_point value;
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+// scheduler
+//-----------------------------------------------------------------------------
+
+inline scheduler::scheduler(boost::asio::io_service& io)
+    : boost::asio::detail::service_base<scheduler>(io)
+    , counter(0)
+{
+}
+
+inline scheduler::key_type scheduler::schedule(time_point when, handler_type handler)
+{
+    const key_type key(when, counter++);
+    events.emplace(key, std::move(handler));
+    return key;
+}
+
+inline scheduler::handler_type scheduler::cancel(const key_type& key)
+{
+    handler_type result;
+    auto where = events.find(key);
+    if (where != events.end())
+    {
+        result = std::move(where->second);
+        events.erase(where);
+    }
+    return result;
+}
+
+inline bool scheduler::empty() const
+{
+    return events.empty();
+}
+
+inline scheduler::time_point scheduler::next() const
+{
+    assert(!events.empty());
+    return events.begin()->first.first;
+}
+
+inline bool scheduler::advance(time_point limit)
+{
+    if (events.empty() || (limit < next()))
+        return false;
+
+    auto handler = std::move(events.begin()->second);
+    virtual_clock::advance(next());
+    events.erase(events.begin());
+    handler(boost::system::error_code());
+    return true;
+}
+
+inline void scheduler::shutdown_service()
+{
+    events.clear();
+}
+
+//-----------------------------------------------------------------------------
+// timer
+//-----------------------------------------------------------------------------
+
+inline timer::timer(boost::asio::io_service& io)
+    : events(boost::asio::use_service<scheduler>(io))
+{
+}
+
+inline timer::~timer()
+{
+    // Pending handlers are still called, but not with this timer
+    cancel();
+}
+
+inline std::size_t timer::expires_from_now(const duration& period)
+{
+    return expires_at(clock_type::now() + period);
+}
+
+inline std::size_t timer::expires_at(const time_point& when)
+{
+    const auto result = cancel();
+    expiry = when;
+    return result;
+}
+
+inline timer::time_point timer::expires_at() const
+{
+    return expiry;
+}
+
+template <typename WaitHandler>
+void timer::async_wait(WaitHandler&& handler)
+{
+    using handler_type = typename std::decay<WaitHandler>::type;
+
+    // Called when the timer expires or is cancelled, which it is before it
+    // is destroyed. The key is only known once it is scheduled.
+    auto& io = get_io_service();
+    auto key = std::make_shared<scheduler::key_type>();
+    *key = events.schedule
+        (expiry,
+         [this, key, handler, &io] (const boost::system::error_code& error) mutable
+         {
+             if (!error)
+             {
+                 waits.erase(std::find(waits.begin(), waits.end(), *key));
+             }
+             io.post(std::bind(handler_type(std::move(handler)), error));
+         });
+    waits.push_back(*key);
+}
+
+inline std::size_t timer::cancel()
+{
+    std::vector<scheduler::key_type> cancelled;
+    cancelled.swap(waits);
+    for (const auto& key : cancelled)
+    {
+        auto handler = events.cancel(key);
+        assert(handler);
+        handler(boost::asio::error::operation_aborted);
+    }
+    return cancelled.size();
+}
+
+inline boost::asio::io_service& timer::get_io_service()
+{
+    return events.get_io_service();
+}
+
+//-----------------------------------------------------------------------------
+// network
+//-----------------------------------------------------------------------------
+
+inline network::port::port()
+    : open(true)
+{
+}
+
+inline void network::port::deliver(datagram message)
+{
+    queue.push_back(std::move(message));
+    if (waiting)
+    {
+        auto handler = std::move(waiting);
+        waiting = nullptr;
+        handler(boost::system::error_code());
+    }
+}
+
+inline void network::port::close()
+{
+    open = false;
+    queue.clear();
+    if (waiting)
+    {
+        auto handler = std::move(waiting);
+        waiting = nullptr;
+        handler(boost::asio::error::operation_aborted);
+    }
+}
+
+inline network::network(boost::asio::io_service& io)
+    : boost::asio::detail::service_base<network>(io)
+    , events(boost::asio::use_service<scheduler>(io))
+    , next_port(49152)
+    , minimum_latency(std::chrono::milliseconds(1))
+    , jitter(duration::zero())
+    , loss_probability(0.0)
+    , delivered_count(0)
+    , dropped_count(0)
+{
+}
+
+inline void network::seed(std::uint32_t value)
+{
+    generator.seed(value);
+}
+
+inline void network::latency(duration minimum, duration extra)
+{
+    assert(minimum >= duration::zero());
+    assert(extra >= duration::zero());
+    minimum_latency = minimum;
+    jitter = extra;
+}
+
+inline void network::loss(double probability)
+{
+    assert((probability >= 0.0) && (probability <= 1.0));
+    loss_probability = probability;
+}
+
+inline std::size_t network::delivered() const
+{
+    return delivered_count;
+}
+
+inline std::size_t network::dropped() const
+{
+    return dropped_count;
+}
+
+inline boost::system::error_code network::bind(const std::shared_ptr<port>& socket,
+                                               endpoint_type local)
+{
+    if (local.port() == 0)
+    {
+        // Ephemeral ports are handed out in turn, which is repeatable
+        for (std::size_t tries = 0; ; ++tries)
+        {
+            if (tries > std::numeric_limits<std::uint16_t>::max())
+                return boost::asio::error::address_in_use;
+
+            local.port(next_port);
+            next_port = (next_port == std::numeric_limits<std::uint16_t>::max())
+                ? 49152
+                : next_port + 1;
+            if (!find(local))
+                break;
+        }
+    }
+    else if (find(local))
+    {
+        return boost::asio::error::address_in_use;
+    }
+
+    socket->local = local;
+    ports.emplace(local, socket);
+    return boost::system::error_code();
+}
+
+inline void network::unbind(const port& socket)
+{
+    ports.erase(socket.local);
+}
+
+inline void network::send(const endpoint_type& from,
+                          const endpoint_type& to,
+                          std::vector<char> data)
+{
+    if (std::bernoulli_distribution(loss_probability)(generator))
+    {
+        ++dropped_count;
+        return;
+    }
+
+    auto delay = minimum_latency;
+    if (jitter > duration::zero())
+    {
+        delay += duration(std::uniform_int_distribution<duration::rep>(0, jitter.count())(generator));
+    }
+
+    // Datagrams from a socket bound to any address come from loopback
+    datagram message;
+    message.from = from;
+    if (from.address().is_unspecified())
+    {
+        message.from.address(from.address().is_v4()
+                             ? boost::asio::ip::address(boost::asio::ip::address_v4::loopback())
+                             : boost::asio::ip::address(boost::asio::ip::address_v6::loopback()));
+    }
+    message.data = std::move(data);
+
+    auto shared = std::make_shared<datagram>(std::move(message));
+    events.schedule
+        (virtual_clock::now() + delay,
+         [this, to, shared] (const boost::system::error_code& error)
+         {
+             if (error)
+                 return;
+
+             // Looked up on arrival, as the receiver may have gone
+             auto receiver = find(to);
+             if (!receiver)
+             {
+                 ++dropped_count;
+                 return;
+             }
+             ++delivered_count;
+             receiver->deliver(std::move(*shared));
+         });
+}
+
+inline void network::shutdown_service()
+{
+    ports.clear();
+}
+
+inline std::shared_ptr<network::port> network::find(const endpoint_type& where) const
+{
+    auto exact = ports.find(where);
+    if (exact != ports.end())
+        return exact->second;
+
+    // Sockets bound to any address receive on all of them
+    const endpoint_type any(where.address().is_v4()
+                            ? boost::asio::ip::address(boost::asio::ip::address_v4::any())
+                            : boost::asio::ip::address(boost::asio::ip::address_v6::any()),
+                            where.port());
+    auto wildcard = ports.find(any);
+    if (wildcard != ports.end())
+        return wildcard->second;
+
+    return std::shared_ptr<port>();
+}
+
+//-----------------------------------------------------------------------------
+// datagram_socket
+//-----------------------------------------------------------------------------
+
+inline datagram_socket::datagram_socket(boost::asio::io_service& io,
+                                        const endpoint_type& local)
+    : fabric(boost::asio::use_service<network>(io))
+    , state(std::make_shared<network::port>())
+{
+    auto error = fabric.bind(state, local);
+    if (error)
+    {
+        state->open = false;
+        boost::throw_exception(boost::system::system_error(error, "bind"));
+    }
+}
+
+inline datagram_socket::datagram_socket(datagram_socket&& other)
+    : fabric(other.fabric)
+    , state(std::move(other.state))
+{
+}
+
+inline datagram_socket::~datagram_socket()
+{
+    close();
+}
+
+inline boost::asio::io_service& datagram_socket::get_io_service()
+{
+    return fabric.get_io_service();
+}
+
+inline datagram_socket::endpoint_type datagram_socket::local_endpoint() const
+{
+    if (!is_open())
+        boost::throw_exception(boost::system::system_error(boost::asio::error::bad_descriptor,
+                                                           "local_endpoint"));
+    return state->local;
+}
+
+inline datagram_socket::endpoint_type
+datagram_socket::local_endpoint(boost::system::error_code& error) const
+{
+    if (!is_open())
+    {
+        error = boost::asio::error::bad_descriptor;
+        return endpoint_type();
+    }
+    error = boost::system::error_code();
+    return state->local;
+}
+
+inline bool datagram_socket::is_open() const
+{
+    return state && state->open;
+}
+
+inline void datagram_socket::close()
+{
+    if (!is_open())
+        return;
+    fabric.unbind(*state);
+    state->close();
+}
+
+inline void datagram_socket::io_control(bytes_readable& command)
+{
+    command.set((is_open() && !state->queue.empty()) ? state->queue.front().data.size() : 0);
+}
+
+template <typename MutableBufferSequence>
+std::size_t datagram_socket::receive_from(const MutableBufferSequence& buffers,
+                                          endpoint_type& remote,
+                                          message_flags flags,
+                                          boost::system::error_code& error)
+{
+    if (!is_open())
+    {
+        error = boost::asio::error::bad_descriptor;
+        return 0;
+    }
+    if (state->queue.empty())
+    {
+        error = boost::asio::error::would_block;
+        return 0;
+    }
+
+    const auto& front = state->queue.front();
+    // Datagrams that do not fit are truncated
+    const auto size = boost::asio::buffer_copy(buffers, boost::asio::buffer(front.data));
+    remote = front.from;
+    if ((flags & message_peek) == 0)
+    {
+        state->queue.pop_front();
+    }
+    error = boost::system::error_code();
+    return size;
+}
+
+template <typename MutableBufferSequence, typename ReadHandler>
+void datagram_socket::async_receive_from(const MutableBufferSequence& buffers,
+                                         endpoint_type& remote,
+                                         message_flags flags,
+                                         ReadHandler&& handler)
+{
+    using handler_type = typename std::decay<ReadHandler>::type;
+
+    auto& io = get_io_service();
+    if (!is_open())
+    {
+        handler_type local(std::forward<ReadHandler>(handler));
+        io.post(std::bind(std::move(local), boost::asio::error::bad_descriptor, 0));
+        return;
+    }
+
+    // Only one receive may be outstanding, as in the multiplexer
+    assert(!state->waiting);
+    auto *current = state.get();
+    auto *destination = &remote;
+    state->waiting =
+        [current, buffers, destination, flags, handler, &io]
+        (const boost::system::error_code& error) mutable
+        {
+            std::size_t size = 0;
+            boost::system::error_code result = error;
+            if (!result)
+            {
+                assert(!current->queue.empty());
+                const auto& front = current->queue.front();
+                size = boost::asio::buffer_copy(buffers, boost::asio::buffer(front.data));
+                *destination = front.from;
+                if ((flags & message_peek) == 0)
+                {
+                    current->queue.pop_front();
+                }
+            }
+            io.post(std::bind(handler_type(std::move(handler)), result, size));
+        };
+
+    if (!state->queue.empty())
+    {
+        auto ready = std::move(state->waiting);
+        state->waiting = nullptr;
+        ready(boost::system::error_code());
+    }
+}
+
+template <typename ConstBufferSequence>
+std::size_t datagram_socket::send_to(const ConstBufferSequence& buffers,
+                                     const endpoint_type& remote,
+                                     message_flags,
+                                     boost::system::error_code& error)
+{
+    if (!is_open())
+    {
+        error = boost::asio::error::bad_descriptor;
+        return 0;
+    }
+
+    // Largest payload of a UDP datagram over IPv4
+    const std::size_t size = boost::asio::buffer_size(buffers);
+    if (size > 65507)
+    {
+        error = boost::asio::error::message_size;
+        return 0;
+    }
+
+    std::vector<char> data(size);
+    boost::asio::buffer_copy(boost::asio::buffer(data), buffers);
+    fabric.send(state->local, remote, std::move(data));
+    error = boost::system::error_code();
+    return size;
+}
+
+template <typename ConstBufferSequence, typename WriteHandler>
+void datagram_socket::async_send_to(const ConstBufferSequence& buffers,
+                                    const endpoint_type& remote,
+                                    WriteHandler&& handler)
+{
+    using handler_type = typename std::decay<WriteHandler>::type;
+
+    boost::system::error_code error;
+    const auto size = send_to(buffers, remote, message_flags(), error);
+    handler_type local(std::forward<WriteHandler>(handler));
+    get_io_service().post(std::bind(std::move(local), error, size));
+}
+
+} // namespace simulation
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_DETAIL_SIMULATION_HPP
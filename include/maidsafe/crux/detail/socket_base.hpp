@@ -29,12 +29,21 @@ namespace crux
 namespace detail
 {
 
+class aead;
+
 class socket_base : public boost::asio::socket_base
 {
 public:
     using endpoint_type = boost::asio::ip::udp::endpoint;
 
-    socket_base() : state_value(connectivity::closed) {}
+    socket_base()
+        : state_value(connectivity::closed)
+        , local_id(0)
+        , remote_id(0)
+        , checksum_agreed(false)
+        , compression_agreed(false)
+        , compact_agreed(false)
+    {}
     virtual ~socket_base() {}
 
     endpoint_type remote_endpoint() const { return remote; }
@@ -62,8 +71,11 @@ protected:
 
     virtual std::vector<boost::asio::mutable_buffer>* get_recv_buffers() = 0;
 
+    // The payload is null if the handshake has none.
     virtual void process_handshake(sequence_type initial,
-                                   endpoint_type remote_endpoint) = 0;
+                                   endpoint_type remote_endpoint,
+                                   std::uint16_t options,
+                                   std::shared_ptr<detail::buffer> payload) = 0;
 
     virtual void process_acknowledgement(const ack_sequence_type& ack) = 0;
 
@@ -73,13 +85,58 @@ protected:
                               sequence_type) = 0;
 
     virtual void process_keepalive(sequence_type) = 0;
+    // The sender has given up on every message up to this one
+    virtual void process_skip(sequence_type) = 0;
+    virtual bool is_expected_packet(sequence_type) = 0;
+    virtual bool is_expected_skip(sequence_type) = 0;
+    // Refusals acknowledge our handshake, and other shutdowns carry our
+    // connection identifier and the next sequence number of the peer
+    virtual void process_shutdown(std::uint16_t connection_id,
+                                  sequence_type,
+                                  boost::optional<sequence_type> ack) = 0;
     virtual void idempotent_start_receive() = 0;
 
     virtual void close() = 0;
 
+    // Completes the pending operations with the error, as when the
+    // connection is lost rather than closed by the application.
+    virtual void abort_operations(const boost::system::error_code&) = 0;
+
+    // Sequence numbers that truncated ones in compact headers are restored
+    // against: the next one expected from the peer, and our last one.
+    virtual sequence_type expected_sequence() = 0;
+    virtual sequence_type last_sent_sequence() const = 0;
+
+    // Connection identifiers let the multiplexer recognize a peer whose
+    // address has changed. Each side draws its own at random and sends it
+    // in the handshake. Zero means that there is none.
+    std::uint16_t local_connection_id() const { return local_id; }
+    std::uint16_t remote_connection_id() const { return remote_id; }
+
+    // Whether keepalive and data packets carry a checksum trailer in both
+    // directions, as agreed in the handshake.
+    bool has_checksum() const { return checksum_agreed; }
+
+    // Whether keepalive and data packets are encrypted, with keys from
+    // the handshake.
+    bool has_encryption() const { return bool(cipher); }
+
+    // Whether data packets may be compressed, with the dictionary if any.
+    bool has_compression() const { return compression_agreed; }
+
+    // Whether keepalive and data packets may have compact headers.
+    bool has_compact_header() const { return compact_agreed; }
+
 protected:
     endpoint_type remote;
     connectivity state_value;
+    std::uint16_t local_id;
+    std::uint16_t remote_id;
+    bool checksum_agreed;
+    std::shared_ptr<aead> cipher;
+    bool compression_agreed;
+    std::shared_ptr<const std::vector<char>> dictionary;
+    bool compact_agreed;
 };
 
 }}} // namespace maidsafe::crux::detail
@@ -11,7 +11,16 @@
 #ifndef MAIDSAFE_CRUX_DETAIL_TRANSMIT_QUEUE_HPP
 #define MAIDSAFE_CRUX_DETAIL_TRANSMIT_QUEUE_HPP
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iterator>
 #include <map>
+#include <boost/asio/error.hpp>
+#include <maidsafe/crux/detail/clock.hpp>
+#include <maidsafe/crux/detail/config.hpp>
+#include <maidsafe/crux/delivery_statistics.hpp>
 #include <maidsafe/crux/detail/sequence_number.hpp>
 #include <maidsafe/crux/detail/timer.hpp>
 #include <maidsafe/crux/detail/constants.hpp>
@@ -24,10 +33,16 @@ template<typename Index> class transmit_queue {
 private:
     using index_type = Index;
     using duration_type = typename detail::timer::duration_type;
+    using clock_type = detail::clock;
 
 public:
     using iteration_handler = std::function<void(const boost::system::error_code&, std::size_t)>;
     using iteration_step    = std::function<void(iteration_handler)>;
+    // Announces that everything from the entry up to and including the
+    // given index has been given up on.
+    using skip_step         = std::function<void(index_type, iteration_handler)>;
+    using statistics_handler = std::function<void(const delivery_statistics&)>;
+    using time_point = clock_type::time_point;
 
 private:
     struct entry_type {
@@ -35,6 +50,22 @@ private:
         duration_type     period;
         iteration_step    step;
         iteration_handler handler;
+
+        // Once past the deadline the handler completes with timed_out, and
+        // the entry is transmitted with the skip step until acknowledged, so
+        // that the receiver does not wait for it. Consecutive expired entries
+        // are merged into the first one, which is then keyed at the last
+        // index and skips them all at once.
+        time_point        deadline = time_point::max();
+        skip_step         skip;
+        bool              expired = false;
+
+        // State of the most recent transmission, from which a delivery
+        // rate sample is taken when the entry is acknowledged.
+        std::size_t            transmissions = 0;
+        clock_type::time_point sent_time;
+        std::uint64_t          delivered_at_send = 0;
+        clock_type::time_point delivered_time_at_send;
     };
 
     // Shared pointer used because lambdas don't support move semantics in c++11
@@ -46,24 +77,40 @@ public:
     void push( index_type
              , std::size_t buffer_size
              , iteration_step
-             , iteration_handler);
+             , iteration_handler
+             , time_point deadline = time_point::max()
+             , skip_step skip = skip_step());
 
     void apply_ack(index_type);
 
-    void shutdown();
+    void shutdown(const boost::system::error_code& = boost::asio::error::operation_aborted);
 
     bool empty() const;
     std::size_t size() const;
 
+    const delivery_statistics& statistics() const;
+    // Called whenever an acknowledgement has updated the statistics
+    void on_statistics(statistics_handler);
+
 private:
     void on_timer_tick();
     void start_step(typename entries_type::iterator);
+    void start_timer();
+    void expire_entries(time_point now);
+    void merge_expired_entries();
+    void update_statistics(const entry_type&);
+    void update_loss_rate(bool lost);
 
 private:
     boost::asio::io_service&       ios;
     entries_type                   entries;
     detail::timer                  timer;
     std::shared_ptr<boost::none_t> shutdown_indicator;
+
+    delivery_statistics            stats;
+    statistics_handler             stats_handler;
+    clock_type::time_point         delivered_time;
+    clock_type::time_point         min_roundtrip_time_stamp;
 };
 
 template<typename Index>
@@ -71,6 +118,7 @@ transmit_queue<Index>::transmit_queue(boost::asio::io_service& ios)
     : ios(ios)
     , timer(ios, [=]() { on_timer_tick(); })
     , shutdown_indicator(std::make_shared<boost::none_t>())
+    , delivered_time(clock_type::now())
 { }
 
 template<typename Index>
@@ -80,7 +128,102 @@ void transmit_queue<Index>::on_timer_tick()
         return;
     }
 
-    start_step(entries.begin());
+    const auto now = clock_type::now();
+    auto& head = *entries.begin()->second;
+    const bool head_expires = head.handler && (head.deadline <= now);
+
+    expire_entries(now);
+
+    if (now - head.sent_time >= head.period) {
+        // The previous transmission has not been acknowledged in time
+        ++stats.retransmissions;
+        update_loss_rate(true);
+        start_step(entries.begin());
+    }
+    else if (head_expires) {
+        // Replace it with a skip right away
+        start_step(entries.begin());
+    }
+    else {
+        // Woken up for the deadline of a waiting entry
+        start_timer();
+    }
+}
+
+template<typename Index>
+void transmit_queue<Index>::start_timer()
+{
+    assert(!entries.empty());
+
+    const auto now = clock_type::now();
+    const auto& head = *entries.begin()->second;
+
+    auto period = head.period - std::chrono::duration_cast<duration_type>(now - head.sent_time);
+    for (const auto& entry_pair : entries) {
+        const auto& entry = *entry_pair.second;
+        if (entry.handler && entry.deadline != time_point::max()) {
+            period = std::min(period, std::chrono::duration_cast<duration_type>(entry.deadline - now));
+        }
+    }
+
+    timer.set_period(std::max(period, duration_type::zero()));
+    timer.start();
+}
+
+template<typename Index>
+void transmit_queue<Index>::expire_entries(time_point now)
+{
+    for (auto& entry_pair : entries) {
+        auto& entry = *entry_pair.second;
+        if (!entry.handler || (now < entry.deadline)) {
+            continue;
+        }
+
+        auto handler = std::move(entry.handler);
+        entry.handler = nullptr;
+        entry.buffer_size = 0;
+        entry.expired = true;
+
+        ios.post([handler]() {
+            handler(boost::asio::error::timed_out, 0);
+            });
+    }
+
+    merge_expired_entries();
+}
+
+template<typename Index>
+void transmit_queue<Index>::merge_expired_entries()
+{
+    auto first = entries.begin();
+    while (first != entries.end()) {
+        if (!first->second->expired) {
+            ++first;
+            continue;
+        }
+
+        auto last = first;
+        auto next = std::next(first);
+        while (next != entries.end()
+               && next->second->expired
+               && next->first == static_cast<index_type>(last->first + 1)) {
+            last = next++;
+        }
+
+        auto entry = first->second;
+        const index_type last_index = last->first;
+        if (last != first) {
+            entries.erase(first, next);
+            entries.insert(next, std::make_pair(last_index, entry));
+        }
+
+        auto skip = entry->skip;
+        entry->step = [skip, last_index](iteration_handler handler) {
+            skip(last_index, std::move(handler));
+        };
+
+        first = next;
+    }
 }
 
 template<typename Index>
@@ -93,6 +236,72 @@ std::size_t transmit_queue<Index>::size() const {
     return entries.size();
 }
 
+template<typename Index>
+const delivery_statistics& transmit_queue<Index>::statistics() const {
+    return stats;
+}
+
+template<typename Index>
+void transmit_queue<Index>::on_statistics(statistics_handler handler) {
+    stats_handler = std::move(handler);
+}
+
+template<typename Index>
+void transmit_queue<Index>::update_loss_rate(bool lost) {
+    stats.loss_rate += ((lost ? 1.0 : 0.0) - stats.loss_rate) / 8;
+}
+
+template<typename Index>
+void transmit_queue<Index>::update_statistics(const entry_type& entry) {
+    const auto now = clock_type::now();
+
+    stats.bytes_delivered += entry.buffer_size;
+    delivered_time = now;
+    update_loss_rate(false);
+
+    // Round-trip times are only sampled from entries that were sent once,
+    // because we cannot tell which transmission the ack belongs to.
+    if (entry.transmissions == 1) {
+        const auto roundtrip_time = now - entry.sent_time;
+
+        if (stats.smoothed_roundtrip_time == duration_type::zero()) {
+            stats.smoothed_roundtrip_time = roundtrip_time;
+        }
+        else {
+            // RFC 6298, section 2.3
+            stats.smoothed_roundtrip_time
+                += (roundtrip_time - stats.smoothed_roundtrip_time) / 8;
+        }
+
+        if (stats.min_roundtrip_time == duration_type::zero()
+            || roundtrip_time <= stats.min_roundtrip_time
+            || now - min_roundtrip_time_stamp > constant::min_roundtrip_time_window) {
+            stats.min_roundtrip_time = roundtrip_time;
+            min_roundtrip_time_stamp = now;
+        }
+    }
+
+    // Delivery rate sample as described in draft-cheng-iccrg-delivery-rate-estimation:
+    // the data delivered since the entry was sent, over the longer of the
+    // send and ack intervals.
+    const auto send_elapsed = now - entry.sent_time;
+    const auto ack_elapsed = now - entry.delivered_time_at_send;
+    const auto interval = std::chrono::duration<double>(std::max(send_elapsed, ack_elapsed));
+    if (interval.count() > 0.0) {
+        const double sample = (stats.bytes_delivered - entry.delivered_at_send) / interval.count();
+        if (stats.delivery_rate == 0.0) {
+            stats.delivery_rate = sample;
+        }
+        else {
+            stats.delivery_rate += (sample - stats.delivery_rate) / 8;
+        }
+    }
+
+    if (stats_handler) {
+        stats_handler(stats);
+    }
+}
+
 template<typename Index>
 void transmit_queue<Index>::apply_ack(index_type index)
 {
@@ -108,6 +317,10 @@ void transmit_queue<Index>::apply_ack(index_type index)
 
     entries.erase(entry_i);
 
+    if (entry->transmissions > 0) {
+        update_statistics(*entry);
+    }
+
     if (is_active) {
         timer.stop();
 
@@ -116,11 +329,13 @@ void transmit_queue<Index>::apply_ack(index_type index)
         }
     }
 
-    entry->handler(boost::system::error_code(), entry->buffer_size);
+    if (entry->handler) {
+        entry->handler(boost::system::error_code(), entry->buffer_size);
+    }
 }
 
 template<typename Index>
-void transmit_queue<Index>::shutdown() {
+void transmit_queue<Index>::shutdown(const boost::system::error_code& error) {
     shutdown_indicator.reset();
 
     timer.stop();
@@ -129,9 +344,17 @@ void transmit_queue<Index>::shutdown() {
 
     for (auto& entry_pair : moved_entries) {
         auto entry = std::move(entry_pair.second);
+        if (!entry->handler) {
+            // Already expired
+            continue;
+        }
+
+        auto handler = std::move(entry->handler);
+        entry->handler = nullptr;
+        auto size = entry->buffer_size;
 
-        ios.post([entry]() {
-            entry->handler(boost::asio::error::operation_aborted, entry->buffer_size);
+        ios.post([handler, error, size]() {
+            handler(error, size);
             });
     }
 }
@@ -140,8 +363,12 @@ template<typename Index>
 void transmit_queue<Index>::push( index_type        index
                                 , std::size_t       buffer_size
                                 , iteration_step    step
-                                , iteration_handler handler)
+                                , iteration_handler handler
+                                , time_point        deadline
+                                , skip_step         skip)
 {
+    assert(deadline == time_point::max() || skip);
+
     bool was_empty = entries.empty();
 
     auto insert_result = entries.insert(std::make_pair(index, std::make_shared<entry_type>()));
@@ -157,6 +384,8 @@ void transmit_queue<Index>::push( index_type        index
     entry.period      = constant::initial_roundtrip_time;
     entry.step        = std::move(step);
     entry.handler     = std::move(handler);
+    entry.deadline    = deadline;
+    entry.skip        = std::move(skip);
 
     if (was_empty) {
         start_step(insert_result.first);
@@ -167,20 +396,49 @@ template<typename Index>
 void transmit_queue<Index>::start_step(typename entries_type::iterator entry_i) {
     auto entry = entry_i->second;
 
+    expire_entries(clock_type::now());
+
+    ++entry->transmissions;
+    ++stats.transmissions;
+    entry->sent_time = clock_type::now();
+    if (entry->transmissions == 1) {
+        // Nothing else is in flight, so the path has been idle since the
+        // last ack and the time in between must not count against the
+        // delivery rate.
+        delivered_time = entry->sent_time;
+    }
+    entry->delivered_at_send = stats.bytes_delivered;
+    entry->delivered_time_at_send = delivered_time;
+
     std::weak_ptr<boost::none_t> shutdown_guard = shutdown_indicator;
 
     entry->step([=]( const boost::system::error_code& error
                    , std::size_t bytes_transferred) {
-                   if (!shutdown_guard.lock() || error) {
-                       return entry->handler(error, bytes_transferred);
+                   if (!shutdown_guard.lock()) {
+                       // The handler has been called by shutdown()
+                       return;
+                   }
+                   if (error) {
+                       if (entry->handler) {
+                           auto handler = std::move(entry->handler);
+                           entry->handler = nullptr;
+                           handler(error, bytes_transferred);
+                       }
+                       return;
                    }
-                   // FIXME: Period should be = 
-                   //        max(0, entry->period - duration of this step)
-                   this->timer.set_period(entry->period);
-                   this->timer.start();
+                   this->start_timer();
                });
 }
 
 }}} // namespace maidsafe::crux::detail
 
+#if !defined(MAIDSAFE_CRUX_HEADER_ONLY)
+namespace maidsafe { namespace crux { namespace detail {
+
+// The queue of sockets is instantiated in the library
+extern template class transmit_queue<std::uint32_t>;
+
+}}} // namespace maidsafe::crux::detail
+#endif
+
 #endif // MAIDSAFE_CRUX_DETAIL_TRANSMIT_QUEUE_HPP
@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_FAN_OUT_HPP
+#define MAIDSAFE_CRUX_FAN_OUT_HPP
+
+#include <memory>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/system/error_code.hpp>
+#include <maidsafe/crux/socket.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+// Send the same payload to every socket in a range.
+//
+// This calls async_send on each socket in turn and gathers the results in
+// one handler. It costs the same as those calls: every socket encodes and
+// submits its own datagrams. The payload is kept alive until every send
+// has completed.
+//
+// The range may hold sockets, raw pointers or smart pointers to sockets.
+// The handler has the signature
+//
+//   void handler(const boost::system::error_code& error,
+//                std::size_t delivered);
+//
+// and is called once all sends have completed, with the first error that
+// occurred (if any) and the number of sockets that acknowledged the payload.
+// It is never called from inside async_fan_out, not even if the range is
+// empty, but is posted to the io_service.
+template <typename SocketRange,
+          typename Payload,
+          typename FanOutHandler>
+void async_fan_out(boost::asio::io_service& io,
+                   SocketRange& sockets,
+                   std::shared_ptr<Payload> payload,
+                   FanOutHandler&& handler);
+
+} // namespace crux
+} // namespace maidsafe
+
+#include <utility>
+#include <type_traits>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+template <typename Handler>
+class fan_out_operation
+{
+public:
+    explicit fan_out_operation(Handler&& handler)
+        : handler(std::move(handler))
+        , pending(0)
+        , delivered(0)
+    {}
+
+    void start() { ++pending; }
+
+    void complete(const boost::system::error_code& error)
+    {
+        if (error)
+        {
+            if (!first_error)
+            {
+                first_error = error;
+            }
+        }
+        else
+        {
+            ++delivered;
+        }
+        finish();
+    }
+
+    void finish()
+    {
+        if (--pending == 0)
+        {
+            handler(first_error, delivered);
+        }
+    }
+
+private:
+    Handler handler;
+    std::size_t pending;
+    std::size_t delivered;
+    boost::system::error_code first_error;
+};
+
+inline crux::socket& dereference_socket(crux::socket& socket)
+{
+    return socket;
+}
+
+template <typename SocketPointer>
+crux::socket& dereference_socket(SocketPointer& socket)
+{
+    return *socket;
+}
+
+} // namespace detail
+
+template <typename SocketRange,
+          typename Payload,
+          typename FanOutHandler>
+void async_fan_out(boost::asio::io_service& io,
+                   SocketRange& sockets,
+                   std::shared_ptr<Payload> payload,
+                   FanOutHandler&& handler)
+{
+    using handler_type = typename std::decay<FanOutHandler>::type;
+    using operation_type = detail::fan_out_operation<handler_type>;
+
+    auto operation = std::make_shared<operation_type>
+        (handler_type(std::forward<FanOutHandler>(handler)));
+
+    const auto buffers = boost::asio::buffer(*payload);
+
+    // Guard against completing before every send has been started.
+    operation->start();
+
+    // One send per socket, as if the caller had looped over them
+    for (auto& element : sockets)
+    {
+        operation->start();
+        detail::dereference_socket(element).async_send
+            (buffers,
+             [operation, payload]
+             (const boost::system::error_code& error, std::size_t)
+             {
+                 operation->complete(error);
+             });
+    }
+
+    io.post([operation]() { operation->finish(); });
+}
+
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_FAN_OUT_HPP
@@ -0,0 +1,373 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_FILE_TRANSFER_HPP
+#define MAIDSAFE_CRUX_FILE_TRANSFER_HPP
+
+#include <cstdint>
+#include <string>
+#include <boost/system/error_code.hpp>
+#include <maidsafe/crux/socket.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+// Send a file over a connected socket.
+//
+// The file is memory mapped and sent in datagram sized slices straight from
+// the mapping, which also serves any retransmissions. At most a window of
+// slices is queued on the socket at a time, so memory use does not grow with
+// the size of the file. The socket sends queued slices one per round trip.
+// The handler has the signature
+//
+//   void handler(const boost::system::error_code& error,
+//                std::size_t bytes_transferred);
+template <typename FileHandler>
+void async_send_file(crux::socket& socket,
+                     const std::string& path,
+                     FileHandler&& handler);
+
+// Receive a file sent with async_send_file and write it to path, which is
+// created or truncated. The slices are received directly into a mapping of
+// the preallocated file.
+//
+// The size is announced by the peer, so files larger than max_size fail
+// with boost::asio::error::message_size before anything is allocated.
+template <typename FileHandler>
+void async_receive_file(crux::socket& socket,
+                        const std::string& path,
+                        std::uint64_t max_size,
+                        FileHandler&& handler);
+
+} // namespace crux
+} // namespace maidsafe
+
+#include <array>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <maidsafe/crux/detail/constants.hpp>
+#include <maidsafe/crux/detail/decoder.hpp>
+#include <maidsafe/crux/detail/encoder.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+// The file size precedes the contents as a 64-bit big-endian integer.
+using file_size_type = std::array<std::uint8_t, 2 * sizeof(std::uint32_t)>;
+
+inline boost::system::error_code
+to_error_code(const boost::interprocess::interprocess_exception& ex)
+{
+    if (ex.get_native_error() != 0)
+    {
+        return boost::system::error_code(ex.get_native_error(),
+                                         boost::system::system_category());
+    }
+    return boost::asio::error::invalid_argument;
+}
+
+class file_sender : public std::enable_shared_from_this<file_sender>
+{
+public:
+    using handler_type = std::function<void (const boost::system::error_code&, std::size_t)>;
+
+    file_sender(crux::socket& socket, handler_type handler)
+        : socket(socket)
+        , handler(std::move(handler))
+        , size(0)
+        , next_offset(0)
+        , transferred(0)
+        , outstanding(0)
+    {}
+
+    void start(const std::string& path)
+    {
+        namespace ipc = boost::interprocess;
+
+        try
+        {
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file)
+            {
+                return fail(boost::asio::error::not_found);
+            }
+            size = file.tellg();
+
+            // Empty files cannot be mapped.
+            if (size > 0)
+            {
+                mapping = ipc::file_mapping(path.c_str(), ipc::read_only);
+                region = ipc::mapped_region(mapping, ipc::read_only);
+            }
+        }
+        catch (const ipc::interprocess_exception& ex)
+        {
+            return fail(to_error_code(ex));
+        }
+
+        detail::encoder encoder(size_header.data(), size_header.size());
+        encoder.put<std::uint32_t>(static_cast<std::uint32_t>(size >> 32));
+        encoder.put<std::uint32_t>(static_cast<std::uint32_t>(size));
+
+        ++outstanding;
+        auto self = shared_from_this();
+        socket.async_send(boost::asio::buffer(size_header),
+                          [self](const boost::system::error_code& error, std::size_t)
+                          {
+                              self->process_send(error, 0);
+                          });
+        send_slices();
+    }
+
+private:
+    void send_slices()
+    {
+        const auto data = static_cast<const char*>(region.get_address());
+
+        while (!first_error && next_offset < size
+               && outstanding < constant::file_transfer_window)
+        {
+            const auto length = static_cast<std::size_t>
+                (std::min<std::uint64_t>(constant::max_payload_size, size - next_offset));
+            const auto offset = next_offset;
+            next_offset += length;
+            ++outstanding;
+
+            auto self = shared_from_this();
+            socket.async_send(boost::asio::buffer(data + offset, length),
+                              [self](const boost::system::error_code& error,
+                                     std::size_t bytes_transferred)
+                              {
+                                  self->process_send(error, bytes_transferred);
+                              });
+        }
+    }
+
+    void process_send(const boost::system::error_code& send_error,
+                      std::size_t bytes_transferred)
+    {
+        --outstanding;
+
+        if (send_error)
+        {
+            if (!first_error) first_error = send_error;
+        }
+        else
+        {
+            transferred += bytes_transferred;
+        }
+
+        send_slices();
+
+        if (outstanding == 0)
+        {
+            handler(first_error, static_cast<std::size_t>(transferred));
+        }
+    }
+
+    void fail(const boost::system::error_code& error)
+    {
+        auto handler = std::move(this->handler);
+        socket.get_io_service().post([handler, error]() { handler(error, 0); });
+    }
+
+private:
+    crux::socket& socket;
+    handler_type handler;
+    boost::interprocess::file_mapping mapping;
+    boost::interprocess::mapped_region region;
+    file_size_type size_header;
+    std::uint64_t size;
+    std::uint64_t next_offset;
+    std::uint64_t transferred;
+    std::size_t outstanding;
+    boost::system::error_code first_error;
+};
+
+class file_receiver : public std::enable_shared_from_this<file_receiver>
+{
+public:
+    using handler_type = std::function<void (const boost::system::error_code&, std::size_t)>;
+
+    file_receiver(crux::socket& socket,
+                  std::uint64_t max_size,
+                  handler_type handler)
+        : socket(socket)
+        , handler(std::move(handler))
+        , max_size(max_size)
+        , size(0)
+        , offset(0)
+    {}
+
+    void start(const std::string& path)
+    {
+        auto self = shared_from_this();
+        socket.async_receive(boost::asio::buffer(size_header),
+                             [self, path](const boost::system::error_code& error,
+                                          std::size_t length)
+                             {
+                                 self->process_size(error, length, path);
+                             });
+    }
+
+private:
+    void process_size(const boost::system::error_code& error,
+                      std::size_t length,
+                      const std::string& path)
+    {
+        namespace ipc = boost::interprocess;
+
+        if (error)
+        {
+            return handler(error, 0);
+        }
+        if (length != size_header.size())
+        {
+            return handler(boost::asio::error::message_size, 0);
+        }
+
+        detail::decoder decoder(size_header.data(), size_header.size());
+        size = std::uint64_t(decoder.get<std::uint32_t>()) << 32;
+        size |= decoder.get<std::uint32_t>();
+        if (size > max_size)
+        {
+            return handler(boost::asio::error::message_size, 0);
+        }
+
+        try
+        {
+            // Preallocate the file so that it can be mapped.
+            {
+                std::ofstream file(path, std::ios::binary | std::ios::trunc);
+                if (!file)
+                {
+                    return handler(boost::asio::error::access_denied, 0);
+                }
+                if (size > 0)
+                {
+                    file.seekp(size - 1);
+                    file.put(0);
+                }
+                if (!file)
+                {
+                    return handler(boost::system::errc::make_error_code
+                                       (boost::system::errc::no_space_on_device), 0);
+                }
+            }
+
+            if (size > 0)
+            {
+                mapping = ipc::file_mapping(path.c_str(), ipc::read_write);
+                region = ipc::mapped_region(mapping, ipc::read_write);
+            }
+        }
+        catch (const ipc::interprocess_exception& ex)
+        {
+            return handler(to_error_code(ex), 0);
+        }
+
+        receive_slice();
+    }
+
+    void receive_slice()
+    {
+        if (offset == size)
+        {
+            if (size > 0)
+            {
+                region.flush();
+            }
+            return handler(boost::system::error_code(),
+                           static_cast<std::size_t>(size));
+        }
+
+        const auto data = static_cast<char*>(region.get_address());
+        const auto length = static_cast<std::size_t>
+            (std::min<std::uint64_t>(constant::max_payload_size, size - offset));
+
+        auto self = shared_from_this();
+        socket.async_receive(boost::asio::buffer(data + offset, length),
+                             [self, length](const boost::system::error_code& error,
+                                            std::size_t bytes_transferred)
+                             {
+                                 self->process_slice(error, length, bytes_transferred);
+                             });
+    }
+
+    void process_slice(const boost::system::error_code& error,
+                       std::size_t length,
+                       std::size_t bytes_transferred)
+    {
+        if (error)
+        {
+            return handler(error, static_cast<std::size_t>(offset));
+        }
+        if (bytes_transferred > length)
+        {
+            // The slice would run past the end of the file
+            return handler(boost::asio::error::message_size,
+                           static_cast<std::size_t>(offset));
+        }
+
+        offset += bytes_transferred;
+        receive_slice();
+    }
+
+private:
+    crux::socket& socket;
+    handler_type handler;
+    boost::interprocess::file_mapping mapping;
+    boost::interprocess::mapped_region region;
+    file_size_type size_header;
+    const std::uint64_t max_size;
+    std::uint64_t size;
+    std::uint64_t offset;
+};
+
+} // namespace detail
+
+template <typename FileHandler>
+void async_send_file(crux::socket& socket,
+                     const std::string& path,
+                     FileHandler&& handler)
+{
+    auto sender = std::make_shared<detail::file_sender>
+        (socket, std::forward<FileHandler>(handler));
+    sender->start(path);
+}
+
+template <typename FileHandler>
+void async_receive_file(crux::socket& socket,
+                        const std::string& path,
+                        std::uint64_t max_size,
+                        FileHandler&& handler)
+{
+    auto receiver = std::make_shared<detail::file_receiver>
+        (socket, max_size, std::forward<FileHandler>(handler));
+    receiver->start(path);
+}
+
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_FILE_TRANSFER_HPP
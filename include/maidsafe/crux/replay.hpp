@@ -0,0 +1,198 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_REPLAY_HPP
+#define MAIDSAFE_CRUX_REPLAY_HPP
+
+#if !defined(MAIDSAFE_CRUX_SIMULATION)
+# error "maidsafe/crux/replay.hpp requires MAIDSAFE_CRUX_SIMULATION"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <maidsafe/crux/simulation.hpp>
+#include <maidsafe/crux/detail/capture.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+// Feeds the datagrams that a local endpoint received in a capture to the
+// same endpoint in a simulation, as they arrived or faster, so that their
+// processing can be profiled offline and repeatably.
+//
+// Only the accepting side is replayed. The connections get the initial
+// sequence numbers that were captured, so that the captured acks match,
+// provided that the sockets are created in the same order. The replay is
+// open loop: datagrams arrive when they were captured, whatever is sent in
+// return. Encrypted connections cannot be replayed, as their keys are not
+// captured. The capture should be of the local endpoint alone, because the
+// datagrams that its peers recorded sending would otherwise arrive twice.
+class replay
+{
+public:
+    using endpoint_type = boost::asio::ip::udp::endpoint;
+    using datagram_type = detail::captured_datagram;
+
+    // The local endpoint is the destination of the first handshake that
+    // acknowledges nothing, which is the first connection attempt captured
+    replay(crux::simulation&, boost::asio::io_service&, std::vector<datagram_type>);
+    replay(crux::simulation&,
+           boost::asio::io_service&,
+           std::vector<datagram_type>,
+           const endpoint_type& local_endpoint);
+
+    const endpoint_type& local_endpoint() const;
+
+    // Number of datagrams received by the local endpoint
+    std::size_t size() const;
+
+    // The speed is relative to the capture, and zero for as fast as
+    // possible. Datagrams are still subject to the latency and loss of the
+    // simulation. Returns once the last datagram has been injected, and can
+    // be called only once.
+    void run(double speed = 0.0);
+
+private:
+    void start(boost::asio::io_service&);
+
+private:
+    crux::simulation& simulation;
+    std::vector<datagram_type> datagrams;
+    endpoint_type local;
+};
+
+} // namespace crux
+} // namespace maidsafe
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <utility>
+#include <maidsafe/crux/detail/header_view.hpp>
+#include <maidsafe/crux/detail/service.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+inline replay::replay(crux::simulation& simulation,
+                      boost::asio::io_service& io,
+                      std::vector<datagram_type> input)
+    : simulation(simulation)
+    , datagrams(std::move(input))
+{
+    for (const auto& datagram : datagrams)
+    {
+        const detail::header::view view(reinterpret_cast<const std::uint8_t *>(datagram.payload.data()),
+                                        datagram.payload.size());
+        if (view.is_valid()
+            && (view.type() == detail::header::constant::type_handshake)
+            && !view.ack())
+        {
+            local = datagram.destination;
+            break;
+        }
+    }
+    start(io);
+}
+
+inline replay::replay(crux::simulation& simulation,
+                      boost::asio::io_service& io,
+                      std::vector<datagram_type> input,
+                      const endpoint_type& local_endpoint)
+    : simulation(simulation)
+    , datagrams(std::move(input))
+    , local(local_endpoint)
+{
+    start(io);
+}
+
+inline void replay::start(boost::asio::io_service& io)
+{
+    // Our initial sequence number goes into the first handshake that we
+    // send to each remote endpoint
+    std::deque<std::uint32_t> sequences;
+    std::set<endpoint_type> remotes;
+    for (const auto& datagram : datagrams)
+    {
+        if (datagram.source != local)
+            continue;
+
+        const detail::header::view view(reinterpret_cast<const std::uint8_t *>(datagram.payload.data()),
+                                        datagram.payload.size());
+        if (view.is_valid()
+            && (view.type() == detail::header::constant::type_handshake)
+            && remotes.insert(datagram.destination).second)
+        {
+            sequences.push_back(view.sequence_number().value());
+        }
+    }
+    boost::asio::use_service<detail::service>(io).initial_sequences(std::move(sequences));
+
+    datagrams.erase(std::remove_if(datagrams.begin(),
+                                   datagrams.end(),
+                                   [this](const datagram_type& datagram) {
+                                       return datagram.destination != local;
+                                   }),
+                    datagrams.end());
+}
+
+inline const replay::endpoint_type& replay::local_endpoint() const
+{
+    return local;
+}
+
+inline std::size_t replay::size() const
+{
+    return datagrams.size();
+}
+
+inline void replay::run(double speed)
+{
+    using wall_clock = std::chrono::steady_clock;
+
+    if (datagrams.empty())
+        return;
+
+    const auto wall_start = wall_clock::now();
+    const auto start = simulation.now();
+    const auto first = datagrams.front().time;
+
+    for (auto& datagram : datagrams)
+    {
+        const auto offset = std::max(datagram.time - first, std::chrono::microseconds::zero());
+        if (speed > 0.0)
+        {
+            const std::chrono::duration<double, std::micro> scaled(offset.count() / speed);
+            std::this_thread::sleep_until(wall_start + std::chrono::duration_cast<wall_clock::duration>(scaled));
+        }
+
+        const auto due = start + offset;
+        if (due > simulation.now())
+        {
+            simulation.run_for(due - simulation.now());
+        }
+        simulation.inject(datagram.source, local, std::move(datagram.payload));
+    }
+    simulation.run_for(crux::simulation::duration_type::zero());
+}
+
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_REPLAY_HPP
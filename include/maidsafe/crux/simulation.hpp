@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_SIMULATION_HPP
+#define MAIDSAFE_CRUX_SIMULATION_HPP
+
+#if !defined(MAIDSAFE_CRUX_SIMULATION)
+# error "maidsafe/crux/simulation.hpp requires MAIDSAFE_CRUX_SIMULATION"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <maidsafe/crux/detail/clock.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+// Drives the sockets of an io_service in virtual time over an in-memory
+// network, in builds with MAIDSAFE_CRUX_SIMULATION defined.
+//
+// Handlers are executed until there are none left, and then the clock is
+// moved to the next timer expiry or datagram arrival, so waiting costs
+// nothing. Runs with the same seed and the same code are identical. Sockets
+// in a simulation must be driven by run() or run_for() rather than by the
+// io_service itself, which knows nothing of timers and datagrams to come.
+class simulation
+{
+public:
+    using clock_type = detail::clock;
+    using duration_type = clock_type::duration;
+    using time_point = clock_type::time_point;
+    using endpoint_type = boost::asio::ip::udp::endpoint;
+
+    simulation(boost::asio::io_service&, std::uint32_t seed);
+
+    // Each datagram takes the minimum latency plus a uniformly distributed
+    // part of the jitter
+    void latency(duration_type minimum, duration_type jitter = duration_type::zero());
+    // Probability in [0, 1] that a datagram is lost
+    void loss(double probability);
+
+    // Sends a datagram from an endpoint outside the simulation, such as one
+    // in a capture that is replayed. It is subject to latency and loss.
+    void inject(const endpoint_type& from, const endpoint_type& to, std::vector<char> payload);
+
+    // Until there is nothing left to do, or until the given time has passed
+    // and the clock has been moved on to its end. Returns the number of
+    // handlers executed.
+    std::size_t run();
+    std::size_t run_for(duration_type);
+
+    static time_point now();
+
+    std::size_t delivered() const;
+    std::size_t dropped() const;
+
+private:
+    std::size_t run_until(time_point);
+
+private:
+    boost::asio::io_service& io;
+    detail::simulation::scheduler& events;
+    detail::simulation::network& fabric;
+};
+
+} // namespace crux
+} // namespace maidsafe
+
+#include <maidsafe/crux/detail/service.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+inline simulation::simulation(boost::asio::io_service& io, std::uint32_t seed)
+    : io(io)
+    , events(boost::asio::use_service<detail::simulation::scheduler>(io))
+    , fabric(boost::asio::use_service<detail::simulation::network>(io))
+{
+    fabric.seed(seed);
+    boost::asio::use_service<detail::service>(io).seed(seed);
+}
+
+inline void simulation::latency(duration_type minimum, duration_type jitter)
+{
+    fabric.latency(minimum, jitter);
+}
+
+inline void simulation::loss(double probability)
+{
+    fabric.loss(probability);
+}
+
+inline void simulation::inject(const endpoint_type& from,
+                               const endpoint_type& to,
+                               std::vector<char> payload)
+{
+    fabric.send(from, to, std::move(payload));
+}
+
+inline std::size_t simulation::run()
+{
+    return run_until(time_point::max());
+}
+
+inline std::size_t simulation::run_for(duration_type period)
+{
+    const auto end = now() + period;
+    const auto result = run_until(end);
+    clock_type::advance(end);
+    return result;
+}
+
+inline simulation::time_point simulation::now()
+{
+    return clock_type::now();
+}
+
+inline std::size_t simulation::delivered() const
+{
+    return fabric.delivered();
+}
+
+inline std::size_t simulation::dropped() const
+{
+    return fabric.dropped();
+}
+
+inline std::size_t simulation::run_until(time_point end)
+{
+    std::size_t result = 0;
+    do
+    {
+        io.reset();
+        result += io.poll();
+    } while (events.advance(end));
+    return result;
+}
+
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_SIMULATION_HPP
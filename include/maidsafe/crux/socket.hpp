@@ -11,9 +11,13 @@
 #ifndef MAIDSAFE_CRUX_SOCKET_HPP
 #define MAIDSAFE_CRUX_SOCKET_HPP
 
+#include <array>
+#include <chrono>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <tuple>
+#include <vector>
 
 #include <boost/optional.hpp>
 #include <boost/asio/basic_io_object.hpp>
@@ -24,6 +28,7 @@
 #include <maidsafe/crux/detail/service.hpp>
 #include <maidsafe/crux/detail/cumulative_set.hpp>
 #include <maidsafe/crux/detail/timer.hpp>
+#include <maidsafe/crux/delivery_statistics.hpp>
 #include <maidsafe/crux/endpoint.hpp>
 #include <maidsafe/crux/resolver.hpp>
 
@@ -31,12 +36,19 @@
 #include <maidsafe/crux/detail/receive_output_type.hpp>
 #include <maidsafe/crux/detail/transmit_queue.hpp>
 #include <maidsafe/crux/detail/constants.hpp>
+#include <maidsafe/crux/detail/local_channel.hpp>
+#include <maidsafe/crux/detail/path_set.hpp>
 
 namespace maidsafe
 {
 namespace crux
 {
-namespace detail { class multiplexer; }
+namespace detail
+{
+class multiplexer;
+class key_exchange;
+namespace compression { class compressor; }
+}
 
 class acceptor;
 
@@ -50,6 +62,8 @@ class socket
     using transmit_queue_type = detail::transmit_queue<sequence_type::value_type>;
 
 public:
+    using deadline_type = detail::clock::time_point;
+
     // Construct a socket
     socket(boost::asio::io_service& io);
 
@@ -76,7 +90,20 @@ public:
                   const std::string& remote_service,
                   CompletionToken&& token);
 
-    // Start asynchronous receive on a connected socket
+    // Start asynchronous receive on a connected socket. Messages larger
+    // than the buffers are truncated, and the receive completes with
+    // message_size and the number of bytes copied.
+    template <typename MutableBufferSequence,
+              typename CompletionToken>
+    typename boost::asio::async_result<
+        typename boost::asio::handler_type<CompletionToken,
+                                           void(boost::system::error_code, std::size_t)>::type
+        >::type
+    async_receive(const MutableBufferSequence& buffers,
+                  CompletionToken&& token);
+
+    // Start asynchronous receive that completes with timed_out if no
+    // message has arrived by the deadline
     template <typename MutableBufferSequence,
               typename CompletionToken>
     typename boost::asio::async_result<
@@ -84,9 +111,11 @@ public:
                                            void(boost::system::error_code, std::size_t)>::type
         >::type
     async_receive(const MutableBufferSequence& buffers,
+                  const deadline_type& deadline,
                   CompletionToken&& token);
 
-    // Start asynchronous send on a connected socket
+    // Start asynchronous send on a connected socket. Sends fail with
+    // no_buffer_space while too many messages are queued.
     template <typename ConstBufferSequence,
               typename CompletionToken>
     typename boost::asio::async_result<
@@ -95,12 +124,117 @@ public:
         >::type
     async_send(ConstBufferSequence&& buffers, CompletionToken&& token);
 
+    // Start asynchronous send of a message that is dropped if it has not
+    // been delivered by the deadline. The handler then completes with
+    // timed_out and the remote peer is told to skip the message, so that
+    // stale messages do not hold up fresh ones. Deadlines are ignored
+    // while the connection uses shared memory.
+    template <typename ConstBufferSequence,
+              typename CompletionToken>
+    typename boost::asio::async_result<
+        typename boost::asio::handler_type<CompletionToken,
+                                           void(boost::system::error_code, std::size_t)>::type
+        >::type
+    async_send(ConstBufferSequence&& buffers,
+               const deadline_type& deadline,
+               CompletionToken&& token);
+
     // Get the io_service associated with the socket
     boost::asio::io_service& get_io_service();
 
     // Get the local endpoint of the socket
     endpoint_type local_endpoint() const;
 
+    // Offer to move the connection to shared memory if the peer turns out
+    // to be on the same host and agrees. Must be set before connecting or
+    // accepting, and is ignored where shared memory is not supported.
+    void shared_memory(bool enable);
+    bool shared_memory() const;
+
+    // Whether the connection has been moved to shared memory.
+    bool uses_shared_memory() const;
+
+    // Offer to protect every packet with a CRC-32C trailer in addition to
+    // the UDP checksum. Damaged packets are dropped and retransmitted. Must
+    // be set before connecting or accepting, and takes effect only if the
+    // peer agrees.
+    void checksum(bool enable);
+    bool checksum() const;
+
+    // Whether the peer has agreed on checksums.
+    bool uses_checksum() const;
+
+    // Offer to encrypt and authenticate every packet with ChaCha20-Poly1305,
+    // with keys from an X25519 exchange in the handshake. This keeps out
+    // eavesdroppers and forged packets, but peers are not authenticated,
+    // so it does not keep out an active man in the middle. Must be set
+    // before connecting or accepting, and is ignored if the library is
+    // built without a crypto implementation. Shared memory connections
+    // are not encrypted. Once keys have been agreed on, shutdowns must be
+    // sealed too, and handshakes, which cannot be, are only answered if
+    // they repeat the one that set up the connection.
+    void encryption(bool enable);
+    bool encryption() const;
+
+    // Whether the peer has agreed on encryption.
+    bool uses_encryption() const;
+
+    // Offer to compress messages with LZ4 when that makes them smaller.
+    // Messages below a threshold are always sent as they are. Must be set
+    // before connecting or accepting, and takes effect only if the peer
+    // agrees. Shared memory connections are not compressed.
+    void compression(bool enable);
+    bool compression() const;
+
+    // Data that resembles the messages, such as a few typical ones, which
+    // both peers know in advance. Small messages compress much better with
+    // it. The peers must use the same dictionary, or compression is not
+    // agreed on. Only the last 64 KiB are used.
+    void compression_dictionary(std::shared_ptr<const std::vector<char>> dictionary);
+
+    // Whether the peer has agreed on compression.
+    bool uses_compression() const;
+
+    // Offer to send keepalive and data packets with compact headers, which
+    // leave out the ack when there is none and truncate sequence numbers
+    // to what the peer needs to tell them apart. This saves up to nine
+    // bytes per packet. Must be set before connecting or accepting, and
+    // takes effect only if the peer agrees.
+    void compact_header(bool enable);
+    bool compact_header() const;
+
+    // Whether the peer has agreed on compact headers.
+    bool uses_compact_header() const;
+
+    // Also use another local endpoint, typically on another interface,
+    // once the connection has been established. Each transmission goes
+    // over the path that is expected to deliver it the soonest, and a
+    // retransmission goes over another path than the lost one, so losing
+    // a path does not lose the connection. The remote peer follows by
+    // connection identifier and needs no configuration. Unless encryption
+    // is agreed on, it first challenges each new path, which costs a
+    // retransmission.
+    //
+    // Paths only provide failover, not aggregation. Only one message is in
+    // flight at a time, and the peer answers over whichever path it heard
+    // from last, so several paths do not add up to more throughput than
+    // the best of them.
+    void add_path(const endpoint_type& local_endpoint);
+
+    // Number of paths in use, including the one of the local endpoint.
+    std::size_t path_count() const;
+
+    // Delivery rate, round-trip time and loss estimates derived from the
+    // acknowledgements of what we have sent. They are not updated while
+    // the connection uses shared memory.
+    const delivery_statistics& statistics() const;
+
+    // Called with the updated statistics on every acknowledgement
+    using statistics_handler_type = std::function<void (const delivery_statistics&)>;
+    void statistics_handler(statistics_handler_type handler);
+
+    // Abort pending operations and tell the peer, whose operations then
+    // fail with connection_reset.
     void close() override;
 
 private:
@@ -110,6 +244,7 @@ private:
     void set_multiplexer(std::shared_ptr<detail::multiplexer> multiplexer);
 
     std::vector<boost::asio::mutable_buffer>* get_recv_buffers() override {
+        pop_expired_receives();
         if (receive_input_queue.empty()) {
             return nullptr;
         }
@@ -118,7 +253,9 @@ private:
     }
 
     virtual void process_handshake(sequence_type initial,
-                                   endpoint_type remote_endpoint) override;
+                                   endpoint_type remote_endpoint,
+                                   std::uint16_t options,
+                                   std::shared_ptr<detail::buffer> payload) override;
     virtual void process_acknowledgement(const ack_sequence_type& ack) override;
     virtual void process_data(const boost::system::error_code& error,
                               std::size_t payload_size,
@@ -130,10 +267,16 @@ private:
                         , read_handler_type&&              handler);
 
     void process_keepalive(sequence_type) override;
+    void process_skip(sequence_type) override;
+    void process_shutdown(std::uint16_t connection_id,
+                          sequence_type,
+                          boost::optional<sequence_type> ack) override;
 
     template <typename Handler>
     void send_handshake(endpoint_type remote_endpoint,
                         boost::optional<sequence_type> ack,
+                        std::uint16_t options,
+                        detail::buffer payload,
                         Handler&& handler);
 
     template <typename Handler>
@@ -142,8 +285,8 @@ private:
                         Handler&& handler);
 
     template <typename ConstBufferSequence, typename Handler>
-    void send_data(endpoint_type remote_endpoint,
-                   ConstBufferSequence&&,
+    void send_data(ConstBufferSequence&&,
+                   const deadline_type& deadline,
                    Handler&& handler);
 
 private:
@@ -178,17 +321,56 @@ private:
                                           const MutableBufferSequence&,
                                           read_handler_type&&);
 
-    bool is_expected_packet(sequence_type seq);
+    bool is_expected_packet(sequence_type seq) override;
+    bool is_expected_skip(sequence_type last) override;
+    bool is_repeated_handshake(sequence_type initial) const;
+    bool is_repeated_packet(sequence_type seq);
+    sequence_type expected_sequence() override;
+    sequence_type last_sent_sequence() const override;
+
+    // Bytes of the sequence number in a compact header, or zero for a
+    // full header
+    std::size_t compact_width() const;
+
+    void reserve_connection_id();
+
+    // Generates our half of the key exchange if encryption is enabled, and
+    // sets up the cipher once the public key of the peer is known.
+    void start_key_exchange();
+    bool finish_key_exchange(std::uint16_t options,
+                             const std::shared_ptr<detail::buffer>& payload,
+                             bool initiator);
+
+    // Whether the handshake offers or echoes compression with the same
+    // dictionary as ours.
+    bool accepts_compression(std::uint16_t options,
+                             const std::shared_ptr<detail::buffer>& payload) const;
+
+    // Public key and dictionary identifier, as far as the options say so,
+    // followed by our connection identifier
+    detail::buffer handshake_payload(std::uint16_t options) const;
+
+    void open_paths();
+    detail::multiplexer& path(std::size_t index);
+    detail::multiplexer& select_path();
+
+    void abort_operations(const boost::system::error_code&) override;
 
     void on_any_packet_received();
     void idempotent_start_receive() override;
     void idempotent_stop_receive();
     void on_keepalive_timeout();
 
+    void on_receive_deadline();
+    void start_receive_timer();
+    void pop_expired_receives();
+
 private:
     std::shared_ptr<detail::multiplexer> multiplexer;
 
-    std::queue<std::unique_ptr<detail::receive_input_type>> receive_input_queue;
+    // Receive operations that have expired stay here, without a handler,
+    // until they reach the front.
+    std::deque<std::unique_ptr<detail::receive_input_type>> receive_input_queue;
     std::queue<std::unique_ptr<detail::receive_output_type>> receive_output_queue;
 
 
@@ -201,10 +383,39 @@ private:
 
     using sequence_history_type = detail::cumulative_set<sequence_type, ack_field_type>;
     sequence_history_type sequence_history;
+    // The peer retransmits its handshake with the same initial sequence
+    // number until it is answered.
+    sequence_type remote_initial;
+    // Our handshake, which refusals acknowledge
+    sequence_type local_initial;
 
     bool is_receiving;
 
     detail::timer keepalive_timer;
+    detail::timer receive_timer;
+
+    bool shared_memory_enabled;
+    std::shared_ptr<detail::local_channel> channel;
+
+    bool checksum_enabled;
+
+    // Our half of the key exchange, until the handshake is done
+    bool encryption_enabled;
+    std::shared_ptr<detail::key_exchange> exchange;
+
+    bool compression_enabled;
+    std::shared_ptr<detail::compression::compressor> compressor;
+
+    bool compact_header_enabled;
+    // The latest of our sequence numbers that the peer has acknowledged,
+    // which bounds those that may still be in flight
+    boost::optional<sequence_type> acknowledged;
+
+    // Multiplexers of the additional local endpoints. Paths are numbered
+    // from the local endpoint of the socket, followed by these. The
+    // statistics are shared with transmissions that may outlive us.
+    std::vector<std::shared_ptr<detail::multiplexer>> paths;
+    std::shared_ptr<detail::path_set> path_statistics;
 };
 
 } // namespace crux
@@ -214,6 +425,10 @@ private:
 #include <functional>
 #include <boost/asio/error.hpp>
 #include <boost/asio/io_service.hpp>
+#include <maidsafe/crux/detail/compact_header.hpp>
+#include <maidsafe/crux/detail/compression.hpp>
+#include <maidsafe/crux/detail/encoder.hpp>
+#include <maidsafe/crux/detail/decoder.hpp>
 #include <maidsafe/crux/detail/multiplexer.hpp>
 
 namespace maidsafe
@@ -226,7 +441,13 @@ inline socket::socket(boost::asio::io_service& io)
       next_sequence(get_service().random()),
       transmit_queue(io),
       is_receiving(false),
-      keepalive_timer(io, [=]() { on_keepalive_timeout(); })
+      keepalive_timer(io, [=]() { on_keepalive_timeout(); }),
+      receive_timer(io, [=]() { on_receive_deadline(); }),
+      shared_memory_enabled(false),
+      checksum_enabled(false),
+      encryption_enabled(false),
+      compression_enabled(false),
+      compact_header_enabled(false)
 {
 }
 
@@ -237,7 +458,13 @@ inline socket::socket(boost::asio::io_service& io,
       next_sequence(get_service().random()),
       transmit_queue(io),
       is_receiving(false),
-      keepalive_timer(io, [=]() { on_keepalive_timeout(); })
+      keepalive_timer(io, [=]() { on_keepalive_timeout(); }),
+      receive_timer(io, [=]() { on_receive_deadline(); }),
+      shared_memory_enabled(false),
+      checksum_enabled(false),
+      encryption_enabled(false),
+      compression_enabled(false),
+      compact_header_enabled(false)
 {
 }
 
@@ -250,34 +477,68 @@ inline void socket::close() {
     // Already closed?
     if (!multiplexer) return;
 
-    keepalive_timer.stop();
-    transmit_queue.shutdown();
-
-    while (!receive_input_queue.empty()) {
-        auto handler = std::move(receive_input_queue.front()->handler);
-        receive_input_queue.pop();
-
-        get_io_service().post([handler]() {
-                handler(boost::asio::error::operation_aborted, 0);
-                });
+    if (state() == connectivity::established) {
+        // The peer learns about it right away rather than when its
+        // keepalive timer runs out.
+        multiplexer->send_shutdown(*this);
     }
 
+    keepalive_timer.stop();
+    receive_timer.stop();
+    abort_operations(boost::asio::error::operation_aborted);
+
     get_service().remove(local_endpoint());
     idempotent_stop_receive();
     multiplexer->remove(this);
     multiplexer = 0;
+
+    std::vector<endpoint_type> path_endpoints;
+    for (auto& path : paths) {
+        path_endpoints.push_back(path->next_layer().local_endpoint());
+        path->remove(this);
+    }
+    paths.clear();
+    path_statistics.reset();
+    for (const auto& endpoint : path_endpoints) {
+        get_service().remove(endpoint);
+    }
+}
+
+inline void socket::abort_operations(const boost::system::error_code& error) {
+    if (channel) {
+        channel->close(error);
+        channel.reset();
+    }
+
+    transmit_queue.shutdown(error);
+
+    while (!receive_input_queue.empty()) {
+        auto handler = std::move(receive_input_queue.front()->handler);
+        receive_input_queue.pop_front();
+
+        if (handler) {
+            get_io_service().post([handler, error]() {
+                    handler(error, 0);
+                    });
+        }
+    }
 }
 
 inline void socket::idempotent_stop_receive() {
     if (!is_receiving) { return; }
     is_receiving = false;
-    multiplexer->stop_receive();
+    // The multiplexers of all paths keep receiving for us.
+    if (!path_statistics) {
+        multiplexer->stop_receive();
+    }
 }
 
 inline void socket::idempotent_start_receive() {
     if (is_receiving) { return; }
     is_receiving = true;
-    multiplexer->start_receive();
+    if (!path_statistics) {
+        multiplexer->start_receive();
+    }
 
     keepalive_timer.set_period(detail::constant::keepalive_timeout);
     keepalive_timer.start();
@@ -292,6 +553,54 @@ inline void socket::on_keepalive_timeout() {
     close();
 }
 
+inline void socket::on_receive_deadline() {
+    const auto now = detail::clock::now();
+
+    if (channel) {
+        channel->expire(now);
+    }
+
+    for (auto& input : receive_input_queue) {
+        if (input->handler && input->deadline <= now) {
+            auto handler = std::move(input->handler);
+            input->handler = nullptr;
+
+            get_io_service().post([handler]() {
+                    handler(boost::asio::error::timed_out, 0);
+                    });
+        }
+    }
+
+    pop_expired_receives();
+    start_receive_timer();
+}
+
+inline void socket::start_receive_timer() {
+    auto deadline = channel ? channel->next_deadline() : deadline_type::max();
+    for (const auto& input : receive_input_queue) {
+        if (input->handler) {
+            deadline = std::min(deadline, input->deadline);
+        }
+    }
+
+    if (deadline == deadline_type::max()) {
+        receive_timer.stop();
+        return;
+    }
+
+    const auto now = detail::clock::now();
+    receive_timer.set_period((deadline > now)
+                             ? std::chrono::duration_cast<detail::timer::duration_type>(deadline - now)
+                             : detail::timer::duration_type::zero());
+    receive_timer.start();
+}
+
+inline void socket::pop_expired_receives() {
+    while (!receive_input_queue.empty() && !receive_input_queue.front()->handler) {
+        receive_input_queue.pop_front();
+    }
+}
+
 inline boost::asio::io_service& socket::get_io_service()
 {
     return boost::asio::basic_io_object<service_type>::get_io_service();
@@ -304,6 +613,143 @@ inline socket::endpoint_type socket::local_endpoint() const
     return multiplexer->next_layer().local_endpoint();
 }
 
+inline void socket::shared_memory(bool enable)
+{
+    shared_memory_enabled = enable;
+}
+
+inline bool socket::shared_memory() const
+{
+    return shared_memory_enabled;
+}
+
+inline bool socket::uses_shared_memory() const
+{
+    return bool(channel);
+}
+
+inline void socket::checksum(bool enable)
+{
+    checksum_enabled = enable;
+}
+
+inline bool socket::checksum() const
+{
+    return checksum_enabled;
+}
+
+inline bool socket::uses_checksum() const
+{
+    return checksum_agreed;
+}
+
+inline void socket::encryption(bool enable)
+{
+    encryption_enabled = enable;
+}
+
+inline bool socket::encryption() const
+{
+    return encryption_enabled;
+}
+
+inline bool socket::uses_encryption() const
+{
+    return has_encryption();
+}
+
+inline void socket::compression(bool enable)
+{
+    compression_enabled = enable;
+}
+
+inline bool socket::compression() const
+{
+    return compression_enabled;
+}
+
+inline void socket::compression_dictionary(std::shared_ptr<const std::vector<char>> value)
+{
+    dictionary = std::move(value);
+}
+
+inline bool socket::uses_compression() const
+{
+    return has_compression();
+}
+
+inline void socket::compact_header(bool enable)
+{
+    compact_header_enabled = enable;
+}
+
+inline bool socket::compact_header() const
+{
+    return compact_header_enabled;
+}
+
+inline bool socket::uses_compact_header() const
+{
+    return has_compact_header();
+}
+
+inline const delivery_statistics& socket::statistics() const
+{
+    return transmit_queue.statistics();
+}
+
+inline void socket::statistics_handler(statistics_handler_type handler)
+{
+    transmit_queue.on_statistics(std::move(handler));
+}
+
+inline void socket::add_path(const endpoint_type& local_endpoint)
+{
+    assert(!path_statistics);
+
+    paths.push_back(get_service().add(local_endpoint));
+}
+
+inline std::size_t socket::path_count() const
+{
+    return path_statistics ? path_statistics->size() : 1;
+}
+
+inline void socket::open_paths()
+{
+    assert(multiplexer);
+
+    if (paths.empty() || path_statistics) {
+        return;
+    }
+
+    path_statistics = std::make_shared<detail::path_set>();
+    path_statistics->add();
+    multiplexer->keep_receiving(this);
+    if (is_receiving) {
+        // Now covered by the line above
+        multiplexer->stop_receive();
+    }
+
+    for (auto& path : paths) {
+        path_statistics->add();
+        path->add(this);
+        path->keep_receiving(this);
+    }
+}
+
+inline detail::multiplexer& socket::path(std::size_t index)
+{
+    assert(index <= paths.size());
+
+    return (index == 0) ? *multiplexer : *paths[index - 1];
+}
+
+inline detail::multiplexer& socket::select_path()
+{
+    return path_statistics ? path(path_statistics->select()) : *multiplexer;
+}
+
 inline bool socket::is_expected_packet(sequence_type seq) {
     // Currently we only let in packets that have sequence
     // number one after the previous one. This will change
@@ -321,6 +767,168 @@ inline bool socket::is_expected_packet(sequence_type seq) {
     return true;
 }
 
+// Packets that have been seen before are retransmitted because their
+// acknowledgement was lost or has not arrived yet.
+inline bool socket::is_repeated_packet(sequence_type seq) {
+    auto last_seen = sequence_history.front();
+    return last_seen && !(*last_seen < seq);
+}
+
+// Handshakes are retransmitted until they are answered, and answers until
+// they are acknowledged, so either may arrive again once it has been seen.
+inline bool socket::is_repeated_handshake(sequence_type initial) const {
+    switch (state())
+    {
+    case connectivity::listening:
+    case connectivity::handshaking:
+    case connectivity::established:
+        return !sequence_history.empty() && (remote_initial == initial);
+    default:
+        return false;
+    }
+}
+
+inline bool socket::is_expected_skip(sequence_type last) {
+    // The sender cannot skip more messages than it may have queued, so
+    // anything further ahead is forged or stale.
+    const auto ahead = expected_sequence().distance(last);
+    return (ahead >= 0)
+        && (static_cast<std::size_t>(ahead) < detail::constant::max_transmit_queue_size);
+}
+
+inline socket::sequence_type socket::expected_sequence() {
+    auto last_seen = sequence_history.front();
+    return last_seen ? last_seen->next() : sequence_type();
+}
+
+inline socket::sequence_type socket::last_sent_sequence() const {
+    return sequence_type(next_sequence.value() - 1);
+}
+
+inline std::size_t socket::compact_width() const {
+    if (!compact_agreed) {
+        return 0;
+    }
+    if (!acknowledged) {
+        return detail::header::compact::max_width;
+    }
+    // Whatever the peer expects next lies between our last acknowledged
+    // sequence number and our next one.
+    return detail::header::compact::width(next_sequence.value() - acknowledged->value());
+}
+
+inline void socket::start_key_exchange() {
+#if defined(MAIDSAFE_CRUX_USE_OPENSSL)
+    if (encryption_enabled && !exchange) {
+        exchange = std::make_shared<detail::key_exchange>();
+        if (!exchange->valid()) {
+            exchange.reset();
+        }
+    }
+#endif
+}
+
+inline detail::buffer socket::handshake_payload(std::uint16_t options) const {
+    detail::buffer result;
+#if defined(MAIDSAFE_CRUX_USE_OPENSSL)
+    if (exchange && (options & detail::header::constant::option_encryption)) {
+        const auto& key = exchange->public_key();
+        result.assign(key.begin(), key.end());
+    }
+#endif
+    if (options & detail::header::constant::option_compression) {
+        result.resize(result.size() + detail::header::constant::dictionary_id_size);
+        detail::encoder encoder(result.data() + result.size()
+                                - detail::header::constant::dictionary_id_size,
+                                result.data() + result.size());
+        encoder.put<std::uint32_t>(detail::compression::dictionary_id(dictionary));
+    }
+    result.resize(result.size() + detail::header::constant::connection_id_size);
+    detail::encoder encoder(result.data() + result.size()
+                            - detail::header::constant::connection_id_size,
+                            result.data() + result.size());
+    encoder.put<std::uint16_t>(local_id);
+    return result;
+}
+
+inline bool socket::finish_key_exchange(std::uint16_t options,
+                                        const std::shared_ptr<detail::buffer>& payload,
+                                        bool initiator) {
+#if defined(MAIDSAFE_CRUX_USE_OPENSSL)
+    if (!(options & detail::header::constant::option_encryption)
+        || !payload
+        || payload->size() < detail::key_exchange::key_size) {
+        return false;
+    }
+
+    // The accepting side only generates its half once it has been asked to
+    start_key_exchange();
+    if (!exchange) {
+        return false;
+    }
+
+    detail::key_exchange::secret_key_type send_key;
+    detail::key_exchange::secret_key_type receive_key;
+    if (!exchange->derive(reinterpret_cast<const std::uint8_t *>(payload->data()),
+                          initiator,
+                          send_key,
+                          receive_key)) {
+        return false;
+    }
+
+    auto result = std::make_shared<detail::aead>(send_key, receive_key);
+    if (!result->valid()) {
+        return false;
+    }
+    cipher = result;
+    return true;
+#else
+    static_cast<void>(options);
+    static_cast<void>(payload);
+    static_cast<void>(initiator);
+    return false;
+#endif
+}
+
+inline bool socket::accepts_compression(std::uint16_t options,
+                                        const std::shared_ptr<detail::buffer>& payload) const {
+    if (!compression_enabled
+        || !(options & detail::header::constant::option_compression)
+        || !payload) {
+        return false;
+    }
+
+    // The identifier follows the public key, if there is one
+    const std::size_t offset = (options & detail::header::constant::option_encryption)
+        ? detail::header::constant::public_key_size
+        : 0;
+    if (payload->size() < offset + detail::header::constant::dictionary_id_size) {
+        return false;
+    }
+    detail::decoder decoder(payload->data() + offset,
+                            detail::header::constant::dictionary_id_size);
+    return decoder.get<std::uint32_t>() == detail::compression::dictionary_id(dictionary);
+}
+
+inline void socket::reserve_connection_id() {
+    assert(multiplexer);
+
+    // Drawn at random, so that the identifier tells nothing about our
+    // sequence numbers. Give up on migration by making it zero if no unique
+    // one turns up on this local endpoint.
+    const int attempts = 16;
+
+    multiplexer->remove_connection_id(local_id, this);
+
+    for (int i = 0; i < attempts; ++i) {
+        local_id = static_cast<std::uint16_t>(get_service().random_nonce());
+        if (multiplexer->add_connection_id(local_id, this)) {
+            return;
+        }
+    }
+    local_id = 0;
+}
+
 template <typename CompletionToken>
 typename boost::asio::async_result<
     typename boost::asio::handler_type<CompletionToken,
@@ -344,30 +952,47 @@ socket::async_connect(endpoint_type remote_endpoint, CompletionToken&& token)
         switch (state())
         {
         case connectivity::closed:
-            if (remote_endpoint.address().is_unspecified()) {
-                if (remote_endpoint.address().is_v4()) {
-                    remote_endpoint.address(boost::asio::ip::address_v4::loopback());
+            {
+                if (remote_endpoint.address().is_unspecified()) {
+                    if (remote_endpoint.address().is_v4()) {
+                        remote_endpoint.address(boost::asio::ip::address_v4::loopback());
+                    }
+                    else {
+                        assert(remote_endpoint.address().is_v6());
+                        remote_endpoint.address(boost::asio::ip::address_v6::loopback());
+                    }
                 }
-                else {
-                    assert(remote_endpoint.address().is_v6());
-                    remote_endpoint.address(boost::asio::ip::address_v6::loopback());
-                }
-            }
-
-            state(connectivity::connecting);
-            remote = remote_endpoint;
-            multiplexer->add(this);
 
-            send_handshake
-                (remote_endpoint, boost::none,
-                 [this, remote_endpoint, handler]
-                 (boost::system::error_code error) mutable
-                 {
-                     if (error) {
-                        return handler(error);
-                     }
-                     this->process_connect(std::forward<handler_type>(handler));
-                 });
+                state(connectivity::connecting);
+                remote = remote_endpoint;
+                multiplexer->add(this);
+                reserve_connection_id();
+                start_key_exchange();
+
+                const std::uint16_t options
+                    = ((shared_memory_enabled
+                        && detail::local_channel::is_same_host(local_endpoint(), remote_endpoint))
+                       ? detail::header::constant::option_shared_memory
+                       : 0)
+                    | (checksum_enabled ? detail::header::constant::option_checksum : 0)
+                    | (exchange ? detail::header::constant::option_encryption : 0)
+                    | (compression_enabled ? detail::header::constant::option_compression : 0)
+                    | (compact_header_enabled ? detail::header::constant::option_compact_header : 0);
+
+                local_initial = next_sequence;
+                send_handshake
+                    (remote_endpoint, boost::none,
+                     options,
+                     handshake_payload(options),
+                     [this, remote_endpoint, handler]
+                     (boost::system::error_code error) mutable
+                     {
+                         if (error) {
+                            return handler(error);
+                         }
+                         this->process_connect(std::forward<handler_type>(handler));
+                     });
+            }
             break;
 
         case connectivity::established:
@@ -511,6 +1136,21 @@ typename boost::asio::async_result<
     >::type
 socket::async_receive(const MutableBufferSequence& buffers,
                       CompletionToken&& token)
+{
+    return async_receive(buffers,
+                         deadline_type::max(),
+                         std::forward<CompletionToken>(token));
+}
+
+template <typename MutableBufferSequence,
+          typename CompletionToken>
+typename boost::asio::async_result<
+    typename boost::asio::handler_type<CompletionToken,
+                                       void(boost::system::error_code, std::size_t)>::type
+    >::type
+socket::async_receive(const MutableBufferSequence& buffers,
+                      const deadline_type& deadline,
+                      CompletionToken&& token)
 {
     using handler_type = typename boost::asio::handler_type<CompletionToken,
                                                             void(boost::system::error_code, std::size_t)>::type;
@@ -523,6 +1163,14 @@ socket::async_receive(const MutableBufferSequence& buffers,
                        boost::asio::error::not_connected,
                        0);
     }
+    else if (channel)
+    {
+        channel->async_receive(buffers, deadline, std::move(handler));
+
+        if (deadline != deadline_type::max()) {
+            start_receive_timer();
+        }
+    }
     else
     {
         if (receive_output_queue.empty())
@@ -531,8 +1179,13 @@ socket::async_receive(const MutableBufferSequence& buffers,
 
             std::unique_ptr<receive_input_type> operation
                 (new receive_input_type(buffers, std::move(handler)));
+            operation->deadline = deadline;
+
+            receive_input_queue.emplace_back(std::move(operation));
 
-            receive_input_queue.emplace(std::move(operation));
+            if (deadline != deadline_type::max()) {
+                start_receive_timer();
+            }
 
             idempotent_start_receive();
         }
@@ -548,7 +1201,7 @@ socket::async_receive(const MutableBufferSequence& buffers,
                      this->copy_buffers_and_process_receive(output->error,
                                                             output->data,
                                                             buffers,
-                                                            handler);
+                                                            std::move(handler));
                  });
         }
     }
@@ -564,12 +1217,17 @@ void socket::copy_buffers_and_process_receive
 {
     namespace asio = boost::asio;
 
-    if (!error)
+    if (error)
     {
-        asio::buffer_copy(user_buffers, asio::buffer(*payload));
+        return process_receive(error, payload->size(), std::move(handler));
     }
 
-    process_receive(error, payload->size(), std::move(handler));
+    const auto size = asio::buffer_copy(user_buffers, asio::buffer(*payload));
+    process_receive((size < payload->size())
+                        ? asio::error::message_size
+                        : boost::system::error_code(),
+                    size,
+                    std::move(handler));
 }
 
 template <typename ConstBufferSequence,
@@ -580,6 +1238,21 @@ typename boost::asio::async_result<
     >::type
 socket::async_send(ConstBufferSequence&& buffers,
                    CompletionToken&& token)
+{
+    return async_send(std::forward<ConstBufferSequence>(buffers),
+                      deadline_type::max(),
+                      std::forward<CompletionToken>(token));
+}
+
+template <typename ConstBufferSequence,
+          typename CompletionToken>
+typename boost::asio::async_result<
+    typename boost::asio::handler_type<CompletionToken,
+                                       void(boost::system::error_code, std::size_t)>::type
+    >::type
+socket::async_send(ConstBufferSequence&& buffers,
+                   const deadline_type& deadline,
+                   CompletionToken&& token)
 {
     using handler_type = typename boost::asio::handler_type<CompletionToken,
                                                             void(boost::system::error_code, std::size_t)>::type;
@@ -592,11 +1265,15 @@ socket::async_send(ConstBufferSequence&& buffers,
                        boost::asio::error::not_connected,
                        0);
     }
+    else if (channel)
+    {
+        channel->async_send(buffers, std::move(handler));
+    }
     else
     {
         send_data
-            (remote,
-             std::forward<ConstBufferSequence>(buffers),
+            (std::forward<ConstBufferSequence>(buffers),
+             deadline,
              [handler] (const boost::system::error_code& error,
                         std::size_t bytes_transferred) mutable
              {
@@ -624,6 +1301,11 @@ void socket::process_data(const boost::system::error_code& error,
     on_any_packet_received();
 
     if (!is_expected_packet(sequence_number)) {
+        if (is_repeated_packet(sequence_number)) {
+            send_keepalive(remote,
+                           sequence_history.front(),
+                           [] (boost::system::error_code) {});
+        }
         // We were receiving, so we need to continue to do so.
         idempotent_start_receive();
         return;
@@ -631,6 +1313,8 @@ void socket::process_data(const boost::system::error_code& error,
 
     sequence_history.insert(sequence_number);
 
+    pop_expired_receives();
+
     // FIXME: Thread-safe
     if (receive_input_queue.empty())
     {
@@ -648,7 +1332,7 @@ void socket::process_data(const boost::system::error_code& error,
         assert(!payload);
 
         auto input = std::move(receive_input_queue.front());
-        receive_input_queue.pop();
+        receive_input_queue.pop_front();
 
         // FIXME: Check the transmission queue if it has jobs and
         // only schedule new job to the queue if it's not empty.
@@ -656,7 +1340,17 @@ void socket::process_data(const boost::system::error_code& error,
                        sequence_history.front(),
                        [] (boost::system::error_code) {});
 
-        process_receive(error, payload_size, std::move(input->handler));
+        // The payload has been received into the buffers of the caller,
+        // as much of it as fits.
+        const auto capacity = boost::asio::buffer_size(input->buffers);
+        if (!error && payload_size > capacity) {
+            process_receive(boost::asio::error::message_size,
+                            capacity,
+                            std::move(input->handler));
+        }
+        else {
+            process_receive(error, payload_size, std::move(input->handler));
+        }
     }
 
     if (!receive_input_queue.empty() || !transmit_queue.empty()) {
@@ -665,22 +1359,89 @@ void socket::process_data(const boost::system::error_code& error,
 }
 
 inline
-void socket::process_keepalive(sequence_type sequence_number) {
+void socket::process_keepalive(sequence_type) {
     on_any_packet_received();
 
-    if (!is_expected_packet(sequence_number)) {
+    // Keepalives carry the next sequence number without using it up, as
+    // they are not retransmitted and a lost one would leave a gap that
+    // holds up everything after it.
+    if (!receive_input_queue.empty()) {
+        idempotent_start_receive();
+    }
+}
+
+inline
+void socket::process_skip(sequence_type last) {
+    on_any_packet_received();
+
+    if (is_repeated_packet(last)) {
+        send_keepalive(remote,
+                       sequence_history.front(),
+                       [] (boost::system::error_code) {});
         idempotent_start_receive();
         return;
     }
 
-    // We need to insert this seq # to the history as well for
-    // the cumulative history to cumulate.
-    sequence_history.insert(sequence_number);
+    if (!is_expected_skip(last)) {
+        idempotent_start_receive();
+        return;
+    }
+
+    // The sender only gives up on messages from the oldest one that it has
+    // not seen acknowledged, so everything that we have not received up to
+    // the last one is skipped at once.
+    sequence_history.insert(expected_sequence(), last);
+
+    // Nothing is delivered, but the sender waits for the ack.
+    send_keepalive(remote,
+                   sequence_history.front(),
+                   [] (boost::system::error_code) {});
+
+    if (!receive_input_queue.empty() || !transmit_queue.empty()) {
+        idempotent_start_receive();
+    }
+}
+
+inline
+void socket::process_shutdown(std::uint16_t connection_id,
+                              sequence_type sequence,
+                              boost::optional<sequence_type> ack) {
+    on_any_packet_received();
+
+    // The remote endpoint has either refused our handshake or dropped the
+    // connection. Anything else is stale or spoofed.
+    boost::system::error_code error;
+    if (state() == connectivity::connecting) {
+        if (ack && (*ack == local_initial)) {
+            error = boost::asio::error::connection_refused;
+        }
+    }
+    else if (state() == connectivity::established) {
+        const auto ahead = expected_sequence().distance(sequence);
+        if ((connection_id == local_id)
+            && (ahead >= 0)
+            && (static_cast<std::size_t>(ahead) <= detail::constant::max_transmit_queue_size)) {
+            error = boost::asio::error::connection_reset;
+        }
+    }
+
+    if (!error) {
+        idempotent_start_receive();
+        return;
+    }
+
+    // Pending operations learn about it before the socket closes, and
+    // the peer need not be told.
+    state(connectivity::closed);
+    abort_operations(error);
+    close();
 }
 
 template <typename Handler>
 void socket::send_handshake(endpoint_type remote_endpoint,
                             boost::optional<sequence_type> ack,
+                            std::uint16_t options,
+                            detail::buffer payload,
                             Handler&& handler)
 {
     assert(multiplexer);
@@ -693,6 +1454,8 @@ void socket::send_handshake(endpoint_type remote_endpoint,
              sequence,
              ack,
              0, // FIXME
+             options,
+             payload,
              [this, handler]
              (boost::system::error_code error)
              {
@@ -718,62 +1481,255 @@ void socket::send_keepalive(endpoint_type remote_endpoint,
 {
     assert(multiplexer);
 
-    auto sequence = next_sequence++;
+    const auto sequence = next_sequence;
 
-    multiplexer->send_keepalive(remote_endpoint,
+    select_path().send_keepalive(remote_endpoint,
                                 sequence,
                                 ack,
                                 0, // FIXME
+                                remote_id,
+                                compact_width(),
+                                checksum_agreed,
+                                cipher,
                                 std::forward<decltype(handler)>(handler));
 }
 
 template <typename ConstBufferSequence, typename Handler>
-void socket::send_data(endpoint_type remote_endpoint,
-                       ConstBufferSequence&& buffers,
+void socket::send_data(ConstBufferSequence&& buffers,
+                       const deadline_type& deadline,
                        Handler&& handler)
 {
     assert(multiplexer);
 
-    auto sequence = next_sequence++;
+    if (transmit_queue.size() >= detail::constant::max_transmit_queue_size) {
+        get_io_service().post([handler]() mutable {
+                handler(boost::asio::error::no_buffer_space, 0);
+            });
+        return;
+    }
 
+    auto sequence = next_sequence;
+
+    // Encoded once, and compressed once if at all, so that retransmissions
+    // send the same bytes. Otherwise the payload refers to the buffers of
+    // the caller, which stay valid until the handler is called, unless they
+    // are too many to gather. The handler is still told the size of the
+    // message.
+    const auto size = boost::asio::buffer_size(buffers);
+    auto packet = multiplexer->make_data_template(sequence, remote_id);
+    std::shared_ptr<detail::buffer> compressed;
+    if (compressor && size >= detail::constant::compression_threshold) {
+        compressed = std::make_shared<detail::buffer>(size);
+        const auto compressed_size = compressor->compress
+            (buffers,
+             reinterpret_cast<std::uint8_t *>(compressed->data()),
+             compressed->size());
+        if (compressed_size > 0) {
+            compressed->resize(compressed_size);
+        }
+        else {
+            compressed.reset();
+        }
+    }
+    if (compressed) {
+        packet->options = detail::header::constant::option_compressed;
+        packet->storage = compressed;
+        packet->payload.push_back(boost::asio::buffer(*compressed));
+    }
+    else {
+        multiplexer->set_payload(*packet, buffers);
+    }
+
+    ++next_sequence;
+
+    if (state() == connectivity::established) {
+        open_paths();
+    }
+
+    struct transmission {
+        std::size_t path = 0;
+        std::size_t count = 0;
+        detail::clock::time_point time;
+    };
+    auto attempt = std::make_shared<transmission>();
+    auto statistics = path_statistics;
+
+    // Retransmissions go to wherever the peer is at the time, which may
+    // differ from the first transmission if the peer has migrated.
     auto send_step = [=](transmit_queue_type::iteration_handler handler) {
-        multiplexer->send_data
-            (buffers, // FIXME: Can be moved? Not sure as this lambda shall be reused
-             remote_endpoint,
-             sequence,
+        std::size_t index = 0;
+        if (statistics) {
+            if (attempt->count > 0) {
+                statistics->on_lost(attempt->path);
+                index = statistics->select(attempt->path);
+            }
+            else {
+                index = statistics->select();
+            }
+        }
+        attempt->path = index;
+        attempt->time = detail::clock::now();
+        ++attempt->count;
+
+        auto on_sent = [handler, statistics, index]
+            (const boost::system::error_code& error,
+             std::size_t bytes_transferred) mutable
+            {
+                if (error && statistics && statistics->size() > 1) {
+                    // Leave it to the retransmission to try another path
+                    statistics->on_error(index);
+                    return handler(boost::system::error_code(), bytes_transferred);
+                }
+                // Process send
+                handler(error, bytes_transferred);
+            };
+
+        path(index).send_data
+            (packet,
+             remote,
              sequence_history.front(),
-             0, // FIMXE
-             [handler] (const boost::system::error_code& error,
-                        std::size_t bytes_transferred) mutable
-             {
-                 // Process send
-                 handler(error, bytes_transferred);
-             });
+             static_cast<std::uint16_t>(attempt->count - 1),
+             compact_width(),
+             checksum_agreed,
+             cipher,
+             std::move(on_sent));
     };
 
+    // Sent instead of the message once the deadline has passed, with the
+    // last of the consecutive expired messages that it stands for
+    transmit_queue_type::skip_step skip_step;
+    if (deadline != deadline_type::max()) {
+        skip_step = [=](sequence_type::value_type last,
+                        transmit_queue_type::iteration_handler handler) {
+            auto skip = multiplexer->make_data_template(sequence_type(last), remote_id);
+            skip->options = detail::header::constant::option_skip;
+
+            select_path().send_data
+                (skip,
+                 remote,
+                 sequence_history.front(),
+                 0,
+                 compact_width(),
+                 checksum_agreed,
+                 cipher,
+                 [handler] (const boost::system::error_code& error, std::size_t) mutable
+                 {
+                     handler(error, 0);
+                 });
+        };
+    }
+
     idempotent_start_receive();
 
     transmit_queue.push( sequence.value()
-                       , boost::asio::buffer_size(buffers)
+                       , size
                        , send_step
-                       , handler);
+                       , [handler, statistics, attempt]
+                         (const boost::system::error_code& error,
+                          std::size_t bytes_transferred) mutable
+                         {
+                             if (!error && statistics) {
+                                 if (attempt->count == 1) {
+                                     statistics->on_acknowledged
+                                         (attempt->path,
+                                          detail::clock::now() - attempt->time);
+                                 }
+                                 else {
+                                     // Karn's algorithm: we cannot tell
+                                     // which transmission was acknowledged.
+                                     statistics->on_acknowledged(attempt->path);
+                                 }
+                             }
+                             handler(error, bytes_transferred);
+                         }
+                       , deadline
+                       , skip_step);
 }
 
 inline
 void socket::process_handshake(sequence_type initial,
-                               endpoint_type remote_endpoint)
+                               endpoint_type remote_endpoint,
+                               std::uint16_t options,
+                               std::shared_ptr<detail::buffer> payload)
 {
     on_any_packet_received();
 
+    if (is_repeated_handshake(initial))
+    {
+        // Our answer is being retransmitted until it is acknowledged, but
+        // the peer may need to see our acknowledgement of its answer again.
+        if (state() == connectivity::established)
+        {
+            send_keepalive(remote_endpoint, initial, [](boost::system::error_code) {});
+        }
+        idempotent_start_receive();
+        return;
+    }
+
+    if (state() != connectivity::listening && state() != connectivity::connecting)
+    {
+        // Only a connection being set up is negotiated, so this handshake
+        // is stale or spoofed.
+        idempotent_start_receive();
+        return;
+    }
+
     sequence_history.insert(initial);
+    remote_initial = initial;
+
+    // The payload ends with the connection identifier of the peer
+    remote_id = 0;
+    if (payload && payload->size() >= detail::header::constant::connection_id_size)
+    {
+        detail::decoder decoder(payload->data() + payload->size()
+                                - detail::header::constant::connection_id_size,
+                                detail::header::constant::connection_id_size);
+        remote_id = decoder.get<std::uint16_t>();
+    }
+
+    // The accepting side echoes the offer if it agrees, and the connecting
+    // side only sees the option if it made the offer.
+    checksum_agreed = checksum_enabled
+        && (options & detail::header::constant::option_checksum);
+    compact_agreed = compact_header_enabled
+        && (options & detail::header::constant::option_compact_header);
+    compression_agreed = accepts_compression(options, payload);
+    if (compression_agreed && !compressor)
+    {
+        compressor = std::make_shared<detail::compression::compressor>(dictionary);
+    }
+
+    const bool offers_shared_memory
+        = shared_memory_enabled
+        && (options & detail::header::constant::option_shared_memory)
+        && detail::local_channel::is_same_host(local_endpoint(), remote_endpoint);
 
     switch (state())
     {
     case connectivity::listening:
         assert(multiplexer);
+        reserve_connection_id();
+        finish_key_exchange(options, payload, false);
+        if (offers_shared_memory)
+        {
+            // Our initial sequence number is the next one to be sent.
+            channel = detail::local_channel::create
+                (get_io_service(),
+                 detail::local_channel::make_name(remote_endpoint,
+                                                  local_endpoint(),
+                                                  next_sequence.value()));
+        }
+        // Echo what we agree to
+        options = (channel ? detail::header::constant::option_shared_memory : 0)
+            | (checksum_agreed ? detail::header::constant::option_checksum : 0)
+            | (cipher ? detail::header::constant::option_encryption : 0)
+            | (compression_agreed ? detail::header::constant::option_compression : 0)
+            | (compact_agreed ? detail::header::constant::option_compact_header : 0);
         send_handshake
             (remote_endpoint,
              initial,
+             options,
+             handshake_payload(options),
              [this, remote_endpoint, initial]
              (boost::system::error_code error) mutable
              {
@@ -785,17 +1741,44 @@ void socket::process_handshake(sequence_type initial,
                  {
                      state(connectivity::established);
                      remote = remote_endpoint;
-                     if (connect_handler)
+                 }
+                 if (channel)
+                 {
+                     // The peer attaches before acknowledging our handshake,
+                     // so by now we know whether it managed to.
+                     if (!error && channel->is_attached())
                      {
-                         connect_handler(error);
-                         connect_handler = nullptr;
+                         channel->unlink();
                      }
+                     else
+                     {
+                         channel.reset();
+                     }
+                 }
+                 if (connect_handler)
+                 {
+                     auto handler = std::move(connect_handler);
+                     connect_handler = nullptr;
+                     handler(error);
                  }
              });
+        exchange.reset();
         break;
 
     case connectivity::connecting:
         state(connectivity::handshaking);
+        finish_key_exchange(options, payload, true);
+        exchange.reset();
+        if (offers_shared_memory)
+        {
+            // Falls back to UDP if this fails, as the peer only switches
+            // once it sees that we have attached.
+            channel = detail::local_channel::attach
+                (get_io_service(),
+                 detail::local_channel::make_name(local_endpoint(),
+                                                  remote_endpoint,
+                                                  initial.value()));
+        }
         send_keepalive
             (remote_endpoint,
              initial,
@@ -811,12 +1794,6 @@ void socket::process_handshake(sequence_type initial,
              });
         break;
 
-    case connectivity::handshaking:
-        assert(false);
-        break;
-    case connectivity::established:
-        assert(false);
-        break;
     default:
         // FIXME: If state == handshaking with the same remote_endpoint as before then remote probably crashed and attempts a new connection (allow reuse_address?)
         assert(false);
@@ -854,6 +1831,10 @@ void socket::process_acknowledgement(const ack_sequence_type& ack)
         break;
     }
 
+    if (!acknowledged || *acknowledged < ack) {
+        acknowledged = ack;
+    }
+
     transmit_queue.apply_ack(ack.value());
 
     if (!transmit_queue.empty()) {
@@ -0,0 +1,395 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MAIDSAFE_CRUX_STREAM_SOCKET_HPP
+#define MAIDSAFE_CRUX_STREAM_SOCKET_HPP
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/version.hpp>
+#include <maidsafe/crux/endpoint.hpp>
+#include <maidsafe/crux/socket.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+// Ordered byte stream on top of a reliable crux::socket.
+//
+// Writes are cut into datagram sized messages, and reads return whatever is
+// contiguously available, so the class models the AsyncReadStream and
+// AsyncWriteStream concepts and works with asio composed operations. Both
+// ends of a connection must use stream_socket.
+//
+// Written bytes are copied into a window of segments that are queued on the
+// next layer, and a write completes as soon as its bytes have been accepted
+// into the window rather than when they have been acknowledged. A write
+// only waits when the window is full. Closing the socket discards segments
+// that have not been acknowledged yet.
+//
+// Reads fail with boost::asio::error::eof once the peer has closed the
+// connection or it has been shut down.
+//
+// Connections are accepted into next_layer().
+class stream_socket
+{
+public:
+    using next_layer_type = crux::socket;
+    using endpoint_type = crux::endpoint;
+
+    explicit stream_socket(boost::asio::io_service& io);
+
+    stream_socket(boost::asio::io_service& io,
+                  const endpoint_type& local_endpoint);
+
+    template <typename CompletionToken>
+    typename boost::asio::async_result<
+        typename boost::asio::handler_type<CompletionToken,
+                                           void(boost::system::error_code)>::type
+        >::type
+    async_connect(endpoint_type remote_endpoint, CompletionToken&& token);
+
+    // Read at least one byte, unless the buffers are empty
+    template <typename MutableBufferSequence,
+              typename CompletionToken>
+    typename boost::asio::async_result<
+        typename boost::asio::handler_type<CompletionToken,
+                                           void(boost::system::error_code, std::size_t)>::type
+        >::type
+    async_read_some(const MutableBufferSequence& buffers,
+                    CompletionToken&& token);
+
+    // Write at most as many bytes as there is room for in the window
+    template <typename ConstBufferSequence,
+              typename CompletionToken>
+    typename boost::asio::async_result<
+        typename boost::asio::handler_type<CompletionToken,
+                                           void(boost::system::error_code, std::size_t)>::type
+        >::type
+    async_write_some(const ConstBufferSequence& buffers,
+                     CompletionToken&& token);
+
+    boost::asio::io_service& get_io_service();
+
+#if BOOST_ASIO_VERSION >= 101100
+    // Composed operations in newer versions of asio look for an executor
+    using executor_type = boost::asio::io_service::executor_type;
+    executor_type get_executor();
+#endif
+
+    next_layer_type& next_layer();
+    const next_layer_type& next_layer() const;
+
+    endpoint_type local_endpoint() const;
+    endpoint_type remote_endpoint() const;
+
+    void close();
+
+private:
+    // Bytes of the last message that did not fit in the reader's buffers.
+    struct pending_type
+    {
+        std::vector<char> data;
+        std::size_t offset = 0;
+
+        std::size_t size() const { return data.size() - offset; }
+    };
+
+    // Segments that have been written but not acknowledged.
+    struct window_type
+    {
+        std::size_t outstanding = 0;
+        // First send error, which fails all later writes.
+        boost::system::error_code error;
+        // Write that waits for room in the window.
+        std::function<void ()> waiting;
+    };
+
+    template <typename ConstBufferSequence>
+    std::size_t enqueue(const ConstBufferSequence& buffers);
+    void send_segment(std::shared_ptr<std::vector<char>> segment);
+
+    static boost::system::error_code
+    to_stream_error(const boost::system::error_code& error);
+
+    next_layer_type socket;
+    std::shared_ptr<pending_type> pending;
+    std::shared_ptr<window_type> window;
+};
+
+} // namespace crux
+} // namespace maidsafe
+
+#include <algorithm>
+#include <boost/asio/error.hpp>
+#include <maidsafe/crux/detail/constants.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+
+inline stream_socket::stream_socket(boost::asio::io_service& io)
+    : socket(io)
+    , pending(std::make_shared<pending_type>())
+    , window(std::make_shared<window_type>())
+{
+}
+
+inline stream_socket::stream_socket(boost::asio::io_service& io,
+                                    const endpoint_type& local_endpoint)
+    : socket(io, local_endpoint)
+    , pending(std::make_shared<pending_type>())
+    , window(std::make_shared<window_type>())
+{
+}
+
+template <typename CompletionToken>
+typename boost::asio::async_result<
+    typename boost::asio::handler_type<CompletionToken,
+                                       void(boost::system::error_code)>::type
+    >::type
+stream_socket::async_connect(endpoint_type remote_endpoint, CompletionToken&& token)
+{
+    return socket.async_connect(remote_endpoint, std::forward<CompletionToken>(token));
+}
+
+template <typename MutableBufferSequence,
+          typename CompletionToken>
+typename boost::asio::async_result<
+    typename boost::asio::handler_type<CompletionToken,
+                                       void(boost::system::error_code, std::size_t)>::type
+    >::type
+stream_socket::async_read_some(const MutableBufferSequence& buffers,
+                               CompletionToken&& token)
+{
+    namespace asio = boost::asio;
+
+    using handler_type = typename boost::asio::handler_type<CompletionToken,
+                                                            void(boost::system::error_code, std::size_t)>::type;
+    handler_type handler(std::forward<decltype(token)>(token));
+    boost::asio::async_result<decltype(handler)> result(handler);
+
+    const auto wanted = asio::buffer_size(buffers);
+
+    if (wanted == 0 || pending->size() > 0)
+    {
+        // Serve what is left of the previous message first.
+        const auto size = asio::buffer_copy(buffers,
+                                            asio::buffer(pending->data) + pending->offset);
+        pending->offset += size;
+
+        get_io_service().post([handler, size]() mutable
+                              {
+                                  handler(boost::system::error_code(), size);
+                              });
+    }
+    else if (wanted >= detail::constant::max_payload_size)
+    {
+        // Every message fits, so receive straight into the caller's buffers.
+        socket.async_receive
+            (buffers,
+             [handler](const boost::system::error_code& error, std::size_t length) mutable
+             {
+                 handler(to_stream_error(error), length);
+             });
+    }
+    else
+    {
+        auto state = pending;
+        state->data.resize(detail::constant::max_payload_size);
+        state->offset = 0;
+
+        socket.async_receive
+            (asio::buffer(state->data),
+             [state, buffers, handler]
+             (const boost::system::error_code& error, std::size_t length) mutable
+             {
+                 state->data.resize(error ? 0 : length);
+                 const auto size = asio::buffer_copy(buffers, asio::buffer(state->data));
+                 state->offset = size;
+                 handler(to_stream_error(error), size);
+             });
+    }
+    return result.get();
+}
+
+template <typename ConstBufferSequence,
+          typename CompletionToken>
+typename boost::asio::async_result<
+    typename boost::asio::handler_type<CompletionToken,
+                                       void(boost::system::error_code, std::size_t)>::type
+    >::type
+stream_socket::async_write_some(const ConstBufferSequence& buffers,
+                                CompletionToken&& token)
+{
+    namespace asio = boost::asio;
+
+    using handler_type = typename boost::asio::handler_type<CompletionToken,
+                                                            void(boost::system::error_code, std::size_t)>::type;
+    handler_type handler(std::forward<decltype(token)>(token));
+    boost::asio::async_result<decltype(handler)> result(handler);
+
+    if (window->error || asio::buffer_size(buffers) == 0)
+    {
+        const auto error = window->error;
+        get_io_service().post([handler, error]() mutable
+                              {
+                                  handler(error, 0);
+                              });
+    }
+    else if (window->outstanding < detail::constant::stream_window)
+    {
+        const auto size = enqueue(buffers);
+        get_io_service().post([handler, size]() mutable
+                              {
+                                  handler(boost::system::error_code(), size);
+                              });
+    }
+    else
+    {
+        // Resumed by the completion of a segment.
+        auto state = window;
+        window->waiting = [this, state, buffers, handler]() mutable
+        {
+            if (state->error)
+            {
+                return handler(state->error, 0);
+            }
+            handler(boost::system::error_code(), enqueue(buffers));
+        };
+    }
+    return result.get();
+}
+
+template <typename ConstBufferSequence>
+std::size_t stream_socket::enqueue(const ConstBufferSequence& buffers)
+{
+    namespace asio = boost::asio;
+    using segment_type = std::vector<char>;
+
+    const auto room = (detail::constant::stream_window - window->outstanding)
+        * detail::constant::max_payload_size;
+    const auto size = std::min(asio::buffer_size(buffers), room);
+
+    // The bytes are copied because the write completes before they have
+    // been acknowledged.
+    std::shared_ptr<segment_type> segment;
+    std::size_t segment_size = 0;
+    std::size_t remaining = size;
+    for (const auto& buffer : buffers)
+    {
+        asio::const_buffer rest(buffer);
+        while (remaining > 0 && asio::buffer_size(rest) > 0)
+        {
+            if (!segment)
+            {
+                segment_size = std::min(detail::constant::max_payload_size, remaining);
+                segment = std::make_shared<segment_type>();
+                segment->reserve(segment_size);
+            }
+            const auto length = std::min({ asio::buffer_size(rest),
+                                           remaining,
+                                           segment_size - segment->size() });
+            const auto data = asio::buffer_cast<const char*>(rest);
+            segment->insert(segment->end(), data, data + length);
+            rest = rest + length;
+            remaining -= length;
+
+            if (segment->size() == segment_size)
+            {
+                send_segment(std::move(segment));
+                segment.reset();
+            }
+        }
+    }
+    return size;
+}
+
+inline void stream_socket::send_segment(std::shared_ptr<std::vector<char>> segment)
+{
+    ++window->outstanding;
+
+    auto state = window;
+    socket.async_send(boost::asio::buffer(*segment),
+                      [state, segment](const boost::system::error_code& error,
+                                       std::size_t)
+                      {
+                          --state->outstanding;
+                          if (error && !state->error)
+                          {
+                              state->error = to_stream_error(error);
+                          }
+                          if (state->waiting)
+                          {
+                              auto waiting = std::move(state->waiting);
+                              state->waiting = nullptr;
+                              waiting();
+                          }
+                      });
+}
+
+inline boost::system::error_code
+stream_socket::to_stream_error(const boost::system::error_code& error)
+{
+    // The peer has shut the connection down.
+    if (error == boost::asio::error::connection_reset)
+    {
+        return boost::asio::error::eof;
+    }
+    return error;
+}
+
+inline boost::asio::io_service& stream_socket::get_io_service()
+{
+    return socket.get_io_service();
+}
+
+#if BOOST_ASIO_VERSION >= 101100
+inline stream_socket::executor_type stream_socket::get_executor()
+{
+    return get_io_service().get_executor();
+}
+#endif
+
+inline stream_socket::next_layer_type& stream_socket::next_layer()
+{
+    return socket;
+}
+
+inline const stream_socket::next_layer_type& stream_socket::next_layer() const
+{
+    return socket;
+}
+
+inline stream_socket::endpoint_type stream_socket::local_endpoint() const
+{
+    return socket.local_endpoint();
+}
+
+inline stream_socket::endpoint_type stream_socket::remote_endpoint() const
+{
+    return socket.remote_endpoint();
+}
+
+inline void stream_socket::close()
+{
+    socket.close();
+}
+
+} // namespace crux
+} // namespace maidsafe
+
+#endif // MAIDSAFE_CRUX_STREAM_SOCKET_HPP
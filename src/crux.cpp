@@ -0,0 +1,38 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// The parts of the library that are compiled once when
+// MAIDSAFE_CRUX_SEPARATE_COMPILATION is defined. Empty otherwise.
+
+#include <maidsafe/crux/detail/config.hpp>
+
+#if !defined(MAIDSAFE_CRUX_HEADER_ONLY)
+
+#include <cstdint>
+#include <maidsafe/crux/detail/impl/compact_header.ipp>
+#include <maidsafe/crux/detail/impl/multiplexer.ipp>
+#include <maidsafe/crux/detail/impl/service.ipp>
+#include <maidsafe/crux/detail/impl/timer.ipp>
+#include <maidsafe/crux/detail/transmit_queue.hpp>
+
+namespace maidsafe
+{
+namespace crux
+{
+namespace detail
+{
+
+template class transmit_queue<std::uint32_t>;
+
+} // namespace detail
+} // namespace crux
+} // namespace maidsafe
+
+#endif
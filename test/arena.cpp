@@ -0,0 +1,139 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include <maidsafe/crux/detail/arena.hpp>
+#include <maidsafe/crux/detail/buffer.hpp>
+#include <maidsafe/crux/detail/buffer_pool.hpp>
+#include <maidsafe/crux/detail/constants.hpp>
+
+namespace detail = maidsafe::crux::detail;
+
+using detail::arena;
+
+BOOST_AUTO_TEST_SUITE(arena_suite)
+
+BOOST_AUTO_TEST_CASE(slots)
+{
+    auto memory = arena::create(256, 4, arena::options());
+    BOOST_REQUIRE_EQUAL(memory->capacity(), 4U);
+    BOOST_REQUIRE_EQUAL(memory->available(), 4U);
+    BOOST_REQUIRE(memory->allocate(257) == nullptr);
+
+    std::vector<void *> taken;
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        taken.push_back(memory->allocate(100));
+        BOOST_REQUIRE(taken.back() != nullptr);
+    }
+    BOOST_REQUIRE(memory->allocate(1) == nullptr);
+    BOOST_REQUIRE_EQUAL(static_cast<char *>(taken[1]) - static_cast<char *>(taken[0]), 256);
+
+    int elsewhere = 0;
+    BOOST_REQUIRE(!memory->deallocate(&elsewhere));
+    for (auto slot : taken)
+    {
+        BOOST_REQUIRE(memory->deallocate(slot));
+    }
+    BOOST_REQUIRE_EQUAL(memory->available(), 4U);
+}
+
+BOOST_AUTO_TEST_CASE(huge_pages)
+{
+    // Whatever the system offers, the region is usable and rounded up to
+    // whole huge pages unless it comes from the heap.
+    arena::options settings;
+    settings.huge_pages = true;
+    settings.local_node = true;
+    auto memory = arena::create(detail::constant::arena_slot_size, 4, settings);
+
+    if (memory->memory() == arena::backing::heap)
+    {
+        BOOST_REQUIRE_EQUAL(memory->capacity(), 4U);
+    }
+    else
+    {
+        BOOST_REQUIRE_EQUAL(memory->capacity(),
+                            detail::constant::huge_page_size / detail::constant::arena_slot_size);
+    }
+
+    char *slot = static_cast<char *>(memory->allocate(detail::constant::arena_slot_size));
+    BOOST_REQUIRE(slot != nullptr);
+    slot[0] = 1;
+    slot[detail::constant::arena_slot_size - 1] = 2;
+    BOOST_REQUIRE(memory->deallocate(slot));
+}
+
+BOOST_AUTO_TEST_CASE(allocator)
+{
+    auto memory = arena::create(64, 2, arena::options());
+    detail::buffer::allocator_type allocator(memory);
+
+    detail::buffer first(32, 'a', allocator);
+    BOOST_REQUIRE_EQUAL(memory->available(), 1U);
+
+    // Too large for a slot
+    detail::buffer large(100, 'b', allocator);
+    BOOST_REQUIRE_EQUAL(memory->available(), 1U);
+
+    // Copies do not take slots, moves keep theirs
+    detail::buffer copy(first);
+    BOOST_REQUIRE(copy == first);
+    BOOST_REQUIRE_EQUAL(memory->available(), 1U);
+    detail::buffer moved(std::move(first));
+    BOOST_REQUIRE_EQUAL(memory->available(), 1U);
+    BOOST_REQUIRE(moved.get_allocator() == allocator);
+
+    // Growing beyond the slot gives it back
+    moved.resize(200);
+    BOOST_REQUIRE_EQUAL(memory->available(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(pool)
+{
+    arena::options settings;
+    settings.local_node = true;
+    auto pool = detail::buffer_pool::create(2, settings);
+    BOOST_REQUIRE(!pool->memory());
+
+    auto first = pool->acquire(detail::constant::max_datagram_size);
+    BOOST_REQUIRE(pool->memory());
+    auto memory = pool->memory();
+    BOOST_REQUIRE_EQUAL(memory->available(), memory->capacity() - 1);
+
+    const void *data = first->data();
+    first.reset();
+    BOOST_REQUIRE_EQUAL(pool->size(), 1U);
+    BOOST_REQUIRE_EQUAL(memory->available(), memory->capacity() - 1);
+
+    // Reused with the same slot
+    auto second = pool->acquire(100);
+    BOOST_REQUIRE(second->data() == data);
+
+    // The arena outlives the pool while buffers use it
+    pool.reset();
+    memory.reset();
+    second->assign(10, 'x');
+    second.reset();
+}
+
+BOOST_AUTO_TEST_CASE(pool_without_arena)
+{
+    auto pool = detail::buffer_pool::create(2);
+    auto datagram = pool->acquire(100);
+    BOOST_REQUIRE(!pool->memory());
+    BOOST_REQUIRE(!datagram->get_allocator().source());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
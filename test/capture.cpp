@@ -0,0 +1,187 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include <boost/system/error_code.hpp>
+#include <maidsafe/crux/socket.hpp>
+#include <maidsafe/crux/acceptor.hpp>
+#include <maidsafe/crux/capture.hpp>
+#include <maidsafe/crux/detail/header_view.hpp>
+
+namespace asio = boost::asio;
+using error_code    = boost::system::error_code;
+using endpoint_type = boost::asio::ip::udp::endpoint;
+using maidsafe::crux::detail::captured_datagram;
+using maidsafe::crux::detail::capture_reader;
+using maidsafe::crux::detail::capture_writer;
+
+namespace
+{
+
+std::vector<captured_datagram> read_all(const std::string& path)
+{
+    std::vector<captured_datagram> result;
+    auto reader = capture_reader::open(path);
+    BOOST_REQUIRE(reader);
+    captured_datagram datagram;
+    while (reader->read(datagram))
+    {
+        result.push_back(datagram);
+    }
+    return result;
+}
+
+captured_datagram make_datagram(const endpoint_type& source,
+                                const endpoint_type& destination,
+                                const std::string& payload)
+{
+    captured_datagram result;
+    result.time = std::chrono::microseconds(1234567890123456);
+    result.source = source;
+    result.destination = destination;
+    result.payload.assign(payload.begin(), payload.end());
+    return result;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(capture_suite)
+
+BOOST_AUTO_TEST_CASE(round_trip)
+{
+    using namespace boost::asio::ip;
+
+    const std::string path = "crux_capture_round_trip.pcap";
+
+    const auto version4 = make_datagram(endpoint_type(address_v4::loopback(), 1234),
+                                        endpoint_type(address_v4::from_string("10.0.0.1"), 5678),
+                                        "alpha");
+    const auto version6 = make_datagram(endpoint_type(address_v6::loopback(), 4321),
+                                        endpoint_type(address_v6::from_string("fe80::1"), 8765),
+                                        "");
+    {
+        auto writer = capture_writer::create(path);
+        BOOST_REQUIRE(writer);
+        writer->write(version4);
+        writer->write(version6);
+        writer->write(version6.source,
+                      version6.destination,
+                      asio::buffer(version4.payload));
+        BOOST_REQUIRE_EQUAL(writer->size(), 3u);
+    }
+
+    const auto datagrams = read_all(path);
+    std::remove(path.c_str());
+
+    BOOST_REQUIRE_EQUAL(datagrams.size(), 3u);
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        const auto& expected = (i == 0) ? version4 : version6;
+        BOOST_REQUIRE(datagrams[i].time == expected.time);
+        BOOST_REQUIRE_EQUAL(datagrams[i].source, expected.source);
+        BOOST_REQUIRE_EQUAL(datagrams[i].destination, expected.destination);
+        BOOST_REQUIRE(datagrams[i].payload == expected.payload);
+    }
+    BOOST_REQUIRE(datagrams[2].payload == version4.payload);
+}
+
+BOOST_AUTO_TEST_CASE(not_a_capture)
+{
+    const std::string path = "crux_capture_not_a_capture.pcap";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "This is not a capture, but it is long enough to be one";
+    }
+    BOOST_REQUIRE(!capture_reader::open(path));
+    std::remove(path.c_str());
+
+    BOOST_REQUIRE(!capture_reader::open("crux_capture_does_not_exist.pcap"));
+}
+
+BOOST_AUTO_TEST_CASE(sockets)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+    namespace header = crux::detail::header;
+
+    const std::string path = "crux_capture_sockets.pcap";
+    const std::string message = "hello";
+
+    asio::io_service ios;
+    BOOST_REQUIRE(crux::start_capture(ios, path));
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    std::vector<char> received(message.size());
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+        BOOST_REQUIRE(!error);
+        server_socket.async_receive(asio::buffer(received), [&](error_code error, std::size_t) {
+            BOOST_REQUIRE(!error);
+            tested_receive = true;
+            server_socket.close();
+        });
+    });
+
+    client_socket.async_connect(acceptor.local_endpoint(), [&](error_code error) {
+        BOOST_REQUIRE(!error);
+        client_socket.async_send(asio::buffer(message), [&](error_code error, std::size_t) {
+            BOOST_REQUIRE(!error);
+            client_socket.close();
+        });
+    });
+
+    ios.run();
+    crux::stop_capture(ios);
+
+    BOOST_REQUIRE(tested_receive);
+
+    const auto datagrams = read_all(path);
+    std::remove(path.c_str());
+
+    // Both sides record the handshakes and the message, as sent and as
+    // received
+    std::size_t handshakes = 0;
+    std::size_t messages = 0;
+    for (const auto& datagram : datagrams)
+    {
+        const auto data = reinterpret_cast<const std::uint8_t *>(datagram.payload.data());
+        const header::view view(data, datagram.payload.size());
+        BOOST_REQUIRE(view.is_valid());
+        if (view.type() == header::constant::type_handshake)
+        {
+            ++handshakes;
+        }
+        const std::string payload(datagram.payload.begin(), datagram.payload.end());
+        if (payload.find(message) != std::string::npos)
+        {
+            ++messages;
+        }
+    }
+    BOOST_REQUIRE_GE(handshakes, 4u);
+    BOOST_REQUIRE_GE(messages, 2u);
+    BOOST_REQUIRE(std::is_sorted(datagrams.begin(),
+                                 datagrams.end(),
+                                 [](const captured_datagram& lhs, const captured_datagram& rhs) {
+                                     return lhs.time < rhs.time;
+                                 }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
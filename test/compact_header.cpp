@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <array>
+#include <cstdint>
+#include <boost/optional.hpp>
+#include <boost/test/unit_test.hpp>
+#include <maidsafe/crux/detail/compact_header.hpp>
+#include <maidsafe/crux/detail/header.hpp>
+
+namespace header = maidsafe::crux::detail::header;
+namespace compact = maidsafe::crux::detail::header::compact;
+
+using sequence_type = header::sequence_type;
+using buffer_type = std::array<std::uint8_t, compact::max_size>;
+
+template <typename Message>
+static header::data_type encode(const Message& message)
+{
+    header::data_type result;
+    maidsafe::crux::detail::encoder encoder(result.data(), result.size());
+    message.encode(encoder);
+    return result;
+}
+
+BOOST_AUTO_TEST_SUITE(compact_header_suite)
+
+BOOST_AUTO_TEST_CASE(data_without_ack)
+{
+    const auto full = encode(header::data(1, sequence_type(1000), boost::none, 0xBEEF));
+
+    buffer_type wire;
+    const auto size = compact::encode(full, 2, wire.data());
+    BOOST_REQUIRE_EQUAL(size, 5U);
+    BOOST_REQUIRE(compact::is_compact(wire[0]));
+
+    header::data_type restored;
+    BOOST_REQUIRE_EQUAL(compact::decode(wire.data(), size,
+                                        sequence_type(990), sequence_type(0),
+                                        restored),
+                        size);
+    BOOST_REQUIRE(restored == full);
+}
+
+BOOST_AUTO_TEST_CASE(keepalive_with_ack)
+{
+    const auto full = encode(header::keepalive(0, sequence_type(70000),
+                                               sequence_type(123456), 42));
+
+    buffer_type wire;
+    const auto size = compact::encode(full, 3, wire.data());
+    BOOST_REQUIRE_EQUAL(size, 1 + 2 + 3 + compact::ack_width);
+
+    header::data_type restored;
+    BOOST_REQUIRE_EQUAL(compact::decode(wire.data(), size,
+                                        sequence_type(69990), sequence_type(123460),
+                                        restored),
+                        size);
+    BOOST_REQUIRE(restored == full);
+}
+
+BOOST_AUTO_TEST_CASE(data_options)
+{
+    const auto options = header::constant::option_skip | header::constant::option_compressed;
+    const auto full = encode(header::data(3, sequence_type(5), sequence_type(7), 1, options));
+
+    buffer_type wire;
+    // All bits of the sequence number, so the expected one does not matter
+    const auto size = compact::encode(full, compact::max_width, wire.data());
+
+    header::data_type restored;
+    BOOST_REQUIRE_EQUAL(compact::decode(wire.data(), size,
+                                        sequence_type(0xF0000000), sequence_type(10),
+                                        restored),
+                        size);
+    BOOST_REQUIRE(restored == full);
+}
+
+BOOST_AUTO_TEST_CASE(not_compactable)
+{
+    buffer_type wire;
+
+    const auto handshake = encode(header::handshake(0, sequence_type(1), boost::none));
+    BOOST_REQUIRE_EQUAL(compact::encode(handshake, 2, wire.data()), 0U);
+    BOOST_REQUIRE(!compact::is_compact(handshake[0]));
+
+    const auto shutdown = encode(header::shutdown(0, sequence_type(1), boost::none));
+    BOOST_REQUIRE_EQUAL(compact::encode(shutdown, 2, wire.data()), 0U);
+
+    const auto data = encode(header::data(0, sequence_type(1), boost::none, 1,
+                                          header::constant::option_shared_memory));
+    BOOST_REQUIRE_EQUAL(compact::encode(data, 2, wire.data()), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(width)
+{
+    BOOST_REQUIRE_EQUAL(compact::width(0), compact::min_width);
+    BOOST_REQUIRE_EQUAL(compact::width(1), compact::min_width);
+    BOOST_REQUIRE_EQUAL(compact::width((1U << 13) - 1), 2U);
+    BOOST_REQUIRE_EQUAL(compact::width(1U << 13), 3U);
+    BOOST_REQUIRE_EQUAL(compact::width(1U << 27), compact::max_width);
+    BOOST_REQUIRE_EQUAL(compact::width(0xFFFFFFFF), compact::max_width);
+}
+
+BOOST_AUTO_TEST_CASE(restore)
+{
+    // Ahead of and behind the reference
+    BOOST_REQUIRE(compact::restore(1010 & 0x3FFF, 14, sequence_type(1000)) == sequence_type(1010));
+    BOOST_REQUIRE(compact::restore(990 & 0x3FFF, 14, sequence_type(1000)) == sequence_type(990));
+
+    // Across the wrap-around of the sequence numbers
+    BOOST_REQUIRE(compact::restore(5, 14, sequence_type(0xFFFFFFF0)) == sequence_type(5));
+    BOOST_REQUIRE(compact::restore(0xFFFFFFF0 & 0x3FFF, 14, sequence_type(5))
+                  == sequence_type(0xFFFFFFF0));
+
+    // All bits
+    BOOST_REQUIRE(compact::restore(0x12345678, 32, sequence_type(0)) == sequence_type(0x12345678));
+}
+
+BOOST_AUTO_TEST_CASE(malformed)
+{
+    const auto full = encode(header::data(0, sequence_type(1000), sequence_type(2000), 7));
+
+    buffer_type wire;
+    const auto size = compact::encode(full, 2, wire.data());
+
+    header::data_type restored;
+    for (std::size_t truncated = 0; truncated < size; ++truncated)
+    {
+        BOOST_REQUIRE_EQUAL(compact::decode(wire.data(), truncated,
+                                            sequence_type(1000), sequence_type(2000),
+                                            restored),
+                            0U);
+    }
+
+    // Full headers are not compact
+    BOOST_REQUIRE_EQUAL(compact::decode(full.data(), full.size(),
+                                        sequence_type(1000), sequence_type(2000),
+                                        restored),
+                        0U);
+
+    // Sequence number that goes on for too long
+    const std::array<std::uint8_t, 9> endless = {{ 0x80, 0, 1, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01 }};
+    BOOST_REQUIRE_EQUAL(compact::decode(endless.data(), endless.size(),
+                                        sequence_type(0), sequence_type(0),
+                                        restored),
+                        0U);
+
+    // Keepalives have no options
+    wire[0] |= 0x20 | 0x01;
+    BOOST_REQUIRE_EQUAL(compact::decode(wire.data(), size,
+                                        sequence_type(1000), sequence_type(2000),
+                                        restored),
+                        0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
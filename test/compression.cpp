@@ -0,0 +1,189 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/test/unit_test.hpp>
+#include <maidsafe/crux/detail/compression.hpp>
+
+namespace compression = maidsafe::crux::detail::compression;
+
+using dictionary_type = std::shared_ptr<const std::vector<char>>;
+
+static std::vector<std::uint8_t> compress(const std::string& text,
+                                          const dictionary_type& dictionary = dictionary_type())
+{
+    compression::compressor compressor(dictionary);
+    std::vector<std::uint8_t> output(text.size());
+    output.resize(compressor.compress(boost::asio::buffer(text),
+                                      output.data(),
+                                      output.size()));
+    return output;
+}
+
+static std::string decompress(const std::vector<std::uint8_t>& input,
+                              const dictionary_type& dictionary = dictionary_type())
+{
+    std::vector<std::uint8_t> output(compression::max_message_size);
+    const auto size = compression::decompress(input.data(), input.size(),
+                                              output.data(), output.size(),
+                                              dictionary);
+    BOOST_REQUIRE(size != compression::invalid);
+    return std::string(output.begin(), output.begin() + size);
+}
+
+static std::string repeat(const std::string& text, std::size_t count)
+{
+    std::string result;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        result += text;
+    }
+    return result;
+}
+
+BOOST_AUTO_TEST_SUITE(compression_suite)
+
+BOOST_AUTO_TEST_CASE(round_trip)
+{
+    const auto text = repeat("The quick brown fox jumps over the lazy dog. ", 40);
+    const auto compressed = compress(text);
+    BOOST_REQUIRE(!compressed.empty());
+    BOOST_REQUIRE_LT(compressed.size(), text.size() / 4);
+    BOOST_REQUIRE_EQUAL(decompress(compressed), text);
+}
+
+BOOST_AUTO_TEST_CASE(round_trip___long_runs)
+{
+    // Literal and match lengths that need extra length bytes
+    const auto text = std::string(1000, 'a') + repeat("0123456789abcdefghij", 30)
+        + std::string(600, 'b');
+    BOOST_REQUIRE_EQUAL(decompress(compress(text)), text);
+}
+
+BOOST_AUTO_TEST_CASE(round_trip___scattered)
+{
+    const auto text = repeat("scattered message ", 20);
+    std::vector<boost::asio::const_buffer> buffers;
+    for (std::size_t i = 0; i < text.size(); i += 50)
+    {
+        buffers.push_back(boost::asio::buffer(text.data() + i,
+                                              std::min<std::size_t>(50, text.size() - i)));
+    }
+
+    compression::compressor compressor{dictionary_type()};
+    std::vector<std::uint8_t> output(text.size());
+    output.resize(compressor.compress(buffers, output.data(), output.size()));
+    BOOST_REQUIRE(!output.empty());
+    BOOST_REQUIRE_EQUAL(decompress(output), text);
+}
+
+BOOST_AUTO_TEST_CASE(incompressible)
+{
+    std::mt19937 generator(42);
+    std::string text;
+    for (int i = 0; i < 1000; ++i)
+    {
+        text.push_back(static_cast<char>(generator()));
+    }
+    BOOST_REQUIRE(compress(text).empty());
+
+    // Too short to be worth it
+    BOOST_REQUIRE(compress("aaaaaaaa").empty());
+}
+
+BOOST_AUTO_TEST_CASE(dictionary)
+{
+    const std::string sample = "{\"type\":\"status\",\"node\":\"alpha\",\"load\":0}";
+    auto dictionary = std::make_shared<const std::vector<char>>(sample.begin(), sample.end());
+
+    // Hardly compressible on its own, but much like the dictionary
+    const std::string text = "{\"type\":\"status\",\"node\":\"gamma\",\"load\":7}";
+    const auto plain = compress(text);
+
+    const auto compressed = compress(text, dictionary);
+    BOOST_REQUIRE(!compressed.empty());
+    BOOST_REQUIRE(plain.empty() || compressed.size() < plain.size());
+    BOOST_REQUIRE_LT(compressed.size(), text.size() * 2 / 3);
+    BOOST_REQUIRE_EQUAL(decompress(compressed, dictionary), text);
+
+    // The compressor can be reused for further messages
+    compression::compressor compressor(dictionary);
+    std::vector<std::uint8_t> output(text.size());
+    for (int i = 0; i < 3; ++i)
+    {
+        output.resize(text.size());
+        output.resize(compressor.compress(boost::asio::buffer(text),
+                                          output.data(),
+                                          output.size()));
+        BOOST_REQUIRE(output == compressed);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dictionary_identifier)
+{
+    BOOST_REQUIRE_EQUAL(compression::dictionary_id(dictionary_type()), 0U);
+    BOOST_REQUIRE_EQUAL(compression::dictionary_id(std::make_shared<const std::vector<char>>()), 0U);
+
+    auto first = std::make_shared<const std::vector<char>>(100, 'a');
+    auto second = std::make_shared<const std::vector<char>>(100, 'b');
+    BOOST_REQUIRE(compression::dictionary_id(first) != 0);
+    BOOST_REQUIRE(compression::dictionary_id(first) != compression::dictionary_id(second));
+}
+
+BOOST_AUTO_TEST_CASE(malformed)
+{
+    const auto text = repeat("malformed ", 30);
+    const auto compressed = compress(text);
+    BOOST_REQUIRE(!compressed.empty());
+
+    std::vector<std::uint8_t> output(text.size());
+
+    // Every truncation is detected
+    for (std::size_t size = 0; size < compressed.size(); ++size)
+    {
+        BOOST_REQUIRE_EQUAL(compression::decompress(compressed.data(), size,
+                                                    output.data(), output.size(),
+                                                    dictionary_type()),
+                            compression::invalid);
+    }
+
+    // Does not fit
+    BOOST_REQUIRE_EQUAL(compression::decompress(compressed.data(), compressed.size(),
+                                                output.data(), output.size() - 1,
+                                                dictionary_type()),
+                        compression::invalid);
+
+    // Wrong size
+    auto resized = compressed;
+    resized[3] ^= 1;
+    BOOST_REQUIRE_EQUAL(compression::decompress(resized.data(), resized.size(),
+                                                output.data(), output.size(),
+                                                dictionary_type()),
+                        compression::invalid);
+
+    // A match before the start of the message, without a dictionary
+    const std::vector<std::uint8_t> reaching = { 0, 0, 0, 8, 0x00, 0x04, 0x00 };
+    BOOST_REQUIRE_EQUAL(compression::decompress(reaching.data(), reaching.size(),
+                                                output.data(), output.size(),
+                                                dictionary_type()),
+                        compression::invalid);
+
+    // Too large to be accepted
+    const std::vector<std::uint8_t> huge = { 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+    BOOST_REQUIRE_EQUAL(compression::decompressed_size(huge.data(), huge.size()),
+                        compression::invalid);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
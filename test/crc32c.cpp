@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/test/unit_test.hpp>
+#include <maidsafe/crux/detail/crc32c.hpp>
+
+using crc32c = maidsafe::crux::detail::crc32c;
+
+static std::uint32_t checksum(const std::string& text)
+{
+    crc32c crc;
+    crc.update(text.data(), text.size());
+    return crc.value();
+}
+
+BOOST_AUTO_TEST_SUITE(crc32c_suite)
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+    BOOST_REQUIRE_EQUAL(checksum(""), 0x00000000U);
+}
+
+BOOST_AUTO_TEST_CASE(check_value)
+{
+    BOOST_REQUIRE_EQUAL(checksum("123456789"), 0xE3069283U);
+}
+
+BOOST_AUTO_TEST_CASE(rfc3720_vectors)
+{
+    // RFC 3720, appendix B.4
+    BOOST_REQUIRE_EQUAL(checksum(std::string(32, '\x00')), 0x8A9136AAU);
+    BOOST_REQUIRE_EQUAL(checksum(std::string(32, '\xFF')), 0x62A8AB43U);
+
+    std::string ascending;
+    for (int i = 0; i < 32; ++i)
+    {
+        ascending.push_back(static_cast<char>(i));
+    }
+    BOOST_REQUIRE_EQUAL(checksum(ascending), 0x46DD794EU);
+}
+
+BOOST_AUTO_TEST_CASE(hardware_matches_software)
+{
+    if (!crc32c::is_hardware_accelerated())
+    {
+        return;
+    }
+
+    std::vector<std::uint8_t> data(1500);
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<std::uint8_t>(i * 7 + 3);
+    }
+
+    // All lengths and alignments around the word sizes
+    for (std::size_t offset = 0; offset < 8; ++offset)
+    {
+        for (std::size_t size = 0; size < 64; ++size)
+        {
+            BOOST_REQUIRE_EQUAL(crc32c::hardware(0xFFFFFFFF, data.data() + offset, size),
+                                crc32c::software(0xFFFFFFFF, data.data() + offset, size));
+        }
+    }
+    BOOST_REQUIRE_EQUAL(crc32c::hardware(0xFFFFFFFF, data.data(), data.size()),
+                        crc32c::software(0xFFFFFFFF, data.data(), data.size()));
+}
+
+BOOST_AUTO_TEST_CASE(buffer_sequence)
+{
+    const std::string text = "The quick brown fox jumps over the lazy dog";
+
+    std::vector<boost::asio::const_buffer> buffers;
+    buffers.push_back(boost::asio::buffer(text.data(), 3));
+    buffers.push_back(boost::asio::buffer(text.data() + 3, 0));
+    buffers.push_back(boost::asio::buffer(text.data() + 3, text.size() - 3));
+
+    crc32c crc;
+    crc.update(buffers);
+    BOOST_REQUIRE_EQUAL(crc.value(), checksum(text));
+    BOOST_REQUIRE_EQUAL(crc.value(), 0x22620404U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
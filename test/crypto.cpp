@@ -0,0 +1,177 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+#include <maidsafe/crux/detail/crypto.hpp>
+
+#if defined(MAIDSAFE_CRUX_USE_OPENSSL)
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using key_exchange = maidsafe::crux::detail::key_exchange;
+using aead = maidsafe::crux::detail::aead;
+
+namespace
+{
+
+struct connection
+{
+    connection()
+    {
+        key_exchange initiator;
+        key_exchange responder;
+        BOOST_REQUIRE(initiator.valid());
+        BOOST_REQUIRE(responder.valid());
+
+        aead::key_type initiator_send, initiator_receive;
+        aead::key_type responder_send, responder_receive;
+        BOOST_REQUIRE(initiator.derive(responder.public_key().data(), true,
+                                       initiator_send, initiator_receive));
+        BOOST_REQUIRE(responder.derive(initiator.public_key().data(), false,
+                                       responder_send, responder_receive));
+
+        client.reset(new aead(initiator_send, initiator_receive));
+        server.reset(new aead(responder_send, responder_receive));
+    }
+
+    std::unique_ptr<aead> client;
+    std::unique_ptr<aead> server;
+};
+
+const std::array<std::uint8_t, 12> header = {{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 }};
+
+std::vector<std::uint8_t> make_packet(const char *text)
+{
+    std::vector<std::uint8_t> packet(text, text + std::strlen(text));
+    packet.resize(packet.size() + aead::overhead);
+    return packet;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(crypto_suite)
+
+BOOST_AUTO_TEST_CASE(key_exchange___agree)
+{
+    key_exchange initiator;
+    key_exchange responder;
+
+    aead::key_type initiator_send, initiator_receive;
+    aead::key_type responder_send, responder_receive;
+    BOOST_REQUIRE(initiator.derive(responder.public_key().data(), true,
+                                   initiator_send, initiator_receive));
+    BOOST_REQUIRE(responder.derive(initiator.public_key().data(), false,
+                                   responder_send, responder_receive));
+
+    BOOST_REQUIRE(initiator_send == responder_receive);
+    BOOST_REQUIRE(initiator_receive == responder_send);
+    BOOST_REQUIRE(initiator_send != initiator_receive);
+}
+
+BOOST_AUTO_TEST_CASE(seal___open)
+{
+    connection peers;
+    const char text[] = "TEST_MESSAGE";
+    const auto size = std::strlen(text);
+
+    auto packet = make_packet(text);
+    peers.client->seal(header.data(), header.size(), packet.data(), size);
+    BOOST_REQUIRE(std::memcmp(packet.data(), text, size) != 0);
+
+    BOOST_REQUIRE(peers.server->open(header.data(), header.size(), packet.data(), packet.size()));
+    BOOST_REQUIRE(std::memcmp(packet.data(), text, size) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(open___forged)
+{
+    connection peers;
+    const char text[] = "TEST_MESSAGE";
+    const auto size = std::strlen(text);
+
+    auto packet = make_packet(text);
+    peers.client->seal(header.data(), header.size(), packet.data(), size);
+
+    // Tampered payload
+    auto forged = packet;
+    forged[0] ^= 0x01;
+    BOOST_REQUIRE(!peers.server->open(header.data(), header.size(), forged.data(), forged.size()));
+
+    // Tampered header
+    auto forged_header = header;
+    forged_header[4] ^= 0x01;
+    forged = packet;
+    BOOST_REQUIRE(!peers.server->open(forged_header.data(), forged_header.size(), forged.data(), forged.size()));
+
+    // Wrong direction
+    forged = packet;
+    BOOST_REQUIRE(!peers.client->open(header.data(), header.size(), forged.data(), forged.size()));
+
+    // Truncated
+    BOOST_REQUIRE(!peers.server->open(header.data(), header.size(), packet.data(), aead::overhead - 1));
+
+    BOOST_REQUIRE(peers.server->open(header.data(), header.size(), packet.data(), packet.size()));
+}
+
+BOOST_AUTO_TEST_CASE(retransmission___new_nonce)
+{
+    connection peers;
+    const char text[] = "TEST_MESSAGE";
+    const auto size = std::strlen(text);
+
+    auto first = make_packet(text);
+    auto second = make_packet(text);
+    peers.client->seal(header.data(), header.size(), first.data(), size);
+    peers.client->seal(header.data(), header.size(), second.data(), size);
+    BOOST_REQUIRE(first != second);
+
+    // Either may arrive first
+    BOOST_REQUIRE(peers.server->open(header.data(), header.size(), second.data(), second.size()));
+    BOOST_REQUIRE(peers.server->open(header.data(), header.size(), first.data(), first.size()));
+}
+
+BOOST_AUTO_TEST_CASE(batch)
+{
+    connection peers;
+    const char *texts[] = { "A", "", "TEST_MESSAGE" };
+    const std::size_t count = sizeof(texts) / sizeof(texts[0]);
+
+    std::vector<std::vector<std::uint8_t>> data;
+    std::vector<aead::packet> packets;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        data.push_back(make_packet(texts[i]));
+    }
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        aead::packet packet = { header.data(), header.size(),
+                                data[i].data(), std::strlen(texts[i]), false };
+        packets.push_back(packet);
+    }
+    peers.client->seal(packets.data(), packets.size());
+
+    data[1][0] ^= 0x01;
+    for (auto& packet : packets)
+    {
+        packet.size += aead::overhead;
+    }
+    BOOST_REQUIRE_EQUAL(peers.server->open(packets.data(), packets.size()), count - 1);
+    BOOST_REQUIRE(packets[0].authentic);
+    BOOST_REQUIRE(!packets[1].authentic);
+    BOOST_REQUIRE(packets[2].authentic);
+    BOOST_REQUIRE(std::memcmp(data[2].data(), texts[2], std::strlen(texts[2])) == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif // defined(MAIDSAFE_CRUX_USE_OPENSSL)
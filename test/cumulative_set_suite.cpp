@@ -89,4 +89,33 @@ BOOST_AUTO_TEST_CASE(out_of_sequence)
     BOOST_REQUIRE_EQUAL(front2, four);
 }
 
+BOOST_AUTO_TEST_CASE(range)
+{
+    cumulative_set history;
+    sequence_number one(41);
+    sequence_number two(42);
+    sequence_number four(44);
+    sequence_number six(46);
+
+    history.insert(one);
+    history.insert(six);
+    history.insert(two, four);
+    auto front = history.front();
+    BOOST_REQUIRE_EQUAL(front, four);
+    history.insert(sequence_number(45));
+    auto front2 = history.front();
+    BOOST_REQUIRE_EQUAL(front2, six);
+}
+
+BOOST_AUTO_TEST_CASE(range_wrap)
+{
+    cumulative_set history;
+    sequence_number last(0xFFFFFFFF);
+
+    history.insert(sequence_number(0xFFFFFFFE));
+    history.insert(last, sequence_number(1));
+    auto front = history.front();
+    BOOST_REQUIRE_EQUAL(front, sequence_number(1));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
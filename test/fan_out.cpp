@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <boost/test/unit_test.hpp>
+#include <boost/system/error_code.hpp>
+#include <maidsafe/crux/socket.hpp>
+#include <maidsafe/crux/acceptor.hpp>
+#include <maidsafe/crux/fan_out.hpp>
+
+namespace asio = boost::asio;
+using error_code    = boost::system::error_code;
+using endpoint_type = boost::asio::ip::udp::endpoint;
+
+BOOST_AUTO_TEST_SUITE(fan_out_suite)
+
+BOOST_AUTO_TEST_CASE(empty_range)
+{
+    using namespace maidsafe;
+
+    asio::io_service ios;
+
+    std::vector<crux::socket*> sockets;
+    auto payload = std::make_shared<const std::string>("hello");
+
+    bool called = false;
+
+    crux::async_fan_out(ios, sockets, payload,
+                        [&](error_code error, std::size_t delivered) {
+                          BOOST_REQUIRE(!error);
+                          BOOST_REQUIRE_EQUAL(delivered, 0);
+                          called = true;
+                        });
+
+    // Completes like any other asynchronous operation
+    BOOST_REQUIRE(!called);
+    ios.run();
+    BOOST_REQUIRE(called);
+}
+
+BOOST_AUTO_TEST_CASE(send_to_many)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    const std::size_t client_count = 3;
+    const std::string message = "fan out";
+
+    std::vector<std::unique_ptr<crux::socket>> client_sockets;
+    std::vector<std::shared_ptr<crux::socket>> server_sockets;
+    std::vector<std::vector<char>> rx_buffers(client_count);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    std::size_t connected = 0;
+    std::size_t received = 0;
+    std::size_t fanned_out = 0;
+
+    auto payload = std::make_shared<const std::string>(message);
+
+    auto close_all = [&]() {
+        for (auto& socket : client_sockets) socket->close();
+        for (auto& socket : server_sockets) socket->close();
+    };
+
+    auto try_finish = [&]() {
+        if (received == client_count && fanned_out == client_count) {
+            close_all();
+        }
+    };
+
+    auto send_all = [&]() {
+        if (connected != client_count || server_sockets.size() != client_count) {
+            return;
+        }
+        acceptor.close();
+        crux::async_fan_out(ios, server_sockets, payload,
+                            [&](error_code error, std::size_t delivered) {
+                              BOOST_VERIFY(!error);
+                              fanned_out = delivered;
+                              try_finish();
+                            });
+    };
+
+    acceptor.async_accept_each(
+            [&]() { return std::make_shared<crux::socket>(ios); },
+            [&](error_code error, std::shared_ptr<crux::socket> socket) {
+              if (error) return;
+              server_sockets.push_back(socket);
+              send_all();
+            });
+
+    for (std::size_t i = 0; i < client_count; ++i) {
+        client_sockets.emplace_back(new crux::socket(ios, endpoint_type(udp::v4(), 0)));
+        auto& client = *client_sockets.back();
+        auto& rx_buffer = rx_buffers[i];
+
+        client.async_connect(
+                acceptor.local_endpoint(),
+                [&](error_code error) {
+                  BOOST_VERIFY(!error);
+
+                  rx_buffer.resize(message.size());
+                  client.async_receive(
+                          asio::buffer(rx_buffer),
+                          [&](error_code error, std::size_t size) {
+                            BOOST_VERIFY(!error);
+                            BOOST_REQUIRE_EQUAL(std::string(rx_buffer.begin(),
+                                                            rx_buffer.begin() + size),
+                                                message);
+                            ++received;
+                            try_finish();
+                          });
+
+                  ++connected;
+                  send_all();
+                });
+    }
+
+    ios.run();
+
+    BOOST_REQUIRE_EQUAL(received, client_count);
+    BOOST_REQUIRE_EQUAL(fanned_out, client_count);
+    // Every transmit queue has released its reference to the payload.
+    BOOST_REQUIRE_EQUAL(payload.use_count(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
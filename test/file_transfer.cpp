@@ -0,0 +1,240 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <boost/test/unit_test.hpp>
+#include <boost/system/error_code.hpp>
+#include <maidsafe/crux/socket.hpp>
+#include <maidsafe/crux/acceptor.hpp>
+#include <maidsafe/crux/file_transfer.hpp>
+
+namespace asio = boost::asio;
+using error_code    = boost::system::error_code;
+using endpoint_type = boost::asio::ip::udp::endpoint;
+
+namespace
+{
+
+std::string read_file(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string& path, const std::string& contents)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), contents.size());
+}
+
+std::string transfer(const std::string& contents)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    const std::string source = "crux_file_transfer_source";
+    const std::string target = "crux_file_transfer_target";
+    write_file(source, contents);
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    bool tested_send = false;
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            crux::async_receive_file(server_socket, target, contents.size(),
+                                     [&](error_code error, std::size_t size) {
+                                       BOOST_VERIFY(!error);
+                                       BOOST_REQUIRE_EQUAL(size, contents.size());
+                                       tested_receive = true;
+                                     });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              crux::async_send_file(client_socket, source,
+                                    [&](error_code error, std::size_t size) {
+                                      BOOST_VERIFY(!error);
+                                      BOOST_REQUIRE_EQUAL(size, contents.size());
+                                      tested_send = true;
+                                    });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_send);
+    BOOST_REQUIRE(tested_receive);
+
+    auto result = read_file(target);
+    std::remove(source.c_str());
+    std::remove(target.c_str());
+    return result;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(file_transfer_suite)
+
+BOOST_AUTO_TEST_CASE(send_receive)
+{
+    // Spans a few windows of slices, with a partial slice at the end.
+    std::string contents(100000, '\0');
+    for (std::size_t i = 0; i < contents.size(); ++i) {
+        contents[i] = static_cast<char>(i * 31 + i / 7);
+    }
+
+    BOOST_REQUIRE(transfer(contents) == contents);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive_empty)
+{
+    BOOST_REQUIRE(transfer(std::string()).empty());
+}
+
+BOOST_AUTO_TEST_CASE(receive_too_large)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    const std::string source = "crux_file_transfer_source";
+    const std::string target = "crux_file_transfer_target";
+    write_file(source, std::string(1000, 'x'));
+    std::remove(target.c_str());
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    bool tested = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            crux::async_receive_file(server_socket, target, 999,
+                                     [&](error_code error, std::size_t size) {
+                                       BOOST_REQUIRE_EQUAL(error, asio::error::message_size);
+                                       BOOST_REQUIRE_EQUAL(size, 0);
+                                       tested = true;
+                                       client_socket.close();
+                                       server_socket.close();
+                                       acceptor.close();
+                                     });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              crux::async_send_file(client_socket, source,
+                                    [&](error_code, std::size_t) {});
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested);
+    BOOST_REQUIRE(!std::ifstream(target));
+    std::remove(source.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(receive_oversized_slice)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    const std::string target = "crux_file_transfer_target";
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    // Announce a 10 byte file and follow it with a larger slice.
+    std::array<std::uint8_t, 8> size_header = {{ 0, 0, 0, 0, 0, 0, 0, 10 }};
+    std::string slice(100, 'x');
+
+    bool tested = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            crux::async_receive_file(server_socket, target, 1000,
+                                     [&](error_code error, std::size_t size) {
+                                       BOOST_REQUIRE_EQUAL(error, asio::error::message_size);
+                                       BOOST_REQUIRE_EQUAL(size, 0);
+                                       tested = true;
+                                       client_socket.close();
+                                       server_socket.close();
+                                       acceptor.close();
+                                     });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_send(asio::buffer(size_header),
+                                       [](error_code, std::size_t) {});
+              client_socket.async_send(asio::buffer(slice),
+                                       [](error_code, std::size_t) {});
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested);
+    BOOST_REQUIRE_EQUAL(read_file(target), std::string(10, 'x'));
+    std::remove(target.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(send_missing_file)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket socket(ios, endpoint_type(udp::v4(), 0));
+
+    bool tested = false;
+
+    crux::async_send_file(socket, "crux_file_transfer_missing",
+                          [&](error_code error, std::size_t size) {
+                            BOOST_REQUIRE_EQUAL(error, asio::error::not_found);
+                            BOOST_REQUIRE_EQUAL(size, 0);
+                            tested = true;
+                          });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
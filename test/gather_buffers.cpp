@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <array>
+#include <string>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+#include <boost/test/unit_test.hpp>
+#include <maidsafe/crux/detail/gather_buffers.hpp>
+
+namespace asio = boost::asio;
+
+using maidsafe::crux::detail::gather_buffers;
+
+BOOST_AUTO_TEST_SUITE(gather_buffers_suite)
+
+BOOST_AUTO_TEST_CASE(flatten)
+{
+    const std::array<char, 3> head = {{ 'a', 'b', 'c' }};
+    const std::vector<asio::const_buffer> body = { asio::buffer("de", 2),
+                                                   asio::const_buffer(),
+                                                   asio::buffer("fgh", 3) };
+    const std::array<char, 1> tail = {{ 'i' }};
+
+    gather_buffers<8> gather;
+    BOOST_REQUIRE(gather.empty());
+    BOOST_REQUIRE(gather.push_back(asio::buffer(head)));
+    BOOST_REQUIRE(gather.append(body));
+    BOOST_REQUIRE(gather.push_back(asio::buffer(tail)));
+
+    // Empty buffers are left out
+    BOOST_REQUIRE_EQUAL(gather.size(), 4U);
+    BOOST_REQUIRE_EQUAL(gather.bytes(), 9U);
+    BOOST_REQUIRE_EQUAL(asio::buffer_size(gather), 9U);
+
+    std::string output(gather.bytes(), ' ');
+    BOOST_REQUIRE_EQUAL(asio::buffer_copy(asio::buffer(&output[0], output.size()), gather), 9U);
+    BOOST_REQUIRE_EQUAL(output, "abcdefghi");
+
+    // Same buffers as the iovecs
+    BOOST_REQUIRE(gather.data()[0].iov_base == head.data());
+    BOOST_REQUIRE_EQUAL(gather.data()[3].iov_len, 1U);
+
+    auto last = gather.end();
+    --last;
+    BOOST_REQUIRE(asio::buffer_cast<const void *>(*last) == tail.data());
+
+    gather.clear();
+    BOOST_REQUIRE(gather.empty());
+    BOOST_REQUIRE(gather.begin() == gather.end());
+    BOOST_REQUIRE_EQUAL(gather.bytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(overflow)
+{
+    const std::array<char, 4> data = {{ 'a', 'b', 'c', 'd' }};
+    const std::vector<asio::const_buffer> many(3, asio::buffer(data));
+
+    gather_buffers<4> gather;
+    BOOST_REQUIRE(gather.push_back(asio::buffer(data)));
+    BOOST_REQUIRE(gather.push_back(asio::buffer(data)));
+
+    // Nothing is added from a sequence that does not fit
+    BOOST_REQUIRE(!gather.append(many));
+    BOOST_REQUIRE_EQUAL(gather.size(), 2U);
+    BOOST_REQUIRE_EQUAL(gather.bytes(), 8U);
+
+    BOOST_REQUIRE(gather.push_back(asio::buffer(data)));
+    BOOST_REQUIRE(gather.push_back(asio::buffer(data)));
+    BOOST_REQUIRE(!gather.push_back(asio::buffer(data)));
+    // Empty buffers still fit
+    BOOST_REQUIRE(gather.push_back(asio::const_buffer()));
+    BOOST_REQUIRE_EQUAL(gather.size(), gather.capacity());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
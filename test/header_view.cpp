@@ -0,0 +1,115 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <boost/optional.hpp>
+#include <boost/test/unit_test.hpp>
+#include <maidsafe/crux/detail/header.hpp>
+#include <maidsafe/crux/detail/header_view.hpp>
+
+namespace header = maidsafe::crux::detail::header;
+
+using sequence_type = header::sequence_type;
+
+template <typename Message>
+static header::data_type encode(const Message& message)
+{
+    header::data_type result;
+    maidsafe::crux::detail::encoder encoder(result.data(), result.size());
+    message.encode(encoder);
+    return result;
+}
+
+BOOST_AUTO_TEST_SUITE(header_view_suite)
+
+BOOST_AUTO_TEST_CASE(handshake)
+{
+    const auto data = encode(header::handshake(2, sequence_type(0x12345678), sequence_type(9),
+                                               header::constant::option_checksum));
+    const header::view view(data);
+    BOOST_REQUIRE(view.is_valid());
+    BOOST_REQUIRE_EQUAL(view.type(), header::constant::type_handshake);
+    BOOST_REQUIRE_EQUAL(view.options(), header::constant::option_checksum);
+    BOOST_REQUIRE_EQUAL(view.retransmission_count(), 2U);
+    BOOST_REQUIRE_EQUAL(view.version(), header::constant::version);
+    BOOST_REQUIRE(view.sequence_number() == sequence_type(0x12345678));
+    BOOST_REQUIRE(view.ack() == sequence_type(9));
+}
+
+BOOST_AUTO_TEST_CASE(data)
+{
+    const auto data = encode(header::data(1, sequence_type(0xFEDCBA98), boost::none, 0xBEEF,
+                                          header::constant::option_skip));
+    const header::view view(data);
+    BOOST_REQUIRE(view.is_valid());
+    BOOST_REQUIRE_EQUAL(view.type(), header::constant::type_data);
+    BOOST_REQUIRE_EQUAL(view.options(), header::constant::option_skip);
+    BOOST_REQUIRE_EQUAL(view.connection_id(), 0xBEEF);
+    BOOST_REQUIRE(view.sequence_number() == sequence_type(0xFEDCBA98));
+    BOOST_REQUIRE(!view.ack());
+}
+
+BOOST_AUTO_TEST_CASE(keepalive_and_shutdown)
+{
+    const auto keepalive = encode(header::keepalive(0, sequence_type(1), sequence_type(2), 3));
+    BOOST_REQUIRE(header::view(keepalive).is_valid());
+    BOOST_REQUIRE_EQUAL(header::view(keepalive).type(), header::constant::type_keepalive);
+
+    const auto shutdown = encode(header::shutdown(0, sequence_type(1), boost::none));
+    BOOST_REQUIRE(header::view(shutdown).is_valid());
+    BOOST_REQUIRE_EQUAL(header::view(shutdown).type(), header::constant::type_shutdown);
+}
+
+BOOST_AUTO_TEST_CASE(keepalive_challenge)
+{
+    const auto data = encode(header::keepalive(0, sequence_type(1), boost::none, 3,
+                                               header::constant::option_challenge,
+                                               0xCAFEF00D));
+    const header::view view(data);
+    BOOST_REQUIRE(view.is_valid());
+    BOOST_REQUIRE_EQUAL(view.type(), header::constant::type_keepalive);
+    BOOST_REQUIRE_EQUAL(view.options(), header::constant::option_challenge);
+    BOOST_REQUIRE(!view.ack());
+    BOOST_REQUIRE_EQUAL(view.nonce(), 0xCAFEF00D);
+}
+
+BOOST_AUTO_TEST_CASE(malformed)
+{
+    const auto data = encode(header::data(0, sequence_type(1), sequence_type(2), 3));
+
+    // Too short
+    for (std::size_t size = 0; size < data.size(); ++size)
+    {
+        BOOST_REQUIRE(!header::view(data.data(), size).is_valid());
+    }
+
+    // Unknown types
+    for (std::uint16_t type = 0; type < 0x20; ++type)
+    {
+        auto unknown = data;
+        unknown[0] = std::uint8_t(type << 3);
+        unknown[2] = 0; // Handshake version
+        unknown[3] = header::constant::version;
+        const bool known = (type >= 0x18 && type <= 0x1B);
+        BOOST_REQUIRE_EQUAL(header::view(unknown).is_valid(), known);
+    }
+
+    // Unknown ack type
+    auto ack = data;
+    ack[1] |= 0x08;
+    BOOST_REQUIRE(!header::view(ack).is_valid());
+
+    // Handshake of another version
+    auto handshake = encode(header::handshake(0, sequence_type(1), boost::none));
+    handshake[3] ^= 1;
+    BOOST_REQUIRE(!header::view(handshake).is_valid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include <maidsafe/crux/detail/local_channel.hpp>
+
+#if defined(MAIDSAFE_CRUX_HAS_LOCAL_CHANNEL)
+
+namespace asio = boost::asio;
+using error_code = boost::system::error_code;
+using endpoint_type = boost::asio::ip::udp::endpoint;
+using local_channel = maidsafe::crux::detail::local_channel;
+
+namespace
+{
+
+std::string unique_name()
+{
+    std::random_device random;
+    const endpoint_type endpoint(asio::ip::address_v4::loopback(), 0);
+    return local_channel::make_name(endpoint, endpoint, random());
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(local_channel_suite)
+
+BOOST_AUTO_TEST_CASE(send_receive)
+{
+    asio::io_service ios;
+
+    const auto name = unique_name();
+    auto creator = local_channel::create(ios, name);
+    BOOST_REQUIRE(creator);
+    auto attacher = local_channel::attach(ios, name);
+    BOOST_REQUIRE(attacher);
+    creator->unlink();
+
+    const std::string message_text = "TEST_MESSAGE";
+    std::vector<char> rx_data(message_text.size());
+
+    bool tested_send = false;
+    bool tested_receive = false;
+
+    attacher->async_send(asio::buffer(message_text),
+                         [&](error_code error, std::size_t size) {
+                           BOOST_REQUIRE(!error);
+                           BOOST_REQUIRE_EQUAL(size, message_text.size());
+                           tested_send = true;
+                         });
+
+    creator->async_receive(asio::buffer(rx_data),
+                           local_channel::time_point::max(),
+                           [&](error_code error, std::size_t size) {
+                             BOOST_REQUIRE(!error);
+                             BOOST_REQUIRE_EQUAL(std::string(rx_data.data(), size),
+                                                 message_text);
+                             tested_receive = true;
+
+                             creator->close(asio::error::operation_aborted);
+                             attacher->close(asio::error::operation_aborted);
+                           });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_send);
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(receive___peer_gone)
+{
+    asio::io_service ios;
+
+    const auto timeout = std::chrono::milliseconds(200);
+    const auto name = unique_name();
+    auto creator = local_channel::create(ios, name, timeout);
+    BOOST_REQUIRE(creator);
+    auto attacher = local_channel::attach(ios, name, timeout);
+    BOOST_REQUIRE(attacher);
+    creator->unlink();
+
+    // The attaching side goes away without closing, as if it had crashed
+    attacher.reset();
+
+    std::vector<char> rx_data(16);
+    bool tested_receive = false;
+
+    creator->async_receive(asio::buffer(rx_data),
+                           local_channel::time_point::max(),
+                           [&](error_code error, std::size_t size) {
+                             BOOST_REQUIRE_EQUAL(error, asio::error::connection_reset);
+                             BOOST_REQUIRE_EQUAL(size, 0U);
+                             tested_receive = true;
+
+                             creator->close(asio::error::operation_aborted);
+                           });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif // defined(MAIDSAFE_CRUX_HAS_LOCAL_CHANNEL)
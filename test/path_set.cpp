@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <boost/test/unit_test.hpp>
+#include <maidsafe/crux/detail/path_set.hpp>
+
+using path_set = maidsafe::crux::detail::path_set;
+using std::chrono::milliseconds;
+
+BOOST_AUTO_TEST_SUITE(path_set_suite)
+
+BOOST_AUTO_TEST_CASE(single_path)
+{
+    path_set paths;
+    BOOST_REQUIRE(paths.empty());
+
+    BOOST_REQUIRE_EQUAL(paths.add(), 0U);
+    BOOST_REQUIRE_EQUAL(paths.select(), 0U);
+    // Nowhere else to go
+    BOOST_REQUIRE_EQUAL(paths.select(0), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(prefer_unmeasured)
+{
+    path_set paths;
+    paths.add();
+    paths.add();
+
+    paths.on_acknowledged(0, milliseconds(1));
+    BOOST_REQUIRE_EQUAL(paths.select(), 1U);
+
+    paths.on_acknowledged(1, milliseconds(10));
+    BOOST_REQUIRE_EQUAL(paths.select(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(smooth_roundtrip_time)
+{
+    path_set paths;
+    paths.add();
+
+    paths.on_acknowledged(0, milliseconds(80));
+    BOOST_REQUIRE(paths.roundtrip_time(0) == milliseconds(80));
+
+    paths.on_acknowledged(0, milliseconds(160));
+    BOOST_REQUIRE(paths.roundtrip_time(0) == milliseconds(90));
+}
+
+BOOST_AUTO_TEST_CASE(avoid_lossy_path)
+{
+    path_set paths;
+    paths.add();
+    paths.add();
+
+    paths.on_acknowledged(0, milliseconds(10));
+    paths.on_acknowledged(1, milliseconds(12));
+    BOOST_REQUIRE_EQUAL(paths.select(), 0U);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        paths.on_lost(0);
+    }
+    BOOST_REQUIRE_GT(paths.loss_rate(0), 0.0);
+    BOOST_REQUIRE_EQUAL(paths.select(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(retransmit_elsewhere)
+{
+    path_set paths;
+    paths.add();
+    paths.add();
+    paths.add();
+
+    paths.on_acknowledged(0, milliseconds(10));
+    paths.on_acknowledged(1, milliseconds(30));
+    paths.on_acknowledged(2, milliseconds(20));
+
+    BOOST_REQUIRE_EQUAL(paths.select(), 0U);
+    BOOST_REQUIRE_EQUAL(paths.select(0), 2U);
+    BOOST_REQUIRE_EQUAL(paths.select(2), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(fail_over)
+{
+    path_set paths;
+    paths.add();
+    paths.add();
+
+    paths.on_acknowledged(0, milliseconds(1));
+    paths.on_acknowledged(1, milliseconds(50));
+
+    for (std::size_t i = 0; i < path_set::failure_limit; ++i)
+    {
+        paths.on_error(0);
+    }
+    BOOST_REQUIRE(paths.is_down(0));
+    BOOST_REQUIRE_EQUAL(paths.select(), 1U);
+    // Retransmissions still probe the failed path
+    BOOST_REQUIRE_EQUAL(paths.select(1), 0U);
+
+    paths.on_acknowledged(0);
+    BOOST_REQUIRE(!paths.is_down(0));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
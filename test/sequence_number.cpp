@@ -12,10 +12,73 @@
 #include <boost/config.hpp>
 #include <boost/integer_traits.hpp>
 #include <cstdint>
+#include <type_traits>
+#include <utility>
 #include <maidsafe/crux/detail/sequence_number.hpp>
 
 using maidsafe::crux::detail::sequence_number;
 
+// Everything but increments is evaluated at compile time and never throws
+namespace
+{
+using sn32 = sequence_number<std::uint32_t>;
+using sn7 = sequence_number<std::uint8_t, 0x7F>;
+
+static_assert(sn32(0xFFFFFFFF) < sn32(0), "Wraps around");
+static_assert(sn32(0) > sn32(0xFFFFFFFF), "Wraps around");
+static_assert(sn32(0xFFFFFFFF).next() == 0U, "Wraps around");
+static_assert(sn32(0xFFFFFFFE).distance(sn32(1)) == 3, "Distance across wrap-around");
+static_assert(sn7(0x7F).next() == 0, "Wraps around in custom range");
+static_assert(sn7(0x7E).distance(sn7(1)) == 3, "Distance across custom wrap-around");
+static_assert(sn7(1).distance(sn7(0x7E)) == -3, "Distance across custom wrap-around");
+static_assert(noexcept(sn32(1) < sn32(2)), "Comparisons do not throw");
+static_assert(noexcept(sn32(1).distance(sn32(2))), "Distances do not throw");
+static_assert(noexcept(++std::declval<sn32&>()), "Increments do not throw");
+static_assert(std::is_trivially_copyable<sn32>::value, "Copies are plain copies");
+}
+
+// The comparison and distance that sequence numbers were defined with
+// before they were branch-free
+template<class SN> bool reference_less(typename SN::value_type a, typename SN::value_type b)
+{
+    const auto middle = SN::middle_value;
+    return ((b > a) && (b - a <= middle))
+        || ((b < a) && (a - b >  middle));
+}
+
+template<class SN> long reference_distance(typename SN::value_type a, typename SN::value_type b)
+{
+    const long max = SN::max_value;
+    const long middle = SN::middle_value;
+    if (b > a)
+    {
+        const long diff = b - a;
+        return (diff > middle) ? -(max - diff + 1) : diff;
+    }
+    const long diff = a - b;
+    if (diff > middle)
+    {
+        const long v = max - diff + 1;
+        return (v > middle) ? -v : v;
+    }
+    return -diff;
+}
+
+template<class SN> void test_exhaustive()
+{
+    for (unsigned a = 0; a <= SN::max_value; ++a)
+    {
+        for (unsigned b = 0; b <= SN::max_value; ++b)
+        {
+            const SN first(static_cast<typename SN::value_type>(a));
+            const SN second(static_cast<typename SN::value_type>(b));
+            BOOST_REQUIRE_EQUAL(first < second, (reference_less<SN>(a, b)));
+            BOOST_REQUIRE_EQUAL(first > second, (reference_less<SN>(b, a)));
+            BOOST_REQUIRE_EQUAL(long(first.distance(second)), (reference_distance<SN>(a, b)));
+        }
+    }
+}
+
 template<class SN> void test_limits()
 {
     BOOST_STATIC_CONSTEXPR auto max = SN::max_value;
@@ -66,6 +129,13 @@ BOOST_AUTO_TEST_CASE(sequence_number_uint32_custom_max)
     test_limits<sequence_number<T, max/16>>();
 }
 
+BOOST_AUTO_TEST_CASE(sequence_number_exhaustive)
+{
+    test_exhaustive<sequence_number<std::uint8_t>>();
+    test_exhaustive<sequence_number<std::uint8_t, 0x3F>>();
+    test_exhaustive<sequence_number<std::uint16_t, 0x1FF>>();
+}
+
 BOOST_AUTO_TEST_CASE(sequence_number_pre_increment)
 {
     using T = std::uint8_t;
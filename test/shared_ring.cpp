@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <array>
+#include <cstring>
+#include <string>
+#include <boost/test/unit_test.hpp>
+#include <maidsafe/crux/detail/shared_ring.hpp>
+
+namespace asio = boost::asio;
+using shared_ring = maidsafe::crux::detail::shared_ring;
+
+namespace
+{
+
+struct fixture
+{
+    static const std::size_t capacity = 64;
+
+    fixture()
+        : ring((shared_ring::initialize(&control), &control), data.data(), capacity)
+    {}
+
+    shared_ring::control control;
+    std::array<char, capacity> data;
+    shared_ring ring;
+};
+
+std::string pop_string(shared_ring& ring)
+{
+    std::array<char, 64> buffer;
+    std::size_t size = 0;
+    boost::system::error_code error;
+    BOOST_REQUIRE(ring.pop(asio::buffer(buffer), size, error));
+    BOOST_REQUIRE(!error);
+    return std::string(buffer.data(), size);
+}
+
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(shared_ring_suite, fixture)
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+    std::array<char, 8> buffer;
+    std::size_t size = 0;
+    boost::system::error_code error;
+
+    BOOST_REQUIRE(ring.empty());
+    BOOST_REQUIRE(!ring.pop(asio::buffer(buffer), size, error));
+    BOOST_REQUIRE(!error);
+}
+
+BOOST_AUTO_TEST_CASE(push_pop)
+{
+    const std::string alpha = "alpha";
+    const std::string beta = "beta";
+
+    BOOST_REQUIRE(ring.push(asio::buffer(alpha)));
+    BOOST_REQUIRE(ring.push(asio::buffer(beta)));
+    BOOST_REQUIRE(!ring.empty());
+
+    BOOST_REQUIRE_EQUAL(pop_string(ring), alpha);
+    BOOST_REQUIRE_EQUAL(pop_string(ring), beta);
+    BOOST_REQUIRE(ring.empty());
+}
+
+BOOST_AUTO_TEST_CASE(full)
+{
+    // Each record takes 24 bytes of the 64 byte ring.
+    const std::string message(20, 'x');
+
+    BOOST_REQUIRE(ring.push(asio::buffer(message)));
+    BOOST_REQUIRE(ring.push(asio::buffer(message)));
+    BOOST_REQUIRE(!ring.push(asio::buffer(message)));
+
+    BOOST_REQUIRE_EQUAL(pop_string(ring), message);
+    BOOST_REQUIRE(ring.push(asio::buffer(message)));
+}
+
+BOOST_AUTO_TEST_CASE(wrap_around)
+{
+    const std::string first(20, 'a');
+    const std::string second(20, 'b');
+    const std::string third(20, 'c');
+
+    BOOST_REQUIRE(ring.push(asio::buffer(first)));
+    BOOST_REQUIRE(ring.push(asio::buffer(second)));
+    BOOST_REQUIRE_EQUAL(pop_string(ring), first);
+    BOOST_REQUIRE_EQUAL(pop_string(ring), second);
+
+    // Only 16 bytes are left before the end, so this record starts over.
+    BOOST_REQUIRE(ring.push(asio::buffer(third)));
+    BOOST_REQUIRE_EQUAL(pop_string(ring), third);
+    BOOST_REQUIRE(ring.empty());
+}
+
+BOOST_AUTO_TEST_CASE(truncate)
+{
+    const std::string message = "truncated";
+    std::array<char, 5> buffer;
+    std::size_t size = 0;
+    boost::system::error_code error;
+
+    BOOST_REQUIRE(ring.push(asio::buffer(message)));
+    BOOST_REQUIRE(ring.pop(asio::buffer(buffer), size, error));
+    BOOST_REQUIRE_EQUAL(error, asio::error::message_size);
+    BOOST_REQUIRE_EQUAL(size, buffer.size());
+    BOOST_REQUIRE_EQUAL(std::string(buffer.data(), size), "trunc");
+    BOOST_REQUIRE(ring.empty());
+}
+
+BOOST_AUTO_TEST_CASE(malformed)
+{
+    const std::string message = "message";
+    std::array<char, 64> buffer;
+    std::size_t size = 0;
+    boost::system::error_code error;
+
+    // Longer than what the producer has published
+    BOOST_REQUIRE(ring.push(asio::buffer(message)));
+    const std::uint32_t length = 40;
+    std::memcpy(data.data(), &length, sizeof(length));
+    BOOST_REQUIRE(!ring.pop(asio::buffer(buffer), size, error));
+    BOOST_REQUIRE(error);
+
+    // Longer than any message
+    const std::uint32_t huge = 0x7FFFFFFF;
+    std::memcpy(data.data(), &huge, sizeof(huge));
+    control.head.store(capacity);
+    BOOST_REQUIRE(!ring.pop(asio::buffer(buffer), size, error));
+    BOOST_REQUIRE(error);
+
+    // Wrapped around onto the head
+    const std::uint32_t marker = 0xFFFFFFFF;
+    std::memcpy(data.data(), &marker, sizeof(marker));
+    BOOST_REQUIRE(!ring.pop(asio::buffer(buffer), size, error));
+    BOOST_REQUIRE(error);
+
+    // Further ahead than the ring is long
+    control.head.store(2 * capacity);
+    BOOST_REQUIRE(!ring.pop(asio::buffer(buffer), size, error));
+    BOOST_REQUIRE(error);
+
+    // Nothing has been consumed
+    BOOST_REQUIRE_EQUAL(control.tail.load(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(wakeup)
+{
+    const std::string message = "wake";
+
+    BOOST_REQUIRE(!ring.consumer_needs_wakeup());
+
+    ring.wait_for_data();
+    BOOST_REQUIRE(ring.push(asio::buffer(message)));
+    BOOST_REQUIRE(ring.consumer_needs_wakeup());
+    BOOST_REQUIRE(!ring.consumer_needs_wakeup());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,314 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Built with MAIDSAFE_CRUX_SIMULATION, in a test program of its own
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include <boost/system/error_code.hpp>
+#include <maidsafe/crux/socket.hpp>
+#include <maidsafe/crux/acceptor.hpp>
+#include <maidsafe/crux/simulation.hpp>
+#include <maidsafe/crux/replay.hpp>
+#include <maidsafe/crux/detail/capture.hpp>
+
+namespace asio = boost::asio;
+using error_code    = boost::system::error_code;
+using endpoint_type = boost::asio::ip::udp::endpoint;
+
+namespace
+{
+
+struct outcome
+{
+    std::size_t received;
+    std::size_t delivered;
+    std::size_t dropped;
+    maidsafe::crux::simulation::duration_type elapsed;
+};
+
+// Clients that each send a number of messages to their own server socket
+// over a lossy network, and close once all have been sent. The datagrams of
+// the server endpoint are recorded if given a capture.
+outcome transfer(std::uint32_t seed,
+                 std::size_t client_count,
+                 std::size_t message_count,
+                 double loss,
+                 std::shared_ptr<maidsafe::crux::detail::capture_writer> recorder = nullptr)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+    crux::simulation simulation(ios, seed);
+    simulation.latency(std::chrono::milliseconds(20), std::chrono::milliseconds(10));
+    simulation.loss(loss);
+
+    const auto start = simulation.now();
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+    if (recorder)
+    {
+        asio::use_service<crux::detail::service>(ios).add(acceptor.local_endpoint())->capture(recorder);
+    }
+
+    std::vector<std::shared_ptr<crux::socket>> server_sockets;
+    std::vector<std::unique_ptr<crux::socket>> client_sockets;
+    std::size_t received = 0;
+
+    std::function<void(std::shared_ptr<crux::socket>, std::shared_ptr<std::vector<char>>)> receive;
+    receive = [&](std::shared_ptr<crux::socket> socket, std::shared_ptr<std::vector<char>> data) {
+        socket->async_receive(asio::buffer(*data),
+                              [&, socket, data](error_code error, std::size_t size) {
+                                  if (error)
+                                      return;
+                                  BOOST_REQUIRE_EQUAL(size, data->size());
+                                  ++received;
+                                  receive(socket, data);
+                              });
+    };
+
+    acceptor.async_accept_each(
+            [&]() { return std::make_shared<crux::socket>(ios); },
+            [&](error_code error, std::shared_ptr<crux::socket> socket) {
+              if (error)
+                  return;
+              server_sockets.push_back(socket);
+              receive(socket, std::make_shared<std::vector<char>>(100));
+              if (server_sockets.size() == client_count)
+                  acceptor.close();
+            });
+
+    const std::vector<char> message(100, 'x');
+
+    std::function<void(crux::socket&, std::size_t)> send;
+    send = [&](crux::socket& socket, std::size_t remaining) {
+        if (remaining == 0) {
+            socket.close();
+            return;
+        }
+        socket.async_send(asio::buffer(message),
+                          [&, remaining](error_code error, std::size_t) {
+                              BOOST_REQUIRE(!error);
+                              send(socket, remaining - 1);
+                          });
+    };
+
+    for (std::size_t i = 0; i < client_count; ++i) {
+        client_sockets.emplace_back(new crux::socket(ios, endpoint_type(udp::v4(), 0)));
+        auto& socket = *client_sockets.back();
+        socket.async_connect(acceptor.local_endpoint(),
+                             [&](error_code error) {
+                                 BOOST_REQUIRE(!error);
+                                 send(socket, message_count);
+                             });
+    }
+
+    simulation.run();
+
+    for (auto& socket : server_sockets) socket->close();
+    simulation.run();
+
+    BOOST_REQUIRE_EQUAL(server_sockets.size(), client_count);
+
+    outcome result;
+    result.received = received;
+    result.delivered = simulation.delivered();
+    result.dropped = simulation.dropped();
+    result.elapsed = simulation.now() - start;
+    return result;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(simulation)
+
+BOOST_AUTO_TEST_CASE(keepalive_timeout)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+    crux::simulation simulation(ios, 1);
+
+    const auto start = simulation.now();
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    bool tested_client = false;
+    bool tested_server = false;
+
+    acceptor.async_accept
+        ( server_socket
+        , [&](error_code error) {
+              BOOST_REQUIRE(!error);
+
+              server_socket.async_receive(
+                  asio::null_buffers(),
+                  [&](const error_code& error, size_t) {
+                    BOOST_REQUIRE(error);
+                    tested_server = true;
+                  });
+          });
+
+    client_socket.async_connect
+        ( acceptor.local_endpoint()
+        , [&](error_code error) {
+            BOOST_REQUIRE(!error);
+            tested_client = true;
+            // The shutdown gets lost, as if the client had crashed
+            simulation.loss(1.0);
+            client_socket.close();
+          });
+
+    simulation.run();
+
+    BOOST_REQUIRE(tested_client);
+    BOOST_REQUIRE(tested_server);
+    // The server only notices that the client has gone when it times out
+    BOOST_REQUIRE(simulation.now() - start >= crux::detail::constant::keepalive_timeout);
+}
+
+BOOST_AUTO_TEST_CASE(run_for)
+{
+    using namespace maidsafe;
+
+    asio::io_service ios;
+    crux::simulation simulation(ios, 1);
+
+    crux::detail::timer timer(ios);
+    std::size_t ticks = 0;
+    timer.set_period(std::chrono::seconds(1));
+    timer.set_handler([&]() {
+            ++ticks;
+            timer.start();
+        });
+    timer.start();
+
+    const auto start = simulation.now();
+    simulation.run_for(std::chrono::hours(10));
+    BOOST_REQUIRE_EQUAL(ticks, 10 * 60 * 60u);
+    BOOST_REQUIRE(simulation.now() - start == std::chrono::hours(10));
+
+    timer.stop();
+    simulation.run();
+}
+
+BOOST_AUTO_TEST_CASE(lossy_transfer)
+{
+    const std::size_t client_count = 10;
+    const std::size_t message_count = 20;
+
+    const auto result = transfer(7, client_count, message_count, 0.05);
+
+    // Everything arrives despite losses, which cost retransmissions
+    BOOST_REQUIRE_EQUAL(result.received, client_count * message_count);
+    BOOST_REQUIRE_GT(result.dropped, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(repeatable_from_seed)
+{
+    const auto first = transfer(42, 5, 10, 0.1);
+    const auto second = transfer(42, 5, 10, 0.1);
+
+    BOOST_REQUIRE_EQUAL(first.received, second.received);
+    BOOST_REQUIRE_EQUAL(first.delivered, second.delivered);
+    BOOST_REQUIRE_EQUAL(first.dropped, second.dropped);
+    BOOST_REQUIRE(first.elapsed == second.elapsed);
+}
+
+BOOST_AUTO_TEST_CASE(many_connections)
+{
+    const std::size_t client_count = 1000;
+
+    const auto result = transfer(3, client_count, 1, 0.01);
+
+    BOOST_REQUIRE_EQUAL(result.received, client_count);
+}
+
+BOOST_AUTO_TEST_CASE(capture_replay)
+{
+    using namespace maidsafe;
+
+    const std::string path = "crux_simulation_capture.pcap";
+    const std::size_t client_count = 3;
+    const std::size_t message_count = 10;
+
+    auto writer = crux::detail::capture_writer::create(path);
+    BOOST_REQUIRE(writer);
+    const auto original = transfer(5, client_count, message_count, 0.05, writer);
+    writer.reset();
+
+    std::vector<crux::detail::captured_datagram> datagrams;
+    {
+        auto reader = crux::detail::capture_reader::open(path);
+        BOOST_REQUIRE(reader);
+        crux::detail::captured_datagram datagram;
+        while (reader->read(datagram))
+        {
+            datagrams.push_back(datagram);
+        }
+    }
+    std::remove(path.c_str());
+
+    // The server endpoint gets what it got in the capture, with nobody to
+    // answer it
+    asio::io_service ios;
+    crux::simulation simulation(ios, 6);
+    simulation.latency(crux::simulation::duration_type::zero());
+
+    crux::replay replay(simulation, ios, std::move(datagrams));
+    BOOST_REQUIRE_NE(replay.size(), 0u);
+
+    crux::acceptor acceptor(ios, replay.local_endpoint());
+
+    std::vector<std::shared_ptr<crux::socket>> sockets;
+    std::size_t received = 0;
+
+    std::function<void(std::shared_ptr<crux::socket>, std::shared_ptr<std::vector<char>>)> receive;
+    receive = [&](std::shared_ptr<crux::socket> socket, std::shared_ptr<std::vector<char>> data) {
+        socket->async_receive(asio::buffer(*data),
+                              [&, socket, data](error_code error, std::size_t) {
+                                  if (error)
+                                      return;
+                                  ++received;
+                                  receive(socket, data);
+                              });
+    };
+
+    acceptor.async_accept_each(
+            [&]() { return std::make_shared<crux::socket>(ios); },
+            [&](error_code error, std::shared_ptr<crux::socket> socket) {
+              if (error)
+                  return;
+              sockets.push_back(socket);
+              receive(socket, std::make_shared<std::vector<char>>(100));
+            });
+
+    replay.run();
+
+    BOOST_REQUIRE_EQUAL(sockets.size(), client_count);
+    BOOST_REQUIRE_EQUAL(received, original.received);
+
+    acceptor.close();
+    for (auto& socket : sockets) socket->close();
+    simulation.run();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,10 +8,17 @@
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <cstring>
+#include <functional>
+#include <set>
 #include <boost/test/unit_test.hpp>
 #include <boost/system/error_code.hpp>
 #include <maidsafe/crux/socket.hpp>
 #include <maidsafe/crux/acceptor.hpp>
+#include <maidsafe/crux/detail/constants.hpp>
+#include <maidsafe/crux/detail/encoder.hpp>
+#include <maidsafe/crux/detail/header.hpp>
+#include <maidsafe/crux/detail/header_view.hpp>
 
 namespace asio = boost::asio;
 using error_code    = boost::system::error_code;
@@ -21,6 +28,137 @@ static std::string to_string(const std::vector<char>& v) {
     return std::string(v.begin(), v.end());
 }
 
+// Forwards datagrams between a client and a server like a NAT box, which may
+// change the port it uses towards the server at any time.
+class udp_relay
+{
+public:
+    using udp = asio::ip::udp;
+
+    udp_relay(asio::io_service& ios, endpoint_type server)
+        : ios(ios)
+        , front(ios, endpoint_type(udp::v4(), 0))
+        , back(ios, endpoint_type(udp::v4(), 0))
+        , server(server)
+        , front_data(2048)
+        , back_data(2048)
+        , corrupt_size(0)
+        , drop_size(0)
+    {
+        receive_front();
+        receive_back();
+    }
+
+    endpoint_type local_endpoint() const
+    {
+        return endpoint_type(asio::ip::address_v4::loopback(),
+                             front.local_endpoint().port());
+    }
+
+    // Continue on a new port towards the server
+    void rebind()
+    {
+        back.close();
+        back = udp::socket(ios, endpoint_type(udp::v4(), 0));
+        receive_back();
+    }
+
+    void close()
+    {
+        front.close();
+        back.close();
+    }
+
+    // Everything sent towards the server so far
+    const std::string& forwarded() const
+    {
+        return forwarded_data;
+    }
+
+    // The last datagram of the given size sent towards the server
+    std::vector<char> last_forwarded(std::size_t size) const
+    {
+        for (auto i = forwarded_datagrams.rbegin(); i != forwarded_datagrams.rend(); ++i)
+        {
+            if (i->size() == size) return *i;
+        }
+        return std::vector<char>();
+    }
+
+    // Flip a bit in the last byte of the next datagram of the given size
+    // towards the server
+    void corrupt_next(std::size_t size)
+    {
+        corrupt_size = size;
+    }
+
+    // Drop the next datagram of the given size towards the client
+    void drop_next_reply(std::size_t size)
+    {
+        drop_size = size;
+    }
+
+    // Send a datagram of our own towards the server, as if from the client
+    void inject(const std::vector<char>& datagram)
+    {
+        error_code error;
+        back.send_to(asio::buffer(datagram), server, 0, error);
+    }
+
+private:
+    void receive_front()
+    {
+        front.async_receive_from
+            (asio::buffer(front_data), client,
+             [this](error_code error, std::size_t size)
+             {
+                 if (error) return;
+                 if (size > 0 && size == corrupt_size)
+                 {
+                     front_data[size - 1] ^= 0x01;
+                     corrupt_size = 0;
+                 }
+                 forwarded_data.append(front_data.data(), size);
+                 forwarded_datagrams.emplace_back(front_data.begin(),
+                                                  front_data.begin() + size);
+                 back.send_to(asio::buffer(front_data, size), server, 0, error);
+                 receive_front();
+             });
+    }
+
+    void receive_back()
+    {
+        back.async_receive_from
+            (asio::buffer(back_data), sender,
+             [this](error_code error, std::size_t size)
+             {
+                 if (error) return;
+                 if (size > 0 && size == drop_size)
+                 {
+                     drop_size = 0;
+                 }
+                 else
+                 {
+                     front.send_to(asio::buffer(back_data, size), client, 0, error);
+                 }
+                 receive_back();
+             });
+    }
+
+    asio::io_service& ios;
+    udp::socket front;
+    udp::socket back;
+    endpoint_type server;
+    endpoint_type client;
+    endpoint_type sender;
+    std::vector<char> front_data;
+    std::vector<char> back_data;
+    std::size_t corrupt_size;
+    std::size_t drop_size;
+    std::string forwarded_data;
+    std::vector<std::vector<char>> forwarded_datagrams;
+};
+
 BOOST_AUTO_TEST_SUITE(socket_suite)
 
 BOOST_AUTO_TEST_CASE(accept___connect)
@@ -551,4 +689,1917 @@ BOOST_AUTO_TEST_CASE(keepalive_timeout)
     BOOST_REQUIRE(tested_server);
 }
 
+BOOST_AUTO_TEST_CASE(accept_accept___connect_connect_refused)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket1(ios, endpoint_type(udp::v4(), 0));
+    crux::socket client_socket2(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket1(ios);
+    crux::socket server_socket2(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+    acceptor.max_connections(1);
+
+    bool tested_refusal = false;
+
+    acceptor.async_accept(server_socket1, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            acceptor.async_accept(server_socket2, [&](error_code error) {
+                    BOOST_VERIFY(error);
+                    });
+
+            client_socket2.async_connect(
+                acceptor.local_endpoint(),
+                [&](error_code error) {
+                  BOOST_REQUIRE_EQUAL(error, asio::error::connection_refused);
+                  tested_refusal = true;
+
+                  client_socket1.close();
+                  server_socket1.close();
+                  acceptor.close();
+                });
+            });
+
+    client_socket1.async_connect(acceptor.local_endpoint(),
+                                 [&](error_code error) {
+                                   BOOST_VERIFY(!error);
+                                 });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_refusal);
+    BOOST_REQUIRE_EQUAL(acceptor.statistics().accepted, 1);
+    BOOST_REQUIRE_EQUAL(acceptor.statistics().refused, 1);
+    BOOST_REQUIRE_EQUAL(acceptor.statistics().evicted, 0);
+}
+
+BOOST_AUTO_TEST_CASE(accept_accept___connect_connect_evict_idle)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket1(ios, endpoint_type(udp::v4(), 0));
+    crux::socket client_socket2(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket1(ios);
+    crux::socket server_socket2(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+    acceptor.max_connections(1);
+    acceptor.admission(crux::admission_policy::evict_idle);
+
+    bool tested_eviction = false;
+    bool tested_evicted  = false;
+    bool tested_accept   = false;
+
+    acceptor.async_accept(server_socket1, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            // The evicted socket tells its user that it did not close
+            // of its own accord
+            server_socket1.async_receive(
+                asio::null_buffers(),
+                [&](const error_code& error, size_t) {
+                  BOOST_REQUIRE_EQUAL(error, asio::error::connection_reset);
+                  tested_evicted = true;
+                });
+
+            acceptor.async_accept(server_socket2, [&](error_code error) {
+                    BOOST_VERIFY(!error);
+                    tested_accept = true;
+
+                    client_socket2.close();
+                    server_socket2.close();
+                    });
+
+            client_socket2.async_connect(acceptor.local_endpoint(),
+                                         [&](error_code error) {
+                                           BOOST_VERIFY(!error);
+                                         });
+            });
+
+    client_socket1.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket1.async_receive(
+                  asio::null_buffers(),
+                  [&](const error_code& error, size_t) {
+                    BOOST_REQUIRE_EQUAL(error, asio::error::connection_reset);
+                    tested_eviction = true;
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_eviction && tested_evicted && tested_accept);
+    BOOST_REQUIRE_EQUAL(acceptor.statistics().accepted, 2);
+    BOOST_REQUIRE_EQUAL(acceptor.statistics().evicted, 1);
+}
+
+BOOST_AUTO_TEST_CASE(accept_each___connect_many)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    const std::size_t client_count = 3;
+
+    std::vector<std::unique_ptr<crux::socket>> client_sockets;
+    std::vector<std::shared_ptr<crux::socket>> server_sockets;
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    std::size_t connected = 0;
+    bool tested_abort = false;
+
+    auto close_all = [&]() {
+        for (auto& socket : client_sockets) socket->close();
+        for (auto& socket : server_sockets) socket->close();
+        acceptor.close();
+    };
+
+    acceptor.async_accept_each(
+            [&]() { return std::make_shared<crux::socket>(ios); },
+            [&](error_code error, std::shared_ptr<crux::socket> socket) {
+              if (error) {
+                  BOOST_REQUIRE_EQUAL(error, asio::error::operation_aborted);
+                  BOOST_REQUIRE(!socket);
+                  tested_abort = true;
+                  return;
+              }
+              BOOST_REQUIRE(socket);
+              server_sockets.push_back(socket);
+
+              if (server_sockets.size() == client_count && connected == client_count) {
+                  close_all();
+              }
+            });
+
+    for (std::size_t i = 0; i < client_count; ++i) {
+        client_sockets.emplace_back(new crux::socket(ios, endpoint_type(udp::v4(), 0)));
+        client_sockets.back()->async_connect(
+                acceptor.local_endpoint(),
+                [&](error_code error) {
+                  BOOST_VERIFY(!error);
+
+                  if (++connected == client_count && server_sockets.size() == client_count) {
+                      close_all();
+                  }
+                });
+    }
+
+    ios.run();
+
+    BOOST_REQUIRE_EQUAL(connected, client_count);
+    BOOST_REQUIRE_EQUAL(server_sockets.size(), client_count);
+    BOOST_REQUIRE(tested_abort);
+    BOOST_REQUIRE_EQUAL(acceptor.statistics().accepted, client_count);
+}
+
+BOOST_AUTO_TEST_CASE(accept_shared_memory___connect_shared_memory)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    client_socket.shared_memory(true);
+    server_socket.shared_memory(true);
+
+    const std::string request = "REQUEST";
+    const std::string response = "RESPONSE";
+    std::vector<char> server_rx(request.size());
+    std::vector<char> client_rx(response.size());
+
+    bool tested_request = false;
+    bool tested_response = false;
+    bool tested_reset = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            BOOST_REQUIRE(server_socket.uses_shared_memory());
+
+            server_socket.async_receive(
+                asio::buffer(server_rx),
+                [&](error_code error, size_t size) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(size, request.size());
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx), request);
+                  tested_request = true;
+
+                  server_socket.async_send(asio::buffer(response),
+                                           [&](error_code error, size_t) {
+                                             BOOST_VERIFY(!error);
+                                           });
+
+                  server_socket.async_receive(
+                      asio::buffer(server_rx),
+                      [&](error_code error, size_t) {
+                        // The client closed the connection.
+                        BOOST_REQUIRE_EQUAL(error, asio::error::connection_reset);
+                        tested_reset = true;
+                        server_socket.close();
+                        acceptor.close();
+                      });
+                });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE(client_socket.uses_shared_memory());
+
+              client_socket.async_send(asio::buffer(request),
+                                       [&](error_code error, size_t size) {
+                                         BOOST_VERIFY(!error);
+                                         BOOST_REQUIRE_EQUAL(size, request.size());
+                                       });
+
+              client_socket.async_receive(
+                  asio::buffer(client_rx),
+                  [&](error_code error, size_t size) {
+                    BOOST_VERIFY(!error);
+                    BOOST_REQUIRE_EQUAL(size, response.size());
+                    BOOST_REQUIRE_EQUAL(to_string(client_rx), response);
+                    tested_response = true;
+                    client_socket.close();
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_request);
+    BOOST_REQUIRE(tested_response);
+    BOOST_REQUIRE(tested_reset);
+}
+
+BOOST_AUTO_TEST_CASE(accept___connect_shared_memory)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    // The server does not agree, so the connection stays on UDP.
+    client_socket.shared_memory(true);
+
+    const std::string message_text = "TEST_MESSAGE";
+    std::vector<char> rx_data(message_text.size());
+
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            BOOST_REQUIRE(!server_socket.uses_shared_memory());
+
+            server_socket.async_receive(
+                asio::buffer(rx_data),
+                [&](error_code error, size_t size) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(size, message_text.size());
+                  BOOST_REQUIRE_EQUAL(to_string(rx_data), message_text);
+                  tested_receive = true;
+                });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE(!client_socket.uses_shared_memory());
+
+              client_socket.async_send(asio::buffer(message_text),
+                                       [&](error_code error, size_t) {
+                                         BOOST_VERIFY(!error);
+                                       });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___migrate)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    udp_relay relay(ios, endpoint_type(asio::ip::address_v4::loopback(),
+                                       acceptor.local_endpoint().port()));
+
+    const std::string message1_text = "TEST_MESSAGE1";
+    const std::string message2_text = "TEST_MESSAGE2";
+    const std::string message3_text = "TEST_MESSAGE3";
+
+    std::vector<char> server_rx_data(message1_text.size());
+    std::vector<char> client_rx_data(message3_text.size());
+
+    endpoint_type first_endpoint;
+    bool tested_migration = false;
+    bool tested_client = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            server_socket.async_receive(
+                asio::buffer(server_rx_data),
+                [&](error_code error, size_t) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message1_text);
+                  first_endpoint = server_socket.remote_endpoint();
+
+                  server_socket.async_receive(
+                      asio::buffer(server_rx_data),
+                      [&](error_code error, size_t) {
+                        BOOST_VERIFY(!error);
+                        BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message2_text);
+                        BOOST_REQUIRE(server_socket.remote_endpoint() != first_endpoint);
+                        tested_migration = true;
+
+                        server_socket.async_send(
+                            asio::buffer(message3_text),
+                            [&](error_code error, size_t) {
+                              BOOST_VERIFY(!error);
+                              relay.close();
+                            });
+                      });
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_send(asio::buffer(message1_text),
+                  [&](error_code error, size_t) {
+                    BOOST_REQUIRE(!error);
+
+                    relay.rebind();
+
+                    client_socket.async_send(asio::buffer(message2_text),
+                        [&](error_code error, size_t) {
+                          BOOST_REQUIRE(!error);
+                        });
+
+                    client_socket.async_receive(asio::buffer(client_rx_data),
+                        [&](error_code error, size_t) {
+                          BOOST_REQUIRE(!error);
+                          BOOST_REQUIRE_EQUAL(to_string(client_rx_data), message3_text);
+                          tested_client = true;
+                        });
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_migration);
+    BOOST_REQUIRE(tested_client);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___migrate_spoofed)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+    namespace header = crux::detail::header;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+    const endpoint_type server_endpoint(asio::ip::address_v4::loopback(),
+                                        acceptor.local_endpoint().port());
+
+    udp_relay relay(ios, server_endpoint);
+
+    // Sees whatever the server sends to it
+    udp::socket attacker(ios, endpoint_type(udp::v4(), 0));
+    std::vector<char> attacker_rx_data(2048);
+    endpoint_type attacker_sender;
+
+    const std::string message1_text = "TEST_MESSAGE1";
+    const std::string message2_text = "TEST_MESSAGE2";
+
+    std::vector<char> server_rx_data(message1_text.size());
+
+    endpoint_type first_endpoint;
+    bool tested_challenge = false;
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            server_socket.async_receive(
+                asio::buffer(server_rx_data),
+                [&](error_code error, size_t) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message1_text);
+                  first_endpoint = server_socket.remote_endpoint();
+
+                  // The next packet of the client, with the connection
+                  // identifier of the server, but from elsewhere
+                  auto forged = relay.last_forwarded(header::constant::size
+                                                     + message1_text.size());
+                  BOOST_REQUIRE(!forged.empty());
+                  const auto sequence = header::view(reinterpret_cast<const std::uint8_t *>(forged.data()),
+                                                     forged.size()).sequence_number();
+                  crux::detail::encoder encoder(reinterpret_cast<std::uint8_t *>(forged.data())
+                                                + header::view::offset_sequence,
+                                                sizeof(std::uint32_t));
+                  encoder.put<std::uint32_t>(sequence.next().value());
+                  attacker.send_to(asio::buffer(forged), server_endpoint);
+
+                  server_socket.async_receive(
+                      asio::buffer(server_rx_data),
+                      [&](error_code error, size_t) {
+                        BOOST_VERIFY(!error);
+                        BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message2_text);
+                        BOOST_REQUIRE(server_socket.remote_endpoint() == first_endpoint);
+                        tested_receive = true;
+                      });
+                });
+            });
+
+    // The server challenges the forged endpoint instead of following it
+    attacker.async_receive_from(
+        asio::buffer(attacker_rx_data), attacker_sender,
+        [&](error_code error, std::size_t size) {
+          BOOST_REQUIRE(!error);
+          BOOST_REQUIRE_EQUAL(size, header::constant::size);
+          const header::view view(reinterpret_cast<const std::uint8_t *>(attacker_rx_data.data()),
+                                  size);
+          BOOST_REQUIRE(view.is_valid());
+          BOOST_REQUIRE_EQUAL(view.type(), header::constant::type_keepalive);
+          BOOST_REQUIRE(view.options() & header::constant::option_challenge);
+          BOOST_REQUIRE(server_socket.remote_endpoint() == first_endpoint);
+          tested_challenge = true;
+
+          client_socket.async_send(asio::buffer(message2_text),
+              [&](error_code error, size_t) {
+                BOOST_REQUIRE(!error);
+
+                client_socket.close();
+                server_socket.close();
+                acceptor.close();
+                relay.close();
+                attacker.close();
+              });
+        });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_send(asio::buffer(message1_text),
+                  [&](error_code error, size_t) {
+                    BOOST_REQUIRE(!error);
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_challenge);
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___multipath)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    const auto loopback = asio::ip::address_v4::loopback();
+
+    crux::socket client_socket(ios, endpoint_type(loopback, 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(loopback, 0));
+
+    client_socket.add_path(endpoint_type(loopback, 0));
+
+    const std::size_t message_count = 4;
+    std::vector<char> rx_data(sizeof(std::size_t));
+    std::set<endpoint_type> remote_endpoints;
+    std::size_t received = 0;
+    std::size_t sent = 0;
+
+    std::function<void()> receive = [&]() {
+        server_socket.async_receive(
+            asio::buffer(rx_data),
+            [&](error_code error, size_t size) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE_EQUAL(size, rx_data.size());
+              std::size_t value;
+              std::memcpy(&value, rx_data.data(), sizeof(value));
+              BOOST_REQUIRE_EQUAL(value, received);
+              remote_endpoints.insert(server_socket.remote_endpoint());
+              if (++received < message_count) {
+                  receive();
+              }
+            });
+    };
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            receive();
+            });
+
+    std::function<void()> send = [&]() {
+        auto tx_data = std::make_shared<std::size_t>(sent);
+        client_socket.async_send(
+            asio::buffer(tx_data.get(), sizeof(*tx_data)),
+            [&, tx_data](error_code error, size_t) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE_EQUAL(client_socket.path_count(), 2U);
+              if (++sent < message_count) {
+                  send();
+              }
+              else {
+                  // Paths keep receiving until the socket is closed
+                  client_socket.close();
+              }
+            });
+    };
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE_EQUAL(client_socket.path_count(), 1U);
+              send();
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE_EQUAL(received, message_count);
+    // Both paths have been measured
+    BOOST_REQUIRE_EQUAL(remote_endpoints.size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(send___statistics)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    const std::string message_text = "TEST_MESSAGE";
+    std::vector<char> rx_data(message_text.size());
+
+    std::size_t updates = 0;
+    bool tested_send = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            server_socket.async_receive(asio::buffer(rx_data),
+                                        [&](error_code error, size_t) {
+                                          BOOST_VERIFY(!error);
+                                        });
+            });
+
+    client_socket.statistics_handler([&](const crux::delivery_statistics&) {
+            ++updates;
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_send(asio::buffer(message_text),
+                  [&](error_code error, size_t) {
+                    BOOST_VERIFY(!error);
+
+                    const auto& statistics = client_socket.statistics();
+                    BOOST_REQUIRE_EQUAL(statistics.bytes_delivered, message_text.size());
+                    BOOST_REQUIRE_GE(statistics.transmissions, 2U);
+                    BOOST_REQUIRE_EQUAL(statistics.retransmissions, 0U);
+                    BOOST_REQUIRE_EQUAL(statistics.loss_rate, 0.0);
+                    BOOST_REQUIRE(statistics.min_roundtrip_time > crux::delivery_statistics::duration_type::zero());
+                    BOOST_REQUIRE(statistics.min_roundtrip_time <= statistics.smoothed_roundtrip_time);
+                    BOOST_REQUIRE_GT(statistics.delivery_rate, 0.0);
+                    tested_send = true;
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_send);
+    // The handshake and the message
+    BOOST_REQUIRE_EQUAL(updates, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(send_expired___receive)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    const std::string message1_text = "TEST_MESSAGE1";
+    const std::string message2_text = "TEST_MESSAGE2";
+    std::vector<char> rx_data(message2_text.size());
+
+    bool tested_expiry = false;
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            server_socket.async_receive(
+                asio::buffer(rx_data),
+                [&](error_code error, size_t) {
+                  BOOST_VERIFY(!error);
+                  // The expired message has been skipped
+                  BOOST_REQUIRE_EQUAL(to_string(rx_data), message2_text);
+                  tested_receive = true;
+                });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_send(asio::buffer(message1_text),
+                                       std::chrono::steady_clock::now(),
+                                       [&](error_code error, size_t size) {
+                                         BOOST_REQUIRE(error == asio::error::timed_out);
+                                         BOOST_REQUIRE_EQUAL(size, 0U);
+                                         tested_expiry = true;
+                                       });
+              client_socket.async_send(asio::buffer(message2_text),
+                                       [&](error_code error, size_t) {
+                                         BOOST_VERIFY(!error);
+                                       });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_expiry);
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(send_expired_several___receive)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    const std::string expired_text = "EXPIRED_MESSAGE";
+    const std::string message_text = "TEST_MESSAGE";
+    std::vector<char> rx_data(expired_text.size());
+    const std::size_t expired_count = 5;
+
+    std::size_t expired = 0;
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            server_socket.async_receive(
+                asio::buffer(rx_data),
+                [&](error_code error, size_t size) {
+                  BOOST_VERIFY(!error);
+                  // All expired messages have been skipped
+                  BOOST_REQUIRE_EQUAL(std::string(rx_data.data(), size), message_text);
+                  tested_receive = true;
+                });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              for (std::size_t i = 0; i < expired_count; ++i) {
+                  client_socket.async_send(asio::buffer(expired_text),
+                                           std::chrono::steady_clock::now(),
+                                           [&](error_code error, size_t size) {
+                                             BOOST_REQUIRE(error == asio::error::timed_out);
+                                             BOOST_REQUIRE_EQUAL(size, 0U);
+                                             ++expired;
+                                           });
+              }
+              client_socket.async_send(asio::buffer(message_text),
+                                       [&](error_code error, size_t) {
+                                         BOOST_VERIFY(!error);
+                                         // The first expired message is
+                                         // skipped on its own, and the
+                                         // others at once.
+                                         BOOST_REQUIRE_LE(client_socket.statistics().transmissions,
+                                                          4U);
+                                       });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE_EQUAL(expired, expired_count);
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___skip_out_of_range)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+    namespace header = crux::detail::header;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+    const endpoint_type server_endpoint(asio::ip::address_v4::loopback(),
+                                        acceptor.local_endpoint().port());
+
+    udp_relay relay(ios, server_endpoint);
+
+    const std::string message1_text = "TEST_MESSAGE1";
+    const std::string message2_text = "TEST_MESSAGE2";
+
+    std::vector<char> server_rx_data(message1_text.size());
+
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            server_socket.async_receive(
+                asio::buffer(server_rx_data),
+                [&](error_code error, size_t) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message1_text);
+
+                  // A skip from the client for more messages than it may
+                  // have queued
+                  auto forged = relay.last_forwarded(header::constant::size
+                                                     + message1_text.size());
+                  BOOST_REQUIRE(!forged.empty());
+                  forged.resize(header::constant::size);
+                  auto data = reinterpret_cast<std::uint8_t *>(forged.data());
+                  const header::view view(data, forged.size());
+                  const auto sequence = view.sequence_number().value()
+                      + crux::detail::constant::max_transmit_queue_size + 1;
+                  const std::uint16_t word = crux::detail::load_big16(data)
+                      | header::constant::option_skip;
+                  crux::detail::encoder encoder(data, header::view::offset_ack);
+                  encoder.put<std::uint16_t>(word);
+                  encoder.put<std::uint16_t>(view.connection_id());
+                  encoder.put<std::uint32_t>(sequence);
+                  relay.inject(forged);
+
+                  client_socket.async_send(asio::buffer(message2_text),
+                                           [](error_code, size_t) {});
+
+                  // The skip is dropped, so the next message still arrives
+                  server_socket.async_receive(
+                      asio::buffer(server_rx_data),
+                      [&](error_code error, size_t) {
+                        BOOST_VERIFY(!error);
+                        BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message2_text);
+                        tested_receive = true;
+
+                        client_socket.close();
+                        server_socket.close();
+                        acceptor.close();
+                        relay.close();
+                      });
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_send(asio::buffer(message1_text),
+                  [&](error_code error, size_t) {
+                    BOOST_REQUIRE(!error);
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___handshake_established)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+    namespace header = crux::detail::header;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+    const endpoint_type server_endpoint(asio::ip::address_v4::loopback(),
+                                        acceptor.local_endpoint().port());
+
+    udp_relay relay(ios, server_endpoint);
+
+    const std::string message1_text = "TEST_MESSAGE1";
+    const std::string message2_text = "TEST_MESSAGE2";
+
+    std::vector<char> server_rx_data(message1_text.size());
+
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            server_socket.async_receive(
+                asio::buffer(server_rx_data),
+                [&](error_code error, size_t) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message1_text);
+
+                  // A handshake from the client with another initial
+                  // sequence number, as if it were starting over
+                  std::vector<char> forged(header::constant::size);
+                  crux::detail::encoder encoder(reinterpret_cast<std::uint8_t *>(forged.data()),
+                                                forged.size());
+                  header::handshake(0, header::sequence_type(12345), boost::none).encode(encoder);
+                  relay.inject(forged);
+
+                  client_socket.async_send(asio::buffer(message2_text),
+                                           [](error_code, size_t) {});
+
+                  // The connection is not renegotiated
+                  server_socket.async_receive(
+                      asio::buffer(server_rx_data),
+                      [&](error_code error, size_t) {
+                        BOOST_VERIFY(!error);
+                        BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message2_text);
+                        tested_receive = true;
+
+                        client_socket.close();
+                        server_socket.close();
+                        acceptor.close();
+                        relay.close();
+                      });
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_send(asio::buffer(message1_text),
+                  [&](error_code error, size_t) {
+                    BOOST_REQUIRE(!error);
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___forged_shutdown)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+    namespace header = crux::detail::header;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    udp_relay relay(ios, endpoint_type(asio::ip::address_v4::loopback(),
+                                       acceptor.local_endpoint().port()));
+
+    const std::string message1_text = "TEST_MESSAGE1";
+    const std::string message2_text = "TEST_MESSAGE2";
+    std::vector<char> server_rx_data(message1_text.size());
+
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            server_socket.async_receive(
+                asio::buffer(server_rx_data),
+                [&](error_code error, size_t) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message1_text);
+
+                  // A shutdown without the connection identifier of the
+                  // server
+                  std::vector<char> forged(header::constant::size);
+                  crux::detail::encoder encoder(reinterpret_cast<std::uint8_t *>(forged.data()),
+                                                forged.size());
+                  header::shutdown(0, header::sequence_type(), boost::none).encode(encoder);
+                  relay.inject(forged);
+
+                  client_socket.async_send(asio::buffer(message2_text),
+                                           [](error_code, size_t) {});
+
+                  server_socket.async_receive(
+                      asio::buffer(server_rx_data),
+                      [&](error_code error, size_t) {
+                        BOOST_VERIFY(!error);
+                        BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message2_text);
+                        tested_receive = true;
+
+                        client_socket.close();
+                        server_socket.close();
+                        acceptor.close();
+                        relay.close();
+                      });
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_send(asio::buffer(message1_text),
+                                       [](error_code, size_t) {});
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(receive_expired___send)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    const std::string message_text = "TEST_MESSAGE";
+    std::vector<char> expired_data(message_text.size());
+    std::vector<char> rx_data(message_text.size());
+
+    bool tested_expiry = false;
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            server_socket.async_receive(
+                asio::buffer(expired_data),
+                std::chrono::steady_clock::now() + std::chrono::milliseconds(50),
+                [&](error_code error, size_t size) {
+                  BOOST_REQUIRE(error == asio::error::timed_out);
+                  BOOST_REQUIRE_EQUAL(size, 0U);
+                  tested_expiry = true;
+
+                  server_socket.async_receive(
+                      asio::buffer(rx_data),
+                      [&](error_code error, size_t) {
+                        BOOST_VERIFY(!error);
+                        BOOST_REQUIRE_EQUAL(to_string(rx_data), message_text);
+                        tested_receive = true;
+                      });
+
+                  client_socket.async_send(asio::buffer(message_text),
+                                           [&](error_code error, size_t) {
+                                             BOOST_VERIFY(!error);
+                                           });
+                });
+            });
+
+    client_socket.async_connect(acceptor.local_endpoint(),
+                                [&](error_code error) {
+                                  BOOST_VERIFY(!error);
+                                });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_expiry);
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(receive_expired___shared_memory)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    client_socket.shared_memory(true);
+    server_socket.shared_memory(true);
+
+    const std::string message_text = "TEST_MESSAGE";
+    std::vector<char> expired_data(message_text.size());
+    std::vector<char> rx_data(message_text.size());
+
+    bool tested_expiry = false;
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            BOOST_REQUIRE(server_socket.uses_shared_memory());
+
+            server_socket.async_receive(
+                asio::buffer(expired_data),
+                std::chrono::steady_clock::now() + std::chrono::milliseconds(50),
+                [&](error_code error, size_t size) {
+                  BOOST_REQUIRE(error == asio::error::timed_out);
+                  BOOST_REQUIRE_EQUAL(size, 0U);
+                  tested_expiry = true;
+
+                  server_socket.async_receive(
+                      asio::buffer(rx_data),
+                      [&](error_code error, size_t) {
+                        BOOST_VERIFY(!error);
+                        BOOST_REQUIRE_EQUAL(to_string(rx_data), message_text);
+                        tested_receive = true;
+                        client_socket.close();
+                        server_socket.close();
+                        acceptor.close();
+                      });
+
+                  client_socket.async_send(asio::buffer(message_text),
+                                           [&](error_code error, size_t) {
+                                             BOOST_VERIFY(!error);
+                                           });
+                });
+            });
+
+    client_socket.async_connect(acceptor.local_endpoint(),
+                                [&](error_code error) {
+                                  BOOST_VERIFY(!error);
+                                });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_expiry);
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___checksum)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+    client_socket.checksum(true);
+    server_socket.checksum(true);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    udp_relay relay(ios, endpoint_type(asio::ip::address_v4::loopback(),
+                                       acceptor.local_endpoint().port()));
+
+    const std::string message_text = "TEST_MESSAGE";
+    std::vector<char> rx_data(message_text.size());
+
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            BOOST_REQUIRE(server_socket.uses_checksum());
+
+            server_socket.async_receive(
+                asio::buffer(rx_data),
+                [&](error_code error, size_t size) {
+                  BOOST_VERIFY(!error);
+                  // The damaged transmission was dropped, and this is the
+                  // retransmission.
+                  BOOST_REQUIRE_EQUAL(size, message_text.size());
+                  BOOST_REQUIRE_EQUAL(to_string(rx_data), message_text);
+                  tested_receive = true;
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE(client_socket.uses_checksum());
+
+              // Header, payload and trailer
+              relay.corrupt_next(12 + message_text.size() + 4);
+
+              client_socket.async_send(asio::buffer(message_text),
+                                       [&](error_code error, size_t size) {
+                                         BOOST_VERIFY(!error);
+                                         BOOST_REQUIRE_EQUAL(size, message_text.size());
+                                         relay.close();
+                                       });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(send_too_many_buffers___receive)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    const std::string message_text = "TEST_MESSAGE";
+    // One more than fits between the header and the trailer
+    const std::vector<asio::const_buffer> scattered
+        (crux::detail::constant::max_gather_buffers - 1, asio::buffer(message_text));
+    std::string expected;
+    for (std::size_t i = 0; i < scattered.size(); ++i) {
+        expected += message_text;
+    }
+    std::vector<char> rx_data(expected.size());
+
+    bool tested_send = false;
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            server_socket.async_receive(
+                asio::buffer(rx_data),
+                [&](error_code error, size_t size) {
+                  BOOST_VERIFY(!error);
+                  // Flattened into one buffer instead
+                  BOOST_REQUIRE_EQUAL(std::string(rx_data.data(), size), expected);
+                  tested_receive = true;
+                });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_send(scattered,
+                                       [&](error_code error, size_t size) {
+                                         BOOST_VERIFY(!error);
+                                         BOOST_REQUIRE_EQUAL(size, expected.size());
+                                         tested_send = true;
+                                       });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_send);
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___retransmission)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+    client_socket.checksum(true);
+    server_socket.checksum(true);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    udp_relay relay(ios, endpoint_type(asio::ip::address_v4::loopback(),
+                                       acceptor.local_endpoint().port()));
+
+    const std::string message_text = "TEST_MESSAGE";
+    const std::size_t datagram_size = 12 + message_text.size() + 4;
+    std::vector<char> rx_data(message_text.size());
+
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            server_socket.async_receive(
+                asio::buffer(rx_data),
+                [&](error_code error, size_t size) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(size, message_text.size());
+                  BOOST_REQUIRE_EQUAL(to_string(rx_data), message_text);
+                  tested_receive = true;
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              relay.corrupt_next(datagram_size);
+
+              client_socket.async_send(asio::buffer(message_text),
+                                       [&](error_code error, size_t size) {
+                                         BOOST_VERIFY(!error);
+                                         BOOST_REQUIRE_EQUAL(size, message_text.size());
+                                         relay.close();
+                                       });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+
+    // The damaged transmission and the retransmission carry the same
+    // message, and only the retransmission count in the header differs.
+    const auto& forwarded = relay.forwarded();
+    BOOST_REQUIRE_GE(forwarded.size(), 2 * datagram_size);
+    const auto retransmission = forwarded.substr(forwarded.size() - datagram_size);
+    const auto original = forwarded.substr(forwarded.size() - 2 * datagram_size, datagram_size);
+    BOOST_REQUIRE_EQUAL(original[1] & 0x03, 0);
+    BOOST_REQUIRE_EQUAL(retransmission[1] & 0x03, 1);
+    BOOST_REQUIRE_EQUAL(retransmission.substr(12, message_text.size()), message_text);
+    BOOST_REQUIRE_EQUAL(original.substr(12, message_text.size()), message_text);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___lost_keepalive)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    udp_relay relay(ios, endpoint_type(asio::ip::address_v4::loopback(),
+                                       acceptor.local_endpoint().port()));
+
+    const std::string message1_text = "TEST_MESSAGE1";
+    const std::string message2_text = "TEST_MESSAGE2";
+    const std::size_t keepalive_size = 12;
+
+    std::vector<char> server_rx_data(message1_text.size());
+    std::vector<char> client_rx_data(message2_text.size());
+
+    bool tested_server = false;
+    bool tested_client = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            server_socket.async_receive(
+                asio::buffer(server_rx_data),
+                [&](error_code error, size_t) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message1_text);
+                  tested_server = true;
+
+                  // Follows the keepalive with the ack that has been lost,
+                  // and must not be taken for a duplicate.
+                  server_socket.async_send(
+                      asio::buffer(message2_text),
+                      [&](error_code error, size_t) {
+                        BOOST_VERIFY(!error);
+                        relay.close();
+                      });
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              relay.drop_next_reply(keepalive_size);
+
+              client_socket.async_send(asio::buffer(message1_text),
+                  [&](error_code error, size_t) {
+                    // Acknowledged once retransmitted
+                    BOOST_VERIFY(!error);
+                  });
+
+              client_socket.async_receive(asio::buffer(client_rx_data),
+                  [&](error_code error, size_t) {
+                    BOOST_REQUIRE(!error);
+                    BOOST_REQUIRE_EQUAL(to_string(client_rx_data), message2_text);
+                    tested_client = true;
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_server);
+    BOOST_REQUIRE(tested_client);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___malformed_header)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    udp_relay relay(ios, endpoint_type(asio::ip::address_v4::loopback(),
+                                       acceptor.local_endpoint().port()));
+
+    const std::string message_text = "TEST_MESSAGE";
+    std::vector<char> rx_data(message_text.size());
+
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            server_socket.async_receive(
+                asio::buffer(rx_data),
+                [&](error_code error, size_t size) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(size, message_text.size());
+                  BOOST_REQUIRE_EQUAL(to_string(rx_data), message_text);
+                  tested_receive = true;
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              // Unknown type, and a handshake of another version
+              std::vector<char> unknown(12 + message_text.size());
+              unknown[0] = char(0xE0);
+              relay.inject(unknown);
+              std::vector<char> version(12);
+              version[0] = char(0xC8);
+              version[3] = 0x7F;
+              relay.inject(version);
+
+              client_socket.async_send(asio::buffer(message_text),
+                                       [&](error_code error, size_t size) {
+                                         BOOST_VERIFY(!error);
+                                         BOOST_REQUIRE_EQUAL(size, message_text.size());
+                                         relay.close();
+                                       });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(connect___checksum_refused)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+    client_socket.checksum(true);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    const std::string message_text = "TEST_MESSAGE";
+    std::vector<char> rx_data(message_text.size());
+
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            BOOST_REQUIRE(!server_socket.uses_checksum());
+
+            server_socket.async_receive(
+                asio::buffer(rx_data),
+                [&](error_code error, size_t) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(to_string(rx_data), message_text);
+                  tested_receive = true;
+                });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE(!client_socket.uses_checksum());
+
+              client_socket.async_send(asio::buffer(message_text),
+                                       [&](error_code error, size_t) {
+                                         BOOST_VERIFY(!error);
+                                       });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+}
+
+#if defined(MAIDSAFE_CRUX_USE_OPENSSL)
+BOOST_AUTO_TEST_CASE(send_receive___encryption)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+    client_socket.encryption(true);
+    server_socket.encryption(true);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    udp_relay relay(ios, endpoint_type(asio::ip::address_v4::loopback(),
+                                       acceptor.local_endpoint().port()));
+
+    const std::string message_text = "TEST_MESSAGE";
+    const std::string reply_text = "TEST_REPLY";
+    std::vector<char> server_rx_data(message_text.size());
+    std::vector<char> client_rx_data(reply_text.size());
+
+    bool tested_server = false;
+    bool tested_client = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            BOOST_REQUIRE(server_socket.uses_encryption());
+
+            server_socket.async_receive(
+                asio::buffer(server_rx_data),
+                [&](error_code error, size_t size) {
+                  BOOST_VERIFY(!error);
+                  // The forged transmission was dropped, and this is the
+                  // retransmission.
+                  BOOST_REQUIRE_EQUAL(size, message_text.size());
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message_text);
+                  tested_server = true;
+
+                  server_socket.async_send(asio::buffer(reply_text),
+                                           [&](error_code error, size_t) {
+                                             BOOST_VERIFY(!error);
+                                             relay.close();
+                                           });
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE(client_socket.uses_encryption());
+
+              // Header, payload, packet counter and tag
+              relay.corrupt_next(12 + message_text.size() + 24);
+
+              client_socket.async_send(asio::buffer(message_text),
+                                       [&](error_code error, size_t size) {
+                                         BOOST_VERIFY(!error);
+                                         BOOST_REQUIRE_EQUAL(size, message_text.size());
+                                       });
+
+              client_socket.async_receive(
+                  asio::buffer(client_rx_data),
+                  [&](error_code error, size_t) {
+                    BOOST_VERIFY(!error);
+                    BOOST_REQUIRE_EQUAL(to_string(client_rx_data), reply_text);
+                    tested_client = true;
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_server);
+    BOOST_REQUIRE(tested_client);
+    BOOST_REQUIRE(relay.forwarded().find(message_text) == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___encryption_forged_shutdown)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+    namespace header = crux::detail::header;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+    client_socket.encryption(true);
+    server_socket.encryption(true);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    udp_relay relay(ios, endpoint_type(asio::ip::address_v4::loopback(),
+                                       acceptor.local_endpoint().port()));
+
+    const std::string message1_text = "TEST_MESSAGE1";
+    const std::string message2_text = "TEST_MESSAGE2";
+    std::vector<char> server_rx_data(message1_text.size());
+
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            server_socket.async_receive(
+                asio::buffer(server_rx_data),
+                [&](error_code error, size_t) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message1_text);
+
+                  // A shutdown that is not sealed with the keys of the
+                  // connection
+                  std::vector<char> forged(header::constant::size);
+                  crux::detail::encoder encoder(reinterpret_cast<std::uint8_t *>(forged.data()),
+                                                forged.size());
+                  header::shutdown(0, header::sequence_type(), boost::none).encode(encoder);
+                  relay.inject(forged);
+
+                  client_socket.async_send(asio::buffer(message2_text),
+                                           [](error_code, size_t) {});
+
+                  server_socket.async_receive(
+                      asio::buffer(server_rx_data),
+                      [&](error_code error, size_t) {
+                        BOOST_VERIFY(!error);
+                        BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message2_text);
+                        tested_receive = true;
+
+                        client_socket.close();
+                        server_socket.close();
+                        acceptor.close();
+                        relay.close();
+                      });
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_send(asio::buffer(message1_text),
+                                       [](error_code, size_t) {});
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(send_receive___compression)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    auto dictionary = std::make_shared<const std::vector<char>>(16, 'x');
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+    client_socket.compression(true);
+    client_socket.compression_dictionary(dictionary);
+    server_socket.compression(true);
+    server_socket.compression_dictionary(dictionary);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    udp_relay relay(ios, endpoint_type(asio::ip::address_v4::loopback(),
+                                       acceptor.local_endpoint().port()));
+
+    std::string message_text;
+    std::string reply_text;
+    for (int i = 0; i < 50; ++i)
+    {
+        message_text += "TEST_MESSAGE ";
+        reply_text += "TEST_REPLY ";
+    }
+    std::vector<char> server_rx_data(message_text.size());
+    // The reply is received into several buffers
+    std::vector<char> client_rx_head(100);
+    std::vector<char> client_rx_tail(reply_text.size() - client_rx_head.size());
+
+    bool tested_server = false;
+    bool tested_client = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            BOOST_REQUIRE(server_socket.uses_compression());
+
+            server_socket.async_receive(
+                asio::buffer(server_rx_data),
+                [&](error_code error, size_t size) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(size, message_text.size());
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message_text);
+                  tested_server = true;
+
+                  server_socket.async_send(asio::buffer(reply_text),
+                                           [&](error_code error, size_t size) {
+                                             BOOST_VERIFY(!error);
+                                             BOOST_REQUIRE_EQUAL(size, reply_text.size());
+                                             relay.close();
+                                           });
+                });
+            });
+
+    client_socket.async_connect(
+            relay.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE(client_socket.uses_compression());
+
+              client_socket.async_send(asio::buffer(message_text),
+                                       [&](error_code error, size_t size) {
+                                         BOOST_VERIFY(!error);
+                                         BOOST_REQUIRE_EQUAL(size, message_text.size());
+                                       });
+
+              std::array<asio::mutable_buffer, 2> buffers
+                  = {{ asio::buffer(client_rx_head), asio::buffer(client_rx_tail) }};
+              client_socket.async_receive(
+                  buffers,
+                  [&](error_code error, size_t size) {
+                    BOOST_VERIFY(!error);
+                    BOOST_REQUIRE_EQUAL(size, reply_text.size());
+                    BOOST_REQUIRE_EQUAL(to_string(client_rx_head) + to_string(client_rx_tail),
+                                        reply_text);
+                    tested_client = true;
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_server);
+    BOOST_REQUIRE(tested_client);
+    BOOST_REQUIRE(relay.forwarded().find(message_text) == std::string::npos);
+    BOOST_REQUIRE_LT(relay.forwarded().size(), message_text.size());
+}
+
+BOOST_AUTO_TEST_CASE(connect___compression_dictionary_mismatch)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+    client_socket.compression(true);
+    client_socket.compression_dictionary(std::make_shared<const std::vector<char>>(16, 'x'));
+    server_socket.compression(true);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    std::string message_text;
+    for (int i = 0; i < 50; ++i)
+    {
+        message_text += "TEST_MESSAGE ";
+    }
+    std::vector<char> rx_data(message_text.size());
+
+    bool tested_receive = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            BOOST_REQUIRE(!server_socket.uses_compression());
+
+            server_socket.async_receive(
+                asio::buffer(rx_data),
+                [&](error_code error, size_t) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(to_string(rx_data), message_text);
+                  tested_receive = true;
+                });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE(!client_socket.uses_compression());
+
+              client_socket.async_send(asio::buffer(message_text),
+                                       [&](error_code error, size_t) {
+                                         BOOST_VERIFY(!error);
+                                       });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_receive);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___compact_header)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+    client_socket.compact_header(true);
+    client_socket.checksum(true);
+    server_socket.compact_header(true);
+    server_socket.checksum(true);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    const std::string message_text = "TEST_MESSAGE";
+    const std::string reply_text = "TEST_REPLY";
+    const int rounds = 3;
+    std::vector<char> server_rx_data(message_text.size());
+    std::vector<char> client_rx_data(reply_text.size());
+
+    int server_rounds = 0;
+    int client_rounds = 0;
+
+    std::function<void()> server_receive = [&]() {
+        server_socket.async_receive(
+            asio::buffer(server_rx_data),
+            [&](error_code error, size_t size) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE_EQUAL(size, message_text.size());
+              BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message_text);
+              ++server_rounds;
+
+              server_socket.async_send(asio::buffer(reply_text),
+                                       [&](error_code error, size_t) {
+                                         BOOST_VERIFY(!error);
+                                         if (server_rounds < rounds) {
+                                             server_receive();
+                                         }
+                                       });
+            });
+    };
+
+    std::function<void()> client_send = [&]() {
+        client_socket.async_send(asio::buffer(message_text),
+                                 [&](error_code error, size_t) {
+                                   BOOST_VERIFY(!error);
+                                 });
+        client_socket.async_receive(
+            asio::buffer(client_rx_data),
+            [&](error_code error, size_t size) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE_EQUAL(size, reply_text.size());
+              BOOST_REQUIRE_EQUAL(to_string(client_rx_data), reply_text);
+              if (++client_rounds < rounds) {
+                  client_send();
+              }
+            });
+    };
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            BOOST_REQUIRE(server_socket.uses_compact_header());
+            server_receive();
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+              BOOST_REQUIRE(client_socket.uses_compact_header());
+              client_send();
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE_EQUAL(server_rounds, rounds);
+    BOOST_REQUIRE_EQUAL(client_rounds, rounds);
+}
+
+BOOST_AUTO_TEST_CASE(send_receive___arena_buffers)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    // Falls back to normal pages where huge pages are not available
+    crux::detail::arena::options memory;
+    memory.huge_pages = true;
+    memory.local_node = true;
+    asio::use_service<crux::detail::service>(ios).buffer_memory(memory);
+
+    crux::socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+    client_socket.checksum(true);
+    server_socket.checksum(true);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    const std::string message_text = "TEST_MESSAGE";
+    const std::string reply_text = "TEST_REPLY";
+    std::vector<char> server_rx_data(message_text.size());
+    std::vector<char> client_rx_data(reply_text.size());
+
+    bool replied = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            server_socket.async_receive(
+                asio::buffer(server_rx_data),
+                [&](error_code error, size_t size) {
+                  BOOST_VERIFY(!error);
+                  BOOST_REQUIRE_EQUAL(size, message_text.size());
+                  BOOST_REQUIRE_EQUAL(to_string(server_rx_data), message_text);
+                  server_socket.async_send(asio::buffer(reply_text),
+                                           [&](error_code error, size_t) {
+                                             BOOST_VERIFY(!error);
+                                           });
+                });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+              client_socket.async_send(asio::buffer(message_text),
+                                       [&](error_code error, size_t) {
+                                         BOOST_VERIFY(!error);
+                                       });
+              client_socket.async_receive(
+                  asio::buffer(client_rx_data),
+                  [&](error_code error, size_t size) {
+                    BOOST_VERIFY(!error);
+                    BOOST_REQUIRE_EQUAL(size, reply_text.size());
+                    BOOST_REQUIRE_EQUAL(to_string(client_rx_data), reply_text);
+                    replied = true;
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(replied);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,263 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/system/error_code.hpp>
+#include <maidsafe/crux/acceptor.hpp>
+#include <maidsafe/crux/stream_socket.hpp>
+
+namespace asio = boost::asio;
+using error_code    = boost::system::error_code;
+using endpoint_type = boost::asio::ip::udp::endpoint;
+
+namespace
+{
+
+std::string make_text(std::size_t size)
+{
+    std::string text(size, '\0');
+    for (std::size_t i = 0; i < size; ++i) {
+        text[i] = 'a' + (i % 26);
+    }
+    return text;
+}
+
+void transfer(const std::string& tx_data)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::stream_socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::stream_socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    std::vector<char> rx_data(tx_data.size());
+
+    bool tested_write = false;
+    bool tested_read = false;
+
+    acceptor.async_accept(server_socket.next_layer(), [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            asio::async_read(server_socket, asio::buffer(rx_data),
+                             [&](error_code error, std::size_t size) {
+                               BOOST_VERIFY(!error);
+                               BOOST_REQUIRE_EQUAL(size, tx_data.size());
+                               BOOST_REQUIRE(std::string(rx_data.begin(), rx_data.end()) == tx_data);
+                               tested_read = true;
+                             });
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              asio::async_write(client_socket, asio::buffer(tx_data),
+                                [&](error_code error, std::size_t size) {
+                                  BOOST_VERIFY(!error);
+                                  BOOST_REQUIRE_EQUAL(size, tx_data.size());
+                                  tested_write = true;
+                                });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_write);
+    BOOST_REQUIRE(tested_read);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(stream_socket_suite)
+
+BOOST_AUTO_TEST_CASE(write_read)
+{
+    // Several segments with a partial one at the end.
+    transfer(make_text(5000));
+}
+
+BOOST_AUTO_TEST_CASE(write_read_beyond_window)
+{
+    // Writes wait for room in the window of unacknowledged segments.
+    transfer(make_text(100000));
+}
+
+BOOST_AUTO_TEST_CASE(write_read_small_buffers)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::stream_socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::stream_socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    const std::string tx_data = make_text(3000);
+    std::string rx_data;
+    std::array<char, 100> rx_buffer;
+
+    bool tested_read = false;
+
+    // Reads smaller than a segment are served from the rest of the segment.
+    std::function<void (error_code, std::size_t)> on_read
+        = [&](error_code error, std::size_t size) {
+            BOOST_VERIFY(!error);
+            BOOST_REQUIRE_LE(size, rx_buffer.size());
+            rx_data.append(rx_buffer.data(), size);
+
+            if (rx_data.size() < tx_data.size()) {
+                server_socket.async_read_some(asio::buffer(rx_buffer), on_read);
+            }
+            else {
+                BOOST_REQUIRE(rx_data == tx_data);
+                tested_read = true;
+            }
+        };
+
+    acceptor.async_accept(server_socket.next_layer(), [&](error_code error) {
+            BOOST_VERIFY(!error);
+            server_socket.async_read_some(asio::buffer(rx_buffer), on_read);
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              asio::async_write(client_socket, asio::buffer(tx_data),
+                                [&](error_code error, std::size_t) {
+                                  BOOST_VERIFY(!error);
+                                });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_read);
+}
+
+BOOST_AUTO_TEST_CASE(read___peer_shutdown)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::stream_socket client_socket1(ios, endpoint_type(udp::v4(), 0));
+    crux::socket client_socket2(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket1(ios);
+    crux::socket server_socket2(ios);
+
+    // The second connection evicts the first one, which is shut down.
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+    acceptor.max_connections(1);
+    acceptor.admission(crux::admission_policy::evict_idle);
+
+    std::array<char, 16> rx_buffer;
+
+    bool tested_read = false;
+    bool tested_accept = false;
+
+    auto close_all = [&]() {
+        if (tested_read && tested_accept) {
+            client_socket2.close();
+            server_socket2.close();
+            acceptor.close();
+        }
+    };
+
+    acceptor.async_accept(server_socket1, [&](error_code error) {
+            BOOST_VERIFY(!error);
+
+            acceptor.async_accept(server_socket2, [&](error_code error) {
+                    BOOST_VERIFY(!error);
+                    tested_accept = true;
+                    close_all();
+                    });
+
+            client_socket2.async_connect(acceptor.local_endpoint(),
+                                         [&](error_code error) {
+                                           BOOST_VERIFY(!error);
+                                         });
+            });
+
+    client_socket1.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket1.async_read_some(
+                  asio::buffer(rx_buffer),
+                  [&](error_code error, std::size_t size) {
+                    BOOST_REQUIRE_EQUAL(error, asio::error::eof);
+                    BOOST_REQUIRE_EQUAL(size, 0U);
+                    tested_read = true;
+                    close_all();
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_read && tested_accept);
+}
+
+BOOST_AUTO_TEST_CASE(read___peer_close)
+{
+    using namespace maidsafe;
+    using udp = asio::ip::udp;
+
+    asio::io_service ios;
+
+    crux::stream_socket client_socket(ios, endpoint_type(udp::v4(), 0));
+    crux::socket server_socket(ios);
+
+    crux::acceptor acceptor(ios, endpoint_type(udp::v4(), 0));
+
+    std::array<char, 16> rx_buffer;
+
+    bool tested_read = false;
+
+    acceptor.async_accept(server_socket, [&](error_code error) {
+            BOOST_VERIFY(!error);
+            server_socket.close();
+            });
+
+    client_socket.async_connect(
+            acceptor.local_endpoint(),
+            [&](error_code error) {
+              BOOST_VERIFY(!error);
+
+              client_socket.async_read_some(
+                  asio::buffer(rx_buffer),
+                  [&](error_code error, std::size_t size) {
+                    BOOST_REQUIRE_EQUAL(error, asio::error::eof);
+                    BOOST_REQUIRE_EQUAL(size, 0U);
+                    tested_read = true;
+                    acceptor.close();
+                  });
+            });
+
+    ios.run();
+
+    BOOST_REQUIRE(tested_read);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (C) 2014 MaidSafe.net Limited
+//
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Replays a capture of an accepting endpoint in virtual time, so that the
+// processing of its traffic can be profiled without the network. Built with
+// MAIDSAFE_CRUX_SIMULATION.
+//
+//   crux_replay <capture> [speed] [local address] [local port]
+//
+// A speed of 1 replays at the pace of the capture, a speed of N paces it N
+// times faster, and a speed of 0 (the default) replays as fast as possible.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <maidsafe/crux/acceptor.hpp>
+#include <maidsafe/crux/socket.hpp>
+#include <maidsafe/crux/simulation.hpp>
+#include <maidsafe/crux/replay.hpp>
+#include <maidsafe/crux/detail/capture.hpp>
+
+namespace asio = boost::asio;
+using endpoint_type = asio::ip::udp::endpoint;
+
+int main(int argc, char *argv[])
+{
+    using namespace maidsafe;
+
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <capture> [speed] [local address] [local port]" << std::endl;
+        return 1;
+    }
+
+    auto reader = crux::detail::capture_reader::open(argv[1]);
+    if (!reader)
+    {
+        std::cerr << "Cannot read " << argv[1] << std::endl;
+        return 1;
+    }
+    const double speed = (argc > 2) ? std::atof(argv[2]) : 0.0;
+
+    std::vector<crux::detail::captured_datagram> datagrams;
+    crux::detail::captured_datagram datagram;
+    // Receive buffers no larger than needed, as they are costly to fill
+    std::size_t largest = 0;
+    while (reader->read(datagram))
+    {
+        largest = std::max(largest, datagram.payload.size());
+        datagrams.push_back(datagram);
+    }
+
+    asio::io_service io;
+    crux::simulation simulation(io, 0);
+    // Datagrams arrive when they were captured
+    simulation.latency(crux::simulation::duration_type::zero());
+
+    std::unique_ptr<crux::replay> replay;
+    if (argc > 4)
+    {
+        const endpoint_type local(asio::ip::address::from_string(argv[3]),
+                                  static_cast<unsigned short>(std::stoi(argv[4])));
+        replay.reset(new crux::replay(simulation, io, std::move(datagrams), local));
+    }
+    else
+    {
+        replay.reset(new crux::replay(simulation, io, std::move(datagrams)));
+    }
+
+    if (replay->local_endpoint().port() == 0)
+    {
+        std::cerr << "No connection attempt in the capture" << std::endl;
+        return 1;
+    }
+
+    crux::acceptor acceptor(io, replay->local_endpoint());
+
+    std::size_t connections = 0;
+    std::size_t messages = 0;
+    std::size_t bytes = 0;
+    std::vector<std::shared_ptr<crux::socket>> sockets;
+
+    std::function<void(std::shared_ptr<crux::socket>, std::shared_ptr<std::vector<char>>)> receive;
+    receive = [&](std::shared_ptr<crux::socket> socket, std::shared_ptr<std::vector<char>> buffer) {
+        socket->async_receive(asio::buffer(*buffer),
+                              [&, socket, buffer](boost::system::error_code error, std::size_t size) {
+                                  if (error)
+                                      return;
+                                  ++messages;
+                                  bytes += size;
+                                  receive(socket, buffer);
+                              });
+    };
+
+    acceptor.async_accept_each(
+        [&]() { return std::make_shared<crux::socket>(io); },
+        [&](boost::system::error_code error, std::shared_ptr<crux::socket> socket) {
+            if (error)
+                return;
+            ++connections;
+            sockets.push_back(socket);
+            receive(socket, std::make_shared<std::vector<char>>(largest));
+        });
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto virtual_start = simulation.now();
+    replay->run(speed);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const auto virtual_elapsed = simulation.now() - virtual_start;
+
+    acceptor.close();
+    for (auto& socket : sockets)
+    {
+        socket->close();
+    }
+    simulation.run();
+
+    using milliseconds = std::chrono::duration<double, std::milli>;
+    std::cout << "local endpoint: " << replay->local_endpoint() << std::endl
+              << "datagrams:      " << replay->size() << std::endl
+              << "connections:    " << connections << std::endl
+              << "messages:       " << messages << std::endl
+              << "bytes:          " << bytes << std::endl
+              << "captured time:  " << milliseconds(virtual_elapsed).count() << " ms" << std::endl
+              << "replay time:    " << milliseconds(elapsed).count() << " ms" << std::endl;
+    return 0;
+}